@@ -25,10 +25,123 @@
 //     distribution.
 //-----------------------------------------------------------------------------
 
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include "openctm2.h"
 #include "internal.h"
 
 
+//-----------------------------------------------------------------------------
+// _ctmHalfToFloat() - Convert a 16-bit (IEEE 754 binary16) float to a float.
+//-----------------------------------------------------------------------------
+static CTMfloat _ctmHalfToFloat(CTMushort aValue)
+{
+  union {
+    CTMfloat f;
+    CTMuint i;
+  } u;
+  CTMuint sign, exponent, mantissa;
+
+  sign = ((CTMuint) aValue & 0x8000) << 16;
+  exponent = ((CTMuint) aValue >> 10) & 0x1f;
+  mantissa = (CTMuint) aValue & 0x03ff;
+
+  if(exponent == 0)
+  {
+    // Zero or denormal (mantissa * 2^-24)
+    u.f = (CTMfloat) mantissa * (1.0f / 16777216.0f);
+    u.i |= sign;
+  }
+  else if(exponent == 31)
+  {
+    // Inf or NaN
+    u.i = sign | 0x7f800000 | (mantissa << 13);
+  }
+  else
+    u.i = sign | ((exponent + 112) << 23) | (mantissa << 13);
+
+  return u.f;
+}
+
+//-----------------------------------------------------------------------------
+// _ctmFloatToHalf() - Convert a float to a 16-bit (IEEE 754 binary16) float,
+// with round to nearest even. Values that are too large become +/-inf.
+//-----------------------------------------------------------------------------
+static CTMushort _ctmFloatToHalf(CTMfloat aValue)
+{
+  union {
+    CTMfloat f;
+    CTMuint i;
+  } u;
+  CTMuint sign, mantissa, half, rest, halfway, shift;
+  CTMint exponent;
+
+  u.f = aValue;
+  sign = (u.i >> 16) & 0x8000;
+  exponent = (CTMint) ((u.i >> 23) & 0xff);
+  mantissa = u.i & 0x007fffff;
+
+  // Inf or NaN (keep NaNs quiet)
+  if(exponent == 0xff)
+    return (CTMushort) (sign | 0x7c00 | (mantissa ? 0x0200 : 0));
+
+  // Re-bias the exponent
+  exponent -= 127 - 15;
+  if(exponent >= 31)
+    return (CTMushort) (sign | 0x7c00);
+
+  if(exponent <= 0)
+  {
+    // Denormal or zero
+    if(exponent < -10)
+      return (CTMushort) sign;
+    mantissa |= 0x00800000;
+    shift = (CTMuint) (14 - exponent);
+    half = mantissa >> shift;
+    rest = mantissa & ((1u << shift) - 1);
+    halfway = 1u << (shift - 1);
+  }
+  else
+  {
+    half = ((CTMuint) exponent << 10) | (mantissa >> 13);
+    rest = mantissa & 0x1fff;
+    halfway = 0x1000;
+  }
+
+  // Round to nearest even (a carry into the exponent is correct, and may give
+  // inf)
+  if((rest > halfway) || ((rest == halfway) && (half & 1)))
+    ++ half;
+
+  return (CTMushort) (sign | half);
+}
+
+//-----------------------------------------------------------------------------
+// _ctmFloatToNorm() - Convert a float to a normalized integer value, given
+// the range [aMin, 1] and the integer scale (e.g. 127 for SNORM8). NaN maps
+// to aMin.
+//-----------------------------------------------------------------------------
+static CTMint _ctmFloatToNorm(CTMfloat aValue, CTMfloat aMin, CTMfloat aScale)
+{
+  if(!(aValue >= aMin))
+    aValue = aMin;
+  else if(aValue > 1.0f)
+    aValue = 1.0f;
+  return (CTMint) floorf(aValue * aScale + 0.5f);
+}
+
+//-----------------------------------------------------------------------------
+// _ctmSnormToFloat() - Convert a signed normalized integer value to a float
+// (the most negative integer value maps to -1, just like its neighbour).
+//-----------------------------------------------------------------------------
+static CTMfloat _ctmSnormToFloat(CTMint aValue, CTMfloat aScale)
+{
+  CTMfloat x = (CTMfloat) aValue * aScale;
+  return x < -1.0f ? -1.0f : x;
+}
+
+
 //-----------------------------------------------------------------------------
 // Generic getter functions.
 //-----------------------------------------------------------------------------
@@ -57,6 +170,16 @@ static CTMuint _ctmGetArrayi(_CTMarray * aArray, CTMuint aElement,
         return (CTMuint) ((CTMfloat *)elementPtr)[aComponent];
       case CTM_DOUBLE:
         return (CTMuint) ((CTMdouble *)elementPtr)[aComponent];
+      case CTM_HALF:
+        return (CTMuint) _ctmHalfToFloat(((CTMushort *)elementPtr)[aComponent]);
+      case CTM_SNORM8:
+        return (CTMuint) ((CTMbyte *)elementPtr)[aComponent];
+      case CTM_UNORM8:
+        return (CTMuint) ((CTMubyte *)elementPtr)[aComponent];
+      case CTM_SNORM16:
+        return (CTMuint) ((CTMshort *)elementPtr)[aComponent];
+      case CTM_UNORM16:
+        return (CTMuint) ((CTMushort *)elementPtr)[aComponent];
       default:
         break;
     }
@@ -88,6 +211,16 @@ static CTMfloat _ctmGetArrayf(_CTMarray * aArray, CTMuint aElement,
         return ((CTMfloat *)elementPtr)[aComponent];
       case CTM_DOUBLE:
         return (CTMfloat) ((CTMdouble *)elementPtr)[aComponent];
+      case CTM_HALF:
+        return _ctmHalfToFloat(((CTMushort *)elementPtr)[aComponent]);
+      case CTM_SNORM8:
+        return _ctmSnormToFloat(((CTMbyte *)elementPtr)[aComponent], 1.0f/127.0f);
+      case CTM_UNORM8:
+        return (1.0f/255.0f) * (CTMfloat) ((CTMubyte *)elementPtr)[aComponent];
+      case CTM_SNORM16:
+        return _ctmSnormToFloat(((CTMshort *)elementPtr)[aComponent], 1.0f/32767.0f);
+      case CTM_UNORM16:
+        return (1.0f/65535.0f) * (CTMfloat) ((CTMushort *)elementPtr)[aComponent];
       default:
         break;
     }
@@ -131,6 +264,21 @@ static void _ctmSetArrayi(_CTMarray * aArray, CTMuint aElement,
       case CTM_DOUBLE:
         ((CTMdouble *)elementPtr)[aComponent] = (CTMdouble) aValue;
         break;
+      case CTM_HALF:
+        ((CTMushort *)elementPtr)[aComponent] = _ctmFloatToHalf((CTMfloat) aValue);
+        break;
+      case CTM_SNORM8:
+        ((CTMbyte *)elementPtr)[aComponent] = (CTMbyte) aValue;
+        break;
+      case CTM_UNORM8:
+        ((CTMubyte *)elementPtr)[aComponent] = (CTMubyte) aValue;
+        break;
+      case CTM_SNORM16:
+        ((CTMshort *)elementPtr)[aComponent] = (CTMshort) aValue;
+        break;
+      case CTM_UNORM16:
+        ((CTMushort *)elementPtr)[aComponent] = (CTMushort) aValue;
+        break;
       default:
         break;
     }
@@ -169,6 +317,21 @@ static void _ctmSetArrayf(_CTMarray * aArray, CTMuint aElement,
       case CTM_DOUBLE:
         ((CTMdouble *)elementPtr)[aComponent] = (CTMdouble) aValue;
         break;
+      case CTM_HALF:
+        ((CTMushort *)elementPtr)[aComponent] = _ctmFloatToHalf(aValue);
+        break;
+      case CTM_SNORM8:
+        ((CTMbyte *)elementPtr)[aComponent] = (CTMbyte) _ctmFloatToNorm(aValue, -1.0f, 127.0f);
+        break;
+      case CTM_UNORM8:
+        ((CTMubyte *)elementPtr)[aComponent] = (CTMubyte) _ctmFloatToNorm(aValue, 0.0f, 255.0f);
+        break;
+      case CTM_SNORM16:
+        ((CTMshort *)elementPtr)[aComponent] = (CTMshort) _ctmFloatToNorm(aValue, -1.0f, 32767.0f);
+        break;
+      case CTM_UNORM16:
+        ((CTMushort *)elementPtr)[aComponent] = (CTMushort) _ctmFloatToNorm(aValue, 0.0f, 65535.0f);
+        break;
       default:
         break;
     }
@@ -351,10 +514,15 @@ CTMenum _ctmInitArray(_CTMarray * aArray, CTMuint aSize, CTMenum aType,
   {
     case CTM_BYTE:
     case CTM_UBYTE:
+    case CTM_SNORM8:
+    case CTM_UNORM8:
       typeSize = sizeof(CTMbyte);
       break;
     case CTM_SHORT:
     case CTM_USHORT:
+    case CTM_HALF:
+    case CTM_SNORM16:
+    case CTM_UNORM16:
       typeSize = sizeof(CTMshort);
       break;
     case CTM_INT:
@@ -443,3 +611,374 @@ CTMenum _ctmInitArray(_CTMarray * aArray, CTMuint aSize, CTMenum aType,
 
   return CTM_NONE;
 }
+
+//-----------------------------------------------------------------------------
+// Bulk access functions. These copy a span of elements between a typed array
+// and a packed buffer (with aSize components per element). The array type is
+// dispatched once per call instead of once per component, and the inner
+// loops are simple enough for the compiler to vectorize. Components that are
+// not present in the array are read as zero, and are ignored when writing
+// (just like the getter & setter functions).
+//-----------------------------------------------------------------------------
+
+#define _CTM_GATHER_LOOP(type, expr) \
+  for(i = 0; i < aCount; ++ i) \
+  { \
+    const type * src = (const type *) ptr; \
+    for(k = 0; k < n; ++ k) \
+      aDst[k] = expr; \
+    for(; k < aSize; ++ k) \
+      aDst[k] = 0; \
+    ptr += aArray->mStride; \
+    aDst += aSize; \
+  }
+
+#define _CTM_SCATTER_LOOP(type, expr) \
+  for(i = 0; i < aCount; ++ i) \
+  { \
+    type * dst = (type *) ptr; \
+    for(k = 0; k < n; ++ k) \
+      dst[k] = expr; \
+    ptr += aArray->mStride; \
+    aSrc += aSize; \
+  }
+
+//-----------------------------------------------------------------------------
+// _ctmGatherArrayf() - Read aCount elements, starting at element aFirst, from
+// a typed array into a packed float buffer.
+//-----------------------------------------------------------------------------
+void _ctmGatherArrayf(_CTMarray * aArray, CTMuint aFirst, CTMuint aCount,
+  CTMuint aSize, CTMfloat * aDst)
+{
+  const CTMubyte * ptr;
+  CTMuint i, k, n;
+
+  // Number of components to read from the array
+  n = aArray->mData ? aArray->mSize : 0;
+  if(n > aSize)
+    n = aSize;
+  if(n == 0)
+  {
+    memset(aDst, 0, sizeof(CTMfloat) * aSize * aCount);
+    return;
+  }
+
+  // Packed float array with the same layout?
+  if((aArray->mType == CTM_FLOAT) && (n == aSize) &&
+     (aArray->mStride == aSize * sizeof(CTMfloat)))
+  {
+    memcpy(aDst, &((CTMfloat *) aArray->mData)[aFirst * aSize],
+           sizeof(CTMfloat) * aSize * aCount);
+    return;
+  }
+
+  ptr = &((const CTMubyte *) aArray->mData)[aFirst * aArray->mStride];
+  switch(aArray->mType)
+  {
+    case CTM_BYTE:
+      _CTM_GATHER_LOOP(CTMbyte, (1.0f/127.0f) * (CTMfloat) src[k])
+      break;
+    case CTM_UBYTE:
+      _CTM_GATHER_LOOP(CTMubyte, (1.0f/255.0f) * (CTMfloat) src[k])
+      break;
+    case CTM_SHORT:
+      _CTM_GATHER_LOOP(CTMshort, (CTMfloat) src[k])
+      break;
+    case CTM_USHORT:
+      _CTM_GATHER_LOOP(CTMushort, (CTMfloat) src[k])
+      break;
+    case CTM_INT:
+      _CTM_GATHER_LOOP(CTMint, (CTMfloat) src[k])
+      break;
+    case CTM_UINT:
+      _CTM_GATHER_LOOP(CTMuint, (CTMfloat) src[k])
+      break;
+    case CTM_FLOAT:
+      _CTM_GATHER_LOOP(CTMfloat, src[k])
+      break;
+    case CTM_DOUBLE:
+      _CTM_GATHER_LOOP(CTMdouble, (CTMfloat) src[k])
+      break;
+    case CTM_HALF:
+      _CTM_GATHER_LOOP(CTMushort, _ctmHalfToFloat(src[k]))
+      break;
+    case CTM_SNORM8:
+      _CTM_GATHER_LOOP(CTMbyte, _ctmSnormToFloat(src[k], 1.0f/127.0f))
+      break;
+    case CTM_UNORM8:
+      _CTM_GATHER_LOOP(CTMubyte, (1.0f/255.0f) * (CTMfloat) src[k])
+      break;
+    case CTM_SNORM16:
+      _CTM_GATHER_LOOP(CTMshort, _ctmSnormToFloat(src[k], 1.0f/32767.0f))
+      break;
+    case CTM_UNORM16:
+      _CTM_GATHER_LOOP(CTMushort, (1.0f/65535.0f) * (CTMfloat) src[k])
+      break;
+    default:
+      memset(aDst, 0, sizeof(CTMfloat) * aSize * aCount);
+      break;
+  }
+}
+
+//-----------------------------------------------------------------------------
+// _ctmScatterArrayf() - Write aCount elements, starting at element aFirst,
+// from a packed float buffer to a typed array.
+//-----------------------------------------------------------------------------
+void _ctmScatterArrayf(_CTMarray * aArray, CTMuint aFirst, CTMuint aCount,
+  CTMuint aSize, const CTMfloat * aSrc)
+{
+  CTMubyte * ptr;
+  CTMuint i, k, n;
+
+  // Number of components to write to the array
+  n = aArray->mData ? aArray->mSize : 0;
+  if(n > aSize)
+    n = aSize;
+  if(n == 0)
+    return;
+
+  // Packed float array with the same layout?
+  if((aArray->mType == CTM_FLOAT) && (n == aSize) &&
+     (aArray->mStride == aSize * sizeof(CTMfloat)))
+  {
+    memcpy(&((CTMfloat *) aArray->mData)[aFirst * aSize], aSrc,
+           sizeof(CTMfloat) * aSize * aCount);
+    return;
+  }
+
+  ptr = &((CTMubyte *) aArray->mData)[aFirst * aArray->mStride];
+  switch(aArray->mType)
+  {
+    case CTM_BYTE:
+      _CTM_SCATTER_LOOP(CTMbyte, (CTMbyte) (127.0f * aSrc[k]))
+      break;
+    case CTM_UBYTE:
+      _CTM_SCATTER_LOOP(CTMubyte, (CTMubyte) (255.0f * aSrc[k]))
+      break;
+    case CTM_SHORT:
+      _CTM_SCATTER_LOOP(CTMshort, (CTMshort) aSrc[k])
+      break;
+    case CTM_USHORT:
+      _CTM_SCATTER_LOOP(CTMushort, (CTMushort) aSrc[k])
+      break;
+    case CTM_INT:
+      _CTM_SCATTER_LOOP(CTMint, (CTMint) aSrc[k])
+      break;
+    case CTM_UINT:
+      _CTM_SCATTER_LOOP(CTMuint, (CTMuint) aSrc[k])
+      break;
+    case CTM_FLOAT:
+      _CTM_SCATTER_LOOP(CTMfloat, aSrc[k])
+      break;
+    case CTM_DOUBLE:
+      _CTM_SCATTER_LOOP(CTMdouble, (CTMdouble) aSrc[k])
+      break;
+    case CTM_HALF:
+      _CTM_SCATTER_LOOP(CTMushort, _ctmFloatToHalf(aSrc[k]))
+      break;
+    case CTM_SNORM8:
+      _CTM_SCATTER_LOOP(CTMbyte, (CTMbyte) _ctmFloatToNorm(aSrc[k], -1.0f, 127.0f))
+      break;
+    case CTM_UNORM8:
+      _CTM_SCATTER_LOOP(CTMubyte, (CTMubyte) _ctmFloatToNorm(aSrc[k], 0.0f, 255.0f))
+      break;
+    case CTM_SNORM16:
+      _CTM_SCATTER_LOOP(CTMshort, (CTMshort) _ctmFloatToNorm(aSrc[k], -1.0f, 32767.0f))
+      break;
+    case CTM_UNORM16:
+      _CTM_SCATTER_LOOP(CTMushort, (CTMushort) _ctmFloatToNorm(aSrc[k], 0.0f, 65535.0f))
+      break;
+    default:
+      break;
+  }
+}
+
+//-----------------------------------------------------------------------------
+// _ctmGatherArrayi() - Read aCount elements, starting at element aFirst, from
+// a typed array into a packed integer buffer.
+//-----------------------------------------------------------------------------
+void _ctmGatherArrayi(_CTMarray * aArray, CTMuint aFirst, CTMuint aCount,
+  CTMuint aSize, CTMuint * aDst)
+{
+  const CTMubyte * ptr;
+  CTMuint i, k, n;
+
+  // Number of components to read from the array
+  n = aArray->mData ? aArray->mSize : 0;
+  if(n > aSize)
+    n = aSize;
+  if(n == 0)
+  {
+    memset(aDst, 0, sizeof(CTMuint) * aSize * aCount);
+    return;
+  }
+
+  // Packed integer array with the same layout?
+  if(((aArray->mType == CTM_UINT) || (aArray->mType == CTM_INT)) &&
+     (n == aSize) && (aArray->mStride == aSize * sizeof(CTMuint)))
+  {
+    memcpy(aDst, &((CTMuint *) aArray->mData)[aFirst * aSize],
+           sizeof(CTMuint) * aSize * aCount);
+    return;
+  }
+
+  ptr = &((const CTMubyte *) aArray->mData)[aFirst * aArray->mStride];
+  switch(aArray->mType)
+  {
+    case CTM_BYTE:
+      _CTM_GATHER_LOOP(CTMbyte, (CTMuint) src[k])
+      break;
+    case CTM_UBYTE:
+      _CTM_GATHER_LOOP(CTMubyte, (CTMuint) src[k])
+      break;
+    case CTM_SHORT:
+      _CTM_GATHER_LOOP(CTMshort, (CTMuint) src[k])
+      break;
+    case CTM_USHORT:
+      _CTM_GATHER_LOOP(CTMushort, (CTMuint) src[k])
+      break;
+    case CTM_INT:
+      _CTM_GATHER_LOOP(CTMint, (CTMuint) src[k])
+      break;
+    case CTM_UINT:
+      _CTM_GATHER_LOOP(CTMuint, src[k])
+      break;
+    case CTM_FLOAT:
+      _CTM_GATHER_LOOP(CTMfloat, (CTMuint) src[k])
+      break;
+    case CTM_DOUBLE:
+      _CTM_GATHER_LOOP(CTMdouble, (CTMuint) src[k])
+      break;
+    case CTM_HALF:
+      _CTM_GATHER_LOOP(CTMushort, (CTMuint) _ctmHalfToFloat(src[k]))
+      break;
+    case CTM_SNORM8:
+      _CTM_GATHER_LOOP(CTMbyte, (CTMuint) src[k])
+      break;
+    case CTM_UNORM8:
+      _CTM_GATHER_LOOP(CTMubyte, (CTMuint) src[k])
+      break;
+    case CTM_SNORM16:
+      _CTM_GATHER_LOOP(CTMshort, (CTMuint) src[k])
+      break;
+    case CTM_UNORM16:
+      _CTM_GATHER_LOOP(CTMushort, (CTMuint) src[k])
+      break;
+    default:
+      memset(aDst, 0, sizeof(CTMuint) * aSize * aCount);
+      break;
+  }
+}
+
+//-----------------------------------------------------------------------------
+// _ctmScatterArrayi() - Write aCount elements, starting at element aFirst,
+// from a packed integer buffer to a typed array.
+//-----------------------------------------------------------------------------
+void _ctmScatterArrayi(_CTMarray * aArray, CTMuint aFirst, CTMuint aCount,
+  CTMuint aSize, const CTMuint * aSrc)
+{
+  CTMubyte * ptr;
+  CTMuint i, k, n;
+
+  // Number of components to write to the array
+  n = aArray->mData ? aArray->mSize : 0;
+  if(n > aSize)
+    n = aSize;
+  if(n == 0)
+    return;
+
+  // Packed integer array with the same layout?
+  if(((aArray->mType == CTM_UINT) || (aArray->mType == CTM_INT)) &&
+     (n == aSize) && (aArray->mStride == aSize * sizeof(CTMuint)))
+  {
+    memcpy(&((CTMuint *) aArray->mData)[aFirst * aSize], aSrc,
+           sizeof(CTMuint) * aSize * aCount);
+    return;
+  }
+
+  ptr = &((CTMubyte *) aArray->mData)[aFirst * aArray->mStride];
+  switch(aArray->mType)
+  {
+    case CTM_BYTE:
+      _CTM_SCATTER_LOOP(CTMbyte, (CTMbyte) aSrc[k])
+      break;
+    case CTM_UBYTE:
+      _CTM_SCATTER_LOOP(CTMubyte, (CTMubyte) aSrc[k])
+      break;
+    case CTM_SHORT:
+      _CTM_SCATTER_LOOP(CTMshort, (CTMshort) aSrc[k])
+      break;
+    case CTM_USHORT:
+      _CTM_SCATTER_LOOP(CTMushort, (CTMushort) aSrc[k])
+      break;
+    case CTM_INT:
+      _CTM_SCATTER_LOOP(CTMint, (CTMint) aSrc[k])
+      break;
+    case CTM_UINT:
+      _CTM_SCATTER_LOOP(CTMuint, aSrc[k])
+      break;
+    case CTM_FLOAT:
+      _CTM_SCATTER_LOOP(CTMfloat, (CTMfloat) aSrc[k])
+      break;
+    case CTM_DOUBLE:
+      _CTM_SCATTER_LOOP(CTMdouble, (CTMdouble) aSrc[k])
+      break;
+    case CTM_HALF:
+      _CTM_SCATTER_LOOP(CTMushort, _ctmFloatToHalf((CTMfloat) aSrc[k]))
+      break;
+    case CTM_SNORM8:
+      _CTM_SCATTER_LOOP(CTMbyte, (CTMbyte) aSrc[k])
+      break;
+    case CTM_UNORM8:
+      _CTM_SCATTER_LOOP(CTMubyte, (CTMubyte) aSrc[k])
+      break;
+    case CTM_SNORM16:
+      _CTM_SCATTER_LOOP(CTMshort, (CTMshort) aSrc[k])
+      break;
+    case CTM_UNORM16:
+      _CTM_SCATTER_LOOP(CTMushort, (CTMushort) aSrc[k])
+      break;
+    default:
+      break;
+  }
+}
+
+//-----------------------------------------------------------------------------
+// _ctmPackedArrayf() - Get the first aCount elements of a typed array as a
+// packed float array (with aSize components per element), for random access.
+// If the array already is a packed float array with that layout, a pointer to
+// the array data is returned (and *aBuffer is set to nil). Otherwise the
+// elements are gathered into a new buffer, which is returned in *aBuffer and
+// must be freed by the caller. A null pointer is returned if out of memory.
+//-----------------------------------------------------------------------------
+const CTMfloat * _ctmPackedArrayf(_CTMcontext * self, _CTMarray * aArray,
+  CTMuint aCount, CTMuint aSize, CTMfloat ** aBuffer)
+{
+  *aBuffer = (CTMfloat *) 0;
+
+  if(aArray->mData && (aArray->mType == CTM_FLOAT) &&
+     (aArray->mSize == aSize) && (aArray->mStride == aSize * sizeof(CTMfloat)))
+    return (const CTMfloat *) aArray->mData;
+
+  *aBuffer = (CTMfloat *) _ctmAlloc(self, sizeof(CTMfloat) * aSize * (aCount > 0 ? aCount : 1));
+  if(*aBuffer)
+    _ctmGatherArrayf(aArray, 0, aCount, aSize, *aBuffer);
+  return *aBuffer;
+}
+
+//-----------------------------------------------------------------------------
+// _ctmFloatsAreFinite() - Check that all the values of a float buffer are
+// finite (non-NaN, non-inf).
+//-----------------------------------------------------------------------------
+CTMbool _ctmFloatsAreFinite(const CTMfloat * aValues, CTMuint aCount)
+{
+  CTMuint i;
+
+  for(i = 0; i < aCount; ++ i)
+  {
+    if(!isfinite(aValues[i]))
+      return CTM_FALSE;
+  }
+
+  return CTM_TRUE;
+}
@@ -27,32 +27,102 @@
 
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
 #include "openctm2.h"
 #include "internal.h"
 
 #ifdef _CTM_SUPPORT_MG1
 
-#ifdef _CTM_SUPPORT_SAVE
 //-----------------------------------------------------------------------------
-// _compareTriangle() - Comparator for the triangle sorting.
+// _CTMmg1frames - MG1 animation state: the values of the previous frame, which
+// are used for predicting the next frame. The values are stored as float keys
+// (see _ctmFloatBitsToKey()).
+//-----------------------------------------------------------------------------
+typedef struct {
+  CTMuint * mVertices;
+  CTMuint * mNormals;
+  CTMuint * mMaps;      // All UV maps followed by all attribute maps
+} _CTMmg1frames;
+
+//-----------------------------------------------------------------------------
+// _ctmFloatBitsToKey() - Convert the bit pattern of a floating point value to
+// an unsigned integer key that is monotonic in the floating point value, so
+// that the integer delta between two keys is small when the values are close
+// (also across zero). The conversion is lossless.
 //-----------------------------------------------------------------------------
-static int _compareTriangle(const void * elem1, const void * elem2)
+static CTMuint _ctmFloatBitsToKey(CTMuint aBits)
 {
-  CTMuint * tri1 = (CTMuint *) elem1;
-  CTMuint * tri2 = (CTMuint *) elem2;
-  if(tri1[0] != tri2[0])
-    return tri1[0] - tri2[0];
+  if(aBits & 0x80000000)
+    return ~aBits;
   else
-    return tri1[1] - tri2[1];
+    return aBits | 0x80000000;
+}
+
+//-----------------------------------------------------------------------------
+// _ctmKeyToFloatBits() - Inverse of _ctmFloatBitsToKey().
+//-----------------------------------------------------------------------------
+static CTMuint _ctmKeyToFloatBits(CTMuint aKey)
+{
+  if(aKey & 0x80000000)
+    return aKey & 0x7fffffff;
+  else
+    return ~aKey;
+}
+
+//-----------------------------------------------------------------------------
+// _ctmFreeFrames_MG1() - Free the MG1 animation state (_CTMfreefn).
+//-----------------------------------------------------------------------------
+static void _ctmFreeFrames_MG1(CTMcontext aContext, void * aState)
+{
+  _CTMcontext * self = (_CTMcontext *) aContext;
+  _CTMmg1frames * frames = (_CTMmg1frames *) aState;
+
+  _ctmFree(self, (void *) frames->mVertices);
+  _ctmFree(self, (void *) frames);
+}
+
+//-----------------------------------------------------------------------------
+// _ctmNewFrames_MG1() - Allocate the MG1 animation state, and attach it to the
+// context (it is freed by the context).
+//-----------------------------------------------------------------------------
+static _CTMmg1frames * _ctmNewFrames_MG1(_CTMcontext * self)
+{
+  _CTMmg1frames * frames;
+  CTMuint size;
+
+  frames = (_CTMmg1frames *) _ctmAlloc(self, sizeof(_CTMmg1frames));
+  if(!frames)
+  {
+    self->mError = CTM_OUT_OF_MEMORY;
+    return (_CTMmg1frames *) 0;
+  }
+
+  // All the values are stored in a single array
+  size = 3 + (self->mHasNormals ? 3 : 0) + 2 * self->mUVMapCount +
+         4 * self->mAttribMapCount;
+  frames->mVertices = (CTMuint *) _ctmAlloc(self, sizeof(CTMuint) * self->mVertexCount * size);
+  if(!frames->mVertices)
+  {
+    self->mError = CTM_OUT_OF_MEMORY;
+    _ctmFree(self, (void *) frames);
+    return (_CTMmg1frames *) 0;
+  }
+  frames->mNormals = &frames->mVertices[self->mVertexCount * 3];
+  frames->mMaps = self->mHasNormals ? &frames->mNormals[self->mVertexCount * 3] :
+                                      frames->mNormals;
+
+  self->mFrameState = (void *) frames;
+  self->mFreeFrameState = _ctmFreeFrames_MG1;
+
+  return frames;
 }
-#endif
 
 #ifdef _CTM_SUPPORT_SAVE
 //-----------------------------------------------------------------------------
 // _ctmReArrangeTriangles() - Re-arrange all triangles for optimal
 // compression.
 //-----------------------------------------------------------------------------
-static void _ctmReArrangeTriangles(_CTMcontext * self, CTMuint * aIndices)
+static CTMbool _ctmReArrangeTriangles(_CTMcontext * self, CTMuint * aIndices)
 {
   CTMuint * tri, tmp, i;
 
@@ -77,8 +147,9 @@ static void _ctmReArrangeTriangles(_CTMcontext * self, CTMuint * aIndices)
     }
   }
 
-  // Step 2: Sort the triangles based on the first triangle index
-  qsort((void *) aIndices, self->mTriangleCount, sizeof(CTMuint) * 3, _compareTriangle);
+  // Step 2: Sort the triangles based on the first triangle index, and
+  // secondly the second triangle index (stable linear time radix sort)
+  return _ctmRadixSort(self, aIndices, self->mTriangleCount, 3, 0, 1);
 }
 #endif
 
@@ -147,23 +218,24 @@ static void _ctmRestoreIndices(_CTMcontext * self, CTMuint * aIndices)
 CTMbool _ctmCompressMesh_MG1(_CTMcontext * self)
 {
   CTMuint * indices;
-  CTMuint i, j;
 
 #ifdef __DEBUG_
   printf("COMPRESSION METHOD: MG1\n");
 #endif
 
   // Perpare (sort) indices
-  indices = (CTMuint *) malloc(sizeof(CTMuint) * self->mTriangleCount * 3);
+  indices = (CTMuint *) _ctmScratchAlloc(self, sizeof(CTMuint) * self->mTriangleCount * 3);
   if(!indices)
   {
     self->mError = CTM_OUT_OF_MEMORY;
     return CTM_FALSE;
   }
-  for(i = 0; i < self->mTriangleCount; ++ i)
-    for(j = 0; j < 3; ++ j)
-      indices[i * 3 + j] = self->mIndices.geti(&self->mIndices, i, j);
-  _ctmReArrangeTriangles(self, indices);
+  _ctmGatherArrayi(&self->mIndices, 0, self->mTriangleCount, 3, indices);
+  if(!_ctmReArrangeTriangles(self, indices))
+  {
+    _ctmScratchFree(self, (void *) indices);
+    return CTM_FALSE;
+  }
 
   // Calculate index deltas (entropy-reduction)
   _ctmMakeIndexDeltas(self, indices);
@@ -175,27 +247,154 @@ CTMbool _ctmCompressMesh_MG1(_CTMcontext * self)
   _ctmStreamWrite(self, (void *) "INDX", 4);
   if(!_ctmStreamWritePackedInts(self, (CTMint *) indices, self->mTriangleCount, 3, CTM_FALSE))
   {
-    free((void *) indices);
+    _ctmScratchFree(self, (void *) indices);
     return CTM_FALSE;
   }
 
   // Free temporary resources
-  free((void *) indices);
+  _ctmScratchFree(self, (void *) indices);
 
   // The vertex data format is the same as for all frames
   return _ctmCompressFrame_MG1(self);
 }
 #endif
 
+#ifdef _CTM_SUPPORT_SAVE
+//-----------------------------------------------------------------------------
+// _ctmArrayToKeys() - Convert a float array to float keys (used for keeping
+// the values of a frame for predicting the next frame).
+//-----------------------------------------------------------------------------
+static void _ctmArrayToKeys(_CTMcontext * self, _CTMarray * aArray,
+  CTMuint aSize, CTMuint * aKeys)
+{
+  CTMuint i, k, blockSize;
+  CTMfloat block[_CTM_ARRAY_BLOCK_SIZE * 4];
+
+  for(i = 0; i < self->mVertexCount; i += blockSize)
+  {
+    blockSize = self->mVertexCount - i;
+    if(blockSize > _CTM_ARRAY_BLOCK_SIZE)
+      blockSize = _CTM_ARRAY_BLOCK_SIZE;
+    _ctmGatherArrayf(aArray, i, blockSize, aSize, block);
+    memcpy(&aKeys[i * aSize], block, blockSize * aSize * sizeof(CTMuint));
+    for(k = i * aSize; k < (i + blockSize) * aSize; ++ k)
+      aKeys[k] = _ctmFloatBitsToKey(aKeys[k]);
+  }
+}
+#endif // _CTM_SUPPORT_SAVE
+
+#ifdef _CTM_SUPPORT_SAVE
+//-----------------------------------------------------------------------------
+// _ctmWritePredictedArray() - Write a float array of a frame as the deltas of
+// the float keys to the previous frame, and replace the previous frame keys
+// with the keys of this frame.
+//-----------------------------------------------------------------------------
+static CTMbool _ctmWritePredictedArray(_CTMcontext * self, _CTMarray * aArray,
+  CTMuint aSize, CTMuint * aKeys)
+{
+  CTMuint i, k, blockSize, key;
+  CTMuint bits[_CTM_ARRAY_BLOCK_SIZE * 4];
+  CTMfloat block[_CTM_ARRAY_BLOCK_SIZE * 4];
+  CTMint * deltas;
+  CTMbool ok;
+
+  deltas = (CTMint *) _ctmScratchAlloc(self, sizeof(CTMint) * self->mVertexCount * aSize);
+  if(!deltas)
+  {
+    self->mError = CTM_OUT_OF_MEMORY;
+    return CTM_FALSE;
+  }
+
+  // Calculate the deltas to the previous frame
+  for(i = 0; i < self->mVertexCount; i += blockSize)
+  {
+    blockSize = self->mVertexCount - i;
+    if(blockSize > _CTM_ARRAY_BLOCK_SIZE)
+      blockSize = _CTM_ARRAY_BLOCK_SIZE;
+    _ctmGatherArrayf(aArray, i, blockSize, aSize, block);
+    memcpy(bits, block, blockSize * aSize * sizeof(CTMuint));
+    for(k = 0; k < blockSize * aSize; ++ k)
+    {
+      key = _ctmFloatBitsToKey(bits[k]);
+      deltas[i * aSize + k] = (CTMint) (key - aKeys[i * aSize + k]);
+      aKeys[i * aSize + k] = key;
+    }
+  }
+
+  // Compress the deltas
+  ok = _ctmStreamWritePackedInts(self, deltas, self->mVertexCount, aSize, CTM_TRUE);
+  _ctmScratchFree(self, (void *) deltas);
+
+  return ok;
+}
+#endif // _CTM_SUPPORT_SAVE
+
+#ifdef _CTM_SUPPORT_SAVE
+//-----------------------------------------------------------------------------
+// _ctmCompressPredictedFrame_MG1() - Compress an animation frame as the
+// deltas to the previous frame (a "PRED" frame).
+//-----------------------------------------------------------------------------
+static CTMbool _ctmCompressPredictedFrame_MG1(_CTMcontext * self,
+  _CTMmg1frames * aFrames)
+{
+  _CTMfloatmap * map;
+  CTMuint * mapKeys;
+
+  _ctmStreamWrite(self, (void *) "PRED", 4);
+
+  // Write vertices
+  _ctmStreamWrite(self, (void *) "VERT", 4);
+  if(!_ctmWritePredictedArray(self, &self->mVertices, 3, aFrames->mVertices))
+    return CTM_FALSE;
+
+  // Write normals
+  if(self->mHasNormals)
+  {
+    _ctmStreamWrite(self, (void *) "NORM", 4);
+    if(!_ctmWritePredictedArray(self, &self->mNormals, 3, aFrames->mNormals))
+      return CTM_FALSE;
+  }
+
+  // Write UV maps
+  mapKeys = aFrames->mMaps;
+  for(map = self->mUVMaps; map; map = map->mNext)
+  {
+    _ctmStreamWrite(self, (void *) "TEXC", 4);
+    if(!_ctmWritePredictedArray(self, &map->mArray, 2, mapKeys))
+      return CTM_FALSE;
+    mapKeys += self->mVertexCount * 2;
+  }
+
+  // Write attribute maps
+  for(map = self->mAttribMaps; map; map = map->mNext)
+  {
+    _ctmStreamWrite(self, (void *) "ATTR", 4);
+    if(!_ctmWritePredictedArray(self, &map->mArray, 4, mapKeys))
+      return CTM_FALSE;
+    mapKeys += self->mVertexCount * 4;
+  }
+
+  return CTM_TRUE;
+}
+#endif // _CTM_SUPPORT_SAVE
+
 #ifdef _CTM_SUPPORT_SAVE
 //-----------------------------------------------------------------------------
 // _ctmCompressFrame_MG1() - Compress the next frame that is stored in the CTM
 // context using the MG1 method, and write it the the output stream in the CTM
-// context.
+// context. The first frame and key frames are stored as is, and with frame
+// prediction (see ctmFramePrediction()) the other frames (if any) are
+// predicted from the previous frame.
 //-----------------------------------------------------------------------------
 CTMbool _ctmCompressFrame_MG1(_CTMcontext * self)
 {
+  _CTMmg1frames * frames = (_CTMmg1frames *) self->mFrameState;
   _CTMfloatmap * map;
+  CTMuint * mapKeys;
+
+  // Predict the frame from the previous frame (unless this is a key frame)?
+  if(frames && !self->mKeyFrame)
+    return _ctmCompressPredictedFrame_MG1(self, frames);
 
   // Write vertices
 #ifdef __DEBUG_
@@ -242,21 +441,264 @@ CTMbool _ctmCompressFrame_MG1(_CTMcontext * self)
     map = map->mNext;
   }
 
+  // Keep the values of the frame for predicting the next frame
+  if(self->mFramePrediction && (self->mFrameCount > 1))
+  {
+    if(!frames)
+      frames = _ctmNewFrames_MG1(self);
+    if(!frames)
+      return CTM_FALSE;
+    _ctmArrayToKeys(self, &self->mVertices, 3, frames->mVertices);
+    if(self->mHasNormals)
+      _ctmArrayToKeys(self, &self->mNormals, 3, frames->mNormals);
+    mapKeys = frames->mMaps;
+    for(map = self->mUVMaps; map; map = map->mNext)
+    {
+      _ctmArrayToKeys(self, &map->mArray, 2, mapKeys);
+      mapKeys += self->mVertexCount * 2;
+    }
+    for(map = self->mAttribMaps; map; map = map->mNext)
+    {
+      _ctmArrayToKeys(self, &map->mArray, 4, mapKeys);
+      mapKeys += self->mVertexCount * 4;
+    }
+  }
+
   return CTM_TRUE;
 }
 #endif // _CTM_SUPPORT_SAVE
 
+//-----------------------------------------------------------------------------
+// _ctmUnpackFrameArray() - Uncompress a float array of a frame, that has been
+// read by _ctmStreamReadPackJob(), into aArray, and update the previous frame
+// keys (aKeys) with the values of this frame. For a predicted frame the packed
+// data are deltas to the previous frame keys, otherwise they are the float
+// values. Errors are reported in aJob->mError (see _ctmUnpackInts()).
+//-----------------------------------------------------------------------------
+static void _ctmUnpackFrameArray(_CTMcontext * self, _CTMunpackjob * aJob,
+  _CTMarray * aArray, CTMuint aSize, CTMuint * aKeys, CTMbool aPredicted)
+{
+  CTMuint i, k, blockSize;
+  CTMuint bits[_CTM_ARRAY_BLOCK_SIZE * 4];
+  CTMfloat block[_CTM_ARRAY_BLOCK_SIZE * 4];
+  CTMint * deltas;
+
+  // Uncompress, and calculate the keys of this frame
+  if(aPredicted)
+  {
+    deltas = (CTMint *) _ctmAlloc(self, sizeof(CTMint) * self->mVertexCount * aSize);
+    if(!deltas)
+    {
+      aJob->mError = CTM_OUT_OF_MEMORY;
+      return;
+    }
+    _ctmUnpackInts(self, aJob, deltas, self->mVertexCount, aSize, CTM_TRUE);
+    if(aJob->mError == CTM_NONE)
+    {
+      for(k = 0; k < self->mVertexCount * aSize; ++ k)
+        aKeys[k] += (CTMuint) deltas[k];
+    }
+    _ctmFree(self, (void *) deltas);
+  }
+  else
+  {
+    _ctmUnpackInts(self, aJob, (CTMint *) aKeys, self->mVertexCount, aSize,
+                   CTM_FALSE);
+    if(aJob->mError == CTM_NONE)
+    {
+      for(k = 0; k < self->mVertexCount * aSize; ++ k)
+        aKeys[k] = _ctmFloatBitsToKey(aKeys[k]);
+    }
+  }
+  if(aJob->mError != CTM_NONE)
+    return;
+
+  // Convert the keys to floats, and output them to the array
+  for(i = 0; i < self->mVertexCount; i += blockSize)
+  {
+    blockSize = self->mVertexCount - i;
+    if(blockSize > _CTM_ARRAY_BLOCK_SIZE)
+      blockSize = _CTM_ARRAY_BLOCK_SIZE;
+    for(k = 0; k < blockSize * aSize; ++ k)
+      bits[k] = _ctmKeyToFloatBits(aKeys[i * aSize + k]);
+    memcpy(block, bits, blockSize * aSize * sizeof(CTMfloat));
+    if(!self->mTrustedInput && !_ctmFloatsAreFinite(block, blockSize * aSize))
+    {
+      aJob->mError = CTM_INVALID_MESH;
+      return;
+    }
+    _ctmScatterArrayf(aArray, i, blockSize, aSize, block);
+  }
+}
+
+//-----------------------------------------------------------------------------
+// _ctmReadFrameArray() - Read a float array of a frame from the stream. If
+// aKeys is non-nil, the previous frame keys are used (predicted frames) and
+// updated (see _ctmUnpackFrameArray()).
+//-----------------------------------------------------------------------------
+static CTMbool _ctmReadFrameArray(_CTMcontext * self, _CTMarray * aArray,
+  CTMuint aSize, CTMuint * aKeys, CTMbool aPredicted)
+{
+  _CTMunpackjob job;
+
+  // Without animation state, uncompress directly from the stream
+  if(!aKeys)
+    return _ctmStreamReadPackedFloatArray(self, aArray, self->mVertexCount, aSize);
+
+  if(!_ctmStreamReadPackJob(self, &job))
+    return CTM_FALSE;
+  _ctmUnpackFrameArray(self, &job, aArray, aSize, aKeys, aPredicted);
+  _ctmFreeUnpackJob(self, &job);
+  if(job.mError != CTM_NONE)
+  {
+    self->mError = job.mError;
+    return CTM_FALSE;
+  }
+
+  return CTM_TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// _CTMmg1mapjob - A UV map or attribute map that is uncompressed in parallel
+// with other maps.
+//-----------------------------------------------------------------------------
+typedef struct {
+  // The map (UV map or attribute map).
+  _CTMfloatmap * mMap;
+
+  // Number of components per element (2 for UV maps, 4 for attribute maps).
+  CTMuint mSize;
+
+  // Previous frame keys (nil if the mesh is not animated).
+  CTMuint * mKeys;
+
+  // Packed data.
+  _CTMunpackjob mJob;
+} _CTMmg1mapjob;
+
+//-----------------------------------------------------------------------------
+// _CTMmg1unpacktask - Argument for _ctmUnpackMapTask().
+//-----------------------------------------------------------------------------
+typedef struct {
+  _CTMcontext * mContext;
+  _CTMmg1mapjob * mMaps;
+  CTMbool mPredicted;
+} _CTMmg1unpacktask;
+
+//-----------------------------------------------------------------------------
+// _ctmUnpackMapTask() - Uncompress one UV map or attribute map (task for
+// _ctmRunTasks()).
+//-----------------------------------------------------------------------------
+static void _ctmUnpackMapTask(void * aArg, CTMuint aIndex)
+{
+  _CTMmg1unpacktask * task = (_CTMmg1unpacktask *) aArg;
+  _CTMmg1mapjob * mapJob = &task->mMaps[aIndex];
+
+  if(mapJob->mKeys)
+    _ctmUnpackFrameArray(task->mContext, &mapJob->mJob, &mapJob->mMap->mArray,
+                         mapJob->mSize, mapJob->mKeys, task->mPredicted);
+  else
+    _ctmUnpackFloatArray(task->mContext, &mapJob->mJob, &mapJob->mMap->mArray,
+                         task->mContext->mVertexCount, mapJob->mSize);
+}
+
+//-----------------------------------------------------------------------------
+// _ctmUncompressMapsParallel_MG1() - Read all the UV maps and attribute maps
+// of a frame from the stream, and uncompress them in parallel (aKeys and
+// aPredicted are used as for _ctmReadFrameArray()).
+//-----------------------------------------------------------------------------
+static CTMbool _ctmUncompressMapsParallel_MG1(_CTMcontext * self,
+  CTMuint * aKeys, CTMbool aPredicted)
+{
+  _CTMfloatmap * map;
+  _CTMmg1mapjob * maps;
+  _CTMmg1unpacktask task;
+  CTMuint i, mapCount, readCount;
+  CTMbool ok = CTM_TRUE;
+
+  // Allocate the map job list
+  mapCount = 0;
+  for(map = self->mUVMaps; map; map = map->mNext)
+    ++ mapCount;
+  for(map = self->mAttribMaps; map; map = map->mNext)
+    ++ mapCount;
+  maps = (_CTMmg1mapjob *) _ctmScratchAlloc(self, sizeof(_CTMmg1mapjob) * mapCount);
+  if(!maps)
+  {
+    self->mError = CTM_OUT_OF_MEMORY;
+    return CTM_FALSE;
+  }
+
+  // Read the packed data of all maps (the stream must be read in order)
+  readCount = 0;
+  for(map = self->mUVMaps; map && ok; map = map->mNext)
+  {
+    if(_ctmStreamReadUINT(self) != FOURCC("TEXC"))
+    {
+      self->mError = CTM_BAD_FORMAT;
+      ok = CTM_FALSE;
+      break;
+    }
+    maps[readCount].mMap = map;
+    maps[readCount].mSize = 2;
+    maps[readCount].mKeys = aKeys;
+    if(aKeys)
+      aKeys += self->mVertexCount * 2;
+    ok = _ctmStreamReadPackJob(self, &maps[readCount].mJob);
+    if(ok) ++ readCount;
+  }
+  for(map = self->mAttribMaps; map && ok; map = map->mNext)
+  {
+    if(_ctmStreamReadUINT(self) != FOURCC("ATTR"))
+    {
+      self->mError = CTM_BAD_FORMAT;
+      ok = CTM_FALSE;
+      break;
+    }
+    maps[readCount].mMap = map;
+    maps[readCount].mSize = 4;
+    maps[readCount].mKeys = aKeys;
+    if(aKeys)
+      aKeys += self->mVertexCount * 4;
+    ok = _ctmStreamReadPackJob(self, &maps[readCount].mJob);
+    if(ok) ++ readCount;
+  }
+
+  // Uncompress the maps
+  if(ok)
+  {
+    task.mContext = self;
+    task.mMaps = maps;
+    task.mPredicted = aPredicted;
+    _ctmRunTasks(self, mapCount, _ctmUnpackMapTask, (void *) &task);
+    for(i = 0; (i < mapCount) && ok; ++ i)
+    {
+      if(maps[i].mJob.mError != CTM_NONE)
+      {
+        self->mError = maps[i].mJob.mError;
+        ok = CTM_FALSE;
+      }
+    }
+  }
+
+  // Free the packed data
+  for(i = 0; i < readCount; ++ i)
+    _ctmFreeUnpackJob(self, &maps[i].mJob);
+  _ctmScratchFree(self, (void *) maps);
+
+  return ok;
+}
+
 //-----------------------------------------------------------------------------
 // _ctmUncompressMesh_MG1() - Uncmpress the mesh from the input stream in the
 // CTM context, and store the resulting mesh in the CTM context.
 //-----------------------------------------------------------------------------
 CTMbool _ctmUncompressMesh_MG1(_CTMcontext * self)
 {
-  CTMuint * indices;
-  CTMuint i, j;
+  CTMuint * indices, i;
 
   // Allocate memory for the indices
-  indices = (CTMuint *) malloc(sizeof(CTMuint) * self->mTriangleCount * 3);
+  indices = (CTMuint *) _ctmScratchAlloc(self, sizeof(CTMuint) * self->mTriangleCount * 3);
   if(!indices)
   {
     self->mError = CTM_OUT_OF_MEMORY;
@@ -267,20 +709,33 @@ CTMbool _ctmUncompressMesh_MG1(_CTMcontext * self)
   if(_ctmStreamReadUINT(self) != FOURCC("INDX"))
   {
     self->mError = CTM_BAD_FORMAT;
-    free(indices);
+    _ctmScratchFree(self, (void *) indices);
     return CTM_FALSE;
   }
   if(!_ctmStreamReadPackedInts(self, (CTMint *) indices, self->mTriangleCount, 3, CTM_FALSE))
+  {
+    _ctmScratchFree(self, (void *) indices);
     return CTM_FALSE;
+  }
 
-  // Restore indices
+  // Restore indices, and check that all indices are within range
   _ctmRestoreIndices(self, indices);
-  for(i = 0; i < self->mTriangleCount; ++ i)
-    for(j = 0; j < 3; ++ j)
-      self->mIndices.seti(&self->mIndices, i, j, indices[i * 3 + j]);
+  if(!self->mTrustedInput)
+  {
+    for(i = 0; i < self->mTriangleCount * 3; ++ i)
+    {
+      if(indices[i] >= self->mVertexCount)
+      {
+        self->mError = CTM_INVALID_MESH;
+        _ctmScratchFree(self, (void *) indices);
+        return CTM_FALSE;
+      }
+    }
+  }
+  _ctmScatterArrayi(&self->mIndices, 0, self->mTriangleCount, 3, indices);
 
   // Free temporary resources
-  free(indices);
+  _ctmScratchFree(self, (void *) indices);
 
   // The vertex data format is the same as for all frames
   return _ctmUncompressFrame_MG1(self);
@@ -293,15 +748,40 @@ CTMbool _ctmUncompressMesh_MG1(_CTMcontext * self)
 //-----------------------------------------------------------------------------
 CTMbool _ctmUncompressFrame_MG1(_CTMcontext * self)
 {
+  _CTMmg1frames * frames = (_CTMmg1frames *) self->mFrameState;
   _CTMfloatmap * map;
+  CTMuint id, * mapKeys;
+  CTMbool predicted = CTM_FALSE;
+
+  // Is the frame predicted from the previous frame?
+  id = _ctmStreamReadUINT(self);
+  if(id == FOURCC("PRED"))
+  {
+    if(!frames)
+    {
+      self->mError = CTM_INVALID_OPERATION;
+      return CTM_FALSE;
+    }
+    predicted = CTM_TRUE;
+    id = _ctmStreamReadUINT(self);
+  }
+  else if(!frames && (self->mFrameCount > 1))
+  {
+    // Keep the values of this frame for predicting the next frame
+    frames = _ctmNewFrames_MG1(self);
+    if(!frames)
+      return CTM_FALSE;
+  }
+  self->mFramePrediction = predicted;
 
   // Read vertices
-  if(_ctmStreamReadUINT(self) != FOURCC("VERT"))
+  if(id != FOURCC("VERT"))
   {
     self->mError = CTM_BAD_FORMAT;
     return CTM_FALSE;
   }
-  if(!_ctmStreamReadPackedFloatArray(self, &self->mVertices, self->mVertexCount, 3))
+  if(!_ctmReadFrameArray(self, &self->mVertices, 3,
+                         frames ? frames->mVertices : (CTMuint *) 0, predicted))
     return CTM_FALSE;
 
 #ifdef _CTM_SUPPORT_V5_FILES
@@ -321,10 +801,16 @@ CTMbool _ctmUncompressFrame_MG1(_CTMcontext * self)
       self->mError = CTM_BAD_FORMAT;
       return CTM_FALSE;
     }
-    if(!_ctmStreamReadPackedFloatArray(self, &self->mNormals, self->mVertexCount, 3))
+    if(!_ctmReadFrameArray(self, &self->mNormals, 3,
+                           frames ? frames->mNormals : (CTMuint *) 0, predicted))
       return CTM_FALSE;
   }
 
+  // Read the UV maps and attribute maps in parallel?
+  mapKeys = frames ? frames->mMaps : (CTMuint *) 0;
+  if(self->mParallelDecode && ((self->mUVMapCount + self->mAttribMapCount) > 1))
+    return _ctmUncompressMapsParallel_MG1(self, mapKeys, predicted);
+
   // Read UV maps
   map = self->mUVMaps;
   while(map)
@@ -334,8 +820,10 @@ CTMbool _ctmUncompressFrame_MG1(_CTMcontext * self)
       self->mError = CTM_BAD_FORMAT;
       return CTM_FALSE;
     }
-    if(!_ctmStreamReadPackedFloatArray(self, &map->mArray, self->mVertexCount, 2))
+    if(!_ctmReadFrameArray(self, &map->mArray, 2, mapKeys, predicted))
       return CTM_FALSE;
+    if(mapKeys)
+      mapKeys += self->mVertexCount * 2;
     map = map->mNext;
   }
 
@@ -348,8 +836,10 @@ CTMbool _ctmUncompressFrame_MG1(_CTMcontext * self)
       self->mError = CTM_BAD_FORMAT;
       return CTM_FALSE;
     }
-    if(!_ctmStreamReadPackedFloatArray(self, &map->mArray, self->mVertexCount, 4))
+    if(!_ctmReadFrameArray(self, &map->mArray, 4, mapKeys, predicted))
       return CTM_FALSE;
+    if(mapKeys)
+      mapKeys += self->mVertexCount * 4;
     map = map->mNext;
   }
 
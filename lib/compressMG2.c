@@ -27,6 +27,8 @@
 
 #include <stdlib.h>
 #include <math.h>
+#include <float.h>
+#include <string.h>
 #include "openctm2.h"
 #include "internal.h"
 
@@ -37,6 +39,44 @@
 #define PI 3.141592653589793238462643f
 #endif
 
+// Flags for the (optional) flags field of the MG2 header
+#define _CTM_MG2_OCT_NORMALS_BIT 0x00000001
+#define _CTM_MG2_PARALLELOGRAM_BIT 0x00000002
+
+// Number of normals per task when octahedral normals are restored
+#define _CTM_OCT_CHUNK_SIZE 65536
+
+// Largest fixed point vertex coordinate with parallelogram prediction (this
+// keeps the sums of the predictions within 32 bits)
+#define _CTM_LATTICE_MAX 0x04000000
+
+// Largest fixed point vertex coordinate (relative to the grid box origin) in
+// an animation frame without parallelogram prediction (the largest float that
+// is below 2^31, so that the rounded value fits in 32 bits)
+#define _CTM_FRAME_FIXED_MAX 2147483520.0f
+
+// Maximum number of parallelograms (or edges, or neighbours) that are averaged
+// for the prediction of one vertex
+#define _CTM_PREDICT_MAX 4
+
+// Maximum number of triangles that are searched for the triangle on the other
+// side of an edge (limits the work for vertices with very many triangles)
+#define _CTM_PREDICT_SCAN 32
+
+// Number of candidate grid resolutions for the grid search (each candidate
+// has about twice as many grid boxes as the previous one)
+#define _CTM_GRID_CANDIDATES 7
+
+// Wanted number of sample vertices for evaluating one candidate grid
+#define _CTM_GRID_SAMPLE_SIZE 65536
+
+// Number of histogram bins for selecting the sample slab of large meshes
+#define _CTM_GRID_SAMPLE_BINS 4096
+
+// Minimum estimated gain (relative to the default grid) for selecting another
+// grid when the estimates are based on a sample of the mesh
+#define _CTM_GRID_SAMPLE_MARGIN 0.03
+
 
 //-----------------------------------------------------------------------------
 // _CTMgrid - 3D space subdivision grid.
@@ -57,8 +97,9 @@ typedef struct {
 // _CTMsortvertex - Vertex information.
 //-----------------------------------------------------------------------------
 typedef struct {
-  // Vertex X coordinate (used for sorting).
-  CTMfloat x;
+  // Vertex X coordinate, as an unsigned integer with the same sort order
+  // (used for sorting).
+  CTMuint mSortX;
 
   // Grid index. This is the index into the 3D space subdivision grid.
   CTMuint mGridIndex;
@@ -67,42 +108,52 @@ typedef struct {
   CTMuint mOriginalIndex;
 } _CTMsortvertex;
 
+//-----------------------------------------------------------------------------
+// _CTMmg2frames - MG2 animation state, which is kept from one frame to the
+// next. All frames are coded on the grid and in the vertex order of the first
+// frame, as fixed point deltas to the previous frame.
+//-----------------------------------------------------------------------------
+typedef struct {
+  // The grid of the first frame.
+  _CTMgrid mGrid;
+
+  // Sorted vertex order (export only).
+  _CTMsortvertex * mSortVertices;
+
+  // Grid index of each (sorted) vertex.
+  CTMuint * mGridIndices;
+
+  // Triangle indices (in sorted vertex order).
+  CTMuint * mIndices;
+
+  // The vertices are on the lattice of the grid (parallelogram prediction),
+  // rather than relative to the grid box origin.
+  CTMbool mParallelogram;
+
+  // Fixed point values of the previous frame: vertices (relative to the grid
+  // box origin, or on the lattice of the grid), normals (magnitude, phi,
+  // theta), and all UV maps followed by all attribute maps.
+  CTMint * mVertices;
+  CTMint * mNormals;
+  CTMint * mMaps;
+} _CTMmg2frames;
+
 #ifdef _CTM_SUPPORT_SAVE
 //-----------------------------------------------------------------------------
-// _ctmSetupGrid() - Setup the 3D space subdivision grid.
+// _ctmSetupGridDivisions() - Determine the grid resolution, based on the
+// number of vertices and the bounding box of the grid, and calculate the grid
+// box sizes. aScale scales the number of divisions along each axis (1.0 gives
+// the default grid resolution).
+// NOTE: This algorithm is quite crude, and could very well be optimized for
+// better compression levels in the future without affecting the file format
+// or backward compatibility at all (see also _ctmSearchGrid()).
 //-----------------------------------------------------------------------------
-static void _ctmSetupGrid(_CTMcontext * self, _CTMgrid * aGrid)
+static void _ctmSetupGridDivisions(_CTMcontext * self, _CTMgrid * aGrid,
+  CTMfloat aScale)
 {
-  CTMuint i, j;
-  CTMfloat p[3], factor[3], sum, wantedGrids;
-
-  // Calculate the mesh bounding box
-  aGrid->mMin[0] = aGrid->mMax[0] = self->mVertices.getf(&self->mVertices, 0, 0);
-  aGrid->mMin[1] = aGrid->mMax[1] = self->mVertices.getf(&self->mVertices, 0, 1);
-  aGrid->mMin[2] = aGrid->mMax[2] = self->mVertices.getf(&self->mVertices, 0, 2);
-  for(i = 1; i < self->mVertexCount; ++ i)
-  {
-    for(j = 0; j < 3; ++ j)
-      p[j] = self->mVertices.getf(&self->mVertices, i, j);
-    if(p[0] < aGrid->mMin[0])
-      aGrid->mMin[0] = p[0];
-    else if(p[0] > aGrid->mMax[0])
-      aGrid->mMax[0] = p[0];
-    if(p[1] < aGrid->mMin[1])
-      aGrid->mMin[1] = p[1];
-    else if(p[1] > aGrid->mMax[1])
-      aGrid->mMax[1] = p[1];
-    if(p[2] < aGrid->mMin[2])
-      aGrid->mMin[2] = p[2];
-    else if(p[2] > aGrid->mMax[2])
-      aGrid->mMax[2] = p[2];
-  }
+  CTMuint i;
+  CTMfloat factor[3], sum, wantedGrids;
 
-  // Determine optimal grid resolution, based on the number of vertices and
-  // the bounding box.
-  // NOTE: This algorithm is quite crude, and could very well be optimized for
-  // better compression levels in the future without affecting the file format
-  // or backward compatibility at all.
   for(i = 0; i < 3; ++ i)
     factor[i] = aGrid->mMax[i] - aGrid->mMin[i];
   sum = factor[0] + factor[1] + factor[2];
@@ -111,7 +162,7 @@ static void _ctmSetupGrid(_CTMcontext * self, _CTMgrid * aGrid)
     sum = 1.0f / sum;
     for(i = 0; i < 3; ++ i)
       factor[i] *= sum;
-    wantedGrids = powf(100.0f * self->mVertexCount, 1.0f / 3.0f);
+    wantedGrids = powf(100.0f * self->mVertexCount, 1.0f / 3.0f) * aScale;
     for(i = 0; i < 3; ++ i)
     {
       aGrid->mDivision[i] = (CTMuint) ceilf(wantedGrids * factor[i]);
@@ -125,21 +176,57 @@ static void _ctmSetupGrid(_CTMcontext * self, _CTMgrid * aGrid)
     aGrid->mDivision[1] = 4;
     aGrid->mDivision[2] = 4;
   }
-#ifdef __DEBUG_
-  printf("Division: (%d %d %d)\n", aGrid->mDivision[0], aGrid->mDivision[1], aGrid->mDivision[2]);
-#endif
 
   // Calculate grid sizes
   for(i = 0; i < 3; ++ i)
     aGrid->mSize[i] = (aGrid->mMax[i] - aGrid->mMin[i]) / aGrid->mDivision[i];
 }
+
+//-----------------------------------------------------------------------------
+// _ctmSetupGrid() - Setup the 3D space subdivision grid (aVertices is the
+// packed vertex array).
+//-----------------------------------------------------------------------------
+static void _ctmSetupGrid(_CTMcontext * self, const CTMfloat * aVertices,
+  _CTMgrid * aGrid)
+{
+  CTMuint i;
+  const CTMfloat * p;
+
+  // Calculate the mesh bounding box
+  aGrid->mMin[0] = aGrid->mMax[0] = aVertices[0];
+  aGrid->mMin[1] = aGrid->mMax[1] = aVertices[1];
+  aGrid->mMin[2] = aGrid->mMax[2] = aVertices[2];
+  for(i = 1; i < self->mVertexCount; ++ i)
+  {
+    p = &aVertices[i * 3];
+    if(p[0] < aGrid->mMin[0])
+      aGrid->mMin[0] = p[0];
+    else if(p[0] > aGrid->mMax[0])
+      aGrid->mMax[0] = p[0];
+    if(p[1] < aGrid->mMin[1])
+      aGrid->mMin[1] = p[1];
+    else if(p[1] > aGrid->mMax[1])
+      aGrid->mMax[1] = p[1];
+    if(p[2] < aGrid->mMin[2])
+      aGrid->mMin[2] = p[2];
+    else if(p[2] > aGrid->mMax[2])
+      aGrid->mMax[2] = p[2];
+  }
+
+  // Determine the grid resolution, based on the number of vertices and the
+  // bounding box
+  _ctmSetupGridDivisions(self, aGrid, 1.0f);
+#ifdef __DEBUG_
+  printf("Division: (%d %d %d)\n", aGrid->mDivision[0], aGrid->mDivision[1], aGrid->mDivision[2]);
+#endif
+}
 #endif // _CTM_SUPPORT_SAVE
 
 #ifdef _CTM_SUPPORT_SAVE
 //-----------------------------------------------------------------------------
 // _ctmPointToGridIdx() - Convert a point to a grid index.
 //-----------------------------------------------------------------------------
-static CTMuint _ctmPointToGridIdx(_CTMgrid * aGrid, CTMfloat * aPoint)
+static CTMuint _ctmPointToGridIdx(_CTMgrid * aGrid, const CTMfloat * aPoint)
 {
   CTMuint i, idx[3];
 
@@ -177,20 +264,23 @@ static void _ctmGridIdxToPoint(_CTMgrid * aGrid, CTMuint aIdx, CTMfloat * aPoint
 
 #ifdef _CTM_SUPPORT_SAVE
 //-----------------------------------------------------------------------------
-// _compareVertex() - Comparator for the vertex sorting.
+// _ctmFloatSortKey() - Convert a floating point value to an unsigned integer
+// that sorts in the same order as the floating point value (-0 and +0 are
+// considered equal).
 //-----------------------------------------------------------------------------
-static int _compareVertex(const void * elem1, const void * elem2)
+static CTMuint _ctmFloatSortKey(CTMfloat aValue)
 {
-  _CTMsortvertex * v1 = (_CTMsortvertex *) elem1;
-  _CTMsortvertex * v2 = (_CTMsortvertex *) elem2;
-  if(v1->mGridIndex != v2->mGridIndex)
-    return v1->mGridIndex - v2->mGridIndex;
-  else if(v1->x < v2->x)
-    return -1;
-  else if(v1->x > v2->x)
-    return 1;
+  union {
+    CTMfloat f;
+    CTMuint i;
+  } u;
+  u.f = aValue;
+  if(u.i == 0x80000000)
+    u.i = 0;
+  if(u.i & 0x80000000)
+    return ~u.i;
   else
-    return 0;
+    return u.i | 0x80000000;
 }
 #endif // _CTM_SUPPORT_SAVE
 
@@ -199,26 +289,28 @@ static int _compareVertex(const void * elem1, const void * elem2)
 // _ctmSortVertices() - Setup the vertex array. Assign each vertex to a grid
 // box, and sort all vertices.
 //-----------------------------------------------------------------------------
-static void _ctmSortVertices(_CTMcontext * self, _CTMsortvertex * aSortVertices,
-  _CTMgrid * aGrid)
+static CTMbool _ctmSortVertices(_CTMcontext * self, const CTMfloat * aVertices,
+  _CTMsortvertex * aSortVertices, _CTMgrid * aGrid)
 {
-  CTMfloat p[3];
-  CTMuint i, j;
+  const CTMfloat * p;
+  CTMuint i;
 
   // Prepare sort vertex array
   for(i = 0; i < self->mVertexCount; ++ i)
   {
     // Store vertex properties in the sort vertex array
-    for(j = 0; j < 3; ++ j)
-      p[j] = self->mVertices.getf(&self->mVertices, i, j);
-    aSortVertices[i].x = p[0];
+    p = &aVertices[i * 3];
+    aSortVertices[i].mSortX = _ctmFloatSortKey(p[0]);
     aSortVertices[i].mGridIndex = _ctmPointToGridIdx(aGrid, p);
     aSortVertices[i].mOriginalIndex = i;
   }
 
   // Sort vertices. The elements are first sorted by their grid indices, and
-  // scondly by their x coordinates.
-  qsort((void *) aSortVertices, self->mVertexCount, sizeof(_CTMsortvertex), _compareVertex);
+  // secondly by their x coordinates (vertices that are equal in both keep
+  // their original order). Each element is sorted as three words: mSortX
+  // (word 0), mGridIndex (word 1) and mOriginalIndex (word 2).
+  return _ctmRadixSort(self, (CTMuint *) aSortVertices, self->mVertexCount,
+                       3, 1, 0);
 }
 #endif // _CTM_SUPPORT_SAVE
 
@@ -229,10 +321,10 @@ static void _ctmSortVertices(_CTMcontext * self, _CTMsortvertex * aSortVertices,
 static CTMbool _ctmReIndexIndices(_CTMcontext * self,
   _CTMsortvertex * aSortVertices, CTMuint * aIndices)
 {
-  CTMuint i, j, * indexLUT, * ptr;
+  CTMuint i, * indexLUT;
 
   // Create temporary lookup-array, O(n)
-  indexLUT = (CTMuint *) malloc(sizeof(CTMuint) * self->mVertexCount);
+  indexLUT = (CTMuint *) _ctmScratchAlloc(self, sizeof(CTMuint) * self->mVertexCount);
   if(!indexLUT)
   {
     self->mError = CTM_OUT_OF_MEMORY;
@@ -242,45 +334,203 @@ static CTMbool _ctmReIndexIndices(_CTMcontext * self,
     indexLUT[aSortVertices[i].mOriginalIndex] = i;
 
   // Convert old indices to new indices, O(n)
-  ptr = aIndices;
-  for(i = 0; i < self->mTriangleCount; ++ i)
-    for(j = 0; j < 3; ++ j)
-      *ptr ++ = indexLUT[self->mIndices.geti(&self->mIndices, i, j)];
+  _ctmGatherArrayi(&self->mIndices, 0, self->mTriangleCount, 3, aIndices);
+  for(i = 0; i < self->mTriangleCount * 3; ++ i)
+    aIndices[i] = indexLUT[aIndices[i]];
 
   // Free temporary lookup-array
-  free((void *) indexLUT);
+  _ctmScratchFree(self, (void *) indexLUT);
 
   return CTM_TRUE;
 }
 #endif // _CTM_SUPPORT_SAVE
 
+//-----------------------------------------------------------------------------
+// _ctmVertexTriangles() - List the triangles of each vertex (in triangle
+// order): the triangles of vertex i are aTriangles[aFirst[i]] up to (but not
+// including) aTriangles[aFirst[i + 1]]. Both arrays are allocated from the
+// scratch arena (aFirst first). Returns CTM_FALSE if there is not enough
+// memory.
+//-----------------------------------------------------------------------------
+static CTMbool _ctmVertexTriangles(_CTMcontext * self, const CTMuint * aIndices,
+  CTMuint ** aFirst, CTMuint ** aTriangles)
+{
+  CTMuint i, * first, * triangles;
+
+  first = (CTMuint *) _ctmScratchAlloc(self, sizeof(CTMuint) * (self->mVertexCount + 1));
+  triangles = (CTMuint *) _ctmScratchAlloc(self, sizeof(CTMuint) * self->mTriangleCount * 3);
+  if(!first || !triangles)
+  {
+    _ctmScratchFree(self, (void *) triangles);
+    _ctmScratchFree(self, (void *) first);
+    self->mError = CTM_OUT_OF_MEMORY;
+    return CTM_FALSE;
+  }
+
+  // Count the triangles of each vertex, and convert the counts to list
+  // offsets (the offsets are moved one step while the lists are filled in)
+  memset(first, 0, sizeof(CTMuint) * (self->mVertexCount + 1));
+  for(i = 0; i < self->mTriangleCount * 3; ++ i)
+    ++ first[aIndices[i] + 1];
+  for(i = 1; i <= self->mVertexCount; ++ i)
+    first[i] += first[i - 1];
+  for(i = 0; i < self->mTriangleCount * 3; ++ i)
+    triangles[first[aIndices[i]] ++] = i / 3;
+  for(i = self->mVertexCount; i > 0; -- i)
+    first[i] = first[i - 1];
+  first[0] = 0;
+
+  *aFirst = first;
+  *aTriangles = triangles;
+  return CTM_TRUE;
+}
+
 #ifdef _CTM_SUPPORT_SAVE
 //-----------------------------------------------------------------------------
-// _compareTriangle() - Comparator for the triangle sorting.
+// _ctmTraversalSort() - Re-order the sorted vertices in the order in which a
+// breadth first traversal of the triangles (across the triangle edges) visits
+// them, for parallelogram prediction: every vertex that is reached through an
+// edge gets a complete parallelogram from already coded vertices. Traversals
+// start at the first unvisited vertex in grid order, so the vertex order
+// still follows the grid between the connected parts of the mesh.
 //-----------------------------------------------------------------------------
-static int _compareTriangle(const void * elem1, const void * elem2)
+static CTMbool _ctmTraversalSort(_CTMcontext * self,
+  _CTMsortvertex * aSortVertices)
 {
-  CTMuint * tri1 = (CTMuint *) elem1;
-  CTMuint * tri2 = (CTMuint *) elem2;
-  if(tri1[0] != tri2[0])
-    return tri1[0] - tri2[0];
-  else
-    return tri1[1] - tri2[1];
+  CTMuint i, j, k, t, u, a, b, v, w, head, tail, count;
+  CTMuint * indices, * first, * triangles, * queue, * order;
+  CTMubyte * visited;
+  _CTMsortvertex * sorted;
+  const CTMuint * tri, * tri2;
+
+  // Triangle indices in the current (grid) vertex order
+  indices = (CTMuint *) _ctmScratchAlloc(self, sizeof(CTMuint) * self->mTriangleCount * 3);
+  if(!indices)
+  {
+    self->mError = CTM_OUT_OF_MEMORY;
+    return CTM_FALSE;
+  }
+  if(!_ctmReIndexIndices(self, aSortVertices, indices) ||
+     !_ctmVertexTriangles(self, indices, &first, &triangles))
+  {
+    _ctmScratchFree(self, (void *) indices);
+    return CTM_FALSE;
+  }
+
+  // Allocate the triangle queue, the new vertex order and the visited flags
+  queue = (CTMuint *) _ctmScratchAlloc(self, sizeof(CTMuint) * self->mTriangleCount);
+  order = (CTMuint *) _ctmScratchAlloc(self, sizeof(CTMuint) * self->mVertexCount);
+  visited = (CTMubyte *) _ctmScratchAlloc(self, self->mVertexCount + self->mTriangleCount);
+  sorted = (_CTMsortvertex *) _ctmScratchAlloc(self, sizeof(_CTMsortvertex) * self->mVertexCount);
+  if(!queue || !order || !visited || !sorted)
+  {
+    _ctmScratchFree(self, (void *) sorted);
+    _ctmScratchFree(self, (void *) visited);
+    _ctmScratchFree(self, (void *) order);
+    _ctmScratchFree(self, (void *) queue);
+    _ctmScratchFree(self, (void *) triangles);
+    _ctmScratchFree(self, (void *) first);
+    _ctmScratchFree(self, (void *) indices);
+    self->mError = CTM_OUT_OF_MEMORY;
+    return CTM_FALSE;
+  }
+  memset(visited, 0, self->mVertexCount + self->mTriangleCount);
+
+  // Visit the vertices (visited[0..n-1]) and the triangles (visited[n..])
+  count = 0;
+  for(i = 0; i < self->mVertexCount; ++ i)
+  {
+    if(visited[i])
+      continue;
+    visited[i] = 1;
+    order[count ++] = i;
+
+    // Start a new traversal from the triangles of the vertex
+    head = tail = 0;
+    for(j = first[i]; j < first[i + 1]; ++ j)
+    {
+      if(!visited[self->mVertexCount + triangles[j]])
+      {
+        visited[self->mVertexCount + triangles[j]] = 1;
+        queue[tail ++] = triangles[j];
+      }
+    }
+    for(j = 0; j < tail; ++ j)
+    {
+      tri = &indices[queue[j] * 3];
+      for(k = 0; k < 3; ++ k)
+      {
+        if(!visited[tri[k]])
+        {
+          visited[tri[k]] = 1;
+          order[count ++] = tri[k];
+        }
+      }
+    }
+
+    while(head < tail)
+    {
+      // Visit the triangles on the other side of the edges of the triangle
+      // (search the triangles of the edge corner that has fewest triangles)
+      t = queue[head ++];
+      tri = &indices[t * 3];
+      for(k = 0; k < 3; ++ k)
+      {
+        a = tri[k];
+        b = tri[(k + 1) % 3];
+        v = (first[a + 1] - first[a]) <= (first[b + 1] - first[b]) ? a : b;
+        for(j = first[v]; j < first[v + 1]; ++ j)
+        {
+          u = triangles[j];
+          if(visited[self->mVertexCount + u])
+            continue;
+          tri2 = &indices[u * 3];
+          if(((tri2[0] == a) || (tri2[1] == a) || (tri2[2] == a)) &&
+             ((tri2[0] == b) || (tri2[1] == b) || (tri2[2] == b)))
+          {
+            visited[self->mVertexCount + u] = 1;
+            queue[tail ++] = u;
+            for(w = 0; w < 3; ++ w)
+            {
+              if(!visited[tri2[w]])
+              {
+                visited[tri2[w]] = 1;
+                order[count ++] = tri2[w];
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // Re-order the sort vertices
+  for(i = 0; i < self->mVertexCount; ++ i)
+    sorted[i] = aSortVertices[order[i]];
+  memcpy(aSortVertices, sorted, sizeof(_CTMsortvertex) * self->mVertexCount);
+
+  _ctmScratchFree(self, (void *) sorted);
+  _ctmScratchFree(self, (void *) visited);
+  _ctmScratchFree(self, (void *) order);
+  _ctmScratchFree(self, (void *) queue);
+  _ctmScratchFree(self, (void *) triangles);
+  _ctmScratchFree(self, (void *) first);
+  _ctmScratchFree(self, (void *) indices);
+
+  return CTM_TRUE;
 }
 #endif // _CTM_SUPPORT_SAVE
 
 #ifdef _CTM_SUPPORT_SAVE
 //-----------------------------------------------------------------------------
-// _ctmReArrangeTriangles() - Re-arrange all triangles for optimal
-// compression.
+// _ctmRotateTriangles() - Make sure that the first index of each triangle is
+// the smallest one (rotate triangle nodes if necessary).
 //-----------------------------------------------------------------------------
-static void _ctmReArrangeTriangles(_CTMcontext * self, CTMuint * aIndices)
+static void _ctmRotateTriangles(CTMuint * aIndices, CTMuint aTriangleCount)
 {
   CTMuint * tri, tmp, i;
 
-  // Step 1: Make sure that the first index of each triangle is the smallest
-  // one (rotate triangle nodes if necessary)
-  for(i = 0; i < self->mTriangleCount; ++ i)
+  for(i = 0; i < aTriangleCount; ++ i)
   {
     tri = &aIndices[i * 3];
     if((tri[1] < tri[0]) && (tri[1] < tri[2]))
@@ -298,9 +548,21 @@ static void _ctmReArrangeTriangles(_CTMcontext * self, CTMuint * aIndices)
       tri[1] = tmp;
     }
   }
+}
+
+//-----------------------------------------------------------------------------
+// _ctmReArrangeTriangles() - Re-arrange all triangles for optimal
+// compression.
+//-----------------------------------------------------------------------------
+static CTMbool _ctmReArrangeTriangles(_CTMcontext * self, CTMuint * aIndices)
+{
+  // Step 1: Make sure that the first index of each triangle is the smallest
+  // one (rotate triangle nodes if necessary)
+  _ctmRotateTriangles(aIndices, self->mTriangleCount);
 
-  // Step 2: Sort the triangles based on the first triangle index
-  qsort((void *) aIndices, self->mTriangleCount, sizeof(CTMuint) * 3, _compareTriangle);
+  // Step 2: Sort the triangles based on the first triangle index, and
+  // secondly the second triangle index (stable linear time radix sort)
+  return _ctmRadixSort(self, aIndices, self->mTriangleCount, 3, 0, 1);
 }
 #endif // _CTM_SUPPORT_SAVE
 
@@ -309,10 +571,10 @@ static void _ctmReArrangeTriangles(_CTMcontext * self, CTMuint * aIndices)
 // _ctmMakeIndexDeltas() - Calculate various forms of derivatives in order to
 // reduce data entropy.
 //-----------------------------------------------------------------------------
-static void _ctmMakeIndexDeltas(_CTMcontext * self, CTMuint * aIndices)
+static void _ctmMakeIndexDeltas(CTMuint * aIndices, CTMuint aTriangleCount)
 {
   CTMint i;
-  for(i = self->mTriangleCount - 1; i >= 0; -- i)
+  for(i = (CTMint) aTriangleCount - 1; i >= 0; -- i)
   {
     // Step 1: Calculate delta from second triangle index to the previous
     // second triangle index, if the previous triangle shares the same first
@@ -367,10 +629,12 @@ static void _ctmRestoreIndices(_CTMcontext * self, CTMuint * aIndices)
 // reduce data entropy.
 //-----------------------------------------------------------------------------
 static void _ctmMakeVertexDeltas(_CTMcontext * self, CTMint * aIntVertices,
-  _CTMsortvertex * aSortVertices, _CTMgrid * aGrid)
+  const CTMfloat * aVertices, _CTMsortvertex * aSortVertices,
+  CTMuint aVertexCount, _CTMgrid * aGrid)
 {
-  CTMuint i, j, gridIdx, prevGridIndex, oldIdx;
-  CTMfloat gridOrigin[3], p[3], scale;
+  CTMuint i, gridIdx, prevGridIndex;
+  CTMfloat gridOrigin[3], scale;
+  const CTMfloat * p;
   CTMint deltaX, prevDeltaX;
 
   // Vertex scaling factor
@@ -378,19 +642,15 @@ static void _ctmMakeVertexDeltas(_CTMcontext * self, CTMint * aIntVertices,
 
   prevGridIndex = 0x7fffffff;
   prevDeltaX = 0;
-  for(i = 0; i < self->mVertexCount; ++ i)
+  for(i = 0; i < aVertexCount; ++ i)
   {
     // Get grid box origin
     gridIdx = aSortVertices[i].mGridIndex;
     _ctmGridIdxToPoint(aGrid, gridIdx, gridOrigin);
 
-    // Get old vertex coordinate index (before vertex sorting)
-    oldIdx = aSortVertices[i].mOriginalIndex;
+    // Get vertex coordinate (at the old index, before vertex sorting)
+    p = &aVertices[aSortVertices[i].mOriginalIndex * 3];
 
-    // Get vertex coordinate
-    for(j = 0; j < 3; ++ j)
-      p[j] = self->mVertices.getf(&self->mVertices, oldIdx, j);
-    
     // Store delta to the grid box origin in the integer vertex array. For the
     // X axis (which is sorted) we also do the delta to the previous coordinate
     // in the box.
@@ -408,15 +668,361 @@ static void _ctmMakeVertexDeltas(_CTMcontext * self, CTMint * aIntVertices,
 }
 #endif // _CTM_SUPPORT_SAVE
 
+#ifdef _CTM_SUPPORT_SAVE
+//-----------------------------------------------------------------------------
+// _CTMgridsample - The sample of the mesh that is used for evaluating the
+// candidate grids of the grid search.
+//-----------------------------------------------------------------------------
+typedef struct {
+  CTMfloat * mVertices;         // Sample vertices
+  CTMuint * mIndices;           // Sample triangles (indices to mVertices)
+  CTMuint mVertexCount;         // Number of sample vertices
+  CTMuint mTriangleCount;       // Number of sample triangles
+} _CTMgridsample;
+
+//-----------------------------------------------------------------------------
+// _CTMgridcandidate - A candidate grid for the grid search.
+//-----------------------------------------------------------------------------
+typedef struct {
+  _CTMcontext * mContext;
+  const _CTMgridsample * mSample; // Mesh sample
+  _CTMgrid mGrid;               // Candidate grid
+  double mSize;                 // Estimated packed size (< 0 if unknown)
+} _CTMgridcandidate;
+
+//-----------------------------------------------------------------------------
+// _ctmEvalGridTask() - Estimate the packed size of the vertex, grid index and
+// triangle index data for one candidate grid (task for _ctmRunTasks()). The
+// data are prepared and packed just like _ctmPrepareSections_MG2() does, but
+// only for the mesh sample, and the packed sizes are scaled up to the full
+// mesh.
+//-----------------------------------------------------------------------------
+static void _ctmEvalGridTask(void * aArg, CTMuint aIdx)
+{
+  _CTMgridcandidate * cand = &((_CTMgridcandidate *) aArg)[aIdx];
+  _CTMcontext * self = cand->mContext;
+  const _CTMgridsample * smp = cand->mSample;
+  _CTMgrid * grid = &cand->mGrid;
+  _CTMsortvertex * sortVertices;
+  _CTMpackjob job;
+  CTMuint * rank, * gridIndices, * indices, * mem;
+  CTMint * intVertices;
+  CTMuint i, count, triCount, maxCount;
+  double vertexSize, indexSize;
+
+  cand->mSize = -1.0;
+  count = smp->mVertexCount;
+  triCount = smp->mTriangleCount;
+  maxCount = count > triCount ? count : triCount;
+
+  // Allocate memory for the sort vertices (+ temporary sort array), the
+  // sorted vertex rank of each vertex, the grid indices, the vertices, the
+  // triangle indices (+ temporary sort array) and the pack buffer
+  mem = (CTMuint *) _ctmAlloc(self, sizeof(CTMuint) *
+    ((size_t) count * 6 + count + count + (size_t) count * 3 +
+    (size_t) triCount * 6) + _ctmPackBufferSize(self, maxCount, 3));
+  if(!mem)
+    return;
+  sortVertices = (_CTMsortvertex *) mem;
+  rank = &mem[count * 6];
+  gridIndices = &rank[count];
+  intVertices = (CTMint *) &gridIndices[count];
+  indices = (CTMuint *) &intVertices[count * 3];
+
+  // Sort the vertices (see _ctmSortVertices())
+  for(i = 0; i < count; ++ i)
+  {
+    sortVertices[i].mSortX = _ctmFloatSortKey(smp->mVertices[i * 3]);
+    sortVertices[i].mGridIndex = _ctmPointToGridIdx(grid, &smp->mVertices[i * 3]);
+    sortVertices[i].mOriginalIndex = i;
+  }
+  _ctmRadixSortSerial((CTMuint *) sortVertices, (CTMuint *) &sortVertices[count],
+                      count, 3, 1, 0);
+  for(i = 0; i < count; ++ i)
+    rank[sortVertices[i].mOriginalIndex] = i;
+
+  // Vertex data and grid index deltas
+  _ctmMakeVertexDeltas(self, intVertices, smp->mVertices, sortVertices, count, grid);
+  gridIndices[0] = sortVertices[0].mGridIndex;
+  for(i = 1; i < count; ++ i)
+    gridIndices[i] = sortVertices[i].mGridIndex - sortVertices[i - 1].mGridIndex;
+
+  // Triangle index deltas (see _ctmReArrangeTriangles())
+  for(i = 0; i < triCount * 3; ++ i)
+    indices[i] = rank[smp->mIndices[i]];
+  _ctmRotateTriangles(indices, triCount);
+  _ctmRadixSortSerial(indices, &indices[triCount * 3], triCount, 3, 0, 1);
+  _ctmMakeIndexDeltas(indices, triCount);
+
+  // Pack the data
+  job.mSignedInts = CTM_FALSE;
+  job.mBuffer = (unsigned char *) &indices[triCount * 6];
+  job.mData = intVertices;
+  job.mCount = count;
+  job.mSize = 3;
+  _ctmPackInts(self, &job);
+  vertexSize = (double) job.mPackedSize;
+  if(job.mError == CTM_NONE)
+  {
+    job.mData = (CTMint *) gridIndices;
+    job.mSize = 1;
+    _ctmPackInts(self, &job);
+    vertexSize += (double) job.mPackedSize;
+  }
+  indexSize = 0.0;
+  if((job.mError == CTM_NONE) && (triCount > 0))
+  {
+    job.mData = (CTMint *) indices;
+    job.mCount = triCount;
+    job.mSize = 3;
+    _ctmPackInts(self, &job);
+    indexSize = (double) job.mPackedSize * self->mTriangleCount / triCount;
+  }
+
+  // Scale the packed sizes to the full mesh
+  if(job.mError == CTM_NONE)
+    cand->mSize = vertexSize * self->mVertexCount / count + indexSize;
+
+  _ctmFree(self, (void *) mem);
+}
+
+//-----------------------------------------------------------------------------
+// _ctmSampleSlab() - Find a slab (along the given axis) around the middle of
+// the mesh that holds about _CTM_GRID_SAMPLE_SIZE vertices (aHist is a work
+// array of _CTM_GRID_SAMPLE_BINS elements). The slab limits are returned in
+// aMin and aMax, and the number of vertices in the slab is returned.
+//-----------------------------------------------------------------------------
+static CTMuint _ctmSampleSlab(_CTMcontext * self, const CTMfloat * aVertices,
+  _CTMgrid * aGrid, CTMuint aAxis, CTMuint * aHist, CTMfloat * aMin,
+  CTMfloat * aMax)
+{
+  CTMuint i, lo, hi, count, bin;
+  CTMfloat scale, range;
+
+  // Histogram of the vertex coordinates
+  range = aGrid->mMax[aAxis] - aGrid->mMin[aAxis];
+  scale = range > 0.0f ? _CTM_GRID_SAMPLE_BINS / range : 0.0f;
+  for(i = 0; i < _CTM_GRID_SAMPLE_BINS; ++ i)
+    aHist[i] = 0;
+  for(i = 0; i < self->mVertexCount; ++ i)
+  {
+    bin = (CTMuint) (scale * (aVertices[i * 3 + aAxis] - aGrid->mMin[aAxis]));
+    if(bin >= _CTM_GRID_SAMPLE_BINS)
+      bin = _CTM_GRID_SAMPLE_BINS - 1;
+    ++ aHist[bin];
+  }
+
+  // Find the median bin
+  count = 0;
+  for(lo = 0; lo < _CTM_GRID_SAMPLE_BINS - 1; ++ lo)
+  {
+    count += aHist[lo];
+    if(count >= self->mVertexCount / 2)
+      break;
+  }
+
+  // Grow the slab from the median bin until it is large enough
+  hi = lo;
+  count = aHist[lo];
+  while((count < _CTM_GRID_SAMPLE_SIZE) &&
+        ((lo > 0) || (hi < _CTM_GRID_SAMPLE_BINS - 1)))
+  {
+    if((lo > 0) && ((hi >= _CTM_GRID_SAMPLE_BINS - 1) ||
+       (aHist[lo - 1] >= aHist[hi + 1])))
+    {
+      -- lo;
+      count += aHist[lo];
+    }
+    else
+    {
+      ++ hi;
+      count += aHist[hi];
+    }
+  }
+
+  // Slab limits (the last bin also holds vertices at the upper bound)
+  *aMin = lo > 0 ? aGrid->mMin[aAxis] + lo * range / _CTM_GRID_SAMPLE_BINS : -FLT_MAX;
+  *aMax = hi < _CTM_GRID_SAMPLE_BINS - 1 ? aGrid->mMin[aAxis] + (hi + 1) * range / _CTM_GRID_SAMPLE_BINS : FLT_MAX;
+  return count;
+}
+
+//-----------------------------------------------------------------------------
+// _ctmSearchGrid() - Select the grid resolution that gives the smallest
+// estimated packed size of the vertex, grid index and triangle index data
+// (see ctmGridSearch()). A few grids that are coarser and finer than the
+// default grid (aGrid) are evaluated in parallel, and the best one is stored
+// in aGrid. For large meshes the grids are evaluated on a sample of the mesh:
+// the vertices in a slab across the middle of the longest axis of the mesh
+// (where the slab is thickest, so that few triangles are cut by the slab
+// limits), and the triangles between them.
+//-----------------------------------------------------------------------------
+static CTMbool _ctmSearchGrid(_CTMcontext * self, const CTMfloat * aVertices,
+  _CTMgrid * aGrid)
+{
+  _CTMgridcandidate cand[_CTM_GRID_CANDIDATES];
+  _CTMgridsample smp;
+  CTMuint i, j, k, count, best, axis, * indices, * map;
+  const CTMuint * tri;
+  CTMfloat slabMin, slabMax, x;
+  _CTMgrid * grid;
+
+  // Set up the candidate grids (each step doubles the number of grid boxes,
+  // and the default grid is in the middle)
+  count = 0;
+  for(k = 0; k < _CTM_GRID_CANDIDATES; ++ k)
+  {
+    grid = &cand[count].mGrid;
+    *grid = *aGrid;
+    _ctmSetupGridDivisions(self, grid, powf(2.0f,
+      ((CTMfloat) k - (_CTM_GRID_CANDIDATES - 1) / 2) / 3.0f));
+
+    // Skip grids with too many grid boxes, and duplicates
+    if(((double) grid->mDivision[0] * grid->mDivision[1] * grid->mDivision[2]) >= 2147483647.0)
+      continue;
+    if((count > 0) &&
+       (grid->mDivision[0] == cand[count - 1].mGrid.mDivision[0]) &&
+       (grid->mDivision[1] == cand[count - 1].mGrid.mDivision[1]) &&
+       (grid->mDivision[2] == cand[count - 1].mGrid.mDivision[2]))
+      continue;
+    ++ count;
+  }
+  if(count < 2)
+    return CTM_TRUE;
+
+  // Get a packed copy of the triangle indices, and the sample vertex index
+  // of every vertex (the histogram of _ctmSampleSlab() fits in the same
+  // array)
+  indices = (CTMuint *) _ctmScratchAlloc(self, sizeof(CTMuint) * 3 * self->mTriangleCount);
+  map = (CTMuint *) _ctmScratchAlloc(self, sizeof(CTMuint) *
+    (self->mVertexCount > _CTM_GRID_SAMPLE_BINS ? self->mVertexCount : _CTM_GRID_SAMPLE_BINS));
+  if(!indices || !map)
+  {
+    _ctmScratchFree(self, (void *) map);
+    _ctmScratchFree(self, (void *) indices);
+    self->mError = CTM_OUT_OF_MEMORY;
+    return CTM_FALSE;
+  }
+  _ctmGatherArrayi(&self->mIndices, 0, self->mTriangleCount, 3, indices);
+
+  // Select the sample slab (use the whole mesh if it is small enough)
+  axis = 2;
+  for(i = 0; i < 2; ++ i)
+  {
+    if((aGrid->mMax[i] - aGrid->mMin[i]) > (aGrid->mMax[axis] - aGrid->mMin[axis]))
+      axis = i;
+  }
+  slabMin = -FLT_MAX;
+  slabMax = FLT_MAX;
+  smp.mVertexCount = self->mVertexCount;
+  if(self->mVertexCount > 2 * _CTM_GRID_SAMPLE_SIZE)
+    smp.mVertexCount = _ctmSampleSlab(self, aVertices, aGrid, axis, map,
+                                      &slabMin, &slabMax);
+
+  // Collect the sample vertices
+  smp.mVertices = (CTMfloat *) _ctmScratchAlloc(self, sizeof(CTMfloat) * 3 * smp.mVertexCount);
+  if(!smp.mVertices)
+  {
+    _ctmScratchFree(self, (void *) map);
+    _ctmScratchFree(self, (void *) indices);
+    self->mError = CTM_OUT_OF_MEMORY;
+    return CTM_FALSE;
+  }
+  j = 0;
+  for(i = 0; i < self->mVertexCount; ++ i)
+  {
+    x = aVertices[i * 3 + axis];
+    map[i] = 0xffffffff;
+    if((x >= slabMin) && (x < slabMax) && (j < smp.mVertexCount))
+    {
+      smp.mVertices[j * 3] = aVertices[i * 3];
+      smp.mVertices[j * 3 + 1] = aVertices[i * 3 + 1];
+      smp.mVertices[j * 3 + 2] = aVertices[i * 3 + 2];
+      map[i] = j ++;
+    }
+  }
+  smp.mVertexCount = j;
+
+  // Collect the sample triangles (in place, the triangles that only use
+  // sample vertices)
+  smp.mIndices = indices;
+  smp.mTriangleCount = 0;
+  for(i = 0; i < self->mTriangleCount; ++ i)
+  {
+    tri = &indices[i * 3];
+    if((map[tri[0]] != 0xffffffff) && (map[tri[1]] != 0xffffffff) &&
+       (map[tri[2]] != 0xffffffff))
+    {
+      j = smp.mTriangleCount * 3;
+      indices[j] = map[tri[0]];
+      indices[j + 1] = map[tri[1]];
+      indices[j + 2] = map[tri[2]];
+      ++ smp.mTriangleCount;
+    }
+  }
+
+  // Evaluate the candidates
+  if(smp.mVertexCount > 0)
+  {
+    for(i = 0; i < count; ++ i)
+    {
+      cand[i].mContext = self;
+      cand[i].mSample = &smp;
+    }
+    _ctmRunTasks(self, count, _ctmEvalGridTask, (void *) cand);
+  }
+  else
+  {
+    for(i = 0; i < count; ++ i)
+      cand[i].mSize = -1.0;
+  }
+  _ctmScratchFree(self, (void *) smp.mVertices);
+  _ctmScratchFree(self, (void *) map);
+  _ctmScratchFree(self, (void *) indices);
+
+  // Pick the candidate with the smallest estimated size (keep the default
+  // grid if no candidate could be evaluated, or if the estimates are based on
+  // a sample and the gain is too small to trust)
+  best = count;
+  for(i = 0; i < count; ++ i)
+  {
+    if((cand[i].mSize >= 0.0) &&
+       ((best == count) || (cand[i].mSize < cand[best].mSize)))
+      best = i;
+  }
+  if((best < count) && (smp.mVertexCount < self->mVertexCount))
+  {
+    for(i = 0; i < count; ++ i)
+    {
+      if((cand[i].mGrid.mDivision[0] == aGrid->mDivision[0]) &&
+         (cand[i].mGrid.mDivision[1] == aGrid->mDivision[1]) &&
+         (cand[i].mGrid.mDivision[2] == aGrid->mDivision[2]) &&
+         (cand[i].mSize >= 0.0) &&
+         (cand[best].mSize > cand[i].mSize * (1.0 - _CTM_GRID_SAMPLE_MARGIN)))
+        best = i;
+    }
+  }
+  if(best < count)
+    *aGrid = cand[best].mGrid;
+#ifdef __DEBUG_
+  printf("Grid search: (%d %d %d)\n", aGrid->mDivision[0], aGrid->mDivision[1], aGrid->mDivision[2]);
+#endif
+
+  return CTM_TRUE;
+}
+#endif // _CTM_SUPPORT_SAVE
+
 //-----------------------------------------------------------------------------
 // _ctmRestoreVertices() - Calculate inverse derivatives of the vertices.
+// Returns CTM_FALSE if any of the vertices is not finite (unless the input is
+// trusted).
 //-----------------------------------------------------------------------------
-static void _ctmRestoreVertices(_CTMcontext * self, CTMint * aIntVertices,
+static CTMbool _ctmRestoreVertices(_CTMcontext * self, CTMint * aIntVertices,
   CTMuint * aGridIndices, _CTMgrid * aGrid, CTMfloat * aVertices)
 {
   CTMuint i, gridIdx, prevGridIndex;
   CTMfloat gridOrigin[3], scale;
   CTMint deltaX, prevDeltaX;
+  CTMbool finite = CTM_TRUE;
 
   scale = self->mVertexPrecision;
 
@@ -431,298 +1037,1205 @@ static void _ctmRestoreVertices(_CTMcontext * self, CTMint * aIntVertices,
     // Restore original point
     deltaX = aIntVertices[i * 3];
     if(gridIdx == prevGridIndex)
-      deltaX += prevDeltaX;
+      deltaX = (CTMint) ((CTMuint) deltaX + (CTMuint) prevDeltaX);
     aVertices[i * 3] = scale * deltaX + gridOrigin[0];
     aVertices[i * 3 + 1] = scale * aIntVertices[i * 3 + 1] + gridOrigin[1];
     aVertices[i * 3 + 2] = scale * aIntVertices[i * 3 + 2] + gridOrigin[2];
+    if(!(isfinite(aVertices[i * 3]) && isfinite(aVertices[i * 3 + 1]) &&
+         isfinite(aVertices[i * 3 + 2])))
+      finite = CTM_FALSE;
 
     prevGridIndex = gridIdx;
     prevDeltaX = deltaX;
   }
+
+  return finite || self->mTrustedInput;
 }
 
+#ifdef _CTM_SUPPORT_SAVE
 //-----------------------------------------------------------------------------
-// _ctmCalcSmoothNormals() - Calculate the smooth normals for a given mesh.
-// These are used as the nominal normals for normal deltas & reconstruction.
+// _ctmLatticeFits() - Check if all the vertices of the grid fit on the fixed
+// point lattice that is used for parallelogram prediction.
 //-----------------------------------------------------------------------------
-static void _ctmCalcSmoothNormals(_CTMcontext * self, CTMfloat * aVertices,
-  CTMuint * aIndices, CTMfloat * aSmoothNormals)
+static CTMbool _ctmLatticeFits(_CTMcontext * self, _CTMgrid * aGrid)
 {
-  CTMuint i, j, k, tri[3];
-  CTMfloat len;
-  CTMfloat v1[3], v2[3], n[3];
+  CTMuint i;
+  CTMfloat scale;
 
-  // Clear smooth normals array
-  for(i = 0; i < 3 * self->mVertexCount; ++ i)
-    aSmoothNormals[i] = 0.0f;
-
-  // Calculate sums of all neigbouring triangle normals for each vertex
-  for(i = 0; i < self->mTriangleCount; ++ i)
+  scale = 1.0f / self->mVertexPrecision;
+  for(i = 0; i < 3; ++ i)
   {
-    // Get triangle corner indices
-    for(j = 0; j < 3; ++ j)
-      tri[j] = aIndices[i * 3 + j];
+    if(!(scale * (aGrid->mMax[i] - aGrid->mMin[i]) < (CTMfloat) (_CTM_LATTICE_MAX - 1)))
+      return CTM_FALSE;
+  }
 
-    // Calculate the normalized cross product of two triangle edges (i.e. the
-    // flat triangle normal)
-    for(j = 0; j < 3; ++ j)
-    {
-      v1[j] = aVertices[tri[1] * 3 + j] - aVertices[tri[0] * 3 + j];
-      v2[j] = aVertices[tri[2] * 3 + j] - aVertices[tri[0] * 3 + j];
-    }
-    n[0] = v1[1] * v2[2] - v1[2] * v2[1];
-    n[1] = v1[2] * v2[0] - v1[0] * v2[2];
-    n[2] = v1[0] * v2[1] - v1[1] * v2[0];
-    len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
-    if(len > 1e-10f)
-      len = 1.0f / len;
-    else
-      len = 1.0f;
-    for(j = 0; j < 3; ++ j)
-      n[j] *= len;
+  return CTM_TRUE;
+}
+#endif // _CTM_SUPPORT_SAVE
 
-    // Add the flat normal to all three triangle vertices
-    for(k = 0; k < 3; ++ k)
-      for(j = 0; j < 3; ++ j)
-        aSmoothNormals[tri[k] * 3 + j] += n[j];
-  }
+#ifdef _CTM_SUPPORT_SAVE
+//-----------------------------------------------------------------------------
+// _ctmMakeLatticeVertices() - Convert the vertices to fixed point values on
+// the lattice of the grid (relative to the grid minimum), in sorted vertex
+// order.
+//-----------------------------------------------------------------------------
+static void _ctmMakeLatticeVertices(_CTMcontext * self, CTMint * aIntVertices,
+  const CTMfloat * aVertices, _CTMsortvertex * aSortVertices, _CTMgrid * aGrid)
+{
+  CTMuint i, j;
+  CTMfloat scale;
+  const CTMfloat * p;
+
+  scale = 1.0f / self->mVertexPrecision;
 
-  // Normalize the normal sums, which gives the unit length smooth normals
   for(i = 0; i < self->mVertexCount; ++ i)
   {
-    len = sqrtf(aSmoothNormals[i * 3] * aSmoothNormals[i * 3] + 
-                aSmoothNormals[i * 3 + 1] * aSmoothNormals[i * 3 + 1] +
-                aSmoothNormals[i * 3 + 2] * aSmoothNormals[i * 3 + 2]);
-    if(len > 1e-10f)
-      len = 1.0f / len;
-    else
-      len = 1.0f;
+    p = &aVertices[aSortVertices[i].mOriginalIndex * 3];
     for(j = 0; j < 3; ++ j)
-      aSmoothNormals[i * 3 + j] *= len;
+      aIntVertices[i * 3 + j] = (CTMint) floorf(scale * (p[j] - aGrid->mMin[j]) + 0.5f);
   }
 }
+#endif // _CTM_SUPPORT_SAVE
 
 //-----------------------------------------------------------------------------
-// _ctmMakeNormalCoordSys() - Create an ortho-normalized coordinate system
-// where the Z-axis is aligned with the given normal.
-// Note 1: This function is central to how the compressed normal data is
-//  interpreted, and it can not be changed (mathematically) without making the
-//  coder/decoder incompatible with other versions of the library!
-// Note 2: Since we do this for every single normal, this routine needs to be
-//  fast. The current implementation uses: 12 MUL, 1 DIV, 1 SQRT, ~6 ADD.
+// _ctmLatticeToVertices() - Convert fixed point vertices on the lattice of the
+// grid to floating point. Returns CTM_FALSE if any of the vertices is not
+// finite (unless the input is trusted).
 //-----------------------------------------------------------------------------
-static void _ctmMakeNormalCoordSys(CTMfloat * aNormal, CTMfloat * aBasisAxes)
+static CTMbool _ctmLatticeToVertices(_CTMcontext * self, _CTMgrid * aGrid,
+  const CTMint * aIntVertices, CTMfloat * aVertices)
 {
-  CTMfloat len, * x, * y, * z;
-  CTMuint i;
-
-  // Pointers to the basis axes (aBasisAxes is a 3x3 matrix)
-  x = aBasisAxes;
-  y = &aBasisAxes[3];
-  z = &aBasisAxes[6];
-
-  // Z = normal (must be unit length!)
-  for(i = 0; i < 3; ++ i)
-    z[i] = aNormal[i];
+  CTMuint i, j;
+  CTMfloat scale;
 
-  // Calculate a vector that is guaranteed to be orthogonal to the normal, non-
-  // zero, and a continuous function of the normal (no discrete jumps):
-  // X = (0,0,1) x normal + (1,0,0) x normal
-  x[0] =  -aNormal[1];
-  x[1] =  aNormal[0] - aNormal[2];
-  x[2] =  aNormal[1];
+  scale = self->mVertexPrecision;
 
-  // Normalize the new X axis (note: |x[2]| = |x[0]|)
-  len = sqrtf(2.0f * x[0] * x[0] + x[1] * x[1]);
-  if(len > 1.0e-20f)
+  for(i = 0; i < self->mVertexCount; ++ i)
   {
-    len = 1.0f / len;
-    x[0] *= len;
-    x[1] *= len;
-    x[2] *= len;
+    for(j = 0; j < 3; ++ j)
+      aVertices[i * 3 + j] = scale * aIntVertices[i * 3 + j] + aGrid->mMin[j];
   }
 
-  // Let Y = Z x X  (no normalization needed, since |Z| = |X| = 1)
-  y[0] = z[1] * x[2] - z[2] * x[1];
-  y[1] = z[2] * x[0] - z[0] * x[2];
-  y[2] = z[0] * x[1] - z[1] * x[0];
+  return self->mTrustedInput ||
+         _ctmFloatsAreFinite(aVertices, self->mVertexCount * 3);
 }
 
-#ifdef _CTM_SUPPORT_SAVE
 //-----------------------------------------------------------------------------
-// _ctmMakeNormalDeltas() - Convert the normals to a new coordinate system:
-// magnitude, phi, theta (relative to predicted smooth normals).
+// _ctmRoundDiv() - Integer division, rounded to the nearest integer
+// (symmetrically around zero).
 //-----------------------------------------------------------------------------
-static CTMbool _ctmMakeNormalDeltas(_CTMcontext * self, CTMint * aIntNormals,
-  CTMfloat * aVertices, CTMuint * aIndices, _CTMsortvertex * aSortVertices)
+static CTMint _ctmRoundDiv(CTMint aValue, CTMint aDivisor)
 {
-  CTMuint i, j, oldIdx, intPhi;
-  CTMfloat magn, phi, theta, scale, thetaScale;
-  CTMfloat * smoothNormals, n0[3], n[3], n2[3], basisAxes[9];
+  if(aValue >= 0)
+    return (aValue + aDivisor / 2) / aDivisor;
+  else
+    return -((aDivisor / 2 - aValue) / aDivisor);
+}
 
-  // Allocate temporary memory for the nominal vertex normals
-  smoothNormals = (CTMfloat *) malloc(3 * sizeof(CTMfloat) * self->mVertexCount);
-  if(!smoothNormals)
+//-----------------------------------------------------------------------------
+// _ctmPredictVertex() - Predict a fixed point vertex from the vertices that
+// precede it (in sorted vertex order). aFirst and aTriangles list the
+// triangles of each vertex. The prediction is the average of the
+// parallelograms that are spanned by the decoded triangles on the other side
+// of the edges (with two decoded corners) of the triangles of the vertex.
+// Without such triangles, the prediction falls back to the average of the
+// edge midpoints, the average of the decoded neighbours, or the previous
+// vertex.
+// NOTE: The prediction must be exactly the same in the coder and in the
+// decoder, so it only uses integer arithmetic.
+//-----------------------------------------------------------------------------
+static void _ctmPredictVertex(const CTMint * aIntVertices,
+  const CTMuint * aIndices, const CTMuint * aFirst, const CTMuint * aTriangles,
+  CTMuint aIdx, CTMint * aPrediction)
+{
+  CTMuint i, j, k, t, a, b, c, v, last, count, edges, neighbours;
+  CTMint sum[3], edgeSum[3], neighbourSum[3];
+  const CTMuint * tri;
+
+  for(k = 0; k < 3; ++ k)
   {
-    self->mError = CTM_OUT_OF_MEMORY;
-    return CTM_FALSE;
+    sum[k] = 0;
+    edgeSum[k] = 0;
+    neighbourSum[k] = 0;
   }
+  count = edges = neighbours = 0;
 
-  // Calculate smooth normals (Note: aVertices and aIndices use the sorted
-  // index space, so smoothNormals will too)
-  _ctmCalcSmoothNormals(self, aVertices, aIndices, smoothNormals);
-
-  // Normal scaling factor
-  scale = 1.0f / self->mNormalPrecision;
-
-  for(i = 0; i < self->mVertexCount; ++ i)
+  for(i = aFirst[aIdx]; (i < aFirst[aIdx + 1]) && (count < _CTM_PREDICT_MAX); ++ i)
   {
-    // Get old normal index (before vertex sorting)
-    oldIdx = aSortVertices[i].mOriginalIndex;
-
-    // Get the normal
-    for(j = 0; j < 3; ++ j)
-      n0[j] = self->mNormals.getf(&self->mNormals, oldIdx, j);
-
-    // Calculate normal magnitude (should always be 1.0 for unit length normals)
-    magn = sqrtf(n0[0] * n0[0] + n0[1] * n0[1] + n0[2] * n0[2]);
-    if(magn < 1e-10f)
-      magn = 1.0f;
+    // The other two corners of the triangle
+    t = aTriangles[i];
+    tri = &aIndices[t * 3];
+    k = (tri[0] == aIdx) ? 0 : ((tri[1] == aIdx) ? 1 : 2);
+    a = tri[(k + 1) % 3];
+    b = tri[(k + 2) % 3];
+    if((a < aIdx) && (neighbours < _CTM_PREDICT_MAX))
+    {
+      for(k = 0; k < 3; ++ k)
+        neighbourSum[k] += aIntVertices[a * 3 + k];
+      ++ neighbours;
+    }
+    if((b < aIdx) && (neighbours < _CTM_PREDICT_MAX))
+    {
+      for(k = 0; k < 3; ++ k)
+        neighbourSum[k] += aIntVertices[b * 3 + k];
+      ++ neighbours;
+    }
+    if((a >= aIdx) || (b >= aIdx))
+      continue;
+    if(edges < _CTM_PREDICT_MAX)
+    {
+      for(k = 0; k < 3; ++ k)
+        edgeSum[k] += aIntVertices[a * 3 + k] + aIntVertices[b * 3 + k];
+      ++ edges;
+    }
 
-    // Invert magnitude if the normal is negative compared to the predicted
-    // smooth normal
-    if((smoothNormals[i * 3] * n0[0] +
-        smoothNormals[i * 3 + 1] * n0[1] +
-        smoothNormals[i * 3 + 2] * n0[2]) < 0.0f)
-      magn = -magn;
+    // Find a triangle on the other side of the edge a-b, with a decoded third
+    // corner (search the triangles of the corner that has fewest triangles)
+    v = (aFirst[a + 1] - aFirst[a]) <= (aFirst[b + 1] - aFirst[b]) ? a : b;
+    last = aFirst[v + 1];
+    if((last - aFirst[v]) > _CTM_PREDICT_SCAN)
+      last = aFirst[v] + _CTM_PREDICT_SCAN;
+    for(j = aFirst[v]; j < last; ++ j)
+    {
+      if(aTriangles[j] == t)
+        continue;
+      tri = &aIndices[aTriangles[j] * 3];
+      if(((tri[0] == a) || (tri[1] == a) || (tri[2] == a)) &&
+         ((tri[0] == b) || (tri[1] == b) || (tri[2] == b)))
+      {
+        c = tri[0] + tri[1] + tri[2] - a - b;
+        if(c < aIdx)
+        {
+          for(k = 0; k < 3; ++ k)
+            sum[k] += aIntVertices[a * 3 + k] + aIntVertices[b * 3 + k] -
+                      aIntVertices[c * 3 + k];
+          ++ count;
+          break;
+        }
+      }
+    }
+  }
 
-    // Store the magnitude in the first element of the three normal elements
-    aIntNormals[i * 3] = (CTMint) floorf(scale * magn + 0.5f);
+  for(k = 0; k < 3; ++ k)
+  {
+    if(count > 0)
+      aPrediction[k] = _ctmRoundDiv(sum[k], (CTMint) count);
+    else if(edges > 0)
+      aPrediction[k] = _ctmRoundDiv(edgeSum[k], (CTMint) (2 * edges));
+    else if(neighbours > 0)
+      aPrediction[k] = _ctmRoundDiv(neighbourSum[k], (CTMint) neighbours);
+    else if(aIdx > 0)
+      aPrediction[k] = aIntVertices[(aIdx - 1) * 3 + k];
+    else
+      aPrediction[k] = 0;
+  }
+}
 
-    // Normalize the normal (1 / magn) - and flip it if magn < 0
-    magn = 1.0f / magn;
-    for(j = 0; j < 3; ++ j)
-      n[j] = n0[j] * magn;
+//-----------------------------------------------------------------------------
+// _ctmParallelogramVertices() - Convert fixed point vertices (on the lattice
+// of the grid) to parallelogram prediction errors, or restore them from the
+// prediction errors (aRestore). aIndices are the triangle indices, in sorted
+// vertex order. The vertices are coded from the last one to the first one,
+// and decoded from the first one to the last one (each vertex is predicted
+// from the vertices that precede it), in place. Returns CTM_FALSE on failure
+// (the error is set in the context).
+//-----------------------------------------------------------------------------
+static CTMbool _ctmParallelogramVertices(_CTMcontext * self,
+  CTMint * aIntVertices, const CTMuint * aIndices, CTMbool aRestore)
+{
+  CTMuint i, k, * first, * triangles;
+  CTMint prediction[3], value;
+  CTMbool ok = CTM_TRUE;
 
-    // Convert the normal to angular representation (phi, theta) in a coordinate
-    // system where the nominal (smooth) normal is the Z-axis
-    _ctmMakeNormalCoordSys(&smoothNormals[i * 3], basisAxes);
-    for(j = 0; j < 3; ++ j)
-      n2[j] = basisAxes[j * 3] * n[0] +
-              basisAxes[j * 3 + 1] * n[1] +
-              basisAxes[j * 3 + 2] * n[2];
-    if(n2[2] >= 1.0f)
-      phi = 0.0f;
-    else
-      phi = acosf(n2[2]);
-    theta = atan2f(n2[1], n2[0]);
+  if(!_ctmVertexTriangles(self, aIndices, &first, &triangles))
+    return CTM_FALSE;
 
-    // Round phi and theta (spherical coordinates) to integers. Note: We let the
-    // theta resolution vary with the x/y circumference (roughly phi).
-    intPhi = (CTMint) floorf(phi * (scale / (0.5f * PI)) + 0.5f);
-    if(intPhi == 0)
-      thetaScale = 0.0f;
-    else if(intPhi <= 4)
-      thetaScale = 2.0f / PI;
-    else
-      thetaScale = ((CTMfloat) intPhi) / (2.0f * PI);
-    aIntNormals[i * 3 + 1] = intPhi;
-    aIntNormals[i * 3 + 2] = (CTMint) floorf((theta + PI) * thetaScale + 0.5f);
+  if(aRestore)
+  {
+    // Restore the vertices (the range check keeps the predictions of corrupt
+    // data from overflowing)
+    for(i = 0; (i < self->mVertexCount) && ok; ++ i)
+    {
+      _ctmPredictVertex(aIntVertices, aIndices, first, triangles, i, prediction);
+      for(k = 0; k < 3; ++ k)
+      {
+        value = (CTMint) ((CTMuint) aIntVertices[i * 3 + k] + (CTMuint) prediction[k]);
+        if((value < -_CTM_LATTICE_MAX) || (value > _CTM_LATTICE_MAX))
+        {
+          self->mError = CTM_INVALID_MESH;
+          ok = CTM_FALSE;
+        }
+        aIntVertices[i * 3 + k] = value;
+      }
+    }
+  }
+  else
+  {
+    // Calculate the prediction errors
+    for(i = self->mVertexCount; i > 0; -- i)
+    {
+      _ctmPredictVertex(aIntVertices, aIndices, first, triangles, i - 1, prediction);
+      for(k = 0; k < 3; ++ k)
+        aIntVertices[(i - 1) * 3 + k] -= prediction[k];
+    }
   }
 
-  // Free temporary resources
-  free(smoothNormals);
+  _ctmScratchFree(self, (void *) triangles);
+  _ctmScratchFree(self, (void *) first);
 
-  return CTM_TRUE;
+  return ok;
 }
-#endif // _CTM_SUPPORT_SAVE
 
 //-----------------------------------------------------------------------------
-// _ctmRestoreNormals() - Convert the normals back to cartesian coordinates.
+// _ctmFreeFrames_MG2() - Free the MG2 animation state (_CTMfreefn).
 //-----------------------------------------------------------------------------
-static CTMbool _ctmRestoreNormals(_CTMcontext * self, CTMuint * aIndices,
-  CTMfloat * aVertices, CTMint * aIntNormals)
+static void _ctmFreeFrames_MG2(CTMcontext aContext, void * aState)
 {
-  CTMuint i, j, intPhi;
-  CTMfloat magn, phi, theta, scale, thetaScale;
-  CTMfloat * smoothNormals, n[3], n2[3], basisAxes[9];
+  _CTMcontext * self = (_CTMcontext *) aContext;
+  _CTMmg2frames * frames = (_CTMmg2frames *) aState;
+
+  if(frames->mSortVertices) _ctmFree(self, (void *) frames->mSortVertices);
+  if(frames->mGridIndices) _ctmFree(self, (void *) frames->mGridIndices);
+  if(frames->mIndices) _ctmFree(self, (void *) frames->mIndices);
+  if(frames->mVertices) _ctmFree(self, (void *) frames->mVertices);
+  if(frames->mNormals) _ctmFree(self, (void *) frames->mNormals);
+  if(frames->mMaps) _ctmFree(self, (void *) frames->mMaps);
+  _ctmFree(self, (void *) frames);
+}
 
-  // Allocate temporary memory for the nominal vertex normals
-  smoothNormals = (CTMfloat *) malloc(3 * sizeof(CTMfloat) * self->mVertexCount);
-  if(!smoothNormals)
+//-----------------------------------------------------------------------------
+// _ctmNewFrames_MG2() - Allocate the MG2 animation state, and attach it to the
+// context (it is freed by the context).
+//-----------------------------------------------------------------------------
+static _CTMmg2frames * _ctmNewFrames_MG2(_CTMcontext * self, _CTMgrid * aGrid)
+{
+  _CTMmg2frames * frames;
+  CTMuint mapSize;
+
+  frames = (_CTMmg2frames *) _ctmAlloc(self, sizeof(_CTMmg2frames));
+  if(!frames)
   {
     self->mError = CTM_OUT_OF_MEMORY;
-    return CTM_FALSE;
+    return (_CTMmg2frames *) 0;
+  }
+  memset(frames, 0, sizeof(_CTMmg2frames));
+  self->mFrameState = (void *) frames;
+  self->mFreeFrameState = _ctmFreeFrames_MG2;
+
+  frames->mGrid = *aGrid;
+  frames->mGridIndices = (CTMuint *) _ctmAlloc(self, sizeof(CTMuint) * self->mVertexCount);
+  frames->mIndices = (CTMuint *) _ctmAlloc(self, sizeof(CTMuint) * self->mTriangleCount * 3);
+  frames->mVertices = (CTMint *) _ctmAlloc(self, sizeof(CTMint) * self->mVertexCount * 3);
+  if(!frames->mGridIndices || !frames->mIndices || !frames->mVertices)
+  {
+    self->mError = CTM_OUT_OF_MEMORY;
+    return (_CTMmg2frames *) 0;
+  }
+  if(self->mHasNormals)
+  {
+    frames->mNormals = (CTMint *) _ctmAlloc(self, sizeof(CTMint) * self->mVertexCount * 3);
+    if(!frames->mNormals)
+    {
+      self->mError = CTM_OUT_OF_MEMORY;
+      return (_CTMmg2frames *) 0;
+    }
+  }
+  mapSize = 2 * self->mUVMapCount + 4 * self->mAttribMapCount;
+  if(mapSize > 0)
+  {
+    frames->mMaps = (CTMint *) _ctmAlloc(self, sizeof(CTMint) * self->mVertexCount * mapSize);
+    if(!frames->mMaps)
+    {
+      self->mError = CTM_OUT_OF_MEMORY;
+      return (_CTMmg2frames *) 0;
+    }
   }
 
-  // Calculate smooth normals (nominal normals)
-  _ctmCalcSmoothNormals(self, aVertices, aIndices, smoothNormals);
+  return frames;
+}
 
-  // Normal scaling factor
-  scale = self->mNormalPrecision;
+//-----------------------------------------------------------------------------
+// _ctmResetFrames_MG2() - Clear the fixed point values of the previous frame,
+// so that the deltas of the next frame are its absolute values (a key frame).
+//-----------------------------------------------------------------------------
+static void _ctmResetFrames_MG2(_CTMcontext * self, _CTMmg2frames * aFrames)
+{
+  CTMuint mapSize;
+
+  memset(aFrames->mVertices, 0, sizeof(CTMint) * self->mVertexCount * 3);
+  if(aFrames->mNormals)
+    memset(aFrames->mNormals, 0, sizeof(CTMint) * self->mVertexCount * 3);
+  mapSize = 2 * self->mUVMapCount + 4 * self->mAttribMapCount;
+  if(aFrames->mMaps)
+    memset(aFrames->mMaps, 0, sizeof(CTMint) * self->mVertexCount * mapSize);
+}
+
+//-----------------------------------------------------------------------------
+// _ctmAbsoluteVertexInts() - Convert the integer vertices of the first frame
+// (as stored in the VERT section) to fixed point values relative to the grid
+// box origin (i.e. undo the X axis delta coding).
+//-----------------------------------------------------------------------------
+static void _ctmAbsoluteVertexInts(_CTMcontext * self, CTMint * aIntVertices,
+  CTMuint * aGridIndices)
+{
+  CTMuint i, prevGridIndex;
 
+  prevGridIndex = 0x7fffffff;
   for(i = 0; i < self->mVertexCount; ++ i)
   {
-    // Get the normal magnitude from the first of the three normal elements
-    magn = aIntNormals[i * 3] * scale;
-
-    // Get phi and theta (spherical coordinates, relative to the smooth normal).
-    intPhi = aIntNormals[i * 3 + 1];
-    phi = intPhi * (0.5f * PI) * scale;
-    if(intPhi == 0)
-      thetaScale = 0.0f;
-    else if(intPhi <= 4)
-      thetaScale = PI / 2.0f;
-    else
-      thetaScale = (2.0f * PI) / ((CTMfloat) intPhi);
-    theta = aIntNormals[i * 3 + 2] * thetaScale - PI;
-
-    // Convert the normal from the angular representation (phi, theta) back to
-    // cartesian coordinates
-    n2[0] = sinf(phi) * cosf(theta);
-    n2[1] = sinf(phi) * sinf(theta);
-    n2[2] = cosf(phi);
-    _ctmMakeNormalCoordSys(&smoothNormals[i * 3], basisAxes);
-    for(j = 0; j < 3; ++ j)
-      n[j] = basisAxes[j] * n2[0] +
-             basisAxes[3 + j] * n2[1] +
-             basisAxes[6 + j] * n2[2];
-
-    // Apply normal magnitude, and output to the normals array
-    for(j = 0; j < 3; ++ j)
-      self->mNormals.setf(&self->mNormals, i, j, n[j] * magn);
+    if(aGridIndices[i] == prevGridIndex)
+      aIntVertices[i * 3] = (CTMint) ((CTMuint) aIntVertices[i * 3] +
+                                      (CTMuint) aIntVertices[(i - 1) * 3]);
+    prevGridIndex = aGridIndices[i];
   }
+}
 
-  // Free temporary resources
-  free(smoothNormals);
+//-----------------------------------------------------------------------------
+// _ctmAccumulateInts() - Convert deltas to the previous element into absolute
+// values (the inverse of the UV/attribute map delta coding of the first
+// frame). The sums are calculated without sign, since the deltas of corrupt
+// data may overflow (the values wrap around).
+//-----------------------------------------------------------------------------
+static void _ctmAccumulateInts(CTMint * aValues, CTMuint aCount,
+  CTMuint aSize)
+{
+  CTMuint i;
 
-  return CTM_TRUE;
+  for(i = aSize; i < aCount * aSize; ++ i)
+    aValues[i] = (CTMint) ((CTMuint) aValues[i] + (CTMuint) aValues[i - aSize]);
 }
 
-#ifdef _CTM_SUPPORT_SAVE
 //-----------------------------------------------------------------------------
-// _ctmMakeUVCoordDeltas() - Calculate various forms of derivatives in order
-// to reduce data entropy.
+// _ctmRestoreFrameVertices() - Convert the fixed point vertices of the current
+// frame to floating point. Returns CTM_FALSE if any of the vertices is not
+// finite (unless the input is trusted).
 //-----------------------------------------------------------------------------
-static void _ctmMakeUVCoordDeltas(_CTMcontext * self, _CTMfloatmap * aMap,
-  CTMint * aIntUVCoords, _CTMsortvertex * aSortVertices)
+static CTMbool _ctmRestoreFrameVertices(_CTMcontext * self,
+  _CTMmg2frames * aFrames, CTMfloat * aVertices)
 {
-  CTMuint i, oldIdx;
-  CTMint u, v, prevU, prevV;
-  CTMfloat scale;
+  CTMuint i, j;
+  CTMfloat gridOrigin[3], scale;
 
-  // UV coordinate scaling factor
-  scale = 1.0f / aMap->mPrecision;
+  if(aFrames->mParallelogram)
+    return _ctmLatticeToVertices(self, &aFrames->mGrid, aFrames->mVertices, aVertices);
+
+  scale = self->mVertexPrecision;
+
+  for(i = 0; i < self->mVertexCount; ++ i)
+  {
+    _ctmGridIdxToPoint(&aFrames->mGrid, aFrames->mGridIndices[i], gridOrigin);
+    for(j = 0; j < 3; ++ j)
+      aVertices[i * 3 + j] = scale * aFrames->mVertices[i * 3 + j] + gridOrigin[j];
+  }
+
+  return self->mTrustedInput ||
+         _ctmFloatsAreFinite(aVertices, self->mVertexCount * 3);
+}
+
+//-----------------------------------------------------------------------------
+// _ctmRestoreFrameMap() - Convert the fixed point values of a UV map or an
+// attribute map to floating point. Returns CTM_FALSE if any of the values is
+// not finite (unless the input is trusted).
+//-----------------------------------------------------------------------------
+static CTMbool _ctmRestoreFrameMap(_CTMcontext * self, _CTMfloatmap * aMap,
+  const CTMint * aValues, CTMuint aSize)
+{
+  CTMuint i, k, blockSize;
+  CTMfloat scale, block[_CTM_ARRAY_BLOCK_SIZE * 4];
+
+  scale = aMap->mPrecision;
+
+  for(i = 0; i < self->mVertexCount; i += blockSize)
+  {
+    blockSize = self->mVertexCount - i;
+    if(blockSize > _CTM_ARRAY_BLOCK_SIZE)
+      blockSize = _CTM_ARRAY_BLOCK_SIZE;
+
+    for(k = 0; k < blockSize * aSize; ++ k)
+      block[k] = (CTMfloat) aValues[i * aSize + k] * scale;
+
+    if(!self->mTrustedInput && !_ctmFloatsAreFinite(block, blockSize * aSize))
+      return CTM_FALSE;
+    _ctmScatterArrayf(&aMap->mArray, i, blockSize, aSize, block);
+  }
+
+  return CTM_TRUE;
+}
+
+// Number of triangles per chunk, and number of vertices per vertex range,
+// when the smooth normals are calculated in parallel (smaller meshes are
+// handled by the calling thread alone)
+#define _CTM_SMOOTH_CHUNK_SIZE 65536
+
+// Maximum number of triangle chunks and vertex ranges
+#define _CTM_SMOOTH_MAX_CHUNKS 64
+
+//-----------------------------------------------------------------------------
+// _CTMsmoothtask - State for the parallel smooth normal calculation.
+//-----------------------------------------------------------------------------
+typedef struct {
+  _CTMcontext * mContext;
+  const CTMfloat * mVertices;   // Vertex coordinates
+  const CTMuint * mIndices;     // Triangle indices
+  CTMfloat * mSmoothNormals;    // Output smooth normals
+  CTMfloat * mFlatNormals;      // Flat normal of each triangle
+  CTMuint * mCorners;           // Triangle corners, grouped by vertex range
+  CTMuint * mHist;              // Corner counts / offsets (per chunk & range)
+  CTMuint mChunkSize;           // Number of triangles per chunk
+  CTMuint mChunkCount;          // Number of triangle chunks
+  CTMuint mRangeSize;           // Number of vertices per vertex range
+  CTMuint mRangeCount;          // Number of vertex ranges
+} _CTMsmoothtask;
+
+//-----------------------------------------------------------------------------
+// _ctmCalcFlatNormal() - Calculate the normalized cross product of two
+// triangle edges (i.e. the flat triangle normal).
+//-----------------------------------------------------------------------------
+static void _ctmCalcFlatNormal(const CTMfloat * aVertices,
+  const CTMuint * aTri, CTMfloat * aNormal)
+{
+  CTMuint j;
+  CTMfloat len, v1[3], v2[3];
+
+  for(j = 0; j < 3; ++ j)
+  {
+    v1[j] = aVertices[aTri[1] * 3 + j] - aVertices[aTri[0] * 3 + j];
+    v2[j] = aVertices[aTri[2] * 3 + j] - aVertices[aTri[0] * 3 + j];
+  }
+  aNormal[0] = v1[1] * v2[2] - v1[2] * v2[1];
+  aNormal[1] = v1[2] * v2[0] - v1[0] * v2[2];
+  aNormal[2] = v1[0] * v2[1] - v1[1] * v2[0];
+  len = sqrtf(aNormal[0] * aNormal[0] + aNormal[1] * aNormal[1] +
+              aNormal[2] * aNormal[2]);
+  if(len > 1e-10f)
+    len = 1.0f / len;
+  else
+    len = 1.0f;
+  for(j = 0; j < 3; ++ j)
+    aNormal[j] *= len;
+}
+
+//-----------------------------------------------------------------------------
+// _ctmNormalizeSmoothNormals() - Normalize the normal sums of aCount vertices,
+// which gives the unit length smooth normals.
+//-----------------------------------------------------------------------------
+static void _ctmNormalizeSmoothNormals(CTMfloat * aSmoothNormals,
+  CTMuint aCount)
+{
+  CTMuint i, j;
+  CTMfloat len;
+
+  for(i = 0; i < aCount; ++ i)
+  {
+    len = sqrtf(aSmoothNormals[i * 3] * aSmoothNormals[i * 3] +
+                aSmoothNormals[i * 3 + 1] * aSmoothNormals[i * 3 + 1] +
+                aSmoothNormals[i * 3 + 2] * aSmoothNormals[i * 3 + 2]);
+    if(len > 1e-10f)
+      len = 1.0f / len;
+    else
+      len = 1.0f;
+    for(j = 0; j < 3; ++ j)
+      aSmoothNormals[i * 3 + j] *= len;
+  }
+}
+
+//-----------------------------------------------------------------------------
+// _ctmSmoothCountTask() - Calculate the flat normals of one chunk of
+// triangles, and count the triangle corners of the chunk in each vertex range.
+//-----------------------------------------------------------------------------
+static void _ctmSmoothCountTask(void * aArg, CTMuint aChunk)
+{
+  _CTMsmoothtask * task = (_CTMsmoothtask *) aArg;
+  CTMuint * hist = &task->mHist[aChunk * task->mRangeCount];
+  CTMuint i, first, last;
+
+  first = aChunk * task->mChunkSize;
+  last = first + task->mChunkSize;
+  if(last > task->mContext->mTriangleCount)
+    last = task->mContext->mTriangleCount;
+
+  memset(hist, 0, task->mRangeCount * sizeof(CTMuint));
+  for(i = first; i < last; ++ i)
+  {
+    _ctmCalcFlatNormal(task->mVertices, &task->mIndices[i * 3],
+                       &task->mFlatNormals[i * 3]);
+    ++ hist[task->mIndices[i * 3] / task->mRangeSize];
+    ++ hist[task->mIndices[i * 3 + 1] / task->mRangeSize];
+    ++ hist[task->mIndices[i * 3 + 2] / task->mRangeSize];
+  }
+}
+
+//-----------------------------------------------------------------------------
+// _ctmSmoothScatterTask() - Move the triangle corners of one chunk to the
+// corner lists of their vertex ranges.
+//-----------------------------------------------------------------------------
+static void _ctmSmoothScatterTask(void * aArg, CTMuint aChunk)
+{
+  _CTMsmoothtask * task = (_CTMsmoothtask *) aArg;
+  CTMuint * offset = &task->mHist[aChunk * task->mRangeCount];
+  CTMuint i, first, last;
+
+  first = aChunk * task->mChunkSize * 3;
+  last = first + task->mChunkSize * 3;
+  if(last > task->mContext->mTriangleCount * 3)
+    last = task->mContext->mTriangleCount * 3;
+
+  for(i = first; i < last; ++ i)
+    task->mCorners[offset[task->mIndices[i] / task->mRangeSize] ++] = i;
+}
+
+//-----------------------------------------------------------------------------
+// _ctmSmoothSumTask() - Sum the flat normals of all the triangles that use
+// each vertex of one vertex range, and normalize the sums.
+//-----------------------------------------------------------------------------
+static void _ctmSmoothSumTask(void * aArg, CTMuint aRange)
+{
+  _CTMsmoothtask * task = (_CTMsmoothtask *) aArg;
+  CTMuint i, j, first, count, corner, cornerFirst, cornerLast;
+  CTMfloat * sum;
+  const CTMfloat * n;
+
+  first = aRange * task->mRangeSize;
+  count = task->mContext->mVertexCount - first;
+  if(count > task->mRangeSize)
+    count = task->mRangeSize;
+
+  // The corners of the range start where the corners of the previous range
+  // end (the scatter offsets of the last chunk)
+  cornerFirst = aRange > 0 ?
+    task->mHist[(task->mChunkCount - 1) * task->mRangeCount + aRange - 1] : 0;
+  cornerLast = task->mHist[(task->mChunkCount - 1) * task->mRangeCount + aRange];
+
+  // Clear the smooth normals of the range
+  for(i = 0; i < 3 * count; ++ i)
+    task->mSmoothNormals[first * 3 + i] = 0.0f;
+
+  // The corners are in triangle order, so each vertex gets its sum in the
+  // same order as in the serial calculation
+  for(i = cornerFirst; i < cornerLast; ++ i)
+  {
+    corner = task->mCorners[i];
+    sum = &task->mSmoothNormals[task->mIndices[corner] * 3];
+    n = &task->mFlatNormals[(corner / 3) * 3];
+    for(j = 0; j < 3; ++ j)
+      sum[j] += n[j];
+  }
+
+  _ctmNormalizeSmoothNormals(&task->mSmoothNormals[first * 3], count);
+}
+
+//-----------------------------------------------------------------------------
+// _ctmCalcSmoothNormalsParallel() - Calculate the smooth normals in parallel
+// (see _ctmCalcSmoothNormals()). The triangle corners are bucket sorted by
+// vertex range (keeping the triangle order within each range), and then each
+// vertex range is summed up by one task. The result is identical to the
+// serial calculation. Returns CTM_FALSE if there is not enough memory.
+//-----------------------------------------------------------------------------
+static CTMbool _ctmCalcSmoothNormalsParallel(_CTMcontext * self,
+  CTMfloat * aVertices, CTMuint * aIndices, CTMfloat * aSmoothNormals)
+{
+  _CTMsmoothtask task;
+  CTMuint c, r, sum, count;
+
+  // Split the triangles into chunks, and the vertices into ranges
+  task.mChunkCount = (self->mTriangleCount + _CTM_SMOOTH_CHUNK_SIZE - 1) / _CTM_SMOOTH_CHUNK_SIZE;
+  if(task.mChunkCount > _CTM_SMOOTH_MAX_CHUNKS)
+    task.mChunkCount = _CTM_SMOOTH_MAX_CHUNKS;
+  task.mChunkSize = (self->mTriangleCount + task.mChunkCount - 1) / task.mChunkCount;
+  task.mRangeCount = (self->mVertexCount + _CTM_SMOOTH_CHUNK_SIZE - 1) / _CTM_SMOOTH_CHUNK_SIZE;
+  if(task.mRangeCount > _CTM_SMOOTH_MAX_CHUNKS)
+    task.mRangeCount = _CTM_SMOOTH_MAX_CHUNKS;
+  task.mRangeSize = (self->mVertexCount + task.mRangeCount - 1) / task.mRangeCount;
+
+  // Allocate memory for the flat normals, the corner lists and the counts
+  task.mFlatNormals = (CTMfloat *) _ctmScratchAlloc(self, sizeof(CTMfloat) * 3 * self->mTriangleCount);
+  task.mCorners = (CTMuint *) _ctmScratchAlloc(self, sizeof(CTMuint) * 3 * self->mTriangleCount);
+  task.mHist = (CTMuint *) _ctmScratchAlloc(self, sizeof(CTMuint) * task.mChunkCount * task.mRangeCount);
+  if(!task.mFlatNormals || !task.mCorners || !task.mHist)
+  {
+    if(task.mHist) _ctmScratchFree(self, (void *) task.mHist);
+    if(task.mCorners) _ctmScratchFree(self, (void *) task.mCorners);
+    if(task.mFlatNormals) _ctmScratchFree(self, (void *) task.mFlatNormals);
+    return CTM_FALSE;
+  }
+  task.mContext = self;
+  task.mVertices = aVertices;
+  task.mIndices = aIndices;
+  task.mSmoothNormals = aSmoothNormals;
+
+  // Calculate the flat normals, and count the corners of each chunk
+  _ctmRunTasks(self, task.mChunkCount, _ctmSmoothCountTask, (void *) &task);
+
+  // Convert the counts to corner list offsets (in range order, and in chunk
+  // order within each range, which keeps the corners in triangle order)
+  sum = 0;
+  for(r = 0; r < task.mRangeCount; ++ r)
+  {
+    for(c = 0; c < task.mChunkCount; ++ c)
+    {
+      count = task.mHist[c * task.mRangeCount + r];
+      task.mHist[c * task.mRangeCount + r] = sum;
+      sum += count;
+    }
+  }
+
+  // Build the corner lists, and sum up the normals of each vertex range
+  _ctmRunTasks(self, task.mChunkCount, _ctmSmoothScatterTask, (void *) &task);
+  _ctmRunTasks(self, task.mRangeCount, _ctmSmoothSumTask, (void *) &task);
+
+  _ctmScratchFree(self, (void *) task.mHist);
+  _ctmScratchFree(self, (void *) task.mCorners);
+  _ctmScratchFree(self, (void *) task.mFlatNormals);
+
+  return CTM_TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// _ctmCalcSmoothNormals() - Calculate the smooth normals for a given mesh.
+// These are used as the nominal normals for normal deltas & reconstruction.
+// Note: The encoder and the decoder must get bit identical results, so the
+// flat normals are always summed in triangle order (also when the normals are
+// calculated in parallel).
+//-----------------------------------------------------------------------------
+static void _ctmCalcSmoothNormals(_CTMcontext * self, CTMfloat * aVertices,
+  CTMuint * aIndices, CTMfloat * aSmoothNormals)
+{
+  CTMuint i, j, k;
+  CTMfloat n[3];
+
+  // Large meshes are handled in parallel (if there is not enough memory for
+  // that, we fall back to the serial calculation)
+  if((self->mTriangleCount > _CTM_SMOOTH_CHUNK_SIZE) &&
+     _ctmCalcSmoothNormalsParallel(self, aVertices, aIndices, aSmoothNormals))
+    return;
+
+  // Clear smooth normals array
+  for(i = 0; i < 3 * self->mVertexCount; ++ i)
+    aSmoothNormals[i] = 0.0f;
+
+  // Calculate sums of all neigbouring triangle normals for each vertex
+  for(i = 0; i < self->mTriangleCount; ++ i)
+  {
+    // Add the flat normal to all three triangle vertices
+    _ctmCalcFlatNormal(aVertices, &aIndices[i * 3], n);
+    for(k = 0; k < 3; ++ k)
+      for(j = 0; j < 3; ++ j)
+        aSmoothNormals[aIndices[i * 3 + k] * 3 + j] += n[j];
+  }
+
+  // Normalize the normal sums, which gives the unit length smooth normals
+  _ctmNormalizeSmoothNormals(aSmoothNormals, self->mVertexCount);
+}
+
+//-----------------------------------------------------------------------------
+// _ctmMakeNormalCoordSys() - Create an ortho-normalized coordinate system
+// where the Z-axis is aligned with the given normal.
+// Note 1: This function is central to how the compressed normal data is
+//  interpreted, and it can not be changed (mathematically) without making the
+//  coder/decoder incompatible with other versions of the library!
+// Note 2: Since we do this for every single normal, this routine needs to be
+//  fast. The current implementation uses: 12 MUL, 1 DIV, 1 SQRT, ~6 ADD.
+//-----------------------------------------------------------------------------
+static void _ctmMakeNormalCoordSys(CTMfloat * aNormal, CTMfloat * aBasisAxes)
+{
+  CTMfloat len, * x, * y, * z;
+  CTMuint i;
+
+  // Pointers to the basis axes (aBasisAxes is a 3x3 matrix)
+  x = aBasisAxes;
+  y = &aBasisAxes[3];
+  z = &aBasisAxes[6];
+
+  // Z = normal (must be unit length!)
+  for(i = 0; i < 3; ++ i)
+    z[i] = aNormal[i];
+
+  // Calculate a vector that is guaranteed to be orthogonal to the normal, non-
+  // zero, and a continuous function of the normal (no discrete jumps):
+  // X = (0,0,1) x normal + (1,0,0) x normal
+  x[0] =  -aNormal[1];
+  x[1] =  aNormal[0] - aNormal[2];
+  x[2] =  aNormal[1];
+
+  // Normalize the new X axis (note: |x[2]| = |x[0]|)
+  len = sqrtf(2.0f * x[0] * x[0] + x[1] * x[1]);
+  if(len > 1.0e-20f)
+  {
+    len = 1.0f / len;
+    x[0] *= len;
+    x[1] *= len;
+    x[2] *= len;
+  }
+
+  // Let Y = Z x X  (no normalization needed, since |Z| = |X| = 1)
+  y[0] = z[1] * x[2] - z[2] * x[1];
+  y[1] = z[2] * x[0] - z[0] * x[2];
+  y[2] = z[0] * x[1] - z[1] * x[0];
+}
+
+#ifdef _CTM_SUPPORT_SAVE
+//-----------------------------------------------------------------------------
+// _ctmMakeNormalDeltas() - Convert the normals to a new coordinate system:
+// magnitude, phi, theta (relative to predicted smooth normals).
+//-----------------------------------------------------------------------------
+static CTMbool _ctmMakeNormalDeltas(_CTMcontext * self, CTMint * aIntNormals,
+  CTMfloat * aVertices, CTMuint * aIndices, _CTMsortvertex * aSortVertices)
+{
+  CTMuint i, j, intPhi;
+  CTMfloat magn, phi, theta, scale, thetaScale;
+  CTMfloat * smoothNormals, * normalsBuf, n[3], n2[3], basisAxes[9];
+  const CTMfloat * normals, * n0;
+
+  // Get a packed view of the normals
+  normals = _ctmPackedArrayf(self, &self->mNormals, self->mVertexCount, 3, &normalsBuf);
+  if(!normals)
+  {
+    self->mError = CTM_OUT_OF_MEMORY;
+    return CTM_FALSE;
+  }
+
+  // Allocate temporary memory for the nominal vertex normals
+  smoothNormals = (CTMfloat *) _ctmScratchAlloc(self, 3 * sizeof(CTMfloat) * self->mVertexCount);
+  if(!smoothNormals)
+  {
+    self->mError = CTM_OUT_OF_MEMORY;
+    if(normalsBuf) _ctmFree(self, (void *) normalsBuf);
+    return CTM_FALSE;
+  }
+
+  // Calculate smooth normals (Note: aVertices and aIndices use the sorted
+  // index space, so smoothNormals will too)
+  _ctmCalcSmoothNormals(self, aVertices, aIndices, smoothNormals);
+
+  // Normal scaling factor
+  scale = 1.0f / self->mNormalPrecision;
+
+  for(i = 0; i < self->mVertexCount; ++ i)
+  {
+    // Get the normal (at the old index, before vertex sorting)
+    n0 = &normals[aSortVertices[i].mOriginalIndex * 3];
+
+    // Calculate normal magnitude (should always be 1.0 for unit length normals)
+    magn = sqrtf(n0[0] * n0[0] + n0[1] * n0[1] + n0[2] * n0[2]);
+    if(magn < 1e-10f)
+      magn = 1.0f;
+
+    // Invert magnitude if the normal is negative compared to the predicted
+    // smooth normal
+    if((smoothNormals[i * 3] * n0[0] +
+        smoothNormals[i * 3 + 1] * n0[1] +
+        smoothNormals[i * 3 + 2] * n0[2]) < 0.0f)
+      magn = -magn;
+
+    // Store the magnitude in the first element of the three normal elements
+    aIntNormals[i * 3] = (CTMint) floorf(scale * magn + 0.5f);
+
+    // Normalize the normal (1 / magn) - and flip it if magn < 0
+    magn = 1.0f / magn;
+    for(j = 0; j < 3; ++ j)
+      n[j] = n0[j] * magn;
+
+    // Convert the normal to angular representation (phi, theta) in a coordinate
+    // system where the nominal (smooth) normal is the Z-axis
+    _ctmMakeNormalCoordSys(&smoothNormals[i * 3], basisAxes);
+    for(j = 0; j < 3; ++ j)
+      n2[j] = basisAxes[j * 3] * n[0] +
+              basisAxes[j * 3 + 1] * n[1] +
+              basisAxes[j * 3 + 2] * n[2];
+    if(n2[2] >= 1.0f)
+      phi = 0.0f;
+    else
+      phi = acosf(n2[2]);
+    theta = atan2f(n2[1], n2[0]);
+
+    // Round phi and theta (spherical coordinates) to integers. Note: We let the
+    // theta resolution vary with the x/y circumference (roughly phi).
+    intPhi = (CTMint) floorf(phi * (scale / (0.5f * PI)) + 0.5f);
+    if(intPhi == 0)
+      thetaScale = 0.0f;
+    else if(intPhi <= 4)
+      thetaScale = 2.0f / PI;
+    else
+      thetaScale = ((CTMfloat) intPhi) / (2.0f * PI);
+    aIntNormals[i * 3 + 1] = intPhi;
+    aIntNormals[i * 3 + 2] = (CTMint) floorf((theta + PI) * thetaScale + 0.5f);
+  }
+
+  // Free temporary resources
+  _ctmScratchFree(self, (void *) smoothNormals);
+  if(normalsBuf) _ctmFree(self, (void *) normalsBuf);
+
+  return CTM_TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// _ctmMakeOctNormals() - Convert the normals to magnitude + octahedral
+// coordinates (u, v), in sorted vertex order (see ctmOctahedralNormals()).
+//-----------------------------------------------------------------------------
+static CTMbool _ctmMakeOctNormals(_CTMcontext * self, CTMint * aIntNormals,
+  _CTMsortvertex * aSortVertices)
+{
+  CTMuint i;
+  CTMfloat magn, sum, scale, u, v, t;
+  CTMfloat * normalsBuf;
+  const CTMfloat * normals, * n0;
+
+  // Get a packed view of the normals
+  normals = _ctmPackedArrayf(self, &self->mNormals, self->mVertexCount, 3, &normalsBuf);
+  if(!normals)
+  {
+    self->mError = CTM_OUT_OF_MEMORY;
+    return CTM_FALSE;
+  }
+
+  // Normal scaling factor
+  scale = 1.0f / self->mNormalPrecision;
+
+  for(i = 0; i < self->mVertexCount; ++ i)
+  {
+    // Get the normal (at the old index, before vertex sorting)
+    n0 = &normals[aSortVertices[i].mOriginalIndex * 3];
+
+    // Store the normal magnitude in the first of the three normal elements
+    magn = sqrtf(n0[0] * n0[0] + n0[1] * n0[1] + n0[2] * n0[2]);
+    if(magn < 1e-10f)
+      magn = 1.0f;
+    aIntNormals[i * 3] = (CTMint) floorf(scale * magn + 0.5f);
+
+    // Project the normal onto the octahedron |x| + |y| + |z| = 1 (a zero
+    // normal becomes +Z)
+    sum = fabsf(n0[0]) + fabsf(n0[1]) + fabsf(n0[2]);
+    if(sum > 1e-20f)
+      sum = 1.0f / sum;
+    else
+      sum = 0.0f;
+    u = n0[0] * sum;
+    v = n0[1] * sum;
+
+    // Unfold the lower half of the octahedron (z < 0) onto the corners of the
+    // unit square
+    if(n0[2] < 0.0f)
+    {
+      t = (1.0f - fabsf(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+      v = (1.0f - fabsf(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+      u = t;
+    }
+
+    // Round the octahedral coordinates to integers
+    aIntNormals[i * 3 + 1] = (CTMint) floorf(scale * u + 0.5f);
+    aIntNormals[i * 3 + 2] = (CTMint) floorf(scale * v + 0.5f);
+  }
+
+  if(normalsBuf) _ctmFree(self, (void *) normalsBuf);
+
+  return CTM_TRUE;
+}
+#endif // _CTM_SUPPORT_SAVE
+
+//-----------------------------------------------------------------------------
+// _ctmSinCosBlock() - Calculate the sine and cosine of aCount angles (in
+// radians). The loop is branch free, so that the compiler can vectorize it.
+// For angles within +/-_CTM_SINCOS_MAX_ANGLE, the absolute error is below
+// FLT_EPSILON (i.e. within two ULP of sinf()/cosf() for results that are not
+// close to zero), which is far below the normal quantization step (see
+// test/normalstest.c). The angle is reduced to [-PI/4, PI/4] (Cody-Waite
+// reduction with a three part PI/2), and the sine and cosine of the reduced
+// angle are approximated with minimax polynomials (the same as in the Cephes
+// library).
+//-----------------------------------------------------------------------------
+void _ctmSinCosBlock(const CTMfloat * aAngles, CTMfloat * aSin,
+  CTMfloat * aCos, CTMuint aCount)
+{
+  CTMuint i;
+  CTMint q;
+  CTMfloat x, x2, s, c, t;
+
+  for(i = 0; i < aCount; ++ i)
+  {
+    // Reduce the angle: x = angle - q * PI/2
+    x = aAngles[i];
+    q = (CTMint) (x * 0.636619772367581343f + (x >= 0.0f ? 0.5f : -0.5f));
+    x = ((x - (CTMfloat) q * 1.5703125f) - (CTMfloat) q * 4.837512969970703125e-4f) -
+        (CTMfloat) q * 7.54978995489188216e-8f;
+
+    // Sine and cosine of the reduced angle
+    x2 = x * x;
+    s = x + x * x2 * (-1.6666654611e-1f + x2 * (8.3321608736e-3f + x2 * -1.9515295891e-4f));
+    c = 1.0f - 0.5f * x2 + x2 * x2 * (4.166664568298827e-2f + x2 * (-1.388731625493765e-3f + x2 * 2.443315711809948e-5f));
+
+    // Select the quadrant
+    t = (q & 1) ? c : s;
+    c = (q & 1) ? s : c;
+    s = t;
+    aSin[i] = (q & 2) ? -s : s;
+    aCos[i] = ((q + 1) & 2) ? -c : c;
+  }
+}
+
+//-----------------------------------------------------------------------------
+// _ctmRestoreNormalBlock() - Convert a block of normals (magnitude, phi, theta)
+// back to cartesian coordinates, relative to the smooth normals. The angles of
+// all the normals are calculated first, so that the trigonometry can be done
+// in one batch by _ctmSinCosBlock().
+//-----------------------------------------------------------------------------
+static void _ctmRestoreNormalBlock(_CTMcontext * self, const CTMint * aIntNormals,
+  CTMfloat * aSmoothNormals, CTMuint aCount, CTMfloat * aNormals)
+{
+  CTMuint j, k;
+  CTMint intPhi, inRange = 1;
+  CTMfloat scale, thetaScale, n[3], n2[3], basisAxes[9];
+  CTMfloat magn[_CTM_ARRAY_BLOCK_SIZE], phi[_CTM_ARRAY_BLOCK_SIZE],
+           theta[_CTM_ARRAY_BLOCK_SIZE], sinPhi[_CTM_ARRAY_BLOCK_SIZE],
+           cosPhi[_CTM_ARRAY_BLOCK_SIZE], sinTheta[_CTM_ARRAY_BLOCK_SIZE],
+           cosTheta[_CTM_ARRAY_BLOCK_SIZE];
+
+  // Normal scaling factor
+  scale = self->mNormalPrecision;
+
+  for(k = 0; k < aCount; ++ k)
+  {
+    // Get the normal magnitude from the first of the three normal elements
+    magn[k] = aIntNormals[k * 3] * scale;
+
+    // Get phi and theta (spherical coordinates, relative to the smooth normal).
+    intPhi = aIntNormals[k * 3 + 1];
+    phi[k] = intPhi * (0.5f * PI) * scale;
+    if(intPhi == 0)
+      thetaScale = 0.0f;
+    else if(intPhi <= 4)
+      thetaScale = PI / 2.0f;
+    else
+      thetaScale = (2.0f * PI) / ((CTMfloat) intPhi);
+    theta[k] = aIntNormals[k * 3 + 2] * thetaScale - PI;
+
+    inRange &= (fabsf(phi[k]) <= _CTM_SINCOS_MAX_ANGLE) &
+               (fabsf(theta[k]) <= _CTM_SINCOS_MAX_ANGLE);
+  }
+
+  // Sine and cosine of the angles (only well formed files are guaranteed to
+  // have all the angles within range, so use the C library otherwise)
+  if(inRange && !self->mReferenceSinCos)
+  {
+    _ctmSinCosBlock(phi, sinPhi, cosPhi, aCount);
+    _ctmSinCosBlock(theta, sinTheta, cosTheta, aCount);
+  }
+  else
+  {
+    for(k = 0; k < aCount; ++ k)
+    {
+      sinPhi[k] = sinf(phi[k]);
+      cosPhi[k] = cosf(phi[k]);
+      sinTheta[k] = sinf(theta[k]);
+      cosTheta[k] = cosf(theta[k]);
+    }
+  }
+
+  for(k = 0; k < aCount; ++ k)
+  {
+    // Convert the normal from the angular representation (phi, theta) back to
+    // cartesian coordinates
+    n2[0] = sinPhi[k] * cosTheta[k];
+    n2[1] = sinPhi[k] * sinTheta[k];
+    n2[2] = cosPhi[k];
+
+    _ctmMakeNormalCoordSys(&aSmoothNormals[k * 3], basisAxes);
+    for(j = 0; j < 3; ++ j)
+      n[j] = basisAxes[j] * n2[0] +
+             basisAxes[3 + j] * n2[1] +
+             basisAxes[6 + j] * n2[2];
+
+    // Apply normal magnitude
+    for(j = 0; j < 3; ++ j)
+      aNormals[k * 3 + j] = n[j] * magn[k];
+  }
+}
+
+//-----------------------------------------------------------------------------
+// _ctmRestoreNormals() - Convert the normals back to cartesian coordinates.
+//-----------------------------------------------------------------------------
+static CTMbool _ctmRestoreNormals(_CTMcontext * self, CTMuint * aIndices,
+  CTMfloat * aVertices, CTMint * aIntNormals)
+{
+  CTMuint i, blockSize;
+  CTMfloat * smoothNormals;
+  CTMfloat block[_CTM_ARRAY_BLOCK_SIZE * 3];
+
+  // Allocate temporary memory for the nominal vertex normals
+  smoothNormals = (CTMfloat *) _ctmScratchAlloc(self, 3 * sizeof(CTMfloat) * self->mVertexCount);
+  if(!smoothNormals)
+  {
+    self->mError = CTM_OUT_OF_MEMORY;
+    return CTM_FALSE;
+  }
+
+  // Calculate smooth normals (nominal normals)
+  _ctmCalcSmoothNormals(self, aVertices, aIndices, smoothNormals);
+
+  for(i = 0; i < self->mVertexCount; i += blockSize)
+  {
+    blockSize = self->mVertexCount - i;
+    if(blockSize > _CTM_ARRAY_BLOCK_SIZE)
+      blockSize = _CTM_ARRAY_BLOCK_SIZE;
+
+    // Convert the normals of the block
+    _ctmRestoreNormalBlock(self, &aIntNormals[i * 3], &smoothNormals[i * 3],
+                           blockSize, block);
+
+    // Check and output the block to the normals array
+    if(!self->mTrustedInput && !_ctmFloatsAreFinite(block, blockSize * 3))
+    {
+      self->mError = CTM_INVALID_MESH;
+      _ctmScratchFree(self, (void *) smoothNormals);
+      return CTM_FALSE;
+    }
+    _ctmScatterArrayf(&self->mNormals, i, blockSize, 3, block);
+  }
+
+  // Free temporary resources
+  _ctmScratchFree(self, (void *) smoothNormals);
+
+  return CTM_TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// _CTMoctnormaltask - State for restoring octahedral normals in parallel.
+//-----------------------------------------------------------------------------
+typedef struct {
+  _CTMcontext * mContext;
+  const CTMint * mIntNormals;   // Magnitude + octahedral coordinates
+  CTMuint mChunkSize;           // Number of normals per task
+  CTMbool * mValid;             // CTM_FALSE if a task found invalid normals
+} _CTMoctnormaltask;
+
+//-----------------------------------------------------------------------------
+// _ctmRestoreOctNormalsTask() - Convert one chunk of octahedral normals back
+// to cartesian coordinates, and write them to the normals array (task for
+// _ctmRunTasks()).
+//-----------------------------------------------------------------------------
+static void _ctmRestoreOctNormalsTask(void * aArg, CTMuint aChunk)
+{
+  _CTMoctnormaltask * task = (_CTMoctnormaltask *) aArg;
+  _CTMcontext * self = task->mContext;
+  const CTMint * src;
+  CTMuint i, k, first, last, blockSize;
+  CTMfloat scale, magn, u, v, z, t, len;
+  CTMfloat block[_CTM_ARRAY_BLOCK_SIZE * 3];
+
+  first = aChunk * task->mChunkSize;
+  last = first + task->mChunkSize;
+  if(last > self->mVertexCount)
+    last = self->mVertexCount;
+
+  // Normal scaling factor
+  scale = self->mNormalPrecision;
+
+  task->mValid[aChunk] = CTM_TRUE;
+  for(i = first; i < last; i += blockSize)
+  {
+    blockSize = last - i;
+    if(blockSize > _CTM_ARRAY_BLOCK_SIZE)
+      blockSize = _CTM_ARRAY_BLOCK_SIZE;
+
+    src = &task->mIntNormals[i * 3];
+    for(k = 0; k < blockSize; ++ k)
+    {
+      magn = src[k * 3] * scale;
+      u = src[k * 3 + 1] * scale;
+      v = src[k * 3 + 2] * scale;
+
+      // Fold the corners of the unit square back to the lower half of the
+      // octahedron
+      z = 1.0f - fabsf(u) - fabsf(v);
+      if(z < 0.0f)
+      {
+        t = (1.0f - fabsf(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+        v = (1.0f - fabsf(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+        u = t;
+      }
+
+      // Normalize, and apply the normal magnitude
+      len = magn / sqrtf(u * u + v * v + z * z);
+      block[k * 3] = u * len;
+      block[k * 3 + 1] = v * len;
+      block[k * 3 + 2] = z * len;
+    }
+
+    // Check and output the block to the normals array
+    if(!self->mTrustedInput && !_ctmFloatsAreFinite(block, blockSize * 3))
+    {
+      task->mValid[aChunk] = CTM_FALSE;
+      return;
+    }
+    _ctmScatterArrayf(&self->mNormals, i, blockSize, 3, block);
+  }
+}
+
+//-----------------------------------------------------------------------------
+// _ctmRestoreOctNormals() - Convert octahedral normals back to cartesian
+// coordinates. Each normal is restored on its own (without the mesh), so the
+// normals are restored in parallel.
+//-----------------------------------------------------------------------------
+static CTMbool _ctmRestoreOctNormals(_CTMcontext * self,
+  const CTMint * aIntNormals)
+{
+  _CTMoctnormaltask task;
+  CTMuint i, chunkCount;
+  CTMbool ok = CTM_TRUE;
+
+  chunkCount = (self->mVertexCount + _CTM_OCT_CHUNK_SIZE - 1) / _CTM_OCT_CHUNK_SIZE;
+  task.mValid = (CTMbool *) _ctmScratchAlloc(self, sizeof(CTMbool) * chunkCount);
+  if(!task.mValid)
+  {
+    self->mError = CTM_OUT_OF_MEMORY;
+    return CTM_FALSE;
+  }
+  task.mContext = self;
+  task.mIntNormals = aIntNormals;
+  task.mChunkSize = _CTM_OCT_CHUNK_SIZE;
+  _ctmRunTasks(self, chunkCount, _ctmRestoreOctNormalsTask, (void *) &task);
+
+  for(i = 0; i < chunkCount; ++ i)
+    ok = ok && task.mValid[i];
+  _ctmScratchFree(self, (void *) task.mValid);
+  if(!ok)
+    self->mError = CTM_INVALID_MESH;
+
+  return ok;
+}
+
+#ifdef _CTM_SUPPORT_SAVE
+//-----------------------------------------------------------------------------
+// _ctmMakeUVCoordDeltas() - Calculate various forms of derivatives in order
+// to reduce data entropy.
+//-----------------------------------------------------------------------------
+static CTMbool _ctmMakeUVCoordDeltas(_CTMcontext * self, _CTMfloatmap * aMap,
+  CTMint * aIntUVCoords, _CTMsortvertex * aSortVertices)
+{
+  CTMuint i;
+  CTMint u, v, prevU, prevV;
+  CTMfloat scale, * uvBuf;
+  const CTMfloat * uv, * p;
+
+  // Get a packed view of the UV coordinates
+  uv = _ctmPackedArrayf(self, &aMap->mArray, self->mVertexCount, 2, &uvBuf);
+  if(!uv)
+  {
+    self->mError = CTM_OUT_OF_MEMORY;
+    return CTM_FALSE;
+  }
+
+  // UV coordinate scaling factor
+  scale = 1.0f / aMap->mPrecision;
 
   prevU = prevV = 0;
   for(i = 0; i < self->mVertexCount; ++ i)
   {
-    // Get old UV coordinate index (before vertex sorting)
-    oldIdx = aSortVertices[i].mOriginalIndex;
+    // Get UV coordinate (at the old index, before vertex sorting)
+    p = &uv[aSortVertices[i].mOriginalIndex * 2];
 
     // Convert to fixed point
-    u = (CTMint) floorf(scale * aMap->mArray.getf(&aMap->mArray, oldIdx, 0) + 0.5f);
-    v = (CTMint) floorf(scale * aMap->mArray.getf(&aMap->mArray, oldIdx, 1) + 0.5f);
+    u = (CTMint) floorf(scale * p[0] + 0.5f);
+    v = (CTMint) floorf(scale * p[1] + 0.5f);
 
     // Calculate delta and store it in the converted array. NOTE: Here we rely
     // on the fact that vertices are sorted, and usually close to each other,
@@ -733,107 +2246,483 @@ static void _ctmMakeUVCoordDeltas(_CTMcontext * self, _CTMfloatmap * aMap,
     prevU = u;
     prevV = v;
   }
-}
-#endif // _CTM_SUPPORT_SAVE
-
-//-----------------------------------------------------------------------------
-// _ctmRestoreUVCoords() - Calculate inverse derivatives of the UV
-// coordinates.
-//-----------------------------------------------------------------------------
-static void _ctmRestoreUVCoords(_CTMcontext * self, _CTMfloatmap * aMap,
-  CTMint * aIntUVCoords)
-{
-  CTMuint i;
-  CTMint u, v, prevU, prevV;
-  CTMfloat scale;
 
-  // UV coordinate scaling factor
-  scale = aMap->mPrecision;
+  if(uvBuf) _ctmFree(self, (void *) uvBuf);
+
+  return CTM_TRUE;
+}
+#endif // _CTM_SUPPORT_SAVE
+
+//-----------------------------------------------------------------------------
+// _ctmRestoreUVCoords() - Calculate inverse derivatives of the UV
+// coordinates. Returns CTM_FALSE if any of the UV coordinates is not finite
+// (unless the input is trusted).
+//-----------------------------------------------------------------------------
+static CTMbool _ctmRestoreUVCoords(_CTMcontext * self, _CTMfloatmap * aMap,
+  CTMint * aIntUVCoords)
+{
+  CTMuint i, k, blockSize;
+  CTMint u, v, prevU, prevV;
+  CTMfloat scale, block[_CTM_ARRAY_BLOCK_SIZE * 2];
+
+  // UV coordinate scaling factor
+  scale = aMap->mPrecision;
+
+  prevU = prevV = 0;
+  for(i = 0; i < self->mVertexCount; i += blockSize)
+  {
+    blockSize = self->mVertexCount - i;
+    if(blockSize > _CTM_ARRAY_BLOCK_SIZE)
+      blockSize = _CTM_ARRAY_BLOCK_SIZE;
+
+    for(k = 0; k < blockSize; ++ k)
+    {
+      // Calculate inverse delta
+      u = (CTMint) ((CTMuint) aIntUVCoords[(i + k) * 2] + (CTMuint) prevU);
+      v = (CTMint) ((CTMuint) aIntUVCoords[(i + k) * 2 + 1] + (CTMuint) prevV);
+
+      // Convert to floating point
+      block[k * 2] = (CTMfloat) u * scale;
+      block[k * 2 + 1] = (CTMfloat) v * scale;
+
+      prevU = u;
+      prevV = v;
+    }
+
+    // Check and output the block to the UV map
+    if(!self->mTrustedInput && !_ctmFloatsAreFinite(block, blockSize * 2))
+      return CTM_FALSE;
+    _ctmScatterArrayf(&aMap->mArray, i, blockSize, 2, block);
+  }
+
+  return CTM_TRUE;
+}
+
+#ifdef _CTM_SUPPORT_SAVE
+//-----------------------------------------------------------------------------
+// _ctmMakeAttribDeltas() - Calculate various forms of derivatives in order
+// to reduce data entropy.
+//-----------------------------------------------------------------------------
+static CTMbool _ctmMakeAttribDeltas(_CTMcontext * self, _CTMfloatmap * aMap,
+  CTMint * aIntAttribs, _CTMsortvertex * aSortVertices)
+{
+  CTMuint i, j;
+  CTMint value[4], prev[4];
+  CTMfloat scale, * attribBuf;
+  const CTMfloat * attribs, * p;
+
+  // Get a packed view of the attributes
+  attribs = _ctmPackedArrayf(self, &aMap->mArray, self->mVertexCount, 4, &attribBuf);
+  if(!attribs)
+  {
+    self->mError = CTM_OUT_OF_MEMORY;
+    return CTM_FALSE;
+  }
+
+  // Attribute scaling factor
+  scale = 1.0f / aMap->mPrecision;
+
+  for(j = 0; j < 4; ++ j)
+    prev[j] = 0;
+
+  for(i = 0; i < self->mVertexCount; ++ i)
+  {
+    // Get attribute (at the old index, before vertex sorting)
+    p = &attribs[aSortVertices[i].mOriginalIndex * 4];
+
+    // Convert to fixed point, and calculate delta and store it in the converted
+    // array. NOTE: Here we rely on the fact that vertices are sorted, and
+    // usually close to each other, which means that attributes should also
+    // be close to each other (and we assume that they somehow vary slowly with
+    // the geometry)...
+    for(j = 0; j < 4; ++ j)
+    {
+      value[j] = (CTMint) floorf(scale * p[j] + 0.5f);
+      aIntAttribs[i * 4 + j] = value[j] - prev[j];
+      prev[j] = value[j];
+    }
+  }
+
+  if(attribBuf) _ctmFree(self, (void *) attribBuf);
+
+  return CTM_TRUE;
+}
+#endif // _CTM_SUPPORT_SAVE
+
+//-----------------------------------------------------------------------------
+// _ctmRestoreAttribs() - Calculate inverse derivatives of the vertex
+// attributes. Returns CTM_FALSE if any of the attributes is not finite (unless
+// the input is trusted).
+//-----------------------------------------------------------------------------
+static CTMbool _ctmRestoreAttribs(_CTMcontext * self, _CTMfloatmap * aMap,
+  CTMint * aIntAttribs)
+{
+  CTMuint i, j, k, blockSize;
+  CTMint value[4], prev[4];
+  CTMfloat scale, block[_CTM_ARRAY_BLOCK_SIZE * 4];
+
+  // Attribute scaling factor
+  scale = aMap->mPrecision;
+
+  for(j = 0; j < 4; ++ j)
+    prev[j] = 0;
+
+  for(i = 0; i < self->mVertexCount; i += blockSize)
+  {
+    blockSize = self->mVertexCount - i;
+    if(blockSize > _CTM_ARRAY_BLOCK_SIZE)
+      blockSize = _CTM_ARRAY_BLOCK_SIZE;
+
+    // Calculate inverse delta, and convert to floating point
+    for(k = 0; k < blockSize; ++ k)
+    {
+      for(j = 0; j < 4; ++ j)
+      {
+        value[j] = (CTMint) ((CTMuint) aIntAttribs[(i + k) * 4 + j] + (CTMuint) prev[j]);
+        block[k * 4 + j] = (CTMfloat) value[j] * scale;
+        prev[j] = value[j];
+      }
+    }
+
+    // Check and output the block to the attribute map
+    if(!self->mTrustedInput && !_ctmFloatsAreFinite(block, blockSize * 4))
+      return CTM_FALSE;
+    _ctmScatterArrayf(&aMap->mArray, i, blockSize, 4, block);
+  }
+
+  return CTM_TRUE;
+}
+
+#ifdef _CTM_SUPPORT_SAVE
+//-----------------------------------------------------------------------------
+// _CTMmg2section - A packed integer section of an MG2 mesh.
+//-----------------------------------------------------------------------------
+typedef struct {
+  // Section identifier ("VERT", "GIDX", ...).
+  const char * mID;
+
+  // UV/attribute map (only used for "TEXC" and "ATTR" sections).
+  _CTMfloatmap * mMap;
+
+  // Integer data & packed result.
+  _CTMpackjob mJob;
+} _CTMmg2section;
+
+//-----------------------------------------------------------------------------
+// _CTMmg2packtask - Argument for _ctmPackSectionTask().
+//-----------------------------------------------------------------------------
+typedef struct {
+  _CTMcontext * mContext;
+  _CTMmg2section * mSections;
+} _CTMmg2packtask;
+
+//-----------------------------------------------------------------------------
+// _ctmAddSection() - Allocate the integer array for the next MG2 section.
+//-----------------------------------------------------------------------------
+static CTMint * _ctmAddSection(_CTMcontext * self, _CTMmg2section * aSections,
+  CTMuint * aSectionCount, const char * aID, _CTMfloatmap * aMap,
+  CTMuint aCount, CTMuint aSize, CTMint aSignedInts)
+{
+  _CTMmg2section * s = &aSections[*aSectionCount];
+
+  // The packing buffer is allocated here (in the calling thread), since the
+  // sections are packed in parallel and the scratch arena is not thread safe
+  s->mJob.mData = (CTMint *) _ctmScratchAlloc(self, sizeof(CTMint) * aSize * aCount);
+  s->mJob.mBuffer = (unsigned char *) _ctmScratchAlloc(self, _ctmPackBufferSize(self, aCount, aSize));
+  if(!s->mJob.mData || !s->mJob.mBuffer)
+  {
+    _ctmScratchFree(self, (void *) s->mJob.mBuffer);
+    _ctmScratchFree(self, (void *) s->mJob.mData);
+    s->mJob.mData = (CTMint *) 0;
+    s->mJob.mBuffer = (unsigned char *) 0;
+    self->mError = CTM_OUT_OF_MEMORY;
+    return (CTMint *) 0;
+  }
+  s->mID = aID;
+  s->mMap = aMap;
+  s->mJob.mCount = aCount;
+  s->mJob.mSize = aSize;
+  s->mJob.mSignedInts = aSignedInts;
+  ++ (*aSectionCount);
+
+  return s->mJob.mData;
+}
+
+//-----------------------------------------------------------------------------
+// _ctmFreeSections() - Free all the data of a list of MG2 sections.
+//-----------------------------------------------------------------------------
+static void _ctmFreeSections(_CTMcontext * self, _CTMmg2section * aSections,
+  CTMuint aCount)
+{
+  CTMuint i;
+
+  // (the packed data lives in mJob.mBuffer)
+  for(i = aCount; i > 0; -- i)
+  {
+    _ctmScratchFree(self, (void *) aSections[i - 1].mJob.mBuffer);
+    _ctmScratchFree(self, (void *) aSections[i - 1].mJob.mData);
+  }
+  _ctmScratchFree(self, (void *) aSections);
+}
+
+//-----------------------------------------------------------------------------
+// _ctmPrepareSections_MG2() - Calculate the integer data (deltas) for all the
+// sections of the mesh. With parallelogram prediction (aParallelogram), the
+// VERT section holds the vertex prediction errors, and there is no GIDX
+// section.
+//-----------------------------------------------------------------------------
+static CTMbool _ctmPrepareSections_MG2(_CTMcontext * self,
+  _CTMmg2section * aSections, CTMuint * aSectionCount, const CTMfloat * aVertices,
+  _CTMsortvertex * aSortVertices, _CTMgrid * aGrid, CTMbool aParallelogram)
+{
+  _CTMfloatmap * map;
+  CTMuint * indices, * deltaIndices, * gridIndices;
+  CTMint * intVertices, * intNormals, * intUVCoords, * intAttribs;
+  CTMfloat * restoredVertices;
+  CTMuint i;
+
+  if(aParallelogram)
+  {
+    // Convert vertices to integers on the lattice of the grid (they are
+    // replaced by the prediction errors when the triangles are ready)
+    intVertices = _ctmAddSection(self, aSections, aSectionCount, "VERT", 0,
+                                 self->mVertexCount, 3, CTM_TRUE);
+    if(!intVertices)
+      return CTM_FALSE;
+    _ctmMakeLatticeVertices(self, intVertices, aVertices, aSortVertices, aGrid);
+  }
+  else
+  {
+    // Convert vertices to integers and calculate vertex deltas
+    // (entropy-reduction)
+    intVertices = _ctmAddSection(self, aSections, aSectionCount, "VERT", 0,
+                                 self->mVertexCount, 3, CTM_FALSE);
+    if(!intVertices)
+      return CTM_FALSE;
+    _ctmMakeVertexDeltas(self, intVertices, aVertices, aSortVertices,
+                         self->mVertexCount, aGrid);
+
+    // Prepare grid indices (deltas)
+    gridIndices = (CTMuint *) _ctmAddSection(self, aSections, aSectionCount,
+                                             "GIDX", 0, self->mVertexCount, 1,
+                                             CTM_FALSE);
+    if(!gridIndices)
+      return CTM_FALSE;
+    gridIndices[0] = aSortVertices[0].mGridIndex;
+    for(i = 1; i < self->mVertexCount; ++ i)
+      gridIndices[i] = aSortVertices[i].mGridIndex - aSortVertices[i - 1].mGridIndex;
+  }
+
+  // Calculate the result of the compressed -> decompressed vertices, in order
+  // to use the same vertex data for calculating nominal normals as the
+  // decompression routine (i.e. compensate for the vertex error when
+  // calculating the normals)
+  if(self->mHasNormals && !self->mOctNormals)
+  {
+    restoredVertices = (CTMfloat *) _ctmScratchAlloc(self, sizeof(CTMfloat) * 3 * self->mVertexCount);
+    if(!restoredVertices)
+    {
+      self->mError = CTM_OUT_OF_MEMORY;
+      return CTM_FALSE;
+    }
+
+    if(aParallelogram)
+      _ctmLatticeToVertices(self, aGrid, intVertices, restoredVertices);
+    else
+    {
+      // Absolute grid indices (the GIDX section holds the deltas)
+      indices = (CTMuint *) _ctmScratchAlloc(self, sizeof(CTMuint) * self->mVertexCount);
+      if(!indices)
+      {
+        self->mError = CTM_OUT_OF_MEMORY;
+        _ctmScratchFree(self, (void *) restoredVertices);
+        return CTM_FALSE;
+      }
+      for(i = 0; i < self->mVertexCount; ++ i)
+        indices[i] = aSortVertices[i].mGridIndex;
+      _ctmRestoreVertices(self, intVertices, indices, aGrid, restoredVertices);
+      _ctmScratchFree(self, (void *) indices);
+    }
+  }
+  else
+    restoredVertices = (CTMfloat *) 0;
+
+  // Perpare (sort) indices
+  indices = (CTMuint *) _ctmScratchAlloc(self, sizeof(CTMuint) * self->mTriangleCount * 3);
+  if(!indices)
+  {
+    self->mError = CTM_OUT_OF_MEMORY;
+    if(restoredVertices) _ctmScratchFree(self, (void *) restoredVertices);
+    return CTM_FALSE;
+  }
+  if(!_ctmReIndexIndices(self, aSortVertices, indices))
+  {
+    _ctmScratchFree(self, (void *) indices);
+    if(restoredVertices) _ctmScratchFree(self, (void *) restoredVertices);
+    return CTM_FALSE;
+  }
+  if(!_ctmReArrangeTriangles(self, indices))
+  {
+    _ctmScratchFree(self, (void *) indices);
+    if(restoredVertices) _ctmScratchFree(self, (void *) restoredVertices);
+    return CTM_FALSE;
+  }
+
+  // Replace the vertices with their parallelogram prediction errors (the
+  // triangles are in the same order as in the decoder)
+  if(aParallelogram &&
+     !_ctmParallelogramVertices(self, intVertices, indices, CTM_FALSE))
+  {
+    _ctmScratchFree(self, (void *) indices);
+    if(restoredVertices) _ctmScratchFree(self, (void *) restoredVertices);
+    return CTM_FALSE;
+  }
+
+  // Calculate index deltas (entropy-reduction)
+  deltaIndices = (CTMuint *) _ctmAddSection(self, aSections, aSectionCount,
+                                            "INDX", 0, self->mTriangleCount, 3,
+                                            CTM_FALSE);
+  if(!deltaIndices)
+  {
+    _ctmScratchFree(self, (void *) indices);
+    if(restoredVertices) _ctmScratchFree(self, (void *) restoredVertices);
+    return CTM_FALSE;
+  }
+  for(i = 0; i < self->mTriangleCount * 3; ++ i)
+    deltaIndices[i] = indices[i];
+  _ctmMakeIndexDeltas(deltaIndices, self->mTriangleCount);
+
+  if(self->mHasNormals && self->mOctNormals)
+  {
+    // Convert normals to octahedral integers (no deltas, since neighbouring
+    // vertices in the sorted vertex order rarely have similar normals)
+    intNormals = _ctmAddSection(self, aSections, aSectionCount, "NORM", 0,
+                                self->mVertexCount, 3, CTM_TRUE);
+    if(!intNormals || !_ctmMakeOctNormals(self, intNormals, aSortVertices))
+    {
+      _ctmScratchFree(self, (void *) indices);
+      return CTM_FALSE;
+    }
+  }
+  else if(self->mHasNormals)
+  {
+    // Convert normals to integers and calculate deltas (entropy-reduction)
+    intNormals = _ctmAddSection(self, aSections, aSectionCount, "NORM", 0,
+                                self->mVertexCount, 3, CTM_FALSE);
+    if(!intNormals ||
+       !_ctmMakeNormalDeltas(self, intNormals, restoredVertices, indices, aSortVertices))
+    {
+      _ctmScratchFree(self, (void *) indices);
+      _ctmScratchFree(self, (void *) restoredVertices);
+      return CTM_FALSE;
+    }
+  }
+
+  // Free restored indices and vertices
+  _ctmScratchFree(self, (void *) indices);
+  if(restoredVertices) _ctmScratchFree(self, (void *) restoredVertices);
 
-  prevU = prevV = 0;
-  for(i = 0; i < self->mVertexCount; ++ i)
+  // Convert UV coordinates to integers and calculate deltas (entropy-reduction)
+  map = self->mUVMaps;
+  while(map)
   {
-    // Calculate inverse delta
-    u = aIntUVCoords[i * 2] + prevU;
-    v = aIntUVCoords[i * 2 + 1] + prevV;
-
-    // Convert to floating point
-    aMap->mArray.setf(&aMap->mArray, i, 0, (CTMfloat) u * scale);
-    aMap->mArray.setf(&aMap->mArray, i, 1, (CTMfloat) v * scale);
+    intUVCoords = _ctmAddSection(self, aSections, aSectionCount, "TEXC", map,
+                                 self->mVertexCount, 2, CTM_TRUE);
+    if(!intUVCoords ||
+       !_ctmMakeUVCoordDeltas(self, map, intUVCoords, aSortVertices))
+      return CTM_FALSE;
+    map = map->mNext;
+  }
 
-    prevU = u;
-    prevV = v;
+  // Convert vertex attributes to integers and calculate deltas (entropy-reduction)
+  map = self->mAttribMaps;
+  while(map)
+  {
+    intAttribs = _ctmAddSection(self, aSections, aSectionCount, "ATTR", map,
+                                self->mVertexCount, 4, CTM_TRUE);
+    if(!intAttribs ||
+       !_ctmMakeAttribDeltas(self, map, intAttribs, aSortVertices))
+      return CTM_FALSE;
+    map = map->mNext;
   }
+
+  return CTM_TRUE;
 }
 
-#ifdef _CTM_SUPPORT_SAVE
 //-----------------------------------------------------------------------------
-// _ctmMakeAttribDeltas() - Calculate various forms of derivatives in order
-// to reduce data entropy.
+// _ctmInitFrames_MG2() - Setup the MG2 animation state from the sections of
+// the first frame (as prepared by _ctmPrepareSections_MG2()). On success, the
+// animation state takes over the sort vertex array.
 //-----------------------------------------------------------------------------
-static void _ctmMakeAttribDeltas(_CTMcontext * self, _CTMfloatmap * aMap,
-  CTMint * aIntAttribs, _CTMsortvertex * aSortVertices)
+static CTMbool _ctmInitFrames_MG2(_CTMcontext * self,
+  _CTMmg2section * aSections, CTMuint aSectionCount,
+  _CTMsortvertex * aSortVertices, _CTMgrid * aGrid, CTMbool aParallelogram)
 {
-  CTMuint i, j, oldIdx;
-  CTMint value[4], prev[4];
-  CTMfloat scale;
-
-  // Attribute scaling factor
-  scale = 1.0f / aMap->mPrecision;
+  _CTMmg2frames * frames;
+  CTMint * mapValues;
+  CTMuint i, s;
 
-  for(j = 0; j < 4; ++ j)
-    prev[j] = 0;
+  frames = _ctmNewFrames_MG2(self, aGrid);
+  if(!frames)
+    return CTM_FALSE;
+  frames->mParallelogram = aParallelogram;
 
+  // Grid indices
   for(i = 0; i < self->mVertexCount; ++ i)
+    frames->mGridIndices[i] = aSortVertices[i].mGridIndex;
+
+  // Triangle indices (INDX section, which follows the GIDX section unless
+  // the vertices are predicted from the triangles)
+  s = aParallelogram ? 1 : 2;
+  memcpy(frames->mIndices, aSections[s].mJob.mData,
+         sizeof(CTMuint) * self->mTriangleCount * 3);
+  _ctmRestoreIndices(self, frames->mIndices);
+  ++ s;
+
+  // Vertices (VERT section)
+  memcpy(frames->mVertices, aSections[0].mJob.mData,
+         sizeof(CTMint) * self->mVertexCount * 3);
+  if(aParallelogram)
   {
-    // Get old attribute index (before vertex sorting)
-    oldIdx = aSortVertices[i].mOriginalIndex;
+    if(!_ctmParallelogramVertices(self, frames->mVertices, frames->mIndices, CTM_TRUE))
+      return CTM_FALSE;
+  }
+  else
+    _ctmAbsoluteVertexInts(self, frames->mVertices, frames->mGridIndices);
 
-    // Convert to fixed point, and calculate delta and store it in the converted
-    // array. NOTE: Here we rely on the fact that vertices are sorted, and
-    // usually close to each other, which means that attributes should also
-    // be close to each other (and we assume that they somehow vary slowly with
-    // the geometry)...
-    for(j = 0; j < 4; ++ j)
-    {
-      value[j] = (CTMint) floorf(scale * aMap->mArray.getf(&aMap->mArray, oldIdx, j) + 0.5f);
-      aIntAttribs[i * 4 + j] = value[j] - prev[j];
-      prev[j] = value[j];
-    }
+  // Normals (NORM section, which has no deltas)
+  if(self->mHasNormals)
+  {
+    memcpy(frames->mNormals, aSections[s].mJob.mData,
+           sizeof(CTMint) * self->mVertexCount * 3);
+    ++ s;
+  }
+
+  // UV maps and attribute maps (TEXC and ATTR sections)
+  mapValues = frames->mMaps;
+  for(; s < aSectionCount; ++ s)
+  {
+    memcpy(mapValues, aSections[s].mJob.mData,
+           sizeof(CTMint) * self->mVertexCount * aSections[s].mJob.mSize);
+    _ctmAccumulateInts(mapValues, self->mVertexCount, aSections[s].mJob.mSize);
+    mapValues += self->mVertexCount * aSections[s].mJob.mSize;
   }
+
+  // Vertex order (taken over last, since the caller frees it on failure)
+  frames->mSortVertices = aSortVertices;
+
+  return CTM_TRUE;
 }
-#endif // _CTM_SUPPORT_SAVE
 
 //-----------------------------------------------------------------------------
-// _ctmRestoreAttribs() - Calculate inverse derivatives of the vertex
-// attributes.
+// _ctmPackSectionTask() - Compress one MG2 section (task for _ctmRunTasks()).
 //-----------------------------------------------------------------------------
-static void _ctmRestoreAttribs(_CTMcontext * self, _CTMfloatmap * aMap,
-  CTMint * aIntAttribs)
+static void _ctmPackSectionTask(void * aArg, CTMuint aIndex)
 {
-  CTMuint i, j;
-  CTMint value[4], prev[4];
-  CTMfloat scale;
-
-  // Attribute scaling factor
-  scale = aMap->mPrecision;
-
-  for(j = 0; j < 4; ++ j)
-    prev[j] = 0;
-
-  for(i = 0; i < self->mVertexCount; ++ i)
-  {
-    // Calculate inverse delta, and convert to floating point
-    for(j = 0; j < 4; ++ j)
-    {
-      value[j] = aIntAttribs[i * 4 + j] + prev[j];
-      aMap->mArray.setf(&aMap->mArray, i, j, (CTMfloat) value[j] * scale);
-      prev[j] = value[j];
-    }
-  }
+  _CTMmg2packtask * task = (_CTMmg2packtask *) aArg;
+  _ctmPackInts(task->mContext, &task->mSections[aIndex].mJob);
 }
 
-#ifdef _CTM_SUPPORT_SAVE
 //-----------------------------------------------------------------------------
 // _ctmCompressMesh_MG2() - Compress the mesh that is stored in the CTM
 // context, and write it the the output stream in the CTM context.
@@ -843,17 +2732,32 @@ CTMbool _ctmCompressMesh_MG2(_CTMcontext * self)
   _CTMgrid grid;
   _CTMsortvertex * sortVertices;
   _CTMfloatmap * map;
-  CTMuint * indices, * deltaIndices, * gridIndices;
-  CTMint * intVertices, * intNormals, * intUVCoords, * intAttribs;
-  CTMfloat * restoredVertices;
-  CTMuint i;
+  _CTMmg2section * sections;
+  _CTMmg2packtask task;
+  CTMuint i, sectionCount, maxSections, flags;
+  CTMfloat * verticesBuf;
+  const CTMfloat * vertices;
+  CTMbool ok, parallelogram;
 
 #ifdef __DEBUG_
   printf("COMPRESSION METHOD: MG2\n");
 #endif
 
+  // Get a packed view of the vertices
+  vertices = _ctmPackedArrayf(self, &self->mVertices, self->mVertexCount, 3, &verticesBuf);
+  if(!vertices)
+  {
+    self->mError = CTM_OUT_OF_MEMORY;
+    return CTM_FALSE;
+  }
+
   // Setup 3D space subdivision grid
-  _ctmSetupGrid(self, &grid);
+  _ctmSetupGrid(self, vertices, &grid);
+  if(self->mGridSearch && !_ctmSearchGrid(self, vertices, &grid))
+  {
+    if(verticesBuf) _ctmFree(self, (void *) verticesBuf);
+    return CTM_FALSE;
+  }
 
   // Write MG2-specific header information to the stream
   _ctmStreamWrite(self, (void *) "MG2H", 4);
@@ -869,275 +2773,559 @@ CTMbool _ctmCompressMesh_MG2(_CTMcontext * self)
   _ctmStreamWriteUINT(self, grid.mDivision[1]);
   _ctmStreamWriteUINT(self, grid.mDivision[2]);
 
+  // The header flags are optional (they are only written if any flag is set,
+  // so that files without special features can be read by older versions)
+  flags = 0;
+  if(self->mHasNormals && self->mOctNormals)
+    flags |= _CTM_MG2_OCT_NORMALS_BIT;
+
+  // Parallelogram prediction is only used if all the vertices fit on the
+  // fixed point lattice (which is practically always the case)
+  parallelogram = self->mParallelogram && _ctmLatticeFits(self, &grid);
+  if(parallelogram)
+    flags |= _CTM_MG2_PARALLELOGRAM_BIT;
+  if(flags)
+  {
+    _ctmStreamWrite(self, (void *) "FLAG", 4);
+    _ctmStreamWriteUINT(self, flags);
+  }
+
   // Prepare (sort) vertices
-  sortVertices = (_CTMsortvertex *) malloc(sizeof(_CTMsortvertex) * self->mVertexCount);
+  sortVertices = (_CTMsortvertex *) _ctmAlloc(self, sizeof(_CTMsortvertex) * self->mVertexCount);
   if(!sortVertices)
   {
     self->mError = CTM_OUT_OF_MEMORY;
+    if(verticesBuf) _ctmFree(self, (void *) verticesBuf);
+    return CTM_FALSE;
+  }
+  if(!_ctmSortVertices(self, vertices, sortVertices, &grid) ||
+     (parallelogram && !_ctmTraversalSort(self, sortVertices)))
+  {
+    _ctmFree(self, (void *) sortVertices);
+    if(verticesBuf) _ctmFree(self, (void *) verticesBuf);
     return CTM_FALSE;
   }
-  _ctmSortVertices(self, sortVertices, &grid);
 
-  // Convert vertices to integers and calculate vertex deltas (entropy-reduction)
-  intVertices = (CTMint *) malloc(sizeof(CTMint) * 3 * self->mVertexCount);
-  if(!intVertices)
+  // Allocate the section list (VERT, GIDX, INDX, NORM + one per map)
+  maxSections = 4;
+  for(map = self->mUVMaps; map; map = map->mNext)
+    ++ maxSections;
+  for(map = self->mAttribMaps; map; map = map->mNext)
+    ++ maxSections;
+  sections = (_CTMmg2section *) _ctmScratchAlloc(self, sizeof(_CTMmg2section) * maxSections);
+  if(!sections)
   {
     self->mError = CTM_OUT_OF_MEMORY;
-    free((void *) sortVertices);
+    _ctmFree(self, (void *) sortVertices);
+    if(verticesBuf) _ctmFree(self, (void *) verticesBuf);
+    return CTM_FALSE;
+  }
+  for(i = 0; i < maxSections; ++ i)
+    sections[i].mJob.mPacked = (unsigned char *) 0;
+
+  // Calculate the integer data for all sections
+  sectionCount = 0;
+  ok = _ctmPrepareSections_MG2(self, sections, &sectionCount, vertices,
+                               sortVertices, &grid, parallelogram);
+
+  // Keep the grid, the vertex order and the fixed point data of the first
+  // frame for coding the following animation frames
+  if(ok && (self->mFrameCount > 1))
+  {
+    ok = _ctmInitFrames_MG2(self, sections, sectionCount, sortVertices, &grid,
+                            parallelogram);
+    if(ok)
+      sortVertices = (_CTMsortvertex *) 0;
+  }
+  if(sortVertices) _ctmFree(self, (void *) sortVertices);
+  if(verticesBuf) _ctmFree(self, (void *) verticesBuf);
+  if(!ok)
+  {
+    _ctmFreeSections(self, sections, sectionCount);
     return CTM_FALSE;
   }
-  _ctmMakeVertexDeltas(self, intVertices, sortVertices, &grid);
 
-  // Write vertices
+  // Compress the sections (they are independent of each other, so they can be
+  // compressed in parallel)
+  task.mContext = self;
+  task.mSections = sections;
+  _ctmRunTasks(self, sectionCount, _ctmPackSectionTask, (void *) &task);
+
+  // Write the sections to the stream, in order
+  for(i = 0; i < sectionCount && ok; ++ i)
+  {
 #ifdef __DEBUG_
-  printf("Vertices: ");
+    printf("%s: ", sections[i].mID);
 #endif
-  _ctmStreamWrite(self, (void *) "VERT", 4);
-  if(!_ctmStreamWritePackedInts(self, intVertices, self->mVertexCount, 3, CTM_FALSE))
+    _ctmStreamWrite(self, (void *) sections[i].mID, 4);
+    if(sections[i].mMap)
+      _ctmStreamWriteFLOAT(self, sections[i].mMap->mPrecision);
+    ok = _ctmStreamWritePackJob(self, &sections[i].mJob);
+  }
+
+  // Free temporary data
+  _ctmFreeSections(self, sections, sectionCount);
+
+  return ok;
+}
+#endif // _CTM_SUPPORT_SAVE
+
+#ifdef _CTM_SUPPORT_SAVE
+//-----------------------------------------------------------------------------
+// _ctmQuantizeFrameVertices() - Convert the vertices of an animation frame to
+// fixed point values relative to the grid box origin, or on the lattice of the
+// grid (in the sorted vertex order of the first frame). Returns CTM_FALSE if
+// the vertices do not fit in the fixed point range. The grid of the first
+// frame is used, so each vertex must be within +/-_CTM_FRAME_FIXED_MAX
+// precision steps of its grid box origin, or within +/-_CTM_LATTICE_MAX steps
+// of the grid minimum with parallelogram prediction.
+//-----------------------------------------------------------------------------
+static CTMbool _ctmQuantizeFrameVertices(_CTMcontext * self,
+  _CTMmg2frames * aFrames, const CTMfloat * aVertices, CTMint * aIntVertices)
+{
+  CTMuint i, j;
+  CTMfloat gridOrigin[3], scale, value;
+  const CTMfloat * p;
+
+  if(aFrames->mParallelogram)
+  {
+    scale = 1.0f / self->mVertexPrecision;
+    for(i = 0; i < self->mVertexCount * 3; ++ i)
+    {
+      value = scale * (aVertices[i] - aFrames->mGrid.mMin[i % 3]);
+      if(!(fabsf(value) < (CTMfloat) (_CTM_LATTICE_MAX - 1)))
+        return CTM_FALSE;
+    }
+    _ctmMakeLatticeVertices(self, aIntVertices, aVertices,
+                            aFrames->mSortVertices, &aFrames->mGrid);
+    return CTM_TRUE;
+  }
+
+  // Vertex scaling factor
+  scale = 1.0f / self->mVertexPrecision;
+
+  for(i = 0; i < self->mVertexCount; ++ i)
+  {
+    _ctmGridIdxToPoint(&aFrames->mGrid, aFrames->mGridIndices[i], gridOrigin);
+    p = &aVertices[aFrames->mSortVertices[i].mOriginalIndex * 3];
+    for(j = 0; j < 3; ++ j)
+    {
+      value = scale * (p[j] - gridOrigin[j]);
+      if(!(fabsf(value) < _CTM_FRAME_FIXED_MAX))
+        return CTM_FALSE;
+      aIntVertices[i * 3 + j] = (CTMint) floorf(value + 0.5f);
+    }
+  }
+
+  return CTM_TRUE;
+}
+#endif // _CTM_SUPPORT_SAVE
+
+#ifdef _CTM_SUPPORT_SAVE
+//-----------------------------------------------------------------------------
+// _ctmQuantizeFrameMap() - Convert the values of a UV map or an attribute map
+// of an animation frame to fixed point values (in the sorted vertex order of
+// the first frame).
+//-----------------------------------------------------------------------------
+static CTMbool _ctmQuantizeFrameMap(_CTMcontext * self,
+  _CTMmg2frames * aFrames, _CTMfloatmap * aMap, CTMuint aSize,
+  CTMint * aIntValues)
+{
+  CTMuint i, j;
+  CTMfloat scale, * valuesBuf;
+  const CTMfloat * values, * p;
+
+  // Get a packed view of the map
+  values = _ctmPackedArrayf(self, &aMap->mArray, self->mVertexCount, aSize, &valuesBuf);
+  if(!values)
   {
-    free((void *) intVertices);
-    free((void *) sortVertices);
+    self->mError = CTM_OUT_OF_MEMORY;
     return CTM_FALSE;
   }
 
-  // Prepare grid indices (deltas)
-  gridIndices = (CTMuint *) malloc(sizeof(CTMuint) * self->mVertexCount);
-  if(!gridIndices)
+  // Map scaling factor
+  scale = 1.0f / aMap->mPrecision;
+
+  for(i = 0; i < self->mVertexCount; ++ i)
+  {
+    p = &values[aFrames->mSortVertices[i].mOriginalIndex * aSize];
+    for(j = 0; j < aSize; ++ j)
+      aIntValues[i * aSize + j] = (CTMint) floorf(scale * p[j] + 0.5f);
+  }
+
+  if(valuesBuf) _ctmFree(self, (void *) valuesBuf);
+
+  return CTM_TRUE;
+}
+#endif // _CTM_SUPPORT_SAVE
+
+#ifdef _CTM_SUPPORT_SAVE
+//-----------------------------------------------------------------------------
+// _ctmMakeFrameDeltas() - Calculate the deltas from the fixed point values of
+// the previous frame to the values of the current frame, and replace the
+// previous frame values with the current values. The deltas wrap around (the
+// decoder adds them with the same wrap around, see _ctmReadFrameDeltas()).
+//-----------------------------------------------------------------------------
+static void _ctmMakeFrameDeltas(CTMint * aValues, CTMint * aPrevValues,
+  CTMuint aCount)
+{
+  CTMuint i;
+  CTMint value;
+
+  for(i = 0; i < aCount; ++ i)
+  {
+    value = aValues[i];
+    aValues[i] = (CTMint) ((CTMuint) value - (CTMuint) aPrevValues[i]);
+    aPrevValues[i] = value;
+  }
+}
+#endif // _CTM_SUPPORT_SAVE
+
+#ifdef _CTM_SUPPORT_SAVE
+//-----------------------------------------------------------------------------
+// _ctmPrepareFrameSections_MG2() - Calculate the integer data (deltas to the
+// previous frame) for all the sections of an animation frame.
+//-----------------------------------------------------------------------------
+static CTMbool _ctmPrepareFrameSections_MG2(_CTMcontext * self,
+  _CTMmg2frames * aFrames, _CTMmg2section * aSections, CTMuint * aSectionCount)
+{
+  _CTMfloatmap * map;
+  CTMint * intVertices, * intNormals, * intValues, * mapValues;
+  CTMfloat * verticesBuf, * restoredVertices;
+  const CTMfloat * vertices;
+
+  // Convert vertices to fixed point, and calculate deltas to the previous frame
+  vertices = _ctmPackedArrayf(self, &self->mVertices, self->mVertexCount, 3, &verticesBuf);
+  if(!vertices)
   {
     self->mError = CTM_OUT_OF_MEMORY;
-    free((void *) intVertices);
-    free((void *) sortVertices);
     return CTM_FALSE;
   }
-  gridIndices[0] = sortVertices[0].mGridIndex;
-  for(i = 1; i < self->mVertexCount; ++ i)
-    gridIndices[i] = sortVertices[i].mGridIndex - sortVertices[i - 1].mGridIndex;
-  
-  // Write grid indices
-#ifdef __DEBUG_
-  printf("Grid indices: ");
-#endif
-  _ctmStreamWrite(self, (void *) "GIDX", 4);
-  if(!_ctmStreamWritePackedInts(self, (CTMint *) gridIndices, self->mVertexCount, 1, CTM_FALSE))
+  intVertices = _ctmAddSection(self, aSections, aSectionCount, "VERT", 0,
+                               self->mVertexCount, 3, CTM_TRUE);
+  if(!intVertices)
+  {
+    if(verticesBuf) _ctmFree(self, (void *) verticesBuf);
+    return CTM_FALSE;
+  }
+  if(!_ctmQuantizeFrameVertices(self, aFrames, vertices, intVertices))
   {
-    free((void *) gridIndices);
-    free((void *) intVertices);
-    free((void *) sortVertices);
+    self->mError = CTM_INVALID_MESH;
+    if(verticesBuf) _ctmFree(self, (void *) verticesBuf);
     return CTM_FALSE;
   }
+  if(verticesBuf) _ctmFree(self, (void *) verticesBuf);
+  _ctmMakeFrameDeltas(intVertices, aFrames->mVertices, self->mVertexCount * 3);
 
-  // Calculate the result of the compressed -> decompressed vertices, in order
-  // to use the same vertex data for calculating nominal normals as the
-  // decompression routine (i.e. compensate for the vertex error when
-  // calculating the normals)
-  if(self->mHasNormals)
+  if(self->mHasNormals && self->mOctNormals)
+  {
+    // Convert normals to octahedral integers, and calculate deltas to the
+    // previous frame
+    intNormals = _ctmAddSection(self, aSections, aSectionCount, "NORM", 0,
+                                self->mVertexCount, 3, CTM_TRUE);
+    if(!intNormals ||
+       !_ctmMakeOctNormals(self, intNormals, aFrames->mSortVertices))
+      return CTM_FALSE;
+    _ctmMakeFrameDeltas(intNormals, aFrames->mNormals, self->mVertexCount * 3);
+  }
+  else if(self->mHasNormals)
   {
-    restoredVertices = (CTMfloat *) malloc(sizeof(CTMfloat) * 3 * self->mVertexCount);
+    // Calculate the decompressed vertices of this frame (the nominal normals
+    // are calculated from the same data as in the decompression routine)
+    restoredVertices = (CTMfloat *) _ctmScratchAlloc(self, sizeof(CTMfloat) * 3 * self->mVertexCount);
     if(!restoredVertices)
     {
       self->mError = CTM_OUT_OF_MEMORY;
-      free((void *) gridIndices);
-      free((void *) intVertices);
-      free((void *) sortVertices);
       return CTM_FALSE;
     }
-    for(i = 1; i < self->mVertexCount; ++ i)
-      gridIndices[i] += gridIndices[i - 1];
-    _ctmRestoreVertices(self, intVertices, gridIndices, &grid, restoredVertices);
+    _ctmRestoreFrameVertices(self, aFrames, restoredVertices);
+
+    // Convert normals to integers, and calculate deltas to the previous frame
+    intNormals = _ctmAddSection(self, aSections, aSectionCount, "NORM", 0,
+                                self->mVertexCount, 3, CTM_TRUE);
+    if(!intNormals ||
+       !_ctmMakeNormalDeltas(self, intNormals, restoredVertices,
+                             aFrames->mIndices, aFrames->mSortVertices))
+    {
+      _ctmScratchFree(self, (void *) restoredVertices);
+      return CTM_FALSE;
+    }
+    _ctmScratchFree(self, (void *) restoredVertices);
+    _ctmMakeFrameDeltas(intNormals, aFrames->mNormals, self->mVertexCount * 3);
   }
-  else
-    restoredVertices = (CTMfloat *) 0;
 
-  // Free temporary resources
-  free((void *) gridIndices);
-  free((void *) intVertices);
+  // Convert UV coordinates to fixed point, and calculate deltas to the
+  // previous frame
+  mapValues = aFrames->mMaps;
+  for(map = self->mUVMaps; map; map = map->mNext)
+  {
+    intValues = _ctmAddSection(self, aSections, aSectionCount, "TEXC", 0,
+                               self->mVertexCount, 2, CTM_TRUE);
+    if(!intValues || !_ctmQuantizeFrameMap(self, aFrames, map, 2, intValues))
+      return CTM_FALSE;
+    _ctmMakeFrameDeltas(intValues, mapValues, self->mVertexCount * 2);
+    mapValues += self->mVertexCount * 2;
+  }
 
-  // Perpare (sort) indices
-  indices = (CTMuint *) malloc(sizeof(CTMuint) * self->mTriangleCount * 3);
-  if(!indices)
+  // Convert vertex attributes to fixed point, and calculate deltas to the
+  // previous frame
+  for(map = self->mAttribMaps; map; map = map->mNext)
+  {
+    intValues = _ctmAddSection(self, aSections, aSectionCount, "ATTR", 0,
+                               self->mVertexCount, 4, CTM_TRUE);
+    if(!intValues || !_ctmQuantizeFrameMap(self, aFrames, map, 4, intValues))
+      return CTM_FALSE;
+    _ctmMakeFrameDeltas(intValues, mapValues, self->mVertexCount * 4);
+    mapValues += self->mVertexCount * 4;
+  }
+
+  return CTM_TRUE;
+}
+#endif // _CTM_SUPPORT_SAVE
+
+#ifdef _CTM_SUPPORT_SAVE
+//-----------------------------------------------------------------------------
+// _ctmCompressFrame_MG2() - Compress the next frame that is stored in the CTM
+// context using the MG2 method, and write it the the output stream in the CTM
+// context. The frame is coded as fixed point deltas to the previous frame, on
+// the grid and in the vertex order of the first frame (the UV map and
+// attribute map precisions are also the same as for the first frame). Key
+// frames are marked with "KEYF", and are coded as deltas to zero.
+//-----------------------------------------------------------------------------
+CTMbool _ctmCompressFrame_MG2(_CTMcontext * self)
+{
+  _CTMmg2frames * frames = (_CTMmg2frames *) self->mFrameState;
+  _CTMmg2section * sections;
+  _CTMmg2packtask task;
+  CTMuint i, sectionCount, maxSections;
+  CTMbool ok;
+
+  // We need the state from the first frame
+  if(!frames)
+  {
+    self->mError = CTM_INVALID_OPERATION;
+    return CTM_FALSE;
+  }
+
+  // Allocate the section list (VERT, NORM + one per map)
+  maxSections = 2 + self->mUVMapCount + self->mAttribMapCount;
+  sections = (_CTMmg2section *) _ctmScratchAlloc(self, sizeof(_CTMmg2section) * maxSections);
+  if(!sections)
   {
     self->mError = CTM_OUT_OF_MEMORY;
-    if(restoredVertices) free((void *) restoredVertices);
-    free((void *) sortVertices);
     return CTM_FALSE;
   }
-  if(!_ctmReIndexIndices(self, sortVertices, indices))
+  for(i = 0; i < maxSections; ++ i)
+    sections[i].mJob.mPacked = (unsigned char *) 0;
+
+  // A key frame does not depend on the previous frame
+  if(self->mKeyFrame)
+    _ctmResetFrames_MG2(self, frames);
+
+  // Calculate the integer data for all sections
+  sectionCount = 0;
+  if(!_ctmPrepareFrameSections_MG2(self, frames, sections, &sectionCount))
   {
-    free((void *) indices);
-    if(restoredVertices) free((void *) restoredVertices);
-    free((void *) sortVertices);
+    _ctmFreeSections(self, sections, sectionCount);
     return CTM_FALSE;
   }
-  _ctmReArrangeTriangles(self, indices);
 
-  // Calculate index deltas (entropy-reduction)
-  deltaIndices = (CTMuint *) malloc(sizeof(CTMuint) * self->mTriangleCount * 3);
-  if(!indices)
+  // Compress the sections in parallel
+  task.mContext = self;
+  task.mSections = sections;
+  _ctmRunTasks(self, sectionCount, _ctmPackSectionTask, (void *) &task);
+
+  // Write the sections to the stream, in order
+  if(self->mKeyFrame)
+    _ctmStreamWrite(self, (void *) "KEYF", 4);
+  ok = CTM_TRUE;
+  for(i = 0; i < sectionCount && ok; ++ i)
+  {
+#ifdef __DEBUG_
+    printf("%s: ", sections[i].mID);
+#endif
+    _ctmStreamWrite(self, (void *) sections[i].mID, 4);
+    ok = _ctmStreamWritePackJob(self, &sections[i].mJob);
+  }
+
+  // Free temporary data
+  _ctmFreeSections(self, sections, sectionCount);
+
+  return ok;
+}
+#endif // _CTM_SUPPORT_SAVE
+
+//-----------------------------------------------------------------------------
+// _CTMmg2mapjob - A UV map or attribute map that is uncompressed in parallel
+// with other maps.
+//-----------------------------------------------------------------------------
+typedef struct {
+  // The map (UV map or attribute map).
+  _CTMfloatmap * mMap;
+
+  // Number of components per element (2 for UV maps, 4 for attribute maps).
+  CTMuint mSize;
+
+  // Fixed point values for the animation state (nil if the mesh is not
+  // animated).
+  CTMint * mValues;
+
+  // Memory for the unpacked fixed point values (allocated by the calling
+  // thread, from the scratch arena).
+  CTMint * mInts;
+
+  // Packed data.
+  _CTMunpackjob mJob;
+} _CTMmg2mapjob;
+
+//-----------------------------------------------------------------------------
+// _CTMmg2unpacktask - Argument for _ctmUnpackMapTask().
+//-----------------------------------------------------------------------------
+typedef struct {
+  _CTMcontext * mContext;
+  _CTMmg2mapjob * mMaps;
+} _CTMmg2unpacktask;
+
+//-----------------------------------------------------------------------------
+// _ctmReadMapJob() - Read the header and the packed data of a UV map or
+// attribute map from the stream (without uncompressing it).
+//-----------------------------------------------------------------------------
+static CTMbool _ctmReadMapJob(_CTMcontext * self, _CTMmg2mapjob * aMapJob,
+  _CTMfloatmap * aMap, const char * aID, CTMuint aSize)
+{
+  if(_ctmStreamReadUINT(self) != FOURCC(aID))
   {
-    self->mError = CTM_OUT_OF_MEMORY;
-    free((void *) indices);
-    if(restoredVertices) free((void *) restoredVertices);
-    free((void *) sortVertices);
+    self->mError = CTM_BAD_FORMAT;
     return CTM_FALSE;
   }
-  for(i = 0; i < self->mTriangleCount * 3; ++ i)
-    deltaIndices[i] = indices[i];
-  _ctmMakeIndexDeltas(self, deltaIndices);
-
-  // Write triangle indices
-#ifdef __DEBUG_
-  printf("Indices: ");
-#endif
-  _ctmStreamWrite(self, (void *) "INDX", 4);
-  if(!_ctmStreamWritePackedInts(self, (CTMint *) deltaIndices, self->mTriangleCount, 3, CTM_FALSE))
+  aMap->mPrecision = _ctmStreamReadFLOAT(self);
+  if(aMap->mPrecision <= 0.0f)
   {
-    free((void *) deltaIndices);
-    free((void *) indices);
-    if(restoredVertices) free((void *) restoredVertices);
-    free((void *) sortVertices);
+    self->mError = CTM_BAD_FORMAT;
     return CTM_FALSE;
   }
+  aMapJob->mMap = aMap;
+  aMapJob->mSize = aSize;
+  return _ctmStreamReadPackJob(self, &aMapJob->mJob);
+}
 
-  // Free temporary data for the indices
-  free((void *) deltaIndices);
-
-  if(self->mHasNormals)
+//-----------------------------------------------------------------------------
+// _ctmUnpackMapTask() - Uncompress and restore one UV map or attribute map
+// (task for _ctmRunTasks()).
+//-----------------------------------------------------------------------------
+static void _ctmUnpackMapTask(void * aArg, CTMuint aIndex)
+{
+  _CTMmg2unpacktask * task = (_CTMmg2unpacktask *) aArg;
+  _CTMmg2mapjob * mapJob = &task->mMaps[aIndex];
+  _CTMcontext * self = task->mContext;
+  CTMint * intValues = mapJob->mInts;
+
+  _ctmUnpackInts(self, &mapJob->mJob, intValues, self->mVertexCount,
+                 mapJob->mSize, CTM_TRUE);
+  if(mapJob->mJob.mError == CTM_NONE)
   {
-    // Sanity check
-    if(!restoredVertices)
-    {
-      self->mError = CTM_INTERNAL_ERROR;
-      free((void *) indices);
-      free((void *) sortVertices);
-      return CTM_FALSE;
-    }
-
-    // Convert normals to integers and calculate deltas (entropy-reduction)
-    intNormals = (CTMint *) malloc(sizeof(CTMint) * 3 * self->mVertexCount);
-    if(!intNormals)
-    {
-      self->mError = CTM_OUT_OF_MEMORY;
-      free((void *) indices);
-      free((void *) restoredVertices);
-      free((void *) sortVertices);
-      return CTM_FALSE;
-    }
-    if(!_ctmMakeNormalDeltas(self, intNormals, restoredVertices, indices, sortVertices))
+    if(mapJob->mSize == 2)
     {
-      free((void *) indices);
-      free((void *) intNormals);
-      free((void *) restoredVertices);
-      free((void *) sortVertices);
-      return CTM_FALSE;
+      if(!_ctmRestoreUVCoords(self, mapJob->mMap, intValues))
+        mapJob->mJob.mError = CTM_INVALID_MESH;
     }
-
-    // Write normals
-#ifdef __DEBUG_
-    printf("Normals: ");
-#endif
-    _ctmStreamWrite(self, (void *) "NORM", 4);
-    if(!_ctmStreamWritePackedInts(self, intNormals, self->mVertexCount, 3, CTM_FALSE))
+    else
     {
-      free((void *) indices);
-      free((void *) intNormals);
-      free((void *) restoredVertices);
-      free((void *) sortVertices);
-      return CTM_FALSE;
+      if(!_ctmRestoreAttribs(self, mapJob->mMap, intValues))
+        mapJob->mJob.mError = CTM_INVALID_MESH;
     }
-
-    // Free temporary normal data
-    free((void *) intNormals);
   }
-
-  // Free restored indices and vertices
-  free((void *) indices);
-  if(restoredVertices) free((void *) restoredVertices);
-
-  // Write UV maps
-  map = self->mUVMaps;
-  while(map)
+  if((mapJob->mJob.mError == CTM_NONE) && mapJob->mValues)
   {
-    // Convert UV coordinates to integers and calculate deltas (entropy-reduction)
-    intUVCoords = (CTMint *) malloc(sizeof(CTMint) * 2 * self->mVertexCount);
-    if(!intUVCoords)
-    {
-      self->mError = CTM_OUT_OF_MEMORY;
-      free((void *) sortVertices);
-      return CTM_FALSE;
-    }
-    _ctmMakeUVCoordDeltas(self, map, intUVCoords, sortVertices);
-
-    // Write UV coordinates
-#ifdef __DEBUG_
-    printf("Texture coordinates (%s): ", map->mName ? map->mName : "no name");
-#endif
-    _ctmStreamWrite(self, (void *) "TEXC", 4);
-    _ctmStreamWriteFLOAT(self, map->mPrecision);
-    if(!_ctmStreamWritePackedInts(self, intUVCoords, self->mVertexCount, 2, CTM_TRUE))
-    {
-      free((void *) intUVCoords);
-      free((void *) sortVertices);
-      return CTM_FALSE;
-    }
+    memcpy(mapJob->mValues, intValues,
+           sizeof(CTMint) * self->mVertexCount * mapJob->mSize);
+    _ctmAccumulateInts(mapJob->mValues, self->mVertexCount, mapJob->mSize);
+  }
+}
 
-    // Free temporary UV coordinate data
-    free((void *) intUVCoords);
+//-----------------------------------------------------------------------------
+// _ctmUncompressMapsParallel_MG2() - Read all the UV maps and attribute maps
+// from the stream, and uncompress them in parallel.
+//-----------------------------------------------------------------------------
+static CTMbool _ctmUncompressMapsParallel_MG2(_CTMcontext * self,
+  _CTMmg2frames * aFrames)
+{
+  _CTMfloatmap * map;
+  _CTMmg2mapjob * maps;
+  _CTMmg2unpacktask task;
+  CTMuint i, mapCount, readCount;
+  CTMint * mapValues;
+  CTMbool ok = CTM_TRUE;
+
+  // Allocate the map job list
+  mapCount = 0;
+  for(map = self->mUVMaps; map; map = map->mNext)
+    ++ mapCount;
+  for(map = self->mAttribMaps; map; map = map->mNext)
+    ++ mapCount;
+  maps = (_CTMmg2mapjob *) _ctmScratchAlloc(self, sizeof(_CTMmg2mapjob) * mapCount);
+  if(!maps)
+  {
+    self->mError = CTM_OUT_OF_MEMORY;
+    return CTM_FALSE;
+  }
 
-    map = map->mNext;
+  // Read the packed data of all maps (the stream must be read in order)
+  readCount = 0;
+  for(map = self->mUVMaps; map && ok; map = map->mNext)
+  {
+    ok = _ctmReadMapJob(self, &maps[readCount], map, "TEXC", 2);
+    if(ok) ++ readCount;
+  }
+  for(map = self->mAttribMaps; map && ok; map = map->mNext)
+  {
+    ok = _ctmReadMapJob(self, &maps[readCount], map, "ATTR", 4);
+    if(ok) ++ readCount;
   }
 
-  // Write vertex attribute maps
-  map = self->mAttribMaps;
-  while(map)
+  // Where to keep the fixed point values (the animation state, and the
+  // temporary unpacked values)
+  mapValues = aFrames ? aFrames->mMaps : (CTMint *) 0;
+  for(i = 0; i < readCount; ++ i)
   {
-    // Convert vertex attributes to integers and calculate deltas (entropy-reduction)
-    intAttribs = (CTMint *) malloc(sizeof(CTMint) * 4 * self->mVertexCount);
-    if(!intAttribs)
+    maps[i].mValues = mapValues;
+    if(mapValues)
+      mapValues += self->mVertexCount * maps[i].mSize;
+    maps[i].mInts = (CTMint *) _ctmScratchAlloc(self, sizeof(CTMint) *
+                                   self->mVertexCount * maps[i].mSize);
+    if(!maps[i].mInts && ok)
     {
       self->mError = CTM_OUT_OF_MEMORY;
-      free((void *) sortVertices);
-      return CTM_FALSE;
+      ok = CTM_FALSE;
     }
-    _ctmMakeAttribDeltas(self, map, intAttribs, sortVertices);
+  }
 
-    // Write vertex attributes
-#ifdef __DEBUG_
-    printf("Vertex attributes (%s): ", map->mName ? map->mName : "no name");
-#endif
-    _ctmStreamWrite(self, (void *) "ATTR", 4);
-    _ctmStreamWriteFLOAT(self, map->mPrecision);
-    if(!_ctmStreamWritePackedInts(self, intAttribs, self->mVertexCount, 4, CTM_TRUE))
+  // Uncompress and restore the maps
+  if(ok)
+  {
+    task.mContext = self;
+    task.mMaps = maps;
+    _ctmRunTasks(self, mapCount, _ctmUnpackMapTask, (void *) &task);
+    for(i = 0; (i < mapCount) && ok; ++ i)
     {
-      free((void *) intAttribs);
-      free((void *) sortVertices);
-      return CTM_FALSE;
+      if(maps[i].mJob.mError != CTM_NONE)
+      {
+        self->mError = maps[i].mJob.mError;
+        ok = CTM_FALSE;
+      }
     }
-
-    // Free temporary vertex attribute data
-    free((void *) intAttribs);
-
-    map = map->mNext;
   }
 
-  // Free temporary data
-  free((void *) sortVertices);
-
-  return CTM_TRUE;
-}
-#endif // _CTM_SUPPORT_SAVE
+  // Free the packed data
+  for(i = readCount; i > 0; -- i)
+  {
+    _ctmScratchFree(self, (void *) maps[i - 1].mInts);
+    _ctmFreeUnpackJob(self, &maps[i - 1].mJob);
+  }
+  _ctmScratchFree(self, (void *) maps);
 
-#ifdef _CTM_SUPPORT_SAVE
-//-----------------------------------------------------------------------------
-// _ctmCompressFrame_MG2() - Compress the next frame that is stored in the CTM
-// context using the MG2 method, and write it the the output stream in the CTM
-// context.
-//-----------------------------------------------------------------------------
-CTMbool _ctmCompressFrame_MG2(_CTMcontext * self)
-{
-  self->mError = CTM_UNSUPPORTED_OPERATION;
-  return CTM_FALSE;
+  return ok;
 }
-#endif // _CTM_SUPPORT_SAVE
 
 //-----------------------------------------------------------------------------
 // _ctmUncompressMesh_MG2() - Uncmpress the mesh from the input stream in the
@@ -1145,11 +3333,13 @@ CTMbool _ctmCompressFrame_MG2(_CTMcontext * self)
 //-----------------------------------------------------------------------------
 CTMbool _ctmUncompressMesh_MG2(_CTMcontext * self)
 {
-  CTMuint * gridIndices, * indices, i, j, idx;
-  CTMint * intVertices, * intNormals, * intUVCoords, * intAttribs;
-  CTMfloat * vertices, * fPtr;
+  CTMuint * gridIndices, * indices, i, id, flags;
+  CTMint * intVertices, * intNormals, * intUVCoords, * intAttribs, * mapValues;
+  CTMfloat * vertices;
   _CTMfloatmap * map;
   _CTMgrid grid;
+  _CTMmg2frames * frames;
+  CTMbool ok;
 
   // Read MG2-specific header information from the stream
 #ifdef __DEBUG_
@@ -1194,85 +3384,130 @@ CTMbool _ctmUncompressMesh_MG2(_CTMcontext * self)
     return CTM_FALSE;
   }
 
+  // Read the (optional) header flags
+  self->mOctNormals = CTM_FALSE;
+  self->mParallelogram = CTM_FALSE;
+  id = _ctmStreamReadUINT(self);
+  if(id == FOURCC("FLAG"))
+  {
+    flags = _ctmStreamReadUINT(self);
+    if(flags & ~(_CTM_MG2_OCT_NORMALS_BIT | _CTM_MG2_PARALLELOGRAM_BIT))
+    {
+      self->mError = CTM_BAD_FORMAT;
+      return CTM_FALSE;
+    }
+    self->mOctNormals = (flags & _CTM_MG2_OCT_NORMALS_BIT) ? CTM_TRUE : CTM_FALSE;
+    self->mParallelogram = (flags & _CTM_MG2_PARALLELOGRAM_BIT) ? CTM_TRUE : CTM_FALSE;
+    id = _ctmStreamReadUINT(self);
+  }
+
   // Initialize 3D space subdivision grid
   for(i = 0; i < 3; ++ i)
     grid.mSize[i] = (grid.mMax[i] - grid.mMin[i]) / grid.mDivision[i];
 
+  // Keep the grid, the vertex order and the fixed point data of the first
+  // frame for decoding the following animation frames
+  frames = (_CTMmg2frames *) 0;
+  if(self->mFrameCount > 1)
+  {
+    frames = _ctmNewFrames_MG2(self, &grid);
+    if(!frames)
+      return CTM_FALSE;
+    frames->mParallelogram = self->mParallelogram;
+  }
+
   // Read vertices
 #ifdef __DEBUG_
   printf("Reading vertices.\n");
 #endif
-  if(_ctmStreamReadUINT(self) != FOURCC("VERT"))
+  if(id != FOURCC("VERT"))
   {
     self->mError = CTM_BAD_FORMAT;
     return CTM_FALSE;
   }
-  intVertices = (CTMint *) malloc(sizeof(CTMint) * self->mVertexCount * 3);
+  intVertices = (CTMint *) _ctmScratchAlloc(self, sizeof(CTMint) * self->mVertexCount * 3);
   if(!intVertices)
   {
     self->mError = CTM_OUT_OF_MEMORY;
     return CTM_FALSE;
   }
-  if(!_ctmStreamReadPackedInts(self, intVertices, self->mVertexCount, 3, CTM_FALSE))
+  if(!_ctmStreamReadPackedInts(self, intVertices, self->mVertexCount, 3, self->mParallelogram))
   {
-    free((void *) intVertices);
+    _ctmScratchFree(self, (void *) intVertices);
     return CTM_FALSE;
   }
 
-  // Read grid indices
+  // Read grid indices and restore vertices (vertices with parallelogram
+  // prediction are restored after the triangle indices, which they depend on)
+  vertices = (CTMfloat *) 0;
+  if(!self->mParallelogram)
+  {
+    // Read grid indices
 #ifdef __DEBUG_
-  printf("Reading grid indices.\n");
+    printf("Reading grid indices.\n");
 #endif
-  if(_ctmStreamReadUINT(self) != FOURCC("GIDX"))
-  {
-    free((void *) intVertices);
-    self->mError = CTM_BAD_FORMAT;
-    return CTM_FALSE;
-  }
-  gridIndices = (CTMuint *) malloc(sizeof(CTMuint) * self->mVertexCount);
-  if(!gridIndices)
-  {
-    self->mError = CTM_OUT_OF_MEMORY;
-    free((void *) intVertices);
-    return CTM_FALSE;
-  }
-  if(!_ctmStreamReadPackedInts(self, (CTMint *) gridIndices, self->mVertexCount, 1, CTM_FALSE))
-  {
-    free((void *) gridIndices);
-    free((void *) intVertices);
-    return CTM_FALSE;
-  }
+    if(_ctmStreamReadUINT(self) != FOURCC("GIDX"))
+    {
+      _ctmScratchFree(self, (void *) intVertices);
+      self->mError = CTM_BAD_FORMAT;
+      return CTM_FALSE;
+    }
+    gridIndices = (CTMuint *) _ctmScratchAlloc(self, sizeof(CTMuint) * self->mVertexCount);
+    if(!gridIndices)
+    {
+      self->mError = CTM_OUT_OF_MEMORY;
+      _ctmScratchFree(self, (void *) intVertices);
+      return CTM_FALSE;
+    }
+    if(!_ctmStreamReadPackedInts(self, (CTMint *) gridIndices, self->mVertexCount, 1, CTM_FALSE))
+    {
+      _ctmScratchFree(self, (void *) gridIndices);
+      _ctmScratchFree(self, (void *) intVertices);
+      return CTM_FALSE;
+    }
 
-  // Restore grid indices (deltas)
-  for(i = 1; i < self->mVertexCount; ++ i)
-    gridIndices[i] += gridIndices[i - 1];
+    // Restore grid indices (deltas)
+    for(i = 1; i < self->mVertexCount; ++ i)
+      gridIndices[i] += gridIndices[i - 1];
 
-  // Restore vertices
+    // Restore vertices
 #ifdef __DEBUG_
-  printf("Restoring vertices.\n");
+    printf("Restoring vertices.\n");
 #endif
-  vertices = (CTMfloat *) malloc(sizeof(CTMfloat) * self->mVertexCount * 3);
-  if(!gridIndices)
-  {
-    self->mError = CTM_OUT_OF_MEMORY;
-    free((void *) gridIndices);
-    free((void *) intVertices);
-    return CTM_FALSE;
-  }
-  _ctmRestoreVertices(self, intVertices, gridIndices, &grid, vertices);
-  fPtr = vertices;
-  for(i = 0; i < self->mVertexCount; ++ i)
-    for(j = 0; j < 3; ++ j)
-      self->mVertices.setf(&self->mVertices, i, j, *fPtr ++);
-  if(!self->mHasNormals)
-  {
-    free((void *) vertices);
-    vertices = (CTMfloat *) 0;
-  }
+    vertices = (CTMfloat *) _ctmScratchAlloc(self, sizeof(CTMfloat) * self->mVertexCount * 3);
+    if(!vertices)
+    {
+      self->mError = CTM_OUT_OF_MEMORY;
+      _ctmScratchFree(self, (void *) gridIndices);
+      _ctmScratchFree(self, (void *) intVertices);
+      return CTM_FALSE;
+    }
+    if(!_ctmRestoreVertices(self, intVertices, gridIndices, &grid, vertices))
+    {
+      self->mError = CTM_INVALID_MESH;
+      _ctmScratchFree(self, (void *) vertices);
+      _ctmScratchFree(self, (void *) gridIndices);
+      _ctmScratchFree(self, (void *) intVertices);
+      return CTM_FALSE;
+    }
+    _ctmScatterArrayf(&self->mVertices, 0, self->mVertexCount, 3, vertices);
+    if(!self->mHasNormals || self->mOctNormals)
+    {
+      _ctmScratchFree(self, (void *) vertices);
+      vertices = (CTMfloat *) 0;
+    }
+    if(frames)
+    {
+      memcpy(frames->mGridIndices, gridIndices, sizeof(CTMuint) * self->mVertexCount);
+      memcpy(frames->mVertices, intVertices, sizeof(CTMint) * self->mVertexCount * 3);
+      _ctmAbsoluteVertexInts(self, frames->mVertices, frames->mGridIndices);
+    }
 
-  // Free temporary resources
-  free((void *) gridIndices);
-  free((void *) intVertices);
+    // Free temporary resources
+    _ctmScratchFree(self, (void *) gridIndices);
+    _ctmScratchFree(self, (void *) intVertices);
+    intVertices = (CTMint *) 0;
+  }
 
   // Read triangle indices
 #ifdef __DEBUG_
@@ -1281,20 +3516,23 @@ CTMbool _ctmUncompressMesh_MG2(_CTMcontext * self)
   if(_ctmStreamReadUINT(self) != FOURCC("INDX"))
   {
     self->mError = CTM_BAD_FORMAT;
-    if(vertices) free((void *) vertices);
+    if(vertices) _ctmScratchFree(self, (void *) vertices);
+    _ctmScratchFree(self, (void *) intVertices);
     return CTM_FALSE;
   }
-  indices = (CTMuint *) malloc(sizeof(CTMuint) * self->mTriangleCount * 3);
+  indices = (CTMuint *) _ctmScratchAlloc(self, sizeof(CTMuint) * self->mTriangleCount * 3);
   if(!indices)
   {
     self->mError = CTM_OUT_OF_MEMORY;
-    if(vertices) free((void *) vertices);
+    if(vertices) _ctmScratchFree(self, (void *) vertices);
+    _ctmScratchFree(self, (void *) intVertices);
     return CTM_FALSE;
   }
   if(!_ctmStreamReadPackedInts(self, (CTMint *) indices, self->mTriangleCount, 3, CTM_FALSE))
   {
-    free((void *) indices);
-    if(vertices) free((void *) vertices);
+    _ctmScratchFree(self, (void *) indices);
+    if(vertices) _ctmScratchFree(self, (void *) vertices);
+    _ctmScratchFree(self, (void *) intVertices);
     return CTM_FALSE;
   }
 
@@ -1303,19 +3541,56 @@ CTMbool _ctmUncompressMesh_MG2(_CTMcontext * self)
   printf("Restoring triangle indices.\n");
 #endif
   _ctmRestoreIndices(self, indices);
-  for(i = 0; i < self->mTriangleCount; ++ i)
+  for(i = 0; i < self->mTriangleCount * 3; ++ i)
   {
-    for(j = 0; j < 3; ++ j)
+    if(indices[i] >= self->mVertexCount)
     {
-      idx = indices[i * 3 + j];
-      if(idx >= self->mVertexCount)
-      {
-        self->mError = CTM_INVALID_MESH;
-        free((void *) indices);
-        if(vertices) free((void *) vertices);
-        return CTM_FALSE;
-      }
-      self->mIndices.seti(&self->mIndices, i, j, idx);
+      self->mError = CTM_INVALID_MESH;
+      _ctmScratchFree(self, (void *) indices);
+      if(vertices) _ctmScratchFree(self, (void *) vertices);
+      _ctmScratchFree(self, (void *) intVertices);
+      return CTM_FALSE;
+    }
+  }
+  _ctmScatterArrayi(&self->mIndices, 0, self->mTriangleCount, 3, indices);
+  if(frames)
+    memcpy(frames->mIndices, indices, sizeof(CTMuint) * self->mTriangleCount * 3);
+
+  // Restore vertices (parallelogram prediction)
+  if(self->mParallelogram)
+  {
+#ifdef __DEBUG_
+    printf("Restoring vertices.\n");
+#endif
+    vertices = (CTMfloat *) _ctmScratchAlloc(self, sizeof(CTMfloat) * self->mVertexCount * 3);
+    if(!vertices)
+    {
+      self->mError = CTM_OUT_OF_MEMORY;
+      _ctmScratchFree(self, (void *) indices);
+      _ctmScratchFree(self, (void *) intVertices);
+      return CTM_FALSE;
+    }
+    ok = _ctmParallelogramVertices(self, intVertices, indices, CTM_TRUE);
+    if(ok && !_ctmLatticeToVertices(self, &grid, intVertices, vertices))
+    {
+      self->mError = CTM_INVALID_MESH;
+      ok = CTM_FALSE;
+    }
+    if(!ok)
+    {
+      _ctmScratchFree(self, (void *) vertices);
+      _ctmScratchFree(self, (void *) indices);
+      _ctmScratchFree(self, (void *) intVertices);
+      return CTM_FALSE;
+    }
+    _ctmScatterArrayf(&self->mVertices, 0, self->mVertexCount, 3, vertices);
+    if(frames)
+      memcpy(frames->mVertices, intVertices, sizeof(CTMint) * self->mVertexCount * 3);
+    _ctmScratchFree(self, (void *) intVertices);
+    if(!self->mHasNormals || self->mOctNormals)
+    {
+      _ctmScratchFree(self, (void *) vertices);
+      vertices = (CTMfloat *) 0;
     }
   }
 
@@ -1326,28 +3601,34 @@ CTMbool _ctmUncompressMesh_MG2(_CTMcontext * self)
     printf("Reading normals.\n");
 #endif
     // Sanity check
-    if(!vertices)
+    if(!vertices && !self->mOctNormals)
     {
       self->mError = CTM_INTERNAL_ERROR;
-      free((void *) indices);
+      _ctmScratchFree(self, (void *) indices);
       return CTM_FALSE;
     }
 
-    intNormals = (CTMint *) malloc(sizeof(CTMint) * self->mVertexCount * 3);
+    intNormals = (CTMint *) _ctmScratchAlloc(self, sizeof(CTMint) * self->mVertexCount * 3);
     if(!intNormals)
     {
       self->mError = CTM_OUT_OF_MEMORY;
+      _ctmScratchFree(self, (void *) indices);
+      _ctmScratchFree(self, (void *) vertices);
       return CTM_FALSE;
     }
     if(_ctmStreamReadUINT(self) != FOURCC("NORM"))
     {
       self->mError = CTM_BAD_FORMAT;
-      free((void *) intNormals);
+      _ctmScratchFree(self, (void *) intNormals);
+      _ctmScratchFree(self, (void *) indices);
+      _ctmScratchFree(self, (void *) vertices);
       return CTM_FALSE;
     }
-    if(!_ctmStreamReadPackedInts(self, intNormals, self->mVertexCount, 3, CTM_FALSE))
+    if(!_ctmStreamReadPackedInts(self, intNormals, self->mVertexCount, 3, self->mOctNormals))
     {
-      free((void *) intNormals);
+      _ctmScratchFree(self, (void *) intNormals);
+      _ctmScratchFree(self, (void *) indices);
+      _ctmScratchFree(self, (void *) vertices);
       return CTM_FALSE;
     }
 
@@ -1355,28 +3636,42 @@ CTMbool _ctmUncompressMesh_MG2(_CTMcontext * self)
 #ifdef __DEBUG_
     printf("Restoring normals.\n");
 #endif
-    if(!_ctmRestoreNormals(self, indices, vertices, intNormals))
+    if(self->mOctNormals)
+      ok = _ctmRestoreOctNormals(self, intNormals);
+    else
+      ok = _ctmRestoreNormals(self, indices, vertices, intNormals);
+    if(!ok)
     {
-      free((void *) intNormals);
+      _ctmScratchFree(self, (void *) intNormals);
+      _ctmScratchFree(self, (void *) indices);
+      _ctmScratchFree(self, (void *) vertices);
       return CTM_FALSE;
     }
 
-    // Free temporary normals data
-    free((void *) intNormals);
+    // Free temporary normals data (the normals have no deltas, so we keep
+    // them as they are for the animation state)
+    if(frames)
+      memcpy(frames->mNormals, intNormals, sizeof(CTMint) * self->mVertexCount * 3);
+    _ctmScratchFree(self, (void *) intNormals);
   }
 
   // Free temporary resources
-  free((void *) indices);
-  if(vertices) free((void *) vertices);
+  _ctmScratchFree(self, (void *) indices);
+  if(vertices) _ctmScratchFree(self, (void *) vertices);
+
+  // Read the UV maps and attribute maps in parallel?
+  if(self->mParallelDecode && ((self->mUVMapCount + self->mAttribMapCount) > 1))
+    return _ctmUncompressMapsParallel_MG2(self, frames);
 
   // Read UV maps
+  mapValues = frames ? frames->mMaps : (CTMint *) 0;
   map = self->mUVMaps;
   while(map)
   {
 #ifdef __DEBUG_
     printf("Reading UV map \"%s\".\n", map->mName);
 #endif
-    intUVCoords = (CTMint *) malloc(sizeof(CTMint) * self->mVertexCount * 2);
+    intUVCoords = (CTMint *) _ctmScratchAlloc(self, sizeof(CTMint) * self->mVertexCount * 2);
     if(!intUVCoords)
     {
       self->mError = CTM_OUT_OF_MEMORY;
@@ -1385,19 +3680,19 @@ CTMbool _ctmUncompressMesh_MG2(_CTMcontext * self)
     if(_ctmStreamReadUINT(self) != FOURCC("TEXC"))
     {
       self->mError = CTM_BAD_FORMAT;
-      free((void *) intUVCoords);
+      _ctmScratchFree(self, (void *) intUVCoords);
       return CTM_FALSE;
     }
     map->mPrecision = _ctmStreamReadFLOAT(self);
     if(map->mPrecision <= 0.0f)
     {
       self->mError = CTM_BAD_FORMAT;
-      free((void *) intUVCoords);
+      _ctmScratchFree(self, (void *) intUVCoords);
       return CTM_FALSE;
     }
     if(!_ctmStreamReadPackedInts(self, intUVCoords, self->mVertexCount, 2, CTM_TRUE))
     {
-      free((void *) intUVCoords);
+      _ctmScratchFree(self, (void *) intUVCoords);
       return CTM_FALSE;
     }
 
@@ -1405,10 +3700,21 @@ CTMbool _ctmUncompressMesh_MG2(_CTMcontext * self)
 #ifdef __DEBUG_
     printf("Restoring UV coordinates.\n");
 #endif
-    _ctmRestoreUVCoords(self, map, intUVCoords);
+    if(!_ctmRestoreUVCoords(self, map, intUVCoords))
+    {
+      self->mError = CTM_INVALID_MESH;
+      _ctmScratchFree(self, (void *) intUVCoords);
+      return CTM_FALSE;
+    }
 
     // Free temporary UV coordinate data
-    free((void *) intUVCoords);
+    if(frames)
+    {
+      memcpy(mapValues, intUVCoords, sizeof(CTMint) * self->mVertexCount * 2);
+      _ctmAccumulateInts(mapValues, self->mVertexCount, 2);
+      mapValues += self->mVertexCount * 2;
+    }
+    _ctmScratchFree(self, (void *) intUVCoords);
 
     map = map->mNext;
   }
@@ -1420,7 +3726,7 @@ CTMbool _ctmUncompressMesh_MG2(_CTMcontext * self)
 #ifdef __DEBUG_
     printf("Reading attribute map \"%s\".\n", map->mName);
 #endif
-    intAttribs = (CTMint *) malloc(sizeof(CTMint) * self->mVertexCount * 4);
+    intAttribs = (CTMint *) _ctmScratchAlloc(self, sizeof(CTMint) * self->mVertexCount * 4);
     if(!intAttribs)
     {
       self->mError = CTM_OUT_OF_MEMORY;
@@ -1429,19 +3735,19 @@ CTMbool _ctmUncompressMesh_MG2(_CTMcontext * self)
     if(_ctmStreamReadUINT(self) != FOURCC("ATTR"))
     {
       self->mError = CTM_BAD_FORMAT;
-      free((void *) intAttribs);
+      _ctmScratchFree(self, (void *) intAttribs);
       return CTM_FALSE;
     }
     map->mPrecision = _ctmStreamReadFLOAT(self);
     if(map->mPrecision <= 0.0f)
     {
       self->mError = CTM_BAD_FORMAT;
-      free((void *) intAttribs);
+      _ctmScratchFree(self, (void *) intAttribs);
       return CTM_FALSE;
     }
     if(!_ctmStreamReadPackedInts(self, intAttribs, self->mVertexCount, 4, CTM_TRUE))
     {
-      free((void *) intAttribs);
+      _ctmScratchFree(self, (void *) intAttribs);
       return CTM_FALSE;
     }
 
@@ -1449,10 +3755,21 @@ CTMbool _ctmUncompressMesh_MG2(_CTMcontext * self)
 #ifdef __DEBUG_
     printf("Restoring attribute values.\n");
 #endif
-    _ctmRestoreAttribs(self, map, intAttribs);
+    if(!_ctmRestoreAttribs(self, map, intAttribs))
+    {
+      self->mError = CTM_INVALID_MESH;
+      _ctmScratchFree(self, (void *) intAttribs);
+      return CTM_FALSE;
+    }
 
     // Free temporary vertex attribute data
-    free((void *) intAttribs);
+    if(frames)
+    {
+      memcpy(mapValues, intAttribs, sizeof(CTMint) * self->mVertexCount * 4);
+      _ctmAccumulateInts(mapValues, self->mVertexCount, 4);
+      mapValues += self->mVertexCount * 4;
+    }
+    _ctmScratchFree(self, (void *) intAttribs);
 
     map = map->mNext;
   }
@@ -1464,6 +3781,43 @@ CTMbool _ctmUncompressMesh_MG2(_CTMcontext * self)
   return CTM_TRUE;
 }
 
+//-----------------------------------------------------------------------------
+// _ctmReadFrameDeltas() - Read a section of an animation frame (deltas to the
+// previous frame), and add the deltas to the fixed point values of the
+// previous frame. If aID is nil, the section ID has already been read. If
+// aLattice is true, the values are vertices on the lattice of the grid, which
+// must be within +/-_CTM_LATTICE_MAX (see ctmParallelogramPrediction()).
+//-----------------------------------------------------------------------------
+static CTMbool _ctmReadFrameDeltas(_CTMcontext * self, const char * aID,
+  CTMint * aDeltas, CTMint * aValues, CTMuint aSize, CTMbool aLattice)
+{
+  CTMuint i;
+  CTMint value;
+
+  if(aID && (_ctmStreamReadUINT(self) != FOURCC(aID)))
+  {
+    self->mError = CTM_BAD_FORMAT;
+    return CTM_FALSE;
+  }
+  if(!_ctmStreamReadPackedInts(self, aDeltas, self->mVertexCount, aSize, CTM_TRUE))
+    return CTM_FALSE;
+
+  // Add the deltas (without sign, since the deltas of corrupt data may
+  // overflow)
+  for(i = 0; i < self->mVertexCount * aSize; ++ i)
+  {
+    value = (CTMint) ((CTMuint) aValues[i] + (CTMuint) aDeltas[i]);
+    if(aLattice && ((value < -_CTM_LATTICE_MAX) || (value > _CTM_LATTICE_MAX)))
+    {
+      self->mError = CTM_INVALID_MESH;
+      return CTM_FALSE;
+    }
+    aValues[i] = value;
+  }
+
+  return CTM_TRUE;
+}
+
 //-----------------------------------------------------------------------------
 // _ctmUncompressFrame_MG2() - Uncmpress the next frame from the input stream
 // in the CTM context using the MG2 method, and store the resulting mesh in the
@@ -1471,8 +3825,93 @@ CTMbool _ctmUncompressMesh_MG2(_CTMcontext * self)
 //-----------------------------------------------------------------------------
 CTMbool _ctmUncompressFrame_MG2(_CTMcontext * self)
 {
-  self->mError = CTM_UNSUPPORTED_OPERATION;
-  return CTM_FALSE;
+  _CTMmg2frames * frames = (_CTMmg2frames *) self->mFrameState;
+  _CTMfloatmap * map;
+  CTMint * deltas, * mapValues;
+  CTMfloat * vertices;
+  CTMuint id;
+  CTMbool ok;
+
+  // We need the state from the first frame
+  if(!frames)
+  {
+    self->mError = CTM_INVALID_OPERATION;
+    return CTM_FALSE;
+  }
+
+  // Allocate temporary memory (the delta buffer is shared by all sections)
+  deltas = (CTMint *) _ctmScratchAlloc(self, sizeof(CTMint) * self->mVertexCount * 4);
+  vertices = (CTMfloat *) _ctmScratchAlloc(self, sizeof(CTMfloat) * self->mVertexCount * 3);
+  if(!deltas || !vertices)
+  {
+    self->mError = CTM_OUT_OF_MEMORY;
+    if(deltas) _ctmScratchFree(self, (void *) deltas);
+    if(vertices) _ctmScratchFree(self, (void *) vertices);
+    return CTM_FALSE;
+  }
+
+  // Is this a key frame (coded as deltas to zero)?
+  id = _ctmStreamReadUINT(self);
+  if(id == FOURCC("KEYF"))
+  {
+    _ctmResetFrames_MG2(self, frames);
+    id = _ctmStreamReadUINT(self);
+  }
+
+  // Read and restore vertices
+  ok = (id == FOURCC("VERT"));
+  if(!ok)
+    self->mError = CTM_BAD_FORMAT;
+  ok = ok && _ctmReadFrameDeltas(self, (const char *) 0, deltas,
+                                 frames->mVertices, 3, frames->mParallelogram);
+  if(ok && !_ctmRestoreFrameVertices(self, frames, vertices))
+  {
+    self->mError = CTM_INVALID_MESH;
+    ok = CTM_FALSE;
+  }
+  if(ok)
+    _ctmScatterArrayf(&self->mVertices, 0, self->mVertexCount, 3, vertices);
+
+  // Read and restore normals (relative to the smooth normals of this frame)
+  if(ok && self->mHasNormals)
+  {
+    ok = _ctmReadFrameDeltas(self, "NORM", deltas, frames->mNormals, 3, CTM_FALSE);
+    if(ok && self->mOctNormals)
+      ok = _ctmRestoreOctNormals(self, frames->mNormals);
+    else if(ok)
+      ok = _ctmRestoreNormals(self, frames->mIndices, vertices, frames->mNormals);
+  }
+
+  // Read and restore UV maps
+  mapValues = frames->mMaps;
+  for(map = self->mUVMaps; map && ok; map = map->mNext)
+  {
+    ok = _ctmReadFrameDeltas(self, "TEXC", deltas, mapValues, 2, CTM_FALSE);
+    if(ok && !_ctmRestoreFrameMap(self, map, mapValues, 2))
+    {
+      self->mError = CTM_INVALID_MESH;
+      ok = CTM_FALSE;
+    }
+    mapValues += self->mVertexCount * 2;
+  }
+
+  // Read and restore vertex attribute maps
+  for(map = self->mAttribMaps; map && ok; map = map->mNext)
+  {
+    ok = _ctmReadFrameDeltas(self, "ATTR", deltas, mapValues, 4, CTM_FALSE);
+    if(ok && !_ctmRestoreFrameMap(self, map, mapValues, 4))
+    {
+      self->mError = CTM_INVALID_MESH;
+      ok = CTM_FALSE;
+    }
+    mapValues += self->mVertexCount * 4;
+  }
+
+  // Free temporary resources
+  _ctmScratchFree(self, (void *) vertices);
+  _ctmScratchFree(self, (void *) deltas);
+
+  return ok;
 }
 
 #endif // _CTM_SUPPORT_MG2
@@ -30,6 +30,110 @@
 
 #ifdef _CTM_SUPPORT_RAW
 
+#ifdef _CTM_SUPPORT_SAVE
+//-----------------------------------------------------------------------------
+// _ctmWriteRawFloats() - Write aCount elements (of aSize <= 4 components) of
+// an array to the output stream, as floats.
+//-----------------------------------------------------------------------------
+static void _ctmWriteRawFloats(_CTMcontext * self, _CTMarray * aArray,
+  CTMuint aCount, CTMuint aSize)
+{
+  CTMfloat block[_CTM_ARRAY_BLOCK_SIZE * 4];
+  CTMuint i, k, blockSize;
+
+  for(i = 0; i < aCount; i += blockSize)
+  {
+    blockSize = aCount - i;
+    if(blockSize > _CTM_ARRAY_BLOCK_SIZE)
+      blockSize = _CTM_ARRAY_BLOCK_SIZE;
+    _ctmGatherArrayf(aArray, i, blockSize, aSize, block);
+    for(k = 0; k < blockSize * aSize; ++ k)
+      _ctmStreamWriteFLOAT(self, block[k]);
+  }
+}
+
+//-----------------------------------------------------------------------------
+// _ctmWriteRawInts() - Write aCount elements (of aSize <= 4 components) of an
+// array to the output stream, as unsigned integers.
+//-----------------------------------------------------------------------------
+static void _ctmWriteRawInts(_CTMcontext * self, _CTMarray * aArray,
+  CTMuint aCount, CTMuint aSize)
+{
+  CTMuint block[_CTM_ARRAY_BLOCK_SIZE * 4];
+  CTMuint i, k, blockSize;
+
+  for(i = 0; i < aCount; i += blockSize)
+  {
+    blockSize = aCount - i;
+    if(blockSize > _CTM_ARRAY_BLOCK_SIZE)
+      blockSize = _CTM_ARRAY_BLOCK_SIZE;
+    _ctmGatherArrayi(aArray, i, blockSize, aSize, block);
+    for(k = 0; k < blockSize * aSize; ++ k)
+      _ctmStreamWriteUINT(self, block[k]);
+  }
+}
+#endif
+
+//-----------------------------------------------------------------------------
+// _ctmReadRawFloats() - Read aCount elements (of aSize <= 4 components) of
+// an array from the input stream, as floats. Unless the input is trusted, all
+// the values must be finite.
+//-----------------------------------------------------------------------------
+static CTMbool _ctmReadRawFloats(_CTMcontext * self, _CTMarray * aArray,
+  CTMuint aCount, CTMuint aSize)
+{
+  CTMfloat block[_CTM_ARRAY_BLOCK_SIZE * 4];
+  CTMuint i, k, blockSize;
+
+  for(i = 0; i < aCount; i += blockSize)
+  {
+    blockSize = aCount - i;
+    if(blockSize > _CTM_ARRAY_BLOCK_SIZE)
+      blockSize = _CTM_ARRAY_BLOCK_SIZE;
+    for(k = 0; k < blockSize * aSize; ++ k)
+      block[k] = _ctmStreamReadFLOAT(self);
+    if(!self->mTrustedInput && !_ctmFloatsAreFinite(block, blockSize * aSize))
+    {
+      self->mError = CTM_INVALID_MESH;
+      return CTM_FALSE;
+    }
+    _ctmScatterArrayf(aArray, i, blockSize, aSize, block);
+  }
+
+  return CTM_TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// _ctmReadRawIndices() - Read aCount elements (of aSize <= 4 components) of an
+// index array from the input stream. Unless the input is trusted, all the
+// indices must be less than the vertex count.
+//-----------------------------------------------------------------------------
+static CTMbool _ctmReadRawIndices(_CTMcontext * self, _CTMarray * aArray,
+  CTMuint aCount, CTMuint aSize)
+{
+  CTMuint block[_CTM_ARRAY_BLOCK_SIZE * 4];
+  CTMuint i, k, blockSize;
+
+  for(i = 0; i < aCount; i += blockSize)
+  {
+    blockSize = aCount - i;
+    if(blockSize > _CTM_ARRAY_BLOCK_SIZE)
+      blockSize = _CTM_ARRAY_BLOCK_SIZE;
+    for(k = 0; k < blockSize * aSize; ++ k)
+    {
+      block[k] = _ctmStreamReadUINT(self);
+      if(!self->mTrustedInput && (block[k] >= self->mVertexCount))
+      {
+        self->mError = CTM_INVALID_MESH;
+        return CTM_FALSE;
+      }
+    }
+    _ctmScatterArrayi(aArray, i, blockSize, aSize, block);
+  }
+
+  return CTM_TRUE;
+}
+
 #ifdef _CTM_SUPPORT_SAVE
 //-----------------------------------------------------------------------------
 // _ctmCompressMesh_RAW() - Compress the mesh that is stored in the CTM
@@ -38,8 +142,6 @@
 //-----------------------------------------------------------------------------
 CTMbool _ctmCompressMesh_RAW(_CTMcontext * self)
 {
-  CTMuint i, j;
-
 #ifdef __DEBUG_
   printf("COMPRESSION METHOD: RAW\n");
 #endif
@@ -49,9 +151,7 @@ CTMbool _ctmCompressMesh_RAW(_CTMcontext * self)
   printf("Inidices: %d bytes\n", (CTMuint)(self->mTriangleCount * 3 * sizeof(CTMuint)));
 #endif
   _ctmStreamWrite(self, (void *) "INDX", 4);
-  for(i = 0; i < self->mTriangleCount; ++ i)
-    for(j = 0; j < 3; ++ j)
-      _ctmStreamWriteUINT(self, self->mIndices.geti(&self->mIndices, i, j));
+  _ctmWriteRawInts(self, &self->mIndices, self->mTriangleCount, 3);
 
   // The vertex data format is the same as for all frames
   return _ctmCompressFrame_RAW(self);
@@ -66,7 +166,6 @@ CTMbool _ctmCompressMesh_RAW(_CTMcontext * self)
 //-----------------------------------------------------------------------------
 CTMbool _ctmCompressFrame_RAW(_CTMcontext * self)
 {
-  CTMuint i, j;
   _CTMfloatmap * map;
 
   // Write vertices
@@ -74,9 +173,7 @@ CTMbool _ctmCompressFrame_RAW(_CTMcontext * self)
   printf("Vertices: %d bytes\n", (CTMuint)(self->mVertexCount * 3 * sizeof(CTMfloat)));
 #endif
   _ctmStreamWrite(self, (void *) "VERT", 4);
-  for(i = 0; i < self->mVertexCount; ++ i)
-    for(j = 0; j < 3; ++ j)
-      _ctmStreamWriteFLOAT(self, self->mVertices.getf(&self->mVertices, i, j));
+  _ctmWriteRawFloats(self, &self->mVertices, self->mVertexCount, 3);
 
   // Write normals
   if(self->mHasNormals)
@@ -85,9 +182,7 @@ CTMbool _ctmCompressFrame_RAW(_CTMcontext * self)
     printf("Normals: %d bytes\n", (CTMuint)(self->mVertexCount * 3 * sizeof(CTMfloat)));
 #endif
     _ctmStreamWrite(self, (void *) "NORM", 4);
-    for(i = 0; i < self->mVertexCount; ++ i)
-      for(j = 0; j < 3; ++ j)
-        _ctmStreamWriteFLOAT(self, self->mNormals.getf(&self->mNormals, i, j));
+    _ctmWriteRawFloats(self, &self->mNormals, self->mVertexCount, 3);
   }
 
   // Write UV maps
@@ -98,9 +193,7 @@ CTMbool _ctmCompressFrame_RAW(_CTMcontext * self)
     printf("UV coordinates (%s): %d bytes\n", map->mName ? map->mName : "no name", (CTMuint)(self->mVertexCount * 2 * sizeof(CTMfloat)));
 #endif
     _ctmStreamWrite(self, (void *) "TEXC", 4);
-    for(i = 0; i < self->mVertexCount; ++ i)
-      for(j = 0; j < 2; ++ j)
-        _ctmStreamWriteFLOAT(self, map->mArray.getf(&map->mArray, i, j));
+    _ctmWriteRawFloats(self, &map->mArray, self->mVertexCount, 2);
     map = map->mNext;
   }
 
@@ -112,9 +205,7 @@ CTMbool _ctmCompressFrame_RAW(_CTMcontext * self)
     printf("Vertex attributes (%s): %d bytes\n", map->mName ? map->mName : "no name", (CTMuint)(self->mVertexCount * 4 * sizeof(CTMfloat)));
 #endif
     _ctmStreamWrite(self, (void *) "ATTR", 4);
-    for(i = 0; i < self->mVertexCount; ++ i)
-      for(j = 0; j < 4; ++ j)
-        _ctmStreamWriteFLOAT(self, map->mArray.getf(&map->mArray, i, j));
+    _ctmWriteRawFloats(self, &map->mArray, self->mVertexCount, 4);
     map = map->mNext;
   }
 
@@ -129,17 +220,14 @@ CTMbool _ctmCompressFrame_RAW(_CTMcontext * self)
 //-----------------------------------------------------------------------------
 CTMbool _ctmUncompressMesh_RAW(_CTMcontext * self)
 {
-  CTMuint i, j;
-
   // Read triangle indices
   if(_ctmStreamReadUINT(self) != FOURCC("INDX"))
   {
     self->mError = CTM_BAD_FORMAT;
     return CTM_FALSE;
   }
-  for(i = 0; i < self->mTriangleCount; ++ i)
-    for(j = 0; j < 3; ++ j)
-      self->mIndices.seti(&self->mIndices, i, j, _ctmStreamReadUINT(self));
+  if(!_ctmReadRawIndices(self, &self->mIndices, self->mTriangleCount, 3))
+    return CTM_FALSE;
 
   // The vertex data format is the same as for all frames
   return _ctmUncompressFrame_RAW(self);
@@ -152,7 +240,6 @@ CTMbool _ctmUncompressMesh_RAW(_CTMcontext * self)
 //-----------------------------------------------------------------------------
 CTMbool _ctmUncompressFrame_RAW(_CTMcontext * self)
 {
-  CTMuint i, j;
   _CTMfloatmap * map;
 
   // Read vertices
@@ -161,9 +248,8 @@ CTMbool _ctmUncompressFrame_RAW(_CTMcontext * self)
     self->mError = CTM_BAD_FORMAT;
     return CTM_FALSE;
   }
-  for(i = 0; i < self->mVertexCount; ++ i)
-    for(j = 0; j < 3; ++ j)
-      self->mVertices.setf(&self->mVertices, i, j, _ctmStreamReadFLOAT(self));
+  if(!_ctmReadRawFloats(self, &self->mVertices, self->mVertexCount, 3))
+    return CTM_FALSE;
 
   // Read normals
   if(self->mHasNormals)
@@ -173,9 +259,8 @@ CTMbool _ctmUncompressFrame_RAW(_CTMcontext * self)
       self->mError = CTM_BAD_FORMAT;
       return CTM_FALSE;
     }
-    for(i = 0; i < self->mVertexCount; ++ i)
-      for(j = 0; j < 3; ++ j)
-        self->mNormals.setf(&self->mNormals, i, j, _ctmStreamReadFLOAT(self));
+    if(!_ctmReadRawFloats(self, &self->mNormals, self->mVertexCount, 3))
+      return CTM_FALSE;
   }
 
   // Read UV maps
@@ -187,9 +272,8 @@ CTMbool _ctmUncompressFrame_RAW(_CTMcontext * self)
       self->mError = CTM_BAD_FORMAT;
       return CTM_FALSE;
     }
-    for(i = 0; i < self->mVertexCount; ++ i)
-      for(j = 0; j < 2; ++ j)
-        map->mArray.setf(&map->mArray, i, j, _ctmStreamReadFLOAT(self));
+    if(!_ctmReadRawFloats(self, &map->mArray, self->mVertexCount, 2))
+      return CTM_FALSE;
     map = map->mNext;
   }
 
@@ -202,9 +286,8 @@ CTMbool _ctmUncompressFrame_RAW(_CTMcontext * self)
       self->mError = CTM_BAD_FORMAT;
       return CTM_FALSE;
     }
-    for(i = 0; i < self->mVertexCount; ++ i)
-      for(j = 0; j < 4; ++ j)
-        map->mArray.setf(&map->mArray, i, j, _ctmStreamReadFLOAT(self));
+    if(!_ctmReadRawFloats(self, &map->mArray, self->mVertexCount, 4))
+      return CTM_FALSE;
     map = map->mNext;
   }
 
@@ -52,6 +52,14 @@
 // Enable support for loading file format v5 (OpenCTM 1.x files).
 #define _CTM_SUPPORT_V5_FILES
 
+// Enable SIMD optimized code paths (SSE2/AVX2/NEON), selected at run time.
+#define _CTM_SUPPORT_SIMD
+
+// Enable memory mapped file reading in ctmOpenReadFile() (POSIX systems only).
+#if !defined(WIN32) && !defined(_WIN32)
+  #define _CTM_SUPPORT_MMAP
+#endif
+
 //-----------------------------------------------------------------------------
 // Default compression parameters.
 //-----------------------------------------------------------------------------
@@ -71,5 +79,30 @@
 // Default vertex attribute precision
 #define _CTM_DEFAULT_ATTRIB_PRECISION (1.0f / 256.0f)
 
+//-----------------------------------------------------------------------------
+// Multi threading parameters.
+//-----------------------------------------------------------------------------
+
+// Maximum number of threads that are used for running parallel tasks.
+#define _CTM_MAX_THREADS 64
+
+// Minimum size (in bytes) of an array for using the multi threaded LZMA match
+// finder (when the number of LZMA threads is automatic). For smaller arrays
+// the cost of starting the match finder threads is higher than the gain.
+#define _CTM_LZMA_MT_MIN_SIZE 1048576
+
+//-----------------------------------------------------------------------------
+// Stream I/O parameters.
+//-----------------------------------------------------------------------------
+
+// Size of the internal stream buffer (in bytes). Small reads and writes are
+// collected in this buffer, so that the user supplied read/write functions are
+// called with large blocks of data.
+#define _CTM_STREAM_BUFFER_SIZE 65536
+
+// Size of the output blocks (in bytes) that the LZMA decoder produces when
+// uncompressing packed arrays.
+#define _CTM_LZMA_DECODE_CHUNK_SIZE 16384
+
 
 #endif // __OPENCTM_CONFIG_H_
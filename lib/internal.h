@@ -44,6 +44,17 @@
 // Flags for the Mesh flags field of the file header
 #define _CTM_HAS_NORMALS_BIT 0x00000001
 
+// First LZMA props byte of a block split packed array (not a valid LZMA props
+// byte, see ctmCompressionBlockSize())
+#define _CTM_PACK_BLOCKS_ID  0xff
+
+// Size of a block table entry of a block split packed array (packed size and
+// LZMA props)
+#define _CTM_PACK_BLOCK_ENTRY_SIZE 9
+
+// Largest angle (in radians) for _ctmSinCosBlock()
+#define _CTM_SINCOS_MAX_ANGLE 8192.0f
+
 //-----------------------------------------------------------------------------
 // Branch optimization macros
 //-----------------------------------------------------------------------------
@@ -76,6 +87,10 @@ struct _CTMarray_struct {
   _CTMarraysetffn setf;   // Float setter function
 };
 
+// Number of elements per block when processing an array in blocks with the
+// bulk access functions (_ctmGatherArrayf() etc).
+#define _CTM_ARRAY_BLOCK_SIZE 256
+
 //-----------------------------------------------------------------------------
 // _CTMfloatmap - Internal representation of a floating point based vertex map
 // (used for UV maps and attribute maps).
@@ -89,6 +104,79 @@ struct _CTMfloatmap_struct {
   _CTMfloatmap * mNext; // Pointer to the next map in the list (linked list)
 };
 
+//-----------------------------------------------------------------------------
+// _CTMpackjob - A packed integer array that is compressed separately from
+// being written to the stream (so that several arrays can be compressed in
+// parallel).
+//-----------------------------------------------------------------------------
+typedef struct {
+  // Input (set by the caller)
+  CTMint * mData;             // Integer array (mCount * mSize elements)
+  CTMuint mCount;             // Number of elements
+  CTMuint mSize;              // Number of components per element
+  CTMint mSignedInts;         // Convert to signed magnitude form?
+  unsigned char * mBuffer;    // Memory for the interleaved and packed data
+                              // (see _ctmPackBufferSize()), or nil
+
+  // Output (set by _ctmPackInts)
+  unsigned char * mPacked;    // Packed data
+  size_t mPackedSize;         // Size of the packed data
+  unsigned char mProps[5];    // LZMA compression props
+  CTMenum mError;             // CTM_NONE if the compression was successful
+} _CTMpackjob;
+
+//-----------------------------------------------------------------------------
+// _CTMunpackjob - A packed array that is read from the stream separately from
+// being uncompressed (so that several arrays can be uncompressed in
+// parallel).
+//-----------------------------------------------------------------------------
+typedef struct {
+  const CTMubyte * mPacked;   // Packed data
+  CTMubyte * mBuffer;         // Allocated copy of the packed data (or nil)
+  CTMuint mPackedSize;        // Size of the packed data
+  unsigned char mProps[5];    // LZMA compression props
+  CTMenum mError;             // CTM_NONE if the uncompression was successful
+} _CTMunpackjob;
+
+//-----------------------------------------------------------------------------
+// _CTMtaskfn - Task function for _ctmRunTasks().
+//-----------------------------------------------------------------------------
+typedef void (*_CTMtaskfn)(void * aArg, CTMuint aIndex);
+
+//-----------------------------------------------------------------------------
+// _CTMplanefns - One implementation of the byte plane functions (see
+// _ctmSplitBytePlanes() and _ctmMergeBytePlane()).
+//-----------------------------------------------------------------------------
+typedef void (*_CTMsplitfn)(const CTMuint *, CTMuint, CTMubyte *, CTMuint, CTMint);
+typedef void (*_CTMmergefn)(CTMuint *, CTMuint, const CTMubyte *, CTMuint, CTMuint, CTMint);
+typedef struct {
+  const char * mName;   // Name of the instruction set ("C", "SSE2", ...)
+  _CTMsplitfn mSplit;
+  _CTMmergefn mMerge;
+} _CTMplanefns;
+
+// Maximum number of byte plane implementations (see _ctmGetPlaneFunctions())
+#define _CTM_MAX_PLANE_FNS 4
+
+//-----------------------------------------------------------------------------
+// _CTMfreefn - Function that frees the inter-frame state of a compression
+// method (see _CTMcontext::mFrameState).
+//-----------------------------------------------------------------------------
+typedef void (*_CTMfreefn)(CTMcontext aContext, void * aState);
+
+//-----------------------------------------------------------------------------
+// _CTMscratch - Scratch memory arena (temporary memory for the codecs, which
+// is kept from one operation to the next, see _ctmScratchAlloc()).
+//-----------------------------------------------------------------------------
+typedef struct {
+  CTMubyte * mBase; // Arena memory (or nil)
+  size_t mSize;     // Size of the arena memory
+  size_t mTop;      // Arena offset of the first free byte
+  size_t mLast;     // Arena offset of the last allocation (if mTop > 0)
+  size_t mInUse;    // Bytes in use (including allocations outside the arena)
+  size_t mPeak;     // High water mark of mInUse since the last reset
+} _CTMscratch;
+
 //-----------------------------------------------------------------------------
 // _CTMcontext - Internal CTM context structure.
 //-----------------------------------------------------------------------------
@@ -108,6 +196,45 @@ typedef struct {
   // Current animation frame (zero index)
   CTMint mCurrentFrame;
 
+  // Inter-frame state of the compression method (only used for animated
+  // meshes), and the function that frees it
+  void * mFrameState;
+  _CTMfreefn mFreeFrameState;
+
+  // Code every Nth frame independently of the previous frames (export, zero
+  // means that only the first frame is independent), and whether the frame
+  // that is being written is such a key frame
+  CTMuint mKeyFrameInterval;
+  CTMbool mKeyFrame;
+
+  // MG1 animation frames are predicted from the previous frame (see
+  // ctmFramePrediction())
+  CTMbool mFramePrediction;
+
+  // Frame offset table (stream offset and key frame of each frame, see
+  // ctmSeekFrame()), or nil if there is none (yet)
+  CTMuint * mFrameIndex;
+
+  // Write a frame offset table (export, see ctmFrameOffsetTable()), or the
+  // file has a valid table (import)
+  CTMbool mFrameOffsetTable;
+
+  // Stream offset of the mesh data (i.e. of the first frame, import)
+  CTMuint mMeshOffset;
+
+  // Memory allocation functions (see ctmNewContextEx())
+  CTMallocfn mAllocFn;
+  CTMfreefn mFreeFn;
+  void * mAllocUserData;
+
+  // Scratch memory for the codecs
+  _CTMscratch mScratch;
+
+  // Number of threads that run the tasks of the current _ctmRunTasks() call
+  // (zero if no tasks are run in parallel). Tasks that start new tasks run
+  // them serially.
+  CTMuint mTaskThreads;
+
   // Indices
   _CTMarray mIndices;
   CTMuint mTriangleCount;
@@ -137,12 +264,43 @@ typedef struct {
   // The selected compression level
   CTMuint mCompressionLevel;
 
+  // LZMA encoder settings (zero means automatic/default, see
+  // ctmCompressionThreads(), ctmCompressionDictSize() and
+  // ctmCompressionFastBytes())
+  CTMuint mLzmaThreads;
+  CTMuint mLzmaDictSize;
+  CTMuint mLzmaFastBytes;
+
+  // Split large packed arrays into independently compressed blocks of this
+  // size (zero means no splitting, see ctmCompressionBlockSize())
+  CTMuint mPackBlockSize;
+
+  // Uncompress independent sections in parallel (import)
+  CTMbool mParallelDecode;
+
+  // Skip validation of the decoded mesh data (import)
+  CTMbool mTrustedInput;
+
   // Vertex coordinate precision
   CTMfloat mVertexPrecision;
 
   // Normal precision (angular + magnitude)
   CTMfloat mNormalPrecision;
 
+  // MG2 normals are stored in octahedral form (see ctmOctahedralNormals())
+  CTMbool mOctNormals;
+
+  // Restore MG2 normals with sinf()/cosf() instead of _ctmSinCosBlock() (only
+  // used for testing, import)
+  CTMbool mReferenceSinCos;
+
+  // Search for the best MG2 grid resolution (see ctmGridSearch())
+  CTMbool mGridSearch;
+
+  // MG2 vertices are predicted from the triangles (see
+  // ctmParallelogramPrediction())
+  CTMbool mParallelogram;
+
   // File comment
   char * mFileComment;
 
@@ -158,6 +316,26 @@ typedef struct {
   // If we use our own file handle, set this handle (otherwise nil)
   FILE * mFileStream;
 
+  // Output memory buffer (used by ctmSaveMemory)
+  CTMubyte * mMemBuf;
+  CTMuint mMemBufSize;       // Number of bytes written to the buffer
+  CTMuint mMemBufCapacity;   // Allocated size of the buffer
+
+#ifdef _CTM_SUPPORT_MMAP
+  // If we use our own memory mapped file, this is the mapping (otherwise nil)
+  void * mFileMap;
+  size_t mFileMapSize;
+#endif
+
+  // Stream buffer (read-ahead data when importing, pending data when
+  // exporting)
+  CTMubyte mStreamBuf[_CTM_STREAM_BUFFER_SIZE];
+  const CTMubyte * mReadBuf; // Current read buffer (mStreamBuf, or the
+                             // caller's memory for memory streams)
+  CTMuint mStreamBufPos;     // Read position in the buffer (import)
+  CTMuint mStreamBufLen;     // Number of valid bytes in the buffer
+  CTMuint mStreamPos;        // Stream offset of the start of the buffer
+
 #ifdef _CTM_SUPPORT_V5_FILES
   // v5 compatibility data
   _CTMv5compat mV5Compat;
@@ -181,10 +359,32 @@ typedef struct {
 void _ctmClearArray(_CTMarray * aArray);
 CTMenum _ctmInitArray(_CTMarray * aArray, CTMuint aSize, CTMenum aType,
   CTMuint aStride, void * aData);
+void _ctmGatherArrayf(_CTMarray * aArray, CTMuint aFirst, CTMuint aCount,
+  CTMuint aSize, CTMfloat * aDst);
+void _ctmScatterArrayf(_CTMarray * aArray, CTMuint aFirst, CTMuint aCount,
+  CTMuint aSize, const CTMfloat * aSrc);
+void _ctmGatherArrayi(_CTMarray * aArray, CTMuint aFirst, CTMuint aCount,
+  CTMuint aSize, CTMuint * aDst);
+void _ctmScatterArrayi(_CTMarray * aArray, CTMuint aFirst, CTMuint aCount,
+  CTMuint aSize, const CTMuint * aSrc);
+const CTMfloat * _ctmPackedArrayf(_CTMcontext * self, _CTMarray * aArray,
+  CTMuint aCount, CTMuint aSize, CTMfloat ** aBuffer);
+CTMbool _ctmFloatsAreFinite(const CTMfloat * aValues, CTMuint aCount);
 
 //-----------------------------------------------------------------------------
 // Function prototypes for stream.c
 //-----------------------------------------------------------------------------
+void _ctmStreamResetBuffer(_CTMcontext * self);
+void _ctmStreamSetMemory(_CTMcontext * self, const void * aData, CTMuint aSize);
+CTMuint _ctmStreamTell(_CTMcontext * self);
+CTMbool _ctmStreamSize(_CTMcontext * self, CTMuint * aSize);
+CTMbool _ctmStreamSeek(_CTMcontext * self, CTMuint aOffset);
+const CTMubyte * _ctmStreamMap(_CTMcontext * self, CTMuint aCount);
+#ifdef _CTM_SUPPORT_MMAP
+CTMbool _ctmStreamMapFile(_CTMcontext * self, const char * aFileName);
+void _ctmStreamUnmapFile(_CTMcontext * self);
+#endif
+CTMbool _ctmStreamFlush(_CTMcontext * self);
 CTMuint _ctmStreamRead(_CTMcontext * self, void * aBuf, CTMuint aCount);
 CTMuint _ctmStreamWrite(_CTMcontext * self, void * aBuf, CTMuint aCount);
 CTMuint _ctmStreamReadUINT(_CTMcontext * self);
@@ -195,9 +395,53 @@ CTMuint _ctmStreamReadSTRING(_CTMcontext * self, char ** aValue);
 void _ctmStreamWriteSTRING(_CTMcontext * self, const char * aValue);
 CTMbool _ctmStreamReadPackedInts(_CTMcontext * self, CTMint * aData, CTMuint aCount, CTMuint aSize, CTMint aSignedInts);
 CTMbool _ctmStreamWritePackedInts(_CTMcontext * self, CTMint * aData, CTMuint aCount, CTMuint aSize, CTMint aSignedInts);
+size_t _ctmPackBufferSize(_CTMcontext * self, CTMuint aCount, CTMuint aSize);
+void _ctmPackInts(_CTMcontext * self, _CTMpackjob * aJob);
+CTMbool _ctmStreamWritePackJob(_CTMcontext * self, _CTMpackjob * aJob);
 CTMbool _ctmStreamReadPackedFloatArray(_CTMcontext * self, _CTMarray * aArray, CTMuint aCount, CTMuint aSize);
+CTMbool _ctmStreamReadPackJob(_CTMcontext * self, _CTMunpackjob * aJob);
+void _ctmFreeUnpackJob(_CTMcontext * self, _CTMunpackjob * aJob);
+void _ctmUnpackInts(_CTMcontext * self, _CTMunpackjob * aJob, CTMint * aData, CTMuint aCount, CTMuint aSize, CTMint aSignedInts);
+void _ctmUnpackFloatArray(_CTMcontext * self, _CTMunpackjob * aJob, _CTMarray * aArray, CTMuint aCount, CTMuint aSize);
 CTMbool _ctmStreamWritePackedFloatArray(_CTMcontext * self, _CTMarray * aArray, CTMuint aCount, CTMuint aSize);
 
+//-----------------------------------------------------------------------------
+// Function prototypes for planes.c
+//-----------------------------------------------------------------------------
+void _ctmSplitBytePlanes(const CTMuint * aSrc, CTMuint aCount,
+  CTMubyte * aDst, CTMuint aPlaneSize, CTMint aSignedInts);
+void _ctmMergeBytePlane(CTMuint * aDst, CTMuint aStride,
+  const CTMubyte * aSrc, CTMuint aCount, CTMuint aShift, CTMint aSignedInts);
+void _ctmSplitBytePlanes_C(const CTMuint * aSrc, CTMuint aCount,
+  CTMubyte * aDst, CTMuint aPlaneSize, CTMint aSignedInts);
+void _ctmMergeBytePlane_C(CTMuint * aDst, CTMuint aStride,
+  const CTMubyte * aSrc, CTMuint aCount, CTMuint aShift, CTMint aSignedInts);
+CTMuint _ctmGetPlaneFunctions(_CTMplanefns * aFns);
+
+//-----------------------------------------------------------------------------
+// Function prototypes for parallel.c
+//-----------------------------------------------------------------------------
+void _ctmRunTasks(_CTMcontext * self, CTMuint aCount, _CTMtaskfn aFn,
+  void * aArg);
+
+//-----------------------------------------------------------------------------
+// Function prototypes for scratch.c
+//-----------------------------------------------------------------------------
+void * _ctmAlloc(_CTMcontext * self, size_t aSize);
+void _ctmFree(_CTMcontext * self, void * aPtr);
+void * _ctmScratchAlloc(_CTMcontext * self, size_t aSize);
+void _ctmScratchFree(_CTMcontext * self, void * aPtr);
+void _ctmScratchReset(_CTMcontext * self);
+void _ctmScratchRelease(_CTMcontext * self);
+
+//-----------------------------------------------------------------------------
+// Function prototypes for sort.c
+//-----------------------------------------------------------------------------
+CTMbool _ctmRadixSort(_CTMcontext * self, CTMuint * aElements, CTMuint aCount,
+  CTMuint aSize, CTMuint aMajorKey, CTMuint aMinorKey);
+void _ctmRadixSortSerial(CTMuint * aElements, CTMuint * aTemp, CTMuint aCount,
+  CTMuint aSize, CTMuint aMajorKey, CTMuint aMinorKey);
+
 //-----------------------------------------------------------------------------
 // Function prototypes for compressRAW.c
 //-----------------------------------------------------------------------------
@@ -221,6 +465,8 @@ CTMbool _ctmCompressMesh_MG2(_CTMcontext * self);
 CTMbool _ctmUncompressMesh_MG2(_CTMcontext * self);
 CTMbool _ctmCompressFrame_MG2(_CTMcontext * self);
 CTMbool _ctmUncompressFrame_MG2(_CTMcontext * self);
+void _ctmSinCosBlock(const CTMfloat * aAngles, CTMfloat * aSin,
+  CTMfloat * aCos, CTMuint aCount);
 
 //-----------------------------------------------------------------------------
 // Function prototypes for v5compat.c
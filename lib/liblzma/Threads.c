@@ -5,7 +5,7 @@ Public domain */
 
 /* OpenCTM configuration */
 #include "../config.h"
-#if defined(_CTM_SUPPORT_SAVE) && defined(_CTM_SUPPORT_MT)
+#if defined(_CTM_SUPPORT_MT)
 
 #include "Threads.h"
 
@@ -332,4 +332,4 @@ WRes CriticalSection_Init(CCriticalSection *p)
 #else
   // Dummy code (ISO C does not like empty source files)
   void __myDummyFunc4(void) {}
-#endif // defined(_CTM_SUPPORT_SAVE) && defined(_CTM_SUPPORT_MT)
+#endif // defined(_CTM_SUPPORT_MT)
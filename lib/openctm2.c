@@ -57,7 +57,7 @@ static CTMuint _ctmAllocateFloatMaps(_CTMcontext * self,
   for(i = 0; i < aCount; ++ i)
   {
     // Allocate & clear memory for this map
-    *mapListPtr = (_CTMfloatmap *) malloc(sizeof(_CTMfloatmap));
+    *mapListPtr = (_CTMfloatmap *) _ctmAlloc(self, sizeof(_CTMfloatmap));
     if(!*mapListPtr)
     {
       self->mError = CTM_OUT_OF_MEMORY;
@@ -89,7 +89,7 @@ static _CTMfloatmap * _ctmAddFloatMap(_CTMcontext * self,
   // Allocate memory for a new map list item and append it to the list
   if(!*aList)
   {
-    *aList = (_CTMfloatmap *) malloc(sizeof(_CTMfloatmap));
+    *aList = (_CTMfloatmap *) _ctmAlloc(self, sizeof(_CTMfloatmap));
     map = *aList;
   }
   else
@@ -97,7 +97,7 @@ static _CTMfloatmap * _ctmAddFloatMap(_CTMcontext * self,
     map = *aList;
     while(map->mNext)
       map = map->mNext;
-    map->mNext = (_CTMfloatmap *) malloc(sizeof(_CTMfloatmap));
+    map->mNext = (_CTMfloatmap *) _ctmAlloc(self, sizeof(_CTMfloatmap));
     map = map->mNext;
   }
   if(!map)
@@ -118,11 +118,11 @@ static _CTMfloatmap * _ctmAddFloatMap(_CTMcontext * self,
     if(len)
     {
       // Copy the string
-      map->mName = (char *) malloc(len + 1);
+      map->mName = (char *) _ctmAlloc(self, len + 1);
       if(!map->mName)
       {
         self->mError = CTM_OUT_OF_MEMORY;
-        free(map);
+        _ctmFree(self, map);
         return (_CTMfloatmap *) 0;
       }
       strcpy(map->mName, aName);
@@ -137,13 +137,13 @@ static _CTMfloatmap * _ctmAddFloatMap(_CTMcontext * self,
     if(len)
     {
       // Copy the string
-      map->mFileName = (char *) malloc(len + 1);
+      map->mFileName = (char *) _ctmAlloc(self, len + 1);
       if(!map->mFileName)
       {
         self->mError = CTM_OUT_OF_MEMORY;
         if(map->mName)
-          free(map->mName);
-        free(map);
+          _ctmFree(self, map->mName);
+        _ctmFree(self, map);
         return (_CTMfloatmap *) 0;
       }
       strcpy(map->mFileName, aFileName);
@@ -157,7 +157,7 @@ static _CTMfloatmap * _ctmAddFloatMap(_CTMcontext * self,
 //-----------------------------------------------------------------------------
 // _ctmFreeMapList() - Free a float map list.
 //-----------------------------------------------------------------------------
-static void _ctmFreeMapList(_CTMfloatmap * aMapList)
+static void _ctmFreeMapList(_CTMcontext * self, _CTMfloatmap * aMapList)
 {
   _CTMfloatmap * map, * nextMap;
   map = aMapList;
@@ -165,18 +165,42 @@ static void _ctmFreeMapList(_CTMfloatmap * aMapList)
   {
     // Free map name
     if(map->mName)
-      free(map->mName);
+      _ctmFree(self, map->mName);
 
     // Free file name
     if(map->mFileName)
-      free(map->mFileName);
+      _ctmFree(self, map->mFileName);
 
     nextMap = map->mNext;
-    free(map);
+    _ctmFree(self, map);
     map = nextMap;
   }
 }
 
+//-----------------------------------------------------------------------------
+// _ctmFreeFrameState() - Free the inter-frame state of the compression method
+// (if any).
+//-----------------------------------------------------------------------------
+static void _ctmFreeFrameState(_CTMcontext * self)
+{
+  if(self->mFrameState)
+    self->mFreeFrameState((CTMcontext) self, self->mFrameState);
+  self->mFrameState = (void *) 0;
+  self->mFreeFrameState = (_CTMfreefn) 0;
+}
+
+//-----------------------------------------------------------------------------
+// _ctmFreeFrameIndex() - Free the frame offset table (if any).
+//-----------------------------------------------------------------------------
+static void _ctmFreeFrameIndex(_CTMcontext * self)
+{
+  if(self->mFrameIndex)
+    _ctmFree(self, (void *) self->mFrameIndex);
+  self->mFrameIndex = (CTMuint *) 0;
+  if(self->mMode == CTM_IMPORT)
+    self->mFrameOffsetTable = CTM_FALSE;
+}
+
 //-----------------------------------------------------------------------------
 // _ctmFreeContextData() - Clear all the context data in a CTM context,
 // and clear external mesh array assignments.
@@ -191,18 +215,22 @@ static void _ctmFreeContextData(_CTMcontext * self)
   _ctmClearArray(&self->mNormals);
 
   // Free UV coordinate map list
-  _ctmFreeMapList(self->mUVMaps);
+  _ctmFreeMapList(self, self->mUVMaps);
   self->mUVMaps = (_CTMfloatmap *) 0;
   self->mUVMapCount = 0;
 
   // Free attribute map list
-  _ctmFreeMapList(self->mAttribMaps);
+  _ctmFreeMapList(self, self->mAttribMaps);
   self->mAttribMaps = (_CTMfloatmap *) 0;
   self->mAttribMapCount = 0;
 
   // Free the file comment
   if(self->mFileComment)
-    free(self->mFileComment);
+    _ctmFree(self, self->mFileComment);
+
+  // Free the inter-frame state and the frame offset table
+  _ctmFreeFrameState(self);
+  _ctmFreeFrameIndex(self);
 
 #ifdef _CTM_SUPPORT_V5_FILES
   // Free v5 compatibility data
@@ -210,56 +238,79 @@ static void _ctmFreeContextData(_CTMcontext * self)
 #endif
 }
 
+//-----------------------------------------------------------------------------
+// _ctmHasMeshData() - Check that the mesh has all the mandatory data (i.e. is
+// non-empty, and has vertex and index arrays).
+//-----------------------------------------------------------------------------
+static CTMint _ctmHasMeshData(_CTMcontext * self)
+{
+  return self->mVertices.mData && self->mIndices.mData &&
+         (self->mVertexCount >= 1) && (self->mTriangleCount >= 1);
+}
+
+//-----------------------------------------------------------------------------
+// _ctmArrayIsFinite() - Check that the first aCount elements (of aSize <= 4
+// components) of an array are finite (non-NaN, non-inf).
+//-----------------------------------------------------------------------------
+static CTMint _ctmArrayIsFinite(_CTMarray * aArray, CTMuint aCount,
+  CTMuint aSize)
+{
+  CTMfloat block[_CTM_ARRAY_BLOCK_SIZE * 4];
+  CTMuint i, blockSize;
+
+  for(i = 0; i < aCount; i += blockSize)
+  {
+    blockSize = aCount - i;
+    if(blockSize > _CTM_ARRAY_BLOCK_SIZE)
+      blockSize = _CTM_ARRAY_BLOCK_SIZE;
+    _ctmGatherArrayf(aArray, i, blockSize, aSize, block);
+    if(!_ctmFloatsAreFinite(block, blockSize * aSize))
+      return CTM_FALSE;
+  }
+
+  return CTM_TRUE;
+}
+
 //-----------------------------------------------------------------------------
 // _ctmCheckMeshIntegrity() - Check if a mesh is valid (i.e. is non-empty, and
 // contains valid data).
 //-----------------------------------------------------------------------------
 static CTMint _ctmCheckMeshIntegrity(_CTMcontext * self)
 {
-  CTMuint i, j;
+  CTMuint i, k, blockSize, block[_CTM_ARRAY_BLOCK_SIZE * 3];
   _CTMfloatmap * map;
 
   // Check that we have all the mandatory data
-  if(!self->mVertices.mData || !self->mIndices.mData ||
-     (self->mVertexCount < 1) || (self->mTriangleCount < 1))
-  {
+  if(!_ctmHasMeshData(self))
     return CTM_FALSE;
-  }
 
   // Check that all indices are within range
-  for(i = 0; i < self->mTriangleCount; ++ i)
+  for(i = 0; i < self->mTriangleCount; i += blockSize)
   {
-    for(j = 0; j < 3; ++ j)
+    blockSize = self->mTriangleCount - i;
+    if(blockSize > _CTM_ARRAY_BLOCK_SIZE)
+      blockSize = _CTM_ARRAY_BLOCK_SIZE;
+    _ctmGatherArrayi(&self->mIndices, i, blockSize, 3, block);
+    for(k = 0; k < blockSize * 3; ++ k)
     {
-      if(self->mIndices.geti(&self->mIndices, i, j) >= self->mVertexCount)
+      if(block[k] >= self->mVertexCount)
         return CTM_FALSE;
     }
   }
 
   // Check that all vertices and normals are finite (non-NaN, non-inf)
-  for(i = 0; i < self->mVertexCount; ++ i)
-  {
-    for(j = 0; j < 3; ++ j)
-    {
-      if(!isfinite(self->mVertices.getf(&self->mVertices, i, j)))
-        return CTM_FALSE;
-      if(self->mHasNormals && !isfinite(self->mNormals.getf(&self->mNormals, i, j)))
-        return CTM_FALSE;
-    }
-  }
+  if(!_ctmArrayIsFinite(&self->mVertices, self->mVertexCount, 3))
+    return CTM_FALSE;
+  if(self->mHasNormals &&
+     !_ctmArrayIsFinite(&self->mNormals, self->mVertexCount, 3))
+    return CTM_FALSE;
 
   // Check that all UV maps are finite (non-NaN, non-inf)
   map = self->mUVMaps;
   while(map)
   {
-    for(i = 0; i < self->mVertexCount; ++ i)
-    {
-      for(j = 0; j < 2; ++ j)
-      {
-        if(!isfinite(map->mArray.getf(&map->mArray, i, j)))
-          return CTM_FALSE;
-      }
-    }
+    if(!_ctmArrayIsFinite(&map->mArray, self->mVertexCount, 2))
+      return CTM_FALSE;
     map = map->mNext;
   }
 
@@ -267,14 +318,8 @@ static CTMint _ctmCheckMeshIntegrity(_CTMcontext * self)
   map = self->mAttribMaps;
   while(map)
   {
-    for(i = 0; i < self->mVertexCount; ++ i)
-    {
-      for(j = 0; j < 4; ++ j)
-      {
-        if(!isfinite(map->mArray.getf(&map->mArray, i, j)))
-          return CTM_FALSE;
-      }
-    }
+    if(!_ctmArrayIsFinite(&map->mArray, self->mVertexCount, 4))
+      return CTM_FALSE;
     map = map->mNext;
   }
 
@@ -290,6 +335,24 @@ static CTMuint CTMCALL _ctmDefaultRead(void * aBuf, CTMuint aCount,
   return (CTMuint) fread(aBuf, 1, (size_t) aCount, (FILE *) aUserData);
 }
 
+//-----------------------------------------------------------------------------
+// _ctmDefaultAlloc()
+//-----------------------------------------------------------------------------
+static void * CTMCALL _ctmDefaultAlloc(size_t aSize, void * aUserData)
+{
+  DUMMYUSE(aUserData);
+  return malloc(aSize);
+}
+
+//-----------------------------------------------------------------------------
+// _ctmDefaultFree()
+//-----------------------------------------------------------------------------
+static void CTMCALL _ctmDefaultFree(void * aPtr, void * aUserData)
+{
+  DUMMYUSE(aUserData);
+  free(aPtr);
+}
+
 #ifdef _CTM_SUPPORT_SAVE
 //-----------------------------------------------------------------------------
 // _ctmDefaultWrite()
@@ -299,6 +362,50 @@ static CTMuint CTMCALL _ctmDefaultWrite(const void * aBuf, CTMuint aCount,
 {
   return (CTMuint) fwrite(aBuf, 1, (size_t) aCount, (FILE *) aUserData);
 }
+
+//-----------------------------------------------------------------------------
+// _ctmMemoryWrite() - Append data to the output memory buffer of the context
+// (given by aUserData), and grow the buffer as necessary.
+//-----------------------------------------------------------------------------
+static CTMuint CTMCALL _ctmMemoryWrite(const void * aBuf, CTMuint aCount,
+  void * aUserData)
+{
+  _CTMcontext * self = (_CTMcontext *) aUserData;
+  CTMubyte * newBuf;
+  CTMuint newCapacity;
+
+  // Grow the buffer (by doubling its size) if necessary
+  if(aCount > self->mMemBufCapacity - self->mMemBufSize)
+  {
+    if(aCount > 0xffffffffU - self->mMemBufSize)
+      return 0;
+    newCapacity = self->mMemBufCapacity > 0 ? self->mMemBufCapacity :
+                  _CTM_STREAM_BUFFER_SIZE;
+    while(newCapacity < self->mMemBufSize + aCount)
+    {
+      if(newCapacity > 0x7fffffffU)
+      {
+        newCapacity = self->mMemBufSize + aCount;
+        break;
+      }
+      newCapacity *= 2;
+    }
+    newBuf = (CTMubyte *) _ctmAlloc(self, newCapacity);
+    if(!newBuf)
+      return 0;
+    if(self->mMemBuf)
+    {
+      memcpy(newBuf, self->mMemBuf, self->mMemBufSize);
+      _ctmFree(self, self->mMemBuf);
+    }
+    self->mMemBuf = newBuf;
+    self->mMemBufCapacity = newCapacity;
+  }
+
+  memcpy(&self->mMemBuf[self->mMemBufSize], aBuf, aCount);
+  self->mMemBufSize += aCount;
+  return aCount;
+}
 #endif
 
 
@@ -310,6 +417,15 @@ static CTMuint CTMCALL _ctmDefaultWrite(const void * aBuf, CTMuint aCount,
 // ctmNewContext()
 //-----------------------------------------------------------------------------
 CTMEXPORT CTMcontext CTMCALL ctmNewContext(CTMenum aMode)
+{
+  return ctmNewContextEx(aMode, _ctmDefaultAlloc, _ctmDefaultFree, (void *) 0);
+}
+
+//-----------------------------------------------------------------------------
+// ctmNewContextEx()
+//-----------------------------------------------------------------------------
+CTMEXPORT CTMcontext CTMCALL ctmNewContextEx(CTMenum aMode,
+  CTMallocfn aAllocFn, CTMfreefn aFreeFn, void * aUserData)
 {
   _CTMcontext * self;
 
@@ -317,14 +433,19 @@ CTMEXPORT CTMcontext CTMCALL ctmNewContext(CTMenum aMode)
   if(aMode == CTM_EXPORT)
     return (CTMcontext) 0;
 #endif
+  if(!aAllocFn || !aFreeFn)
+    return (CTMcontext) 0;
 
   // Allocate memory for the new structure
-  self = (_CTMcontext *) malloc(sizeof(_CTMcontext));
+  self = (_CTMcontext *) aAllocFn(sizeof(_CTMcontext), aUserData);
   if(!self)
     return (CTMcontext) 0;
 
   // Initialize structure (set null pointers and zero array lengths)
   memset(self, 0, sizeof(_CTMcontext));
+  self->mAllocFn = aAllocFn;
+  self->mFreeFn = aFreeFn;
+  self->mAllocUserData = aUserData;
   self->mMode = aMode;
   self->mFrameCount = 1;
   self->mCurrentFrame = -1;
@@ -354,12 +475,20 @@ CTMEXPORT void CTMCALL ctmFreeContext(CTMcontext aContext)
   // Close the file stream, if necessary
   if(self->mFileStream)
     fclose(self->mFileStream);
+#ifdef _CTM_SUPPORT_MMAP
+  _ctmStreamUnmapFile(self);
+#endif
 
   // Free all mesh resources
   _ctmFreeContextData(self);
 
+  // Free the output memory buffer and the scratch memory
+  if(self->mMemBuf)
+    _ctmFree(self, self->mMemBuf);
+  _ctmScratchRelease(self);
+
   // Free the context
-  free(self);
+  _ctmFree(self, self);
 }
 
 //-----------------------------------------------------------------------------
@@ -425,6 +554,27 @@ CTMEXPORT CTMbool CTMCALL ctmGetBoolean(CTMcontext aContext, CTMenum aProperty)
     case CTM_HAS_NORMALS:
       return self->mHasNormals ? CTM_TRUE : CTM_FALSE;
 
+    case CTM_PARALLEL_DECODE:
+      return self->mParallelDecode ? CTM_TRUE : CTM_FALSE;
+
+    case CTM_TRUSTED_INPUT:
+      return self->mTrustedInput ? CTM_TRUE : CTM_FALSE;
+
+    case CTM_OCTAHEDRAL_NORMALS:
+      return self->mOctNormals ? CTM_TRUE : CTM_FALSE;
+
+    case CTM_GRID_SEARCH:
+      return self->mGridSearch ? CTM_TRUE : CTM_FALSE;
+
+    case CTM_PARALLELOGRAM_PREDICTION:
+      return self->mParallelogram ? CTM_TRUE : CTM_FALSE;
+
+    case CTM_FRAME_PREDICTION:
+      return self->mFramePrediction ? CTM_TRUE : CTM_FALSE;
+
+    case CTM_FRAME_OFFSET_TABLE:
+      return self->mFrameOffsetTable ? CTM_TRUE : CTM_FALSE;
+
     default:
       self->mError = CTM_INVALID_ARGUMENT;
   }
@@ -463,6 +613,9 @@ CTMEXPORT CTMuint CTMCALL ctmGetInteger(CTMcontext aContext, CTMenum aProperty)
     case CTM_FRAME_INDEX:
       return self->mCurrentFrame - 1;
 
+    case CTM_MEMORY_SIZE:
+      return self->mMemBufSize;
+
     default:
       self->mError = CTM_INVALID_ARGUMENT;
   }
@@ -965,7 +1118,7 @@ CTMEXPORT void CTMCALL ctmFileComment(CTMcontext aContext,
   // Free the old comment string, if necessary
   if(self->mFileComment)
   {
-    free(self->mFileComment);
+    _ctmFree(self, self->mFileComment);
     self->mFileComment = (char *) 0;
   }
 
@@ -977,7 +1130,7 @@ CTMEXPORT void CTMCALL ctmFileComment(CTMcontext aContext,
     return;
 
   // Copy the string
-  self->mFileComment = (char *) malloc(len + 1);
+  self->mFileComment = (char *) _ctmAlloc(self, len + 1);
   if(!self->mFileComment)
   {
     self->mError = CTM_OUT_OF_MEMORY;
@@ -1019,6 +1172,78 @@ CTMEXPORT void CTMCALL ctmFrameCount(CTMcontext aContext, CTMuint aCount)
 #endif
 }
 
+//-----------------------------------------------------------------------------
+// ctmKeyFrameInterval()
+//-----------------------------------------------------------------------------
+CTMEXPORT void CTMCALL ctmKeyFrameInterval(CTMcontext aContext,
+  CTMuint aInterval)
+{
+  _CTMcontext * self = (_CTMcontext *) aContext;
+  if(!self) return;
+
+#ifdef _CTM_SUPPORT_SAVE
+  // You are only allowed to change the key frame interval in export mode
+  if((self->mMode != CTM_EXPORT) || (self->mCurrentFrame >= 0))
+  {
+    self->mError = CTM_INVALID_OPERATION;
+    return;
+  }
+
+  self->mKeyFrameInterval = aInterval;
+#else
+  DUMMYUSE(aInterval);
+  self->mError = CTM_UNSUPPORTED_OPERATION;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// ctmFramePrediction()
+//-----------------------------------------------------------------------------
+CTMEXPORT void CTMCALL ctmFramePrediction(CTMcontext aContext,
+  CTMbool aEnable)
+{
+  _CTMcontext * self = (_CTMcontext *) aContext;
+  if(!self) return;
+
+#ifdef _CTM_SUPPORT_SAVE
+  // You are only allowed to change compression attributes in export mode
+  if((self->mMode != CTM_EXPORT) || (self->mCurrentFrame >= 0))
+  {
+    self->mError = CTM_INVALID_OPERATION;
+    return;
+  }
+
+  self->mFramePrediction = aEnable ? CTM_TRUE : CTM_FALSE;
+#else
+  DUMMYUSE(aEnable);
+  self->mError = CTM_UNSUPPORTED_OPERATION;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// ctmFrameOffsetTable()
+//-----------------------------------------------------------------------------
+CTMEXPORT void CTMCALL ctmFrameOffsetTable(CTMcontext aContext,
+  CTMbool aEnable)
+{
+  _CTMcontext * self = (_CTMcontext *) aContext;
+  if(!self) return;
+
+#ifdef _CTM_SUPPORT_SAVE
+  // You are only allowed to change the frame offset table in export mode
+  if((self->mMode != CTM_EXPORT) || (self->mCurrentFrame >= 0))
+  {
+    self->mError = CTM_INVALID_OPERATION;
+    return;
+  }
+
+  self->mFrameOffsetTable = aEnable ? CTM_TRUE : CTM_FALSE;
+#else
+  DUMMYUSE(aEnable);
+  self->mError = CTM_UNSUPPORTED_OPERATION;
+#endif
+}
+
 //-----------------------------------------------------------------------------
 // ctmCompressionMethod()
 //-----------------------------------------------------------------------------
@@ -1108,10 +1333,10 @@ CTMEXPORT void CTMCALL ctmCompressionLevel(CTMcontext aContext,
 }
 
 //-----------------------------------------------------------------------------
-// ctmVertexPrecision()
+// ctmCompressionThreads()
 //-----------------------------------------------------------------------------
-CTMEXPORT void CTMCALL ctmVertexPrecision(CTMcontext aContext,
-  CTMfloat aPrecision)
+CTMEXPORT void CTMCALL ctmCompressionThreads(CTMcontext aContext,
+  CTMuint aThreads)
 {
   _CTMcontext * self = (_CTMcontext *) aContext;
   if(!self) return;
@@ -1125,31 +1350,27 @@ CTMEXPORT void CTMCALL ctmVertexPrecision(CTMcontext aContext,
   }
 
   // Check arguments
-  if(aPrecision <= 0.0f)
+  if(aThreads > 2)
   {
     self->mError = CTM_INVALID_ARGUMENT;
     return;
   }
 
-  // Set precision
-  self->mVertexPrecision = aPrecision;
+  // Set the number of LZMA threads
+  self->mLzmaThreads = aThreads;
 #else
-  DUMMYUSE(aPrecision);
+  DUMMYUSE(aThreads);
   self->mError = CTM_UNSUPPORTED_OPERATION;
 #endif
 }
 
 //-----------------------------------------------------------------------------
-// ctmVertexPrecisionRel()
+// ctmCompressionDictSize()
 //-----------------------------------------------------------------------------
-CTMEXPORT void CTMCALL ctmVertexPrecisionRel(CTMcontext aContext,
-  CTMfloat aRelPrecision)
+CTMEXPORT void CTMCALL ctmCompressionDictSize(CTMcontext aContext,
+  CTMuint aSize)
 {
   _CTMcontext * self = (_CTMcontext *) aContext;
-#ifdef _CTM_SUPPORT_SAVE
-  CTMfloat avgEdgeLength, p1[3], p2[3];
-  CTMuint edgeCount, i, j, k, idx[3];
-#endif
   if(!self) return;
 
 #ifdef _CTM_SUPPORT_SAVE
@@ -1161,61 +1382,57 @@ CTMEXPORT void CTMCALL ctmVertexPrecisionRel(CTMcontext aContext,
   }
 
   // Check arguments
-  if(aRelPrecision <= 0.0f)
+  if((aSize != 0) && ((aSize < 4096) || (aSize > (1U << 30))))
   {
     self->mError = CTM_INVALID_ARGUMENT;
     return;
   }
 
-  // Check that the index array and vertex array have been defined
-  if((!self->mIndices.mData) || (!self->mVertices.mData))
+  // Set the LZMA dictionary size
+  self->mLzmaDictSize = aSize;
+#else
+  DUMMYUSE(aSize);
+  self->mError = CTM_UNSUPPORTED_OPERATION;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// ctmCompressionFastBytes()
+//-----------------------------------------------------------------------------
+CTMEXPORT void CTMCALL ctmCompressionFastBytes(CTMcontext aContext,
+  CTMuint aFastBytes)
+{
+  _CTMcontext * self = (_CTMcontext *) aContext;
+  if(!self) return;
+
+#ifdef _CTM_SUPPORT_SAVE
+  // You are only allowed to change compression attributes in export mode
+  if((self->mMode != CTM_EXPORT) || (self->mCurrentFrame >= 0))
   {
-    self->mError = CTM_INVALID_MESH;
+    self->mError = CTM_INVALID_OPERATION;
     return;
   }
 
-  // Calculate the average edge length (Note: we actually sum up all the half-
-  // edges, so in a proper solid mesh all connected edges are counted twice)
-  avgEdgeLength = 0.0f;
-  edgeCount = 0;
-  for(i = 0; i < self->mTriangleCount; ++ i)
-  {
-    for(j = 0; j < 3; ++ j)
-      idx[j] = self->mIndices.geti(&self->mIndices, i, j);
-    for(k = 0; k < 3; ++ k)
-      p1[k] = self->mVertices.getf(&self->mVertices, idx[2], k);
-    for(j = 0; j < 3; ++ j)
-    {
-      for(k = 0; k < 3; ++ k)
-        p2[k] = self->mVertices.getf(&self->mVertices, idx[j], k);
-      avgEdgeLength += sqrtf((p2[0] - p1[0]) * (p2[0] - p1[0]) +
-                             (p2[1] - p1[1]) * (p2[1] - p1[1]) +
-                             (p2[2] - p1[2]) * (p2[2] - p1[2]));
-      for(k = 0; k < 3; ++ k)
-        p1[k] = p2[k];
-      ++ edgeCount;
-    }
-  }
-  if(edgeCount == 0)
+  // Check arguments
+  if((aFastBytes != 0) && ((aFastBytes < 5) || (aFastBytes > 273)))
   {
-    self->mError = CTM_INVALID_MESH;
+    self->mError = CTM_INVALID_ARGUMENT;
     return;
   }
-  avgEdgeLength /= (CTMfloat) edgeCount;
 
-  // Set precision
-  self->mVertexPrecision = aRelPrecision * avgEdgeLength;
+  // Set the number of LZMA fast bytes
+  self->mLzmaFastBytes = aFastBytes;
 #else
-  DUMMYUSE(aRelPrecision);
+  DUMMYUSE(aFastBytes);
   self->mError = CTM_UNSUPPORTED_OPERATION;
 #endif
 }
 
 //-----------------------------------------------------------------------------
-// ctmNormalPrecision()
+// ctmCompressionBlockSize()
 //-----------------------------------------------------------------------------
-CTMEXPORT void CTMCALL ctmNormalPrecision(CTMcontext aContext,
-  CTMfloat aPrecision)
+CTMEXPORT void CTMCALL ctmCompressionBlockSize(CTMcontext aContext,
+  CTMuint aSize)
 {
   _CTMcontext * self = (_CTMcontext *) aContext;
   if(!self) return;
@@ -1229,31 +1446,27 @@ CTMEXPORT void CTMCALL ctmNormalPrecision(CTMcontext aContext,
   }
 
   // Check arguments
-  if(aPrecision <= 0.0f)
+  if((aSize != 0) && ((aSize < 65536) || (aSize > (1U << 30))))
   {
     self->mError = CTM_INVALID_ARGUMENT;
     return;
   }
 
-  // Set precision
-  self->mNormalPrecision = aPrecision;
+  // Set the block size
+  self->mPackBlockSize = aSize;
 #else
-  DUMMYUSE(aPrecision);
+  DUMMYUSE(aSize);
   self->mError = CTM_UNSUPPORTED_OPERATION;
 #endif
 }
 
 //-----------------------------------------------------------------------------
-// ctmUVCoordPrecision()
+// ctmVertexPrecision()
 //-----------------------------------------------------------------------------
-CTMEXPORT void CTMCALL ctmUVCoordPrecision(CTMcontext aContext,
-  CTMenum aUVMap, CTMfloat aPrecision)
+CTMEXPORT void CTMCALL ctmVertexPrecision(CTMcontext aContext,
+  CTMfloat aPrecision)
 {
   _CTMcontext * self = (_CTMcontext *) aContext;
-#ifdef _CTM_SUPPORT_SAVE
-  _CTMfloatmap * map;
-  CTMuint i;
-#endif
   if(!self) return;
 
 #ifdef _CTM_SUPPORT_SAVE
@@ -1271,39 +1484,25 @@ CTMEXPORT void CTMCALL ctmUVCoordPrecision(CTMcontext aContext,
     return;
   }
 
-  // Find the indicated map
-  map = self->mUVMaps;
-  i = CTM_UV_MAP_1;
-  while(map && (i != aUVMap))
-  {
-    ++ i;
-    map = map->mNext;
-  }
-  if(!map)
-  {
-    self->mError = CTM_INVALID_ARGUMENT;
-    return;
-  }
-
-  // Update the precision
-  map->mPrecision = aPrecision;
+  // Set precision
+  self->mVertexPrecision = aPrecision;
 #else
-  DUMMYUSE(aUVMap);
   DUMMYUSE(aPrecision);
   self->mError = CTM_UNSUPPORTED_OPERATION;
 #endif
 }
 
 //-----------------------------------------------------------------------------
-// ctmAttribPrecision()
+// ctmVertexPrecisionRel()
 //-----------------------------------------------------------------------------
-CTMEXPORT void CTMCALL ctmAttribPrecision(CTMcontext aContext,
-  CTMenum aAttribMap, CTMfloat aPrecision)
+CTMEXPORT void CTMCALL ctmVertexPrecisionRel(CTMcontext aContext,
+  CTMfloat aRelPrecision)
 {
   _CTMcontext * self = (_CTMcontext *) aContext;
 #ifdef _CTM_SUPPORT_SAVE
-  _CTMfloatmap * map;
-  CTMuint i;
+  CTMfloat avgEdgeLength, * verticesBuf;
+  const CTMfloat * vertices, * p1, * p2;
+  CTMuint edgeCount, i, j, k, blockSize, idx[_CTM_ARRAY_BLOCK_SIZE * 3];
 #endif
   if(!self) return;
 
@@ -1316,85 +1515,327 @@ CTMEXPORT void CTMCALL ctmAttribPrecision(CTMcontext aContext,
   }
 
   // Check arguments
-  if(aPrecision <= 0.0f)
+  if(aRelPrecision <= 0.0f)
   {
     self->mError = CTM_INVALID_ARGUMENT;
     return;
   }
 
-  // Find the indicated map
-  map = self->mAttribMaps;
-  i = CTM_ATTRIB_MAP_1;
-  while(map && (i != aAttribMap))
+  // Check that the index array and vertex array have been defined
+  if((!self->mIndices.mData) || (!self->mVertices.mData))
   {
-    ++ i;
-    map = map->mNext;
+    self->mError = CTM_INVALID_MESH;
+    return;
   }
-  if(!map)
+
+  // Get a packed view of the vertices
+  vertices = _ctmPackedArrayf(self, &self->mVertices, self->mVertexCount, 3, &verticesBuf);
+  if(!vertices)
   {
-    self->mError = CTM_INVALID_ARGUMENT;
+    self->mError = CTM_OUT_OF_MEMORY;
     return;
   }
 
-  // Update the precision
-  map->mPrecision = aPrecision;
-#else
-  DUMMYUSE(aAttribMap);
-  DUMMYUSE(aPrecision);
+  // Calculate the average edge length (Note: we actually sum up all the half-
+  // edges, so in a proper solid mesh all connected edges are counted twice)
+  avgEdgeLength = 0.0f;
+  edgeCount = 0;
+  for(i = 0; i < self->mTriangleCount; i += blockSize)
+  {
+    blockSize = self->mTriangleCount - i;
+    if(blockSize > _CTM_ARRAY_BLOCK_SIZE)
+      blockSize = _CTM_ARRAY_BLOCK_SIZE;
+    _ctmGatherArrayi(&self->mIndices, i, blockSize, 3, idx);
+    for(k = 0; k < blockSize * 3; ++ k)
+    {
+      if(idx[k] >= self->mVertexCount)
+      {
+        self->mError = CTM_INVALID_MESH;
+        if(verticesBuf) _ctmFree(self, (void *) verticesBuf);
+        return;
+      }
+    }
+
+    for(k = 0; k < blockSize; ++ k)
+    {
+      p1 = &vertices[idx[k * 3 + 2] * 3];
+      for(j = 0; j < 3; ++ j)
+      {
+        p2 = &vertices[idx[k * 3 + j] * 3];
+        avgEdgeLength += sqrtf((p2[0] - p1[0]) * (p2[0] - p1[0]) +
+                               (p2[1] - p1[1]) * (p2[1] - p1[1]) +
+                               (p2[2] - p1[2]) * (p2[2] - p1[2]));
+        p1 = p2;
+        ++ edgeCount;
+      }
+    }
+  }
+  if(verticesBuf) _ctmFree(self, (void *) verticesBuf);
+  if(edgeCount == 0)
+  {
+    self->mError = CTM_INVALID_MESH;
+    return;
+  }
+  avgEdgeLength /= (CTMfloat) edgeCount;
+
+  // Set precision
+  self->mVertexPrecision = aRelPrecision * avgEdgeLength;
+#else
+  DUMMYUSE(aRelPrecision);
   self->mError = CTM_UNSUPPORTED_OPERATION;
 #endif
 }
 
 //-----------------------------------------------------------------------------
-// ctmOpenReadFile()
+// ctmGridSearch()
 //-----------------------------------------------------------------------------
-CTMEXPORT void CTMCALL ctmOpenReadFile(CTMcontext aContext,
-  const char * aFileName)
+CTMEXPORT void CTMCALL ctmGridSearch(CTMcontext aContext, CTMbool aEnable)
 {
   _CTMcontext * self = (_CTMcontext *) aContext;
   if(!self) return;
 
-  // Are we allowed to read the file?
-  if((self->mMode != CTM_IMPORT) || (self->mCurrentFrame >= 0) ||
-     self->mFileStream)
+#ifdef _CTM_SUPPORT_SAVE
+  // You are only allowed to change compression attributes in export mode
+  if((self->mMode != CTM_EXPORT) || (self->mCurrentFrame >= 0))
   {
     self->mError = CTM_INVALID_OPERATION;
     return;
   }
 
-  // Open file stream
-  self->mFileStream = fopen(aFileName, "rb");
-  if(!self->mFileStream)
+  self->mGridSearch = aEnable ? CTM_TRUE : CTM_FALSE;
+#else
+  DUMMYUSE(aEnable);
+  self->mError = CTM_UNSUPPORTED_OPERATION;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// ctmParallelogramPrediction()
+//-----------------------------------------------------------------------------
+CTMEXPORT void CTMCALL ctmParallelogramPrediction(CTMcontext aContext,
+  CTMbool aEnable)
+{
+  _CTMcontext * self = (_CTMcontext *) aContext;
+  if(!self) return;
+
+#ifdef _CTM_SUPPORT_SAVE
+  // You are only allowed to change compression attributes in export mode
+  if((self->mMode != CTM_EXPORT) || (self->mCurrentFrame >= 0))
   {
-    self->mError = CTM_FILE_ERROR;
+    self->mError = CTM_INVALID_OPERATION;
     return;
   }
 
-  // ...continue with the custom function
-  ctmOpenReadCustom(aContext, _ctmDefaultRead, self->mFileStream);
+  self->mParallelogram = aEnable ? CTM_TRUE : CTM_FALSE;
+#else
+  DUMMYUSE(aEnable);
+  self->mError = CTM_UNSUPPORTED_OPERATION;
+#endif
 }
 
 //-----------------------------------------------------------------------------
-// ctmOpenReadCustom()
+// ctmNormalPrecision()
 //-----------------------------------------------------------------------------
-CTMEXPORT void CTMCALL ctmOpenReadCustom(CTMcontext aContext,
-  CTMreadfn aReadFn, void * aUserData)
+CTMEXPORT void CTMCALL ctmNormalPrecision(CTMcontext aContext,
+  CTMfloat aPrecision)
 {
   _CTMcontext * self = (_CTMcontext *) aContext;
-  CTMuint flags, method;
+  if(!self) return;
+
+#ifdef _CTM_SUPPORT_SAVE
+  // You are only allowed to change compression attributes in export mode
+  if((self->mMode != CTM_EXPORT) || (self->mCurrentFrame >= 0))
+  {
+    self->mError = CTM_INVALID_OPERATION;
+    return;
+  }
+
+  // Check arguments
+  if(aPrecision <= 0.0f)
+  {
+    self->mError = CTM_INVALID_ARGUMENT;
+    return;
+  }
+
+  // Set precision
+  self->mNormalPrecision = aPrecision;
+#else
+  DUMMYUSE(aPrecision);
+  self->mError = CTM_UNSUPPORTED_OPERATION;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// ctmOctahedralNormals()
+//-----------------------------------------------------------------------------
+CTMEXPORT void CTMCALL ctmOctahedralNormals(CTMcontext aContext,
+  CTMbool aEnable)
+{
+  _CTMcontext * self = (_CTMcontext *) aContext;
+  if(!self) return;
+
+#ifdef _CTM_SUPPORT_SAVE
+  // You are only allowed to change compression attributes in export mode
+  if((self->mMode != CTM_EXPORT) || (self->mCurrentFrame >= 0))
+  {
+    self->mError = CTM_INVALID_OPERATION;
+    return;
+  }
+
+  self->mOctNormals = aEnable ? CTM_TRUE : CTM_FALSE;
+#else
+  DUMMYUSE(aEnable);
+  self->mError = CTM_UNSUPPORTED_OPERATION;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// ctmUVCoordPrecision()
+//-----------------------------------------------------------------------------
+CTMEXPORT void CTMCALL ctmUVCoordPrecision(CTMcontext aContext,
+  CTMenum aUVMap, CTMfloat aPrecision)
+{
+  _CTMcontext * self = (_CTMcontext *) aContext;
+#ifdef _CTM_SUPPORT_SAVE
   _CTMfloatmap * map;
+  CTMuint i;
+#endif
   if(!self) return;
 
-  // Are we allowed to read the file?
-  if((self->mMode != CTM_IMPORT) || (self->mCurrentFrame >= 0))
+#ifdef _CTM_SUPPORT_SAVE
+  // You are only allowed to change compression attributes in export mode
+  if((self->mMode != CTM_EXPORT) || (self->mCurrentFrame >= 0))
   {
     self->mError = CTM_INVALID_OPERATION;
     return;
   }
 
-  // Initialize stream
-  self->mReadFn = aReadFn;
-  self->mUserData = aUserData;
+  // Check arguments
+  if(aPrecision <= 0.0f)
+  {
+    self->mError = CTM_INVALID_ARGUMENT;
+    return;
+  }
+
+  // Find the indicated map
+  map = self->mUVMaps;
+  i = CTM_UV_MAP_1;
+  while(map && (i != aUVMap))
+  {
+    ++ i;
+    map = map->mNext;
+  }
+  if(!map)
+  {
+    self->mError = CTM_INVALID_ARGUMENT;
+    return;
+  }
+
+  // Update the precision
+  map->mPrecision = aPrecision;
+#else
+  DUMMYUSE(aUVMap);
+  DUMMYUSE(aPrecision);
+  self->mError = CTM_UNSUPPORTED_OPERATION;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// ctmAttribPrecision()
+//-----------------------------------------------------------------------------
+CTMEXPORT void CTMCALL ctmAttribPrecision(CTMcontext aContext,
+  CTMenum aAttribMap, CTMfloat aPrecision)
+{
+  _CTMcontext * self = (_CTMcontext *) aContext;
+#ifdef _CTM_SUPPORT_SAVE
+  _CTMfloatmap * map;
+  CTMuint i;
+#endif
+  if(!self) return;
+
+#ifdef _CTM_SUPPORT_SAVE
+  // You are only allowed to change compression attributes in export mode
+  if((self->mMode != CTM_EXPORT) || (self->mCurrentFrame >= 0))
+  {
+    self->mError = CTM_INVALID_OPERATION;
+    return;
+  }
+
+  // Check arguments
+  if(aPrecision <= 0.0f)
+  {
+    self->mError = CTM_INVALID_ARGUMENT;
+    return;
+  }
+
+  // Find the indicated map
+  map = self->mAttribMaps;
+  i = CTM_ATTRIB_MAP_1;
+  while(map && (i != aAttribMap))
+  {
+    ++ i;
+    map = map->mNext;
+  }
+  if(!map)
+  {
+    self->mError = CTM_INVALID_ARGUMENT;
+    return;
+  }
+
+  // Update the precision
+  map->mPrecision = aPrecision;
+#else
+  DUMMYUSE(aAttribMap);
+  DUMMYUSE(aPrecision);
+  self->mError = CTM_UNSUPPORTED_OPERATION;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// ctmParallelDecode()
+//-----------------------------------------------------------------------------
+CTMEXPORT void CTMCALL ctmParallelDecode(CTMcontext aContext,
+  CTMbool aEnable)
+{
+  _CTMcontext * self = (_CTMcontext *) aContext;
+  if(!self) return;
+
+  // This is only an import option
+  if(self->mMode != CTM_IMPORT)
+  {
+    self->mError = CTM_INVALID_OPERATION;
+    return;
+  }
+
+  self->mParallelDecode = aEnable ? CTM_TRUE : CTM_FALSE;
+}
+
+//-----------------------------------------------------------------------------
+// ctmTrustedInput()
+//-----------------------------------------------------------------------------
+CTMEXPORT void CTMCALL ctmTrustedInput(CTMcontext aContext,
+  CTMbool aTrusted)
+{
+  _CTMcontext * self = (_CTMcontext *) aContext;
+  if(!self) return;
+
+  // This is only an import option
+  if(self->mMode != CTM_IMPORT)
+  {
+    self->mError = CTM_INVALID_OPERATION;
+    return;
+  }
+
+  self->mTrustedInput = aTrusted ? CTM_TRUE : CTM_FALSE;
+}
+
+//-----------------------------------------------------------------------------
+// _ctmReadHeader() - Read the file header from the (newly opened) stream.
+//-----------------------------------------------------------------------------
+static void _ctmReadHeader(_CTMcontext * self)
+{
+  CTMuint flags, method;
+  _CTMfloatmap * map;
 
   // Clear any old mesh data
   _ctmFreeContextData(self);
@@ -1506,6 +1947,9 @@ CTMEXPORT void CTMCALL ctmOpenReadCustom(CTMcontext aContext,
     }
   }
 
+  // The mesh data (first frame) starts here
+  self->mMeshOffset = _ctmStreamTell(self);
+
   // Reset the frame counter (no frames have been read yet)
   self->mCurrentFrame = 0;
 
@@ -1514,86 +1958,178 @@ CTMEXPORT void CTMCALL ctmOpenReadCustom(CTMcontext aContext,
 }
 
 //-----------------------------------------------------------------------------
-// ctmReadMesh()
+// ctmOpenReadFile()
 //-----------------------------------------------------------------------------
-CTMEXPORT void CTMCALL ctmReadMesh(CTMcontext aContext)
+CTMEXPORT void CTMCALL ctmOpenReadFile(CTMcontext aContext,
+  const char * aFileName)
 {
   _CTMcontext * self = (_CTMcontext *) aContext;
   if(!self) return;
 
-  // Are we allowed to read the first frame?
-  if((self->mMode != CTM_IMPORT) || (self->mCurrentFrame != 0))
+  // Are we allowed to read the file?
+  if((self->mMode != CTM_IMPORT) || (self->mCurrentFrame >= 0) ||
+     self->mFileStream)
   {
     self->mError = CTM_INVALID_OPERATION;
     return;
   }
 
+#ifdef _CTM_SUPPORT_MMAP
+  // Map the file into memory, and decode directly from the mapping
+  _ctmStreamUnmapFile(self);
+  if(_ctmStreamMapFile(self, aFileName))
+  {
+    _ctmReadHeader(self);
+    return;
+  }
+#endif
+
+  // Open file stream
+  self->mFileStream = fopen(aFileName, "rb");
+  if(!self->mFileStream)
+  {
+    self->mError = CTM_FILE_ERROR;
+    return;
+  }
+
+  // ...continue with the custom function
+  ctmOpenReadCustom(aContext, _ctmDefaultRead, self->mFileStream);
+}
+
+//-----------------------------------------------------------------------------
+// ctmOpenReadCustom()
+//-----------------------------------------------------------------------------
+CTMEXPORT void CTMCALL ctmOpenReadCustom(CTMcontext aContext,
+  CTMreadfn aReadFn, void * aUserData)
+{
+  _CTMcontext * self = (_CTMcontext *) aContext;
+  if(!self) return;
+
+  // Are we allowed to read the file?
+  if((self->mMode != CTM_IMPORT) || (self->mCurrentFrame >= 0))
+  {
+    self->mError = CTM_INVALID_OPERATION;
+    return;
+  }
+
+  // Initialize stream
+  self->mReadFn = aReadFn;
+  self->mUserData = aUserData;
+  _ctmStreamResetBuffer(self);
+
+  // Read the file header
+  _ctmReadHeader(self);
+}
+
+//-----------------------------------------------------------------------------
+// ctmOpenReadMemory()
+//-----------------------------------------------------------------------------
+CTMEXPORT void CTMCALL ctmOpenReadMemory(CTMcontext aContext,
+  const void * aData, CTMuint aSize)
+{
+  _CTMcontext * self = (_CTMcontext *) aContext;
+  if(!self) return;
+
+  // Are we allowed to read the file?
+  if((self->mMode != CTM_IMPORT) || (self->mCurrentFrame >= 0) ||
+     self->mFileStream)
+  {
+    self->mError = CTM_INVALID_OPERATION;
+    return;
+  }
+  if(!aData)
+  {
+    self->mError = CTM_INVALID_ARGUMENT;
+    return;
+  }
+
+  // Initialize stream (the entire file is in the read buffer, so no read
+  // function is needed)
+  self->mReadFn = (CTMreadfn) 0;
+  self->mUserData = (void *) 0;
+  _ctmStreamSetMemory(self, aData, aSize);
+
+  // Read the file header
+  _ctmReadHeader(self);
+}
+
+//-----------------------------------------------------------------------------
+// _ctmReadFirstFrame() - Read the mesh data (the first frame) from the current
+// stream position.
+//-----------------------------------------------------------------------------
+static CTMbool _ctmReadFirstFrame(_CTMcontext * self)
+{
+  CTMbool ok = CTM_FALSE;
+
   // Animation properties for the first frame
   self->mFrameTime = 0.0f;
+  _ctmFreeFrameState(self);
 
   // Uncompress from stream
   switch(self->mMethod)
   {
     case CTM_METHOD_RAW:
 #ifdef _CTM_SUPPORT_RAW
-      _ctmUncompressMesh_RAW(self);
+      ok = _ctmUncompressMesh_RAW(self);
       break;
 #else
       _ctmFreeContextData(self);
       self->mError = CTM_UNSUPPORTED_OPERATION;
-      return;
+      return CTM_FALSE;
 #endif
 
     case CTM_METHOD_MG1:
 #ifdef _CTM_SUPPORT_MG1
-      _ctmUncompressMesh_MG1(self);
+      ok = _ctmUncompressMesh_MG1(self);
       break;
 #else
       _ctmFreeContextData(self);
       self->mError = CTM_UNSUPPORTED_OPERATION;
-      return;
+      return CTM_FALSE;
 #endif
 
     case CTM_METHOD_MG2:
 #ifdef _CTM_SUPPORT_MG2
-      _ctmUncompressMesh_MG2(self);
+      ok = _ctmUncompressMesh_MG2(self);
       break;
 #else
       _ctmFreeContextData(self);
       self->mError = CTM_UNSUPPORTED_OPERATION;
-      return;
+      return CTM_FALSE;
 #endif
 
     default:
       self->mError = CTM_INTERNAL_ERROR;
   }
+  _ctmScratchReset(self);
 
   // We are done with the frame, on to the next...
   ++ self->mCurrentFrame;
+  if(!ok)
+  {
+    // The following frames can not be decoded without the first frame
+    _ctmFreeFrameState(self);
+    return CTM_FALSE;
+  }
 
-  // Check mesh integrity
-  if(!_ctmCheckMeshIntegrity(self))
+  // Check that we got a mesh (the mesh data has already been validated by the
+  // decoder, see ctmTrustedInput())
+  if(!_ctmHasMeshData(self))
   {
     self->mError = CTM_INVALID_MESH;
-    return;
+    return CTM_FALSE;
   }
+
+  return CTM_TRUE;
 }
 
 //-----------------------------------------------------------------------------
-// ctmReadNextFrame()
+// _ctmReadFrame() - Read the next animation frame from the current stream
+// position.
 //-----------------------------------------------------------------------------
-CTMEXPORT void CTMCALL ctmReadNextFrame(CTMcontext aContext)
+static CTMbool _ctmReadFrame(_CTMcontext * self)
 {
-  _CTMcontext * self = (_CTMcontext *) aContext;
-  if(!self) return;
-
-  // Are we allowed to read the next frame?
-  if((self->mMode != CTM_IMPORT) || (self->mCurrentFrame < 1) ||
-     (self->mCurrentFrame >= self->mFrameCount))
-  {
-    self->mError = CTM_INVALID_OPERATION;
-    return;
-  }
+  CTMbool ok = CTM_FALSE;
 
   // Read frame header
   self->mFrameTime = _ctmStreamReadFLOAT(self);
@@ -1603,39 +2139,237 @@ CTMEXPORT void CTMCALL ctmReadNextFrame(CTMcontext aContext)
   {
     case CTM_METHOD_RAW:
 #ifdef _CTM_SUPPORT_RAW
-      _ctmUncompressFrame_RAW(self);
+      ok = _ctmUncompressFrame_RAW(self);
       break;
 #else
       self->mError = CTM_UNSUPPORTED_OPERATION;
-      return;
+      return CTM_FALSE;
 #endif
 
     case CTM_METHOD_MG1:
 #ifdef _CTM_SUPPORT_MG1
-      _ctmUncompressFrame_MG1(self);
+      ok = _ctmUncompressFrame_MG1(self);
       break;
 #else
       self->mError = CTM_UNSUPPORTED_OPERATION;
-      return;
+      return CTM_FALSE;
 #endif
 
     case CTM_METHOD_MG2:
 #ifdef _CTM_SUPPORT_MG2
-      _ctmUncompressFrame_MG2(self);
+      ok = _ctmUncompressFrame_MG2(self);
       break;
 #else
       self->mError = CTM_UNSUPPORTED_OPERATION;
-      return;
+      return CTM_FALSE;
 #endif
 
     default:
       self->mError = CTM_INTERNAL_ERROR;
   }
+  _ctmScratchReset(self);
 
   // We are done with the frame, on to the next...
   ++ self->mCurrentFrame;
+
+  // The following frames can not be decoded without this frame
+  if(!ok)
+    _ctmFreeFrameState(self);
+
+  return ok;
 }
 
+//-----------------------------------------------------------------------------
+// _ctmReadFrameIndex() - Read the frame offset table from the end of the
+// stream (if the stream is seekable, and the file has a valid table). The
+// stream position is left unchanged.
+//-----------------------------------------------------------------------------
+static void _ctmReadFrameIndex(_CTMcontext * self)
+{
+  CTMuint i, pos, size, tableOffset, * table;
+  CTMbool ok;
+
+  // Only animated files have a frame offset table
+  if(self->mFrameIndex || (self->mFrameCount < 2) ||
+     !_ctmStreamSize(self, &size))
+    return;
+
+  // Find the table from the end of the stream (the table must fill up the
+  // rest of the stream, see _ctmWriteFrameIndex())
+  pos = _ctmStreamTell(self);
+  if((size < 12) || !_ctmStreamSeek(self, size - 8))
+    return;
+  tableOffset = _ctmStreamReadUINT(self);
+  ok = (_ctmStreamReadUINT(self) == FOURCC("FIDX")) &&
+       (tableOffset >= self->mMeshOffset) && (tableOffset <= size - 12) &&
+       ((size - tableOffset - 12) % 8 == 0) &&
+       ((size - tableOffset - 12) / 8 == (CTMuint) self->mFrameCount) &&
+       _ctmStreamSeek(self, tableOffset) &&
+       (_ctmStreamReadUINT(self) == FOURCC("FIDX"));
+  table = (CTMuint *) 0;
+  if(ok)
+  {
+    table = (CTMuint *) _ctmAlloc(self, sizeof(CTMuint) * 2 * self->mFrameCount);
+    ok = table ? CTM_TRUE : CTM_FALSE;
+  }
+
+  // Read the stream offset and the key frame of each frame
+  for(i = 0; ok && (i < (CTMuint) self->mFrameCount); ++ i)
+  {
+    table[i * 2] = _ctmStreamReadUINT(self);
+    table[i * 2 + 1] = _ctmStreamReadUINT(self);
+
+    // Frames must be stored in order, and key frames must depend on nothing
+    // but themselves
+    if(i == 0)
+      ok = (table[0] == self->mMeshOffset) && (table[1] == 0);
+    else
+      ok = (table[i * 2] > table[i * 2 - 2]) && (table[i * 2] < tableOffset) &&
+           (table[i * 2 + 1] <= i) &&
+           (table[table[i * 2 + 1] * 2 + 1] == table[i * 2 + 1]);
+  }
+
+  // Go back to where we were
+  if(!_ctmStreamSeek(self, pos))
+  {
+    self->mError = CTM_FILE_ERROR;
+    ok = CTM_FALSE;
+  }
+
+  if(ok)
+  {
+    self->mFrameIndex = table;
+    self->mFrameOffsetTable = CTM_TRUE;
+  }
+  else if(table)
+    _ctmFree(self, (void *) table);
+}
+
+//-----------------------------------------------------------------------------
+// ctmReadMesh()
+//-----------------------------------------------------------------------------
+CTMEXPORT void CTMCALL ctmReadMesh(CTMcontext aContext)
+{
+  _CTMcontext * self = (_CTMcontext *) aContext;
+  if(!self) return;
+
+  // Are we allowed to read the first frame?
+  if((self->mMode != CTM_IMPORT) || (self->mCurrentFrame != 0))
+  {
+    self->mError = CTM_INVALID_OPERATION;
+    return;
+  }
+
+  _ctmReadFirstFrame(self);
+}
+
+//-----------------------------------------------------------------------------
+// ctmReadNextFrame()
+//-----------------------------------------------------------------------------
+CTMEXPORT void CTMCALL ctmReadNextFrame(CTMcontext aContext)
+{
+  _CTMcontext * self = (_CTMcontext *) aContext;
+  if(!self) return;
+
+  // Are we allowed to read the next frame?
+  if((self->mMode != CTM_IMPORT) || (self->mCurrentFrame < 1) ||
+     (self->mCurrentFrame >= self->mFrameCount))
+  {
+    self->mError = CTM_INVALID_OPERATION;
+    return;
+  }
+
+  _ctmReadFrame(self);
+}
+
+//-----------------------------------------------------------------------------
+// ctmSeekFrame()
+//-----------------------------------------------------------------------------
+CTMEXPORT void CTMCALL ctmSeekFrame(CTMcontext aContext, CTMuint aIndex)
+{
+  _CTMcontext * self = (_CTMcontext *) aContext;
+  CTMuint key, offset;
+  CTMint last;
+  if(!self) return;
+
+  // Are we allowed to seek (the mesh must have been read)?
+  if((self->mMode != CTM_IMPORT) || (self->mCurrentFrame < 1))
+  {
+    self->mError = CTM_INVALID_OPERATION;
+    return;
+  }
+  if(aIndex >= (CTMuint) self->mFrameCount)
+  {
+    self->mError = CTM_INVALID_ARGUMENT;
+    return;
+  }
+
+  // Find the key frame that decoding has to start from (without a frame
+  // offset table, we have to start from the first frame)
+  _ctmReadFrameIndex(self);
+  if(self->mFrameIndex)
+  {
+    key = self->mFrameIndex[aIndex * 2 + 1];
+    offset = self->mFrameIndex[key * 2];
+  }
+  else
+  {
+    key = 0;
+    offset = self->mMeshOffset;
+  }
+
+  // MG2 frames (also key frames) are coded on the grid of the first frame
+  if((self->mMethod == CTM_METHOD_MG2) && !self->mFrameState)
+  {
+    key = 0;
+    offset = self->mMeshOffset;
+  }
+
+  // Unless we can just continue decoding from the last frame (the inter-frame
+  // state is dropped if a frame fails to decode), go to the key frame
+  last = self->mCurrentFrame - 1;
+  if((last < (CTMint) key) || (last >= (CTMint) aIndex) ||
+     ((self->mMethod != CTM_METHOD_RAW) && !self->mFrameState))
+  {
+    if(!_ctmStreamSeek(self, offset))
+    {
+      self->mError = CTM_UNSUPPORTED_OPERATION;
+      return;
+    }
+    self->mCurrentFrame = (CTMint) key;
+    if((key == 0) && !_ctmReadFirstFrame(self))
+      return;
+  }
+
+  // Decode frames until we reach the requested frame
+  while(self->mCurrentFrame <= (CTMint) aIndex)
+  {
+    if(!_ctmReadFrame(self))
+      return;
+  }
+}
+
+#ifdef _CTM_SUPPORT_SAVE
+//-----------------------------------------------------------------------------
+// _ctmWriteFrameIndex() - Write the frame offset table to the end of the
+// stream (after the last frame). The table is stored as "FIDX", followed by
+// the stream offset and the key frame index of each frame, followed by the
+// stream offset of the table and "FIDX" (so that the table can be found from
+// the end of the stream).
+//-----------------------------------------------------------------------------
+static void _ctmWriteFrameIndex(_CTMcontext * self)
+{
+  CTMuint i, tableOffset;
+
+  tableOffset = _ctmStreamTell(self);
+  _ctmStreamWrite(self, (void *) "FIDX", 4);
+  for(i = 0; i < (CTMuint) self->mFrameCount * 2; ++ i)
+    _ctmStreamWriteUINT(self, self->mFrameIndex[i]);
+  _ctmStreamWriteUINT(self, tableOffset);
+  _ctmStreamWrite(self, (void *) "FIDX", 4);
+}
+#endif // _CTM_SUPPORT_SAVE
+
 //-----------------------------------------------------------------------------
 // ctmSaveFile()
 //-----------------------------------------------------------------------------
@@ -1701,6 +2435,7 @@ CTMEXPORT void CTMCALL ctmSaveCustom(CTMcontext aContext,
   // Initialize stream
   self->mWriteFn = aWriteFn;
   self->mUserData = aUserData;
+  _ctmStreamResetBuffer(self);
 
   // Determine flags
   flags = 0;
@@ -1761,7 +2496,24 @@ CTMEXPORT void CTMCALL ctmSaveCustom(CTMcontext aContext,
     }
   }
 
-  // Compress to stream
+  // Start a new frame offset table (only for animated meshes, and only if
+  // asked for)
+  _ctmFreeFrameIndex(self);
+  if(self->mFrameOffsetTable && (self->mFrameCount > 1))
+  {
+    self->mFrameIndex = (CTMuint *) _ctmAlloc(self, sizeof(CTMuint) * 2 * self->mFrameCount);
+    if(!self->mFrameIndex)
+    {
+      self->mError = CTM_OUT_OF_MEMORY;
+      return;
+    }
+    self->mFrameIndex[0] = _ctmStreamTell(self);
+    self->mFrameIndex[1] = 0;
+  }
+
+  // Compress to stream (the first frame is always a key frame)
+  _ctmFreeFrameState(self);
+  self->mKeyFrame = CTM_TRUE;
   switch(self->mMethod)
   {
 #ifdef _CTM_SUPPORT_RAW
@@ -1786,6 +2538,11 @@ CTMEXPORT void CTMCALL ctmSaveCustom(CTMcontext aContext,
       self->mError = CTM_INTERNAL_ERROR;
       return;
   }
+  _ctmScratchReset(self);
+
+  // Write any buffered data to the stream
+  if(!_ctmStreamFlush(self))
+    self->mError = CTM_FILE_ERROR;
 
   // We are done with the frame, on to the next...
   self->mCurrentFrame = 1;
@@ -1796,6 +2553,44 @@ CTMEXPORT void CTMCALL ctmSaveCustom(CTMcontext aContext,
 #endif
 }
 
+//-----------------------------------------------------------------------------
+// ctmSaveMemory()
+//-----------------------------------------------------------------------------
+CTMEXPORT void CTMCALL ctmSaveMemory(CTMcontext aContext)
+{
+  _CTMcontext * self = (_CTMcontext *) aContext;
+  if(!self) return;
+
+#ifdef _CTM_SUPPORT_SAVE
+  // Are we allowed to write the file?
+  if((self->mMode != CTM_EXPORT) || (self->mCurrentFrame >= 0) ||
+     self->mFileStream)
+  {
+    self->mError = CTM_INVALID_OPERATION;
+    return;
+  }
+
+  // Start over with an empty buffer (keep the memory for re-use)
+  self->mMemBufSize = 0;
+
+  // ...continue with the custom function
+  ctmSaveCustom(aContext, _ctmMemoryWrite, (void *) self);
+#else
+  self->mError = CTM_UNSUPPORTED_OPERATION;
+#endif
+}
+
+//-----------------------------------------------------------------------------
+// ctmGetMemoryBuffer()
+//-----------------------------------------------------------------------------
+CTMEXPORT const void * CTMCALL ctmGetMemoryBuffer(CTMcontext aContext)
+{
+  _CTMcontext * self = (_CTMcontext *) aContext;
+  if(!self) return (const void *) 0;
+
+  return (const void *) self->mMemBuf;
+}
+
 //-----------------------------------------------------------------------------
 // ctmWriteNextFrame()
 //-----------------------------------------------------------------------------
@@ -1803,6 +2598,9 @@ CTMEXPORT void CTMCALL ctmWriteNextFrame(CTMcontext aContext,
   CTMfloat aFrameTime)
 {
   _CTMcontext * self = (_CTMcontext *) aContext;
+#ifdef _CTM_SUPPORT_SAVE
+  CTMuint * idx;
+#endif
   if(!self) return;
 
 #ifdef _CTM_SUPPORT_SAVE
@@ -1823,6 +2621,24 @@ CTMEXPORT void CTMCALL ctmWriteNextFrame(CTMcontext aContext,
     return;
   }
   self->mFrameTime = aFrameTime;
+
+  // Should this frame be independent of the previous frames (a key frame)?
+  self->mKeyFrame = (self->mKeyFrameInterval > 0) &&
+                    ((self->mCurrentFrame % self->mKeyFrameInterval) == 0);
+
+  // Add the frame to the frame offset table (RAW frames, and MG1 frames
+  // without frame prediction, are always independent of the previous frames)
+  if(self->mFrameIndex)
+  {
+    idx = &self->mFrameIndex[self->mCurrentFrame * 2];
+    idx[0] = _ctmStreamTell(self);
+    if(self->mKeyFrame || (self->mMethod == CTM_METHOD_RAW) ||
+       ((self->mMethod == CTM_METHOD_MG1) && !self->mFramePrediction))
+      idx[1] = self->mCurrentFrame;
+    else
+      idx[1] = idx[-1];
+  }
+
   _ctmStreamWriteFLOAT(self, self->mFrameTime);
 
   // Compress to stream
@@ -1850,6 +2666,15 @@ CTMEXPORT void CTMCALL ctmWriteNextFrame(CTMcontext aContext,
       self->mError = CTM_INTERNAL_ERROR;
       return;
   }
+  _ctmScratchReset(self);
+
+  // Finish the file with the frame offset table after the last frame
+  if(self->mFrameIndex && (self->mCurrentFrame == self->mFrameCount - 1))
+    _ctmWriteFrameIndex(self);
+
+  // Write any buffered data to the stream
+  if(!_ctmStreamFlush(self))
+    self->mError = CTM_FILE_ERROR;
 
   // We are done with the frame, on to the next...
   ++ self->mCurrentFrame;
@@ -1872,12 +2697,18 @@ CTMEXPORT void CTMCALL ctmClose(CTMcontext aContext)
     fclose(self->mFileStream);
     self->mFileStream = (FILE *) 0;
   }
+#ifdef _CTM_SUPPORT_MMAP
+  _ctmStreamUnmapFile(self);
+#endif
 
   // Clear load/save handles
   self->mReadFn = (CTMreadfn) 0;
   self->mWriteFn = (CTMwritefn) 0;
   self->mUserData = (void *) 0;
+  _ctmStreamResetBuffer(self);
 
   // Unset the internal frame counter (ready for writing/reading new files)
   self->mCurrentFrame = -1;
+  _ctmFreeFrameState(self);
+  _ctmFreeFrameIndex(self);
 }
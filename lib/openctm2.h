@@ -121,6 +121,9 @@ extern "C" {
   #include <stdint.h>
 #endif
 
+// size_t (used by the memory allocation functions)
+#include <stddef.h>
+
 
 /// OpenCTM API version (2.0).
 #define CTM_API_VERSION 0x00000200
@@ -210,6 +213,14 @@ typedef enum {
   CTM_FRAME_COUNT       = 0x030A, ///< Number of animation frames (integer).
   CTM_FRAME_TIME        = 0x030B, ///< Current animation frame time (float).
   CTM_FRAME_INDEX       = 0x030C, ///< Current animation frame index (integer).
+  CTM_MEMORY_SIZE       = 0x030D, ///< Number of bytes in the memory buffer (integer).
+  CTM_PARALLEL_DECODE   = 0x030E, ///< CTM_TRUE if parallel decoding is enabled (integer).
+  CTM_TRUSTED_INPUT     = 0x030F, ///< CTM_TRUE if the input is trusted (integer).
+  CTM_OCTAHEDRAL_NORMALS = 0x0310, ///< CTM_TRUE if MG2 normals are stored in octahedral form (integer).
+  CTM_GRID_SEARCH       = 0x0311, ///< CTM_TRUE if the MG2 grid resolution is searched for (integer).
+  CTM_PARALLELOGRAM_PREDICTION = 0x0312, ///< CTM_TRUE if MG2 vertices are predicted from the triangles (integer).
+  CTM_FRAME_PREDICTION  = 0x0313, ///< CTM_TRUE if MG1 animation frames are predicted from the previous frame (integer).
+  CTM_FRAME_OFFSET_TABLE = 0x0314, ///< CTM_TRUE if animated files have a frame offset table (integer).
 
   // UV/attribute map queries
   CTM_NAME              = 0x0501, ///< Unique name (UV/attrib map string).
@@ -247,7 +258,12 @@ typedef enum {
   CTM_INT               = 0x0905, ///< Signed 32-bit integer.
   CTM_UINT              = 0x0906, ///< Unsigned 32-bit integer.
   CTM_FLOAT             = 0x0907, ///< 32-bit floating point.
-  CTM_DOUBLE            = 0x0908  ///< 64-bit floating point.
+  CTM_DOUBLE            = 0x0908, ///< 64-bit floating point.
+  CTM_HALF              = 0x0909, ///< 16-bit floating point (IEEE 754 binary16).
+  CTM_SNORM8            = 0x090A, ///< Signed normalized 8-bit integer ([-1, 1]).
+  CTM_UNORM8            = 0x090B, ///< Unsigned normalized 8-bit integer ([0, 1]).
+  CTM_SNORM16           = 0x090C, ///< Signed normalized 16-bit integer ([-1, 1]).
+  CTM_UNORM16           = 0x090D  ///< Unsigned normalized 16-bit integer ([0, 1]).
 } CTMenum;
 
 /// Stream read() function pointer.
@@ -269,6 +285,21 @@ typedef CTMuint (CTMCALL * CTMreadfn)(void * aBuf, CTMuint aCount, void * aUserD
 ///         indicates that an error occured).
 typedef CTMuint (CTMCALL * CTMwritefn)(const void * aBuf, CTMuint aCount, void * aUserData);
 
+/// Memory allocation function pointer (works like malloc()).
+/// @param[in] aSize The number of bytes to allocate.
+/// @param[in] aUserData The custom user data that was passed to the
+///            ctmNewContextEx() function.
+/// @return A pointer to the allocated memory, or NULL if the memory could not
+///         be allocated.
+typedef void * (CTMCALL * CTMallocfn)(size_t aSize, void * aUserData);
+
+/// Memory free function pointer (works like free()).
+/// @param[in] aPtr Pointer to memory that has been allocated by the
+///            corresponding CTMallocfn function (never NULL).
+/// @param[in] aUserData The custom user data that was passed to the
+///            ctmNewContextEx() function.
+typedef void (CTMCALL * CTMfreefn)(void * aPtr, void * aUserData);
+
 /// Create a new OpenCTM context. The context is used for all subsequent
 /// OpenCTM function calls. Several contexts can coexist at the same time.
 /// @param[in] aMode An OpenCTM context mode. Set this to CTM_IMPORT if the
@@ -277,6 +308,25 @@ typedef CTMuint (CTMCALL * CTMwritefn)(const void * aBuf, CTMuint aCount, void *
 /// @return An OpenCTM context handle (or NULL if no context could be created).
 CTMEXPORT CTMcontext CTMCALL ctmNewContext(CTMenum aMode);
 
+/// Create a new OpenCTM context that uses custom memory allocation functions.
+/// All the memory that is used by the context (including the context itself
+/// and the memory that is used by the LZMA compressor and decompressor) is
+/// allocated and freed with the given functions. Otherwise the context works
+/// as a context that has been created by ctmNewContext().
+/// @param[in] aMode An OpenCTM context mode (CTM_IMPORT or CTM_EXPORT, see
+///            ctmNewContext()).
+/// @param[in] aAllocFn Pointer to a custom memory allocation function.
+/// @param[in] aFreeFn Pointer to a custom memory free function.
+/// @param[in] aUserData Custom user data, which will be passed as a parameter
+///            to the aAllocFn and aFreeFn functions.
+/// @return An OpenCTM context handle (or NULL if no context could be created).
+/// @note The functions may be called from several threads at the same time
+///       (the library uses worker threads for compressing and uncompressing
+///       data), so they must be thread safe.
+/// @see ctmNewContext()
+CTMEXPORT CTMcontext CTMCALL ctmNewContextEx(CTMenum aMode,
+  CTMallocfn aAllocFn, CTMfreefn aFreeFn, void * aUserData);
+
 /// Free an OpenCTM context.
 /// @param[in] aContext An OpenCTM context that has been created by
 ///            ctmNewContext().
@@ -305,7 +355,10 @@ CTMEXPORT const char * CTMCALL ctmErrorString(CTMenum aError);
 /// @param[in] aContext An OpenCTM context that has been created by
 ///            ctmNewContext().
 /// @param[in] aProperty Which property to return. Valid properties are:
-///            CTM_HAS_NORMALS.
+///            CTM_HAS_NORMALS, CTM_PARALLEL_DECODE, CTM_TRUSTED_INPUT,
+///            CTM_OCTAHEDRAL_NORMALS, CTM_GRID_SEARCH,
+///            CTM_PARALLELOGRAM_PREDICTION, CTM_FRAME_PREDICTION,
+///            CTM_FRAME_OFFSET_TABLE.
 /// @return A boolean value, representing the OpenCTM context property given
 ///         by \c aProperty.
 /// @see CTMenum
@@ -316,7 +369,8 @@ CTMEXPORT CTMbool CTMCALL ctmGetBoolean(CTMcontext aContext, CTMenum aProperty);
 ///            ctmNewContext().
 /// @param[in] aProperty Which property to return. Valid properties are:
 ///            CTM_VERTEX_COUNT, CTM_TRIANGLE_COUNT, CTM_UV_MAP_COUNT,
-///            CTM_ATTRIB_MAP_COUNT, CTM_COMPRESSION_METHOD, CTM_FRAME_COUNT.
+///            CTM_ATTRIB_MAP_COUNT, CTM_COMPRESSION_METHOD, CTM_FRAME_COUNT,
+///            CTM_FRAME_INDEX, CTM_MEMORY_SIZE.
 /// @return An integer value, representing the OpenCTM context property given
 ///         by \c aProperty.
 /// @see CTMenum
@@ -487,13 +541,18 @@ CTMEXPORT CTMenum CTMCALL ctmAddAttribMap(CTMcontext aContext,
 ///             CTM_NORMALS, CTM_UV_MAP_x or CTM_ATTRIB_MAP_x).
 /// @param[in] aSize The number of components of each element (1, 2, 3 or 4).
 /// @param[in] aType The type of each element (CTM_BYTE, CTM_UBYTE, CTM_SHORT,
-///             CTM_UCHORT, CTM_INT, CTM_UINT, CTM_FLOAT or CTM_DOUBLE).
+///             CTM_UCHORT, CTM_INT, CTM_UINT, CTM_FLOAT, CTM_DOUBLE, CTM_HALF,
+///             CTM_SNORM8, CTM_UNORM8, CTM_SNORM16 or CTM_UNORM16).
 /// @param[in] aStride Specifies the byte offset between consecutive elements.
 ///             If the special value zero (0) is given, the elements are
 ///             understood to be tightly packed in the array (e.g. for a packed
 ///             four component CTM_UCHAR array, specifying a stride of zero is
 ///             equal to specifying a stride of 4).
 /// @param[in] aData Pointer to the first element of the array.
+/// @note The CTM_HALF and CTM_xNORMx types can be used for reading vertex data
+///        directly into GPU ready vertex buffers. Normalized values are clamped
+///        to their range ([-1, 1] or [0, 1]) when written, and half floats are
+///        rounded to nearest.
 /// @note When defining an UV map (CTM_UV_MAP_x) or an attribute map
 ///        (CTM_ATTRIB_MAP_x) for an export context, the corresponding map must
 ///        first have been created by a call to ctmAddUVMap() or
@@ -515,6 +574,52 @@ CTMEXPORT void CTMCALL ctmFileComment(CTMcontext aContext,
 /// @param[in] aCount Number of animation frames.
 CTMEXPORT void CTMCALL ctmFrameCount(CTMcontext aContext, CTMuint aCount);
 
+/// Define how often an animation frame is coded independently of the previous
+/// frames (a key frame). Frames that are not key frames are predicted from the
+/// previous frame by the MG2 method (and by the MG1 method with
+/// ctmFramePrediction()), so ctmSeekFrame() has to decode all the frames from
+/// the nearest preceding key frame (which it finds in the frame offset table,
+/// see ctmFrameOffsetTable()).
+/// @param[in] aContext An OpenCTM context that has been created by
+///            ctmNewContext().
+/// @param[in] aInterval Every aInterval:th frame is a key frame (the first
+///            frame is always a key frame). Zero (the default) means that no
+///            other frames are key frames, which gives the best compression.
+/// @note RAW frames are always independent of the previous frames.
+CTMEXPORT void CTMCALL ctmKeyFrameInterval(CTMcontext aContext,
+  CTMuint aInterval);
+
+/// Predict the animation frames from the previous frame (only used by the MG1
+/// compression method). By default, each MG1 frame is stored as is. With
+/// frame prediction, the frames after the first frame (except key frames, see
+/// ctmKeyFrameInterval()) are stored losslessly as the differences to the
+/// previous frame, which usually gives much smaller files for smooth
+/// animations. For imported files, ctmGetBoolean(CTM_FRAME_PREDICTION) tells
+/// whether the last read frame was predicted. Frame prediction is disabled by
+/// default.
+/// @param[in] aContext An OpenCTM context that has been created by
+///            ctmNewContext().
+/// @param[in] aEnable CTM_TRUE to enable frame prediction, or CTM_FALSE to
+///            disable it.
+/// @note Files with frame prediction can not be loaded by older versions of
+///       OpenCTM.
+CTMEXPORT void CTMCALL ctmFramePrediction(CTMcontext aContext,
+  CTMbool aEnable);
+
+/// Write a frame offset table at the end of animated files. The table holds
+/// the stream offset and the key frame of every frame (8 bytes per frame,
+/// plus 12 bytes), so that ctmSeekFrame() can go directly to the nearest
+/// key frame (see ctmKeyFrameInterval()). For imported files,
+/// ctmGetBoolean(CTM_FRAME_OFFSET_TABLE) tells whether a valid table was
+/// found (after ctmSeekFrame()). The table is disabled by default.
+/// @param[in] aContext An OpenCTM context that has been created by
+///            ctmNewContext().
+/// @param[in] aEnable CTM_TRUE to write a frame offset table, or CTM_FALSE
+///            to not write one.
+/// @note Older versions of OpenCTM ignore the table.
+CTMEXPORT void CTMCALL ctmFrameOffsetTable(CTMcontext aContext,
+  CTMbool aEnable);
+
 /// Set which compression method to use for the given OpenCTM context.
 /// The selected compression method will be used when calling the ctmSave()
 /// function.
@@ -537,6 +642,55 @@ CTMEXPORT void CTMCALL ctmCompressionMethod(CTMcontext aContext,
 CTMEXPORT void CTMCALL ctmCompressionLevel(CTMcontext aContext,
   CTMuint aLevel);
 
+/// Set how many threads the LZMA compressor may use for compressing one array.
+/// With two threads, the multi threaded match finder is used (only for
+/// compression levels 1 and higher). Note that the arrays of the MG2 method
+/// are compressed in parallel anyway, and with two threads per array, only
+/// half as many arrays are compressed at a time.
+/// @param[in] aContext An OpenCTM context that has been created by
+///            ctmNewContext().
+/// @param[in] aThreads Number of threads (1 or 2). Zero (the default) means
+///            that two threads are used for large arrays (if the system has
+///            more than one core) that are not compressed in parallel with
+///            other arrays, and one thread otherwise.
+CTMEXPORT void CTMCALL ctmCompressionThreads(CTMcontext aContext,
+  CTMuint aThreads);
+
+/// Set the LZMA dictionary size. A larger dictionary can give better
+/// compression, but requires more memory for compression and decompression.
+/// The dictionary is never made larger than the array that is compressed.
+/// @param[in] aContext An OpenCTM context that has been created by
+///            ctmNewContext().
+/// @param[in] aSize Dictionary size in bytes (4096 to 2^30). Zero (the
+///            default) means that the dictionary size is given by the
+///            compression level.
+/// @see ctmCompressionLevel()
+CTMEXPORT void CTMCALL ctmCompressionDictSize(CTMcontext aContext,
+  CTMuint aSize);
+
+/// Set the number of LZMA fast bytes (the match length at which the encoder
+/// stops looking for longer matches). More fast bytes can give slightly
+/// better compression, but makes the compression slower.
+/// @param[in] aContext An OpenCTM context that has been created by
+///            ctmNewContext().
+/// @param[in] aFastBytes Number of fast bytes (5 to 273). Zero (the default)
+///            means that the number is given by the compression level.
+/// @see ctmCompressionLevel()
+CTMEXPORT void CTMCALL ctmCompressionFastBytes(CTMcontext aContext,
+  CTMuint aFastBytes);
+
+/// Split large arrays into blocks that are compressed independently. The
+/// blocks are compressed in parallel when the file is saved, and uncompressed
+/// in parallel when the file is loaded, at the cost of a slightly larger file.
+/// Note that files with block split arrays can not be loaded by older versions
+/// of OpenCTM.
+/// @param[in] aContext An OpenCTM context that has been created by
+///            ctmNewContext().
+/// @param[in] aSize Block size in bytes (65536 to 2^30) of the uncompressed
+///            data. Zero (the default) means that arrays are not split.
+CTMEXPORT void CTMCALL ctmCompressionBlockSize(CTMcontext aContext,
+  CTMuint aSize);
+
 /// Set the vertex coordinate precision (only used by the MG2 compression
 /// method).
 /// @param[in] aContext An OpenCTM context that has been created by
@@ -561,6 +715,50 @@ CTMEXPORT void CTMCALL ctmVertexPrecision(CTMcontext aContext,
 CTMEXPORT void CTMCALL ctmVertexPrecisionRel(CTMcontext aContext,
   CTMfloat aRelPrecision);
 
+/// Search for the space subdivision grid resolution that gives the smallest
+/// file (only used by the MG2 compression method). By default, the grid
+/// resolution is derived from the number of vertices and the mesh bounding
+/// box. With the grid search enabled, a few finer and coarser grids are
+/// evaluated (on a sample of the mesh, for large meshes) by packing the
+/// vertex, grid index and triangle index data, and the grid that gives the
+/// smallest data is used. This makes compression slower (several times slower
+/// for small meshes), and does not affect the file format. The grid search is
+/// disabled by default.
+/// @param[in] aContext An OpenCTM context that has been created by
+///            ctmNewContext().
+/// @param[in] aEnable CTM_TRUE to enable the grid search, or CTM_FALSE to
+///            disable it.
+CTMEXPORT void CTMCALL ctmGridSearch(CTMcontext aContext, CTMbool aEnable);
+
+/// Predict the vertices from the triangles (only used by the MG2 compression
+/// method). By default, each vertex is stored relative to the origin of its
+/// grid box (and to the previous vertex in the box). With parallelogram
+/// prediction, each vertex is instead predicted from already decoded
+/// neighbouring triangles (the fourth corner of the parallelogram that is
+/// spanned by an adjacent triangle), and only the prediction error is stored
+/// (the vertices are stored in the order in which the triangles are reached
+/// by a traversal across the triangle edges). This usually gives smaller
+/// vertex data for smooth, well connected meshes (but not for point clouds or
+/// meshes with few shared vertices), at the cost of a slower, serial vertex
+/// decoding. The vertices are rounded to the vertex precision in both cases.
+/// For imported files, ctmGetBoolean(CTM_PARALLELOGRAM_PREDICTION) tells which
+/// form was used (after ctmReadMesh()). Parallelogram prediction is disabled
+/// by default.
+/// @param[in] aContext An OpenCTM context that has been created by
+///            ctmNewContext().
+/// @param[in] aEnable CTM_TRUE to enable parallelogram prediction, or
+///            CTM_FALSE to disable it.
+/// @note Files with parallelogram prediction can not be loaded by older
+///       versions of OpenCTM.
+/// @note The vertices of animated meshes are stored on a fixed point lattice
+///       that is given by the first frame. If a vertex of a later frame is
+///       more than 2^26 vertex precision steps away from the bounding box
+///       minimum of the first frame, ctmWriteNextFrame() fails with
+///       CTM_INVALID_MESH.
+/// @see ctmVertexPrecision()
+CTMEXPORT void CTMCALL ctmParallelogramPrediction(CTMcontext aContext,
+  CTMbool aEnable);
+
 /// Set the normal precision (only used by the MG2 compression method). The
 /// normal is represented in spherical coordinates in the MG2 compression
 /// method, and the normal precision controls the angular and radial resolution.
@@ -575,6 +773,25 @@ CTMEXPORT void CTMCALL ctmVertexPrecisionRel(CTMcontext aContext,
 CTMEXPORT void CTMCALL ctmNormalPrecision(CTMcontext aContext,
   CTMfloat aPrecision);
 
+/// Store the normals in octahedral form (only used by the MG2 compression
+/// method). The normal direction is mapped to two coordinates on an octahedron,
+/// which are rounded to the normal precision (the magnitude is stored as
+/// usual). Octahedral normals are not predicted from the mesh (depending on
+/// the mesh, they compress better or worse than the default normals), but
+/// they are decoded without the triangles and without any trigonometry, and
+/// in parallel, which makes loading faster. For imported files,
+/// ctmGetBoolean(CTM_OCTAHEDRAL_NORMALS) tells which form was used (after
+/// ctmReadMesh()). Octahedral normals are disabled by default.
+/// @param[in] aContext An OpenCTM context that has been created by
+///            ctmNewContext().
+/// @param[in] aEnable CTM_TRUE to store octahedral normals, or CTM_FALSE to
+///            store normals relative to the smooth mesh normals.
+/// @note Files with octahedral normals can not be loaded by older versions of
+///       OpenCTM.
+/// @see ctmNormalPrecision()
+CTMEXPORT void CTMCALL ctmOctahedralNormals(CTMcontext aContext,
+  CTMbool aEnable);
+
 /// Set the coordinate precision for the specified UV map (only used by the
 /// MG2 compression method).
 /// @param[in] aContext An OpenCTM context that has been created by
@@ -602,10 +819,42 @@ CTMEXPORT void CTMCALL ctmUVCoordPrecision(CTMcontext aContext,
 CTMEXPORT void CTMCALL ctmAttribPrecision(CTMcontext aContext,
   CTMenum aAttribMap, CTMfloat aPrecision);
 
+/// Enable or disable parallel decoding of independent mesh data (e.g. UV maps
+/// and attribute maps) when reading a mesh. When enabled, the compressed data
+/// of the maps is read into memory up front, and the maps are then
+/// uncompressed by several threads. This reduces the load time for meshes
+/// with many maps, at the cost of more memory. Parallel decoding is disabled
+/// by default.
+/// @param[in] aContext An OpenCTM context that has been created by
+///            ctmNewContext() (import mode).
+/// @param[in] aEnable CTM_TRUE to enable parallel decoding, or CTM_FALSE to
+///            disable it.
+/// @note Without thread support in the library, the maps are still read up
+///       front, but uncompressed one at a time.
+CTMEXPORT void CTMCALL ctmParallelDecode(CTMcontext aContext,
+  CTMbool aEnable);
+
+/// Mark the input as trusted (e.g. files that were written by the application
+/// itself). Normally the mesh data is validated while it is being decoded
+/// (triangle indices must be within range, and all floating point values must
+/// be finite), and ctmReadMesh() fails with CTM_INVALID_MESH for invalid
+/// data. For trusted input, these checks are skipped. The input is not trusted
+/// by default.
+/// @param[in] aContext An OpenCTM context that has been created by
+///            ctmNewContext() (import mode).
+/// @param[in] aTrusted CTM_TRUE if the input is trusted, otherwise CTM_FALSE.
+/// @note Only use this for input that is known to be valid. The MG2 method
+///       always checks the triangle indices, since they are used for
+///       addressing vertex data while decoding.
+CTMEXPORT void CTMCALL ctmTrustedInput(CTMcontext aContext,
+  CTMbool aTrusted);
+
 /// Open an OpenCTM format file for reading, and read the header information.
 /// @param[in] aContext An OpenCTM context that has been created by
 ///            ctmNewContext().
 /// @param[in] aFileName The name of the file to be loaded.
+/// @note On POSIX systems the file is memory mapped (if possible), and the
+///       mesh data is decoded directly from the mapping.
 CTMEXPORT void CTMCALL ctmOpenReadFile(CTMcontext aContext,
   const char * aFileName);
 
@@ -618,10 +867,26 @@ CTMEXPORT void CTMCALL ctmOpenReadFile(CTMcontext aContext,
 ///            handle, C++ istream object, or a custom object pointer
 ///            of any type. The user data pointer will be passed to the
 ///            custom stream read function.
+/// @note The stream is read in large blocks, so the read function may be asked
+///       for more data than what remains of the OpenCTM file (which is fine,
+///       as long as it returns the number of bytes actually read).
 /// @see CTMreadfn.
 CTMEXPORT void CTMCALL ctmOpenReadCustom(CTMcontext aContext,
   CTMreadfn aReadFn, void * aUserData);
 
+/// Open an OpenCTM format file that has been loaded into memory, and read the
+/// header information.
+/// @param[in] aContext An OpenCTM context that has been created by
+///            ctmNewContext().
+/// @param[in] aData Pointer to the first byte of the OpenCTM file data.
+/// @param[in] aSize Size of the OpenCTM file data (in bytes).
+/// @note The data is decoded directly from the given memory, without making a
+///       copy of it, so the memory must stay valid until the mesh has been
+///       read (i.e. until ctmReadMesh() or the last ctmReadNextFrame() call,
+///       or until ctmClose() if ctmSeekFrame() is used).
+CTMEXPORT void CTMCALL ctmOpenReadMemory(CTMcontext aContext,
+  const void * aData, CTMuint aSize);
+
 /// Read the mesh data from an opened file.
 /// @param[in] aContext An OpenCTM context that has been created by
 ///            ctmNewContext().
@@ -632,6 +897,23 @@ CTMEXPORT void CTMCALL ctmReadMesh(CTMcontext aContext);
 ///            ctmNewContext().
 CTMEXPORT void CTMCALL ctmReadNextFrame(CTMcontext aContext);
 
+/// Read any frame in an animated mesh from an opened file. The following
+/// ctmReadNextFrame() call reads the frame after the given frame.
+/// @param[in] aContext An OpenCTM context that has been created by
+///            ctmNewContext().
+/// @param[in] aIndex Index of the frame to read (0 for the first frame, i.e.
+///            the mesh).
+/// @note The mesh must have been read with ctmReadMesh() first.
+/// @note Files that were written with ctmFrameOffsetTable() have a frame
+///       offset table at the end, which is used for going directly to the
+///       nearest key frame (see ctmKeyFrameInterval()). Files without a
+///       table are decoded from the first frame (or from the current frame
+///       when seeking forwards).
+/// @note Seeking backwards requires a file that was opened with
+///       ctmOpenReadFile() or ctmOpenReadMemory() (otherwise the function
+///       fails with CTM_UNSUPPORTED_OPERATION).
+CTMEXPORT void CTMCALL ctmSeekFrame(CTMcontext aContext, CTMuint aIndex);
+
 /// Open an OpenCTM format file for writing, and write the header and mesh
 /// information to it.
 /// @param[in] aContext An OpenCTM context that has been created by
@@ -653,6 +935,30 @@ CTMEXPORT void CTMCALL ctmSaveFile(CTMcontext aContext,
 CTMEXPORT void CTMCALL ctmSaveCustom(CTMcontext aContext,
   CTMwritefn aWriteFn, void * aUserData);
 
+/// Open a memory buffer for writing, and write the header and mesh information
+/// to it. The buffer is managed by the library, and grows as necessary.
+/// @param[in] aContext An OpenCTM context that has been created by
+///            ctmNewContext().
+/// @note The size of the written data is given by ctmGetInteger() with
+///       CTM_MEMORY_SIZE, and the data itself by ctmGetMemoryBuffer(). Both
+///       are only final after the last frame has been written with
+///       ctmWriteNextFrame() (for animated meshes).
+/// @see ctmGetMemoryBuffer().
+CTMEXPORT void CTMCALL ctmSaveMemory(CTMcontext aContext);
+
+/// Get a pointer to the memory buffer that has been written by
+/// ctmSaveMemory() (and ctmWriteNextFrame()).
+/// @param[in] aContext An OpenCTM context that has been created by
+///            ctmNewContext().
+/// @return A pointer to the first byte of the written data.
+/// @note Any further write to the buffer (ctmWriteNextFrame(), or a new call to
+///       ctmSaveMemory()) may move the buffer, and invalidates both the
+///       pointer and the CTM_MEMORY_SIZE value that were read before it. Get
+///       them after the last frame has been written. The pointer is also
+///       invalidated by ctmFreeContext().
+/// @see ctmSaveMemory().
+CTMEXPORT const void * CTMCALL ctmGetMemoryBuffer(CTMcontext aContext);
+
 /// Write the next frame in an animated mesh to an opened file.
 /// @param[in] aContext An OpenCTM context that has been created by
 ///            ctmNewContext().
@@ -665,6 +971,18 @@ CTMEXPORT void CTMCALL ctmSaveCustom(CTMcontext aContext,
 ///            CTM_INVALID_ARGUMENT).
 /// @note The frame time for the first frame (written by ctmSaveFile() or
 ///       ctmSaveCustom()) is always zero (0.0).
+/// @note With the MG2 compression method, each frame is coded as fixed point
+///       deltas to the previous frame, using the vertex precision and the
+///       UV/attribute map precisions of the first frame. The vertices are
+///       coded relative to the grid boxes of the first frame, so a vertex
+///       must stay within 2^31 vertex precision steps of its grid box in the
+///       first frame (or within 2^26 steps of the bounding box minimum of the
+///       first frame with ctmParallelogramPrediction()). Otherwise the
+///       function generates the error CTM_INVALID_MESH.
+/// @note With the MG1 compression method, each frame is coded losslessly,
+///       either as is, or as deltas to the previous frame with
+///       ctmFramePrediction() (such files can not be loaded by older versions
+///       of OpenCTM).
 CTMEXPORT void CTMCALL ctmWriteNextFrame(CTMcontext aContext,
   CTMfloat aFrameTime);
 
@@ -92,6 +92,13 @@ class CTMimporter {
       mContext = ctmNewContext(CTM_IMPORT);
     }
 
+    /// Constructor (with custom memory allocation functions, see
+    /// ctmNewContextEx())
+    CTMimporter(CTMallocfn aAllocFn, CTMfreefn aFreeFn, void * aUserData)
+    {
+      mContext = ctmNewContextEx(CTM_IMPORT, aAllocFn, aFreeFn, aUserData);
+    }
+
     /// Destructor
     ~CTMimporter()
     {
@@ -186,6 +193,20 @@ class CTMimporter {
       CheckError();
     }
 
+    /// Wrapper for ctmParallelDecode()
+    void ParallelDecode(CTMbool aEnable)
+    {
+      ctmParallelDecode(mContext, aEnable);
+      CheckError();
+    }
+
+    /// Wrapper for ctmTrustedInput()
+    void TrustedInput(CTMbool aTrusted)
+    {
+      ctmTrustedInput(mContext, aTrusted);
+      CheckError();
+    }
+
     /// Wrapper for ctmOpenReadFile()
     void OpenReadFile(const char * aFileName)
     {
@@ -200,6 +221,13 @@ class CTMimporter {
       CheckError();
     }
 
+    /// Wrapper for ctmOpenReadMemory()
+    void OpenReadMemory(const void * aData, CTMuint aSize)
+    {
+      ctmOpenReadMemory(mContext, aData, aSize);
+      CheckError();
+    }
+
     /// Wrapper for ctmReadMesh()
     void ReadMesh()
     {
@@ -214,6 +242,13 @@ class CTMimporter {
       CheckError();
     }
 
+    /// Wrapper for ctmSeekFrame()
+    void SeekFrame(CTMuint aIndex)
+    {
+      ctmSeekFrame(mContext, aIndex);
+      CheckError();
+    }
+
     /// Wrapper for ctmClose()
     void Close()
     {
@@ -257,6 +292,13 @@ class CTMexporter {
       mContext = ctmNewContext(CTM_EXPORT);
     }
 
+    /// Constructor (with custom memory allocation functions, see
+    /// ctmNewContextEx())
+    CTMexporter(CTMallocfn aAllocFn, CTMfreefn aFreeFn, void * aUserData)
+    {
+      mContext = ctmNewContextEx(CTM_EXPORT, aAllocFn, aFreeFn, aUserData);
+    }
+
     /// Destructor
     ~CTMexporter()
     {
@@ -315,6 +357,27 @@ class CTMexporter {
       CheckError();
     }
 
+    /// Wrapper for ctmKeyFrameInterval()
+    void KeyFrameInterval(CTMuint aInterval)
+    {
+      ctmKeyFrameInterval(mContext, aInterval);
+      CheckError();
+    }
+
+    /// Wrapper for ctmFramePrediction()
+    void FramePrediction(CTMbool aEnable)
+    {
+      ctmFramePrediction(mContext, aEnable);
+      CheckError();
+    }
+
+    /// Wrapper for ctmFrameOffsetTable()
+    void FrameOffsetTable(CTMbool aEnable)
+    {
+      ctmFrameOffsetTable(mContext, aEnable);
+      CheckError();
+    }
+
     /// Wrapper for ctmCompressionMethod()
     void CompressionMethod(CTMenum aMethod)
     {
@@ -329,6 +392,34 @@ class CTMexporter {
       CheckError();
     }
 
+    /// Wrapper for ctmCompressionThreads()
+    void CompressionThreads(CTMuint aThreads)
+    {
+      ctmCompressionThreads(mContext, aThreads);
+      CheckError();
+    }
+
+    /// Wrapper for ctmCompressionDictSize()
+    void CompressionDictSize(CTMuint aSize)
+    {
+      ctmCompressionDictSize(mContext, aSize);
+      CheckError();
+    }
+
+    /// Wrapper for ctmCompressionFastBytes()
+    void CompressionFastBytes(CTMuint aFastBytes)
+    {
+      ctmCompressionFastBytes(mContext, aFastBytes);
+      CheckError();
+    }
+
+    /// Wrapper for ctmCompressionBlockSize()
+    void CompressionBlockSize(CTMuint aSize)
+    {
+      ctmCompressionBlockSize(mContext, aSize);
+      CheckError();
+    }
+
     /// Wrapper for ctmVertexPrecision()
     void VertexPrecision(CTMfloat aPrecision)
     {
@@ -343,6 +434,20 @@ class CTMexporter {
       CheckError();
     }
 
+    /// Wrapper for ctmGridSearch()
+    void GridSearch(CTMbool aEnable)
+    {
+      ctmGridSearch(mContext, aEnable);
+      CheckError();
+    }
+
+    /// Wrapper for ctmParallelogramPrediction()
+    void ParallelogramPrediction(CTMbool aEnable)
+    {
+      ctmParallelogramPrediction(mContext, aEnable);
+      CheckError();
+    }
+
     /// Wrapper for ctmNormalPrecision()
     void NormalPrecision(CTMfloat aPrecision)
     {
@@ -350,6 +455,13 @@ class CTMexporter {
       CheckError();
     }
 
+    /// Wrapper for ctmOctahedralNormals()
+    void OctahedralNormals(CTMbool aEnable)
+    {
+      ctmOctahedralNormals(mContext, aEnable);
+      CheckError();
+    }
+
     /// Wrapper for ctmUVCoordPrecision()
     void UVCoordPrecision(CTMenum aUVMap, CTMfloat aPrecision)
     {
@@ -378,6 +490,29 @@ class CTMexporter {
       CheckError();
     }
 
+    /// Wrapper for ctmSaveMemory()
+    void SaveMemory()
+    {
+      ctmSaveMemory(mContext);
+      CheckError();
+    }
+
+    /// Wrapper for ctmGetInteger()
+    CTMuint GetInteger(CTMenum aProperty)
+    {
+      CTMuint res = ctmGetInteger(mContext, aProperty);
+      CheckError();
+      return res;
+    }
+
+    /// Wrapper for ctmGetMemoryBuffer()
+    const void * GetMemoryBuffer()
+    {
+      const void * res = ctmGetMemoryBuffer(mContext);
+      CheckError();
+      return res;
+    }
+
     /// Wrapper for ctmWriteNextFrame()
     void WriteNextFrame(CTMfloat aFrameTime)
     {
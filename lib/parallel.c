@@ -0,0 +1,148 @@
+//-----------------------------------------------------------------------------
+// Product:     OpenCTM
+// File:        parallel.c
+// Description: Simple parallel task execution (a worker pool that runs a set
+//              of independent tasks).
+//-----------------------------------------------------------------------------
+// Copyright (c) 2009-2013 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+
+#include "openctm2.h"
+#include "internal.h"
+
+#ifdef _CTM_SUPPORT_MT
+  #include <Threads.h>
+#endif
+
+
+#ifdef _CTM_SUPPORT_MT
+//-----------------------------------------------------------------------------
+// _CTMtaskqueue - Shared state for the workers of a _ctmRunTasks() call.
+//-----------------------------------------------------------------------------
+typedef struct {
+  _CTMtaskfn mFn;         // Task function
+  void * mArg;            // Task function argument
+  CTMuint mCount;         // Number of tasks
+  CTMuint mNext;          // Next task to run
+  CCriticalSection mLock; // Protects mNext
+} _CTMtaskqueue;
+
+//-----------------------------------------------------------------------------
+// _ctmTaskWorker() - Worker thread function: run tasks from the queue until it
+// is empty.
+//-----------------------------------------------------------------------------
+static THREAD_FUNC_DECL _ctmTaskWorker(void * aQueue)
+{
+  _CTMtaskqueue * queue = (_CTMtaskqueue *) aQueue;
+  CTMuint idx;
+
+  while(1)
+  {
+    CriticalSection_Enter(&queue->mLock);
+    idx = queue->mNext;
+    if(idx < queue->mCount)
+      ++ queue->mNext;
+    CriticalSection_Leave(&queue->mLock);
+    if(idx >= queue->mCount)
+      break;
+    queue->mFn(queue->mArg, idx);
+  }
+
+  return 0;
+}
+#endif // _CTM_SUPPORT_MT
+
+//-----------------------------------------------------------------------------
+// _ctmRunTasks() - Run aCount independent tasks, aFn(aArg, 0) ...
+// aFn(aArg, aCount - 1), and wait for all of them to finish. The tasks are
+// distributed over as many threads as the system has cores (the calling thread
+// is one of them). Tasks that are started by a task (a nested call) are run
+// in order by the calling thread, since the outer call already uses all the
+// cores. The same goes if threads are not supported (or can not be created).
+//-----------------------------------------------------------------------------
+void _ctmRunTasks(_CTMcontext * self, CTMuint aCount, _CTMtaskfn aFn,
+  void * aArg)
+{
+#ifdef _CTM_SUPPORT_MT
+  _CTMtaskqueue queue;
+  CThread threads[_CTM_MAX_THREADS];
+  CTMuint i, threadCount;
+#endif
+  CTMuint idx;
+
+#ifndef _CTM_SUPPORT_MT
+  DUMMYUSE(self);
+#else
+  // How many threads should we use? If the LZMA compressor has been told to
+  // use several threads for each array, fewer tasks are run in parallel, so
+  // that the total number of threads does not exceed the number of cores.
+  threadCount = Thread_HardwareConcurrency();
+  if(self->mLzmaThreads > 1)
+    threadCount /= self->mLzmaThreads;
+  if(threadCount > aCount)
+    threadCount = aCount;
+  if(threadCount > _CTM_MAX_THREADS)
+    threadCount = _CTM_MAX_THREADS;
+
+  // Only the outermost call runs tasks in parallel (mTaskThreads is set
+  // before the worker threads are started, and cleared after they have
+  // finished, so the nested calls in the workers can read it safely)
+  if((threadCount > 1) && (self->mTaskThreads == 0))
+  {
+    queue.mFn = aFn;
+    queue.mArg = aArg;
+    queue.mCount = aCount;
+    queue.mNext = 0;
+    if(CriticalSection_Init(&queue.mLock) == 0)
+    {
+      // Start the worker threads (the calling thread is the first worker)
+      self->mTaskThreads = threadCount;
+      for(i = 1; i < threadCount; ++ i)
+      {
+        Thread_Construct(&threads[i]);
+        Thread_Create(&threads[i], _ctmTaskWorker, (void *) &queue);
+      }
+      _ctmTaskWorker((void *) &queue);
+
+      // Wait for all the workers to finish
+      for(i = 1; i < threadCount; ++ i)
+      {
+        if(Thread_WasCreated(&threads[i]))
+        {
+          Thread_Wait(&threads[i]);
+#ifdef _USE_WIN32_THREADS
+          // (POSIX threads are released by the join)
+          Thread_Close(&threads[i]);
+#endif
+        }
+      }
+      self->mTaskThreads = 0;
+      CriticalSection_Delete(&queue.mLock);
+      return;
+    }
+  }
+#endif
+
+  // Run the tasks serially
+  for(idx = 0; idx < aCount; ++ idx)
+    aFn(aArg, idx);
+}
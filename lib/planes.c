@@ -0,0 +1,503 @@
+//-----------------------------------------------------------------------------
+// Product:     OpenCTM
+// File:        planes.c
+// Description: Byte plane interleaving and de-interleaving of packed arrays,
+//              with SIMD optimized versions that are selected at run time.
+//-----------------------------------------------------------------------------
+// Copyright (c) 2009-2013 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+
+#include "openctm2.h"
+#include "internal.h"
+
+//-----------------------------------------------------------------------------
+// Determine which SIMD instruction sets we can build code for.
+//-----------------------------------------------------------------------------
+#ifdef _CTM_SUPPORT_SIMD
+  #if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define _CTM_SIMD_SSE2
+    #if defined(__clang__) || (__GNUC__ > 4) || \
+        ((__GNUC__ == 4) && (__GNUC_MINOR__ >= 9))
+      #define _CTM_SIMD_AVX2
+    #endif
+    #define _CTM_TARGET(x) __attribute__((target(x)))
+  #elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    #define _CTM_SIMD_SSE2
+    #if _MSC_VER >= 1800
+      #define _CTM_SIMD_AVX2
+    #endif
+    #define _CTM_TARGET(x)
+    #include <intrin.h>
+  #elif (defined(__ARM_NEON) || defined(__ARM_NEON__)) && !defined(__ARM_BIG_ENDIAN)
+    #define _CTM_SIMD_NEON
+  #endif
+#endif
+
+#if defined(_CTM_SIMD_SSE2)
+  #include <emmintrin.h>
+#endif
+#if defined(_CTM_SIMD_AVX2)
+  #include <immintrin.h>
+#endif
+#if defined(_CTM_SIMD_NEON)
+  #include <arm_neon.h>
+#endif
+
+
+//-----------------------------------------------------------------------------
+// Signed magnitude ("zigzag") conversion macros. Small negative and positive
+// values are mapped to small unsigned values (0, -1, 1, -2, 2, ... becomes
+// 0, 1, 2, 3, 4, ...).
+//-----------------------------------------------------------------------------
+#define _CTM_ZIGZAG_ENC(x) (((x) << 1) ^ (0U - ((x) >> 31)))
+#define _CTM_ZIGZAG_DEC(x) (((x) >> 1) ^ (0U - ((x) & 1)))
+
+
+//-----------------------------------------------------------------------------
+// _ctmSplitBytePlanes_C() - Reference implementation of
+// _ctmSplitBytePlanes().
+//-----------------------------------------------------------------------------
+void _ctmSplitBytePlanes_C(const CTMuint * aSrc, CTMuint aCount,
+  CTMubyte * aDst, CTMuint aPlaneSize, CTMint aSignedInts)
+{
+  CTMuint i, x;
+
+  for(i = 0; i < aCount; ++ i)
+  {
+    x = aSrc[i];
+    if(aSignedInts)
+      x = _CTM_ZIGZAG_ENC(x);
+    aDst[i] = (CTMubyte) (x >> 24);
+    aDst[i + aPlaneSize] = (CTMubyte) (x >> 16);
+    aDst[i + 2 * aPlaneSize] = (CTMubyte) (x >> 8);
+    aDst[i + 3 * aPlaneSize] = (CTMubyte) x;
+  }
+}
+
+//-----------------------------------------------------------------------------
+// _ctmMergeBytePlane_C() - Reference implementation of _ctmMergeBytePlane().
+//-----------------------------------------------------------------------------
+void _ctmMergeBytePlane_C(CTMuint * aDst, CTMuint aStride,
+  const CTMubyte * aSrc, CTMuint aCount, CTMuint aShift, CTMint aSignedInts)
+{
+  CTMuint i, x;
+
+  if(aShift == 24)
+  {
+    for(i = 0; i < aCount; ++ i)
+      aDst[i * aStride] = ((CTMuint) aSrc[i]) << 24;
+  }
+  else if(aShift > 0 || !aSignedInts)
+  {
+    for(i = 0; i < aCount; ++ i)
+      aDst[i * aStride] |= ((CTMuint) aSrc[i]) << aShift;
+  }
+  else
+  {
+    for(i = 0; i < aCount; ++ i)
+    {
+      x = aDst[i * aStride] | (CTMuint) aSrc[i];
+      aDst[i * aStride] = _CTM_ZIGZAG_DEC(x);
+    }
+  }
+}
+
+
+#ifdef _CTM_SIMD_SSE2
+//-----------------------------------------------------------------------------
+// SSE2 implementations.
+//-----------------------------------------------------------------------------
+
+_CTM_TARGET("sse2")
+static void _ctmSplitBytePlanes_SSE2(const CTMuint * aSrc, CTMuint aCount,
+  CTMubyte * aDst, CTMuint aPlaneSize, CTMint aSignedInts)
+{
+  __m128i v[4], t[4], mask = _mm_set1_epi32(0xff);
+  CTMuint i, j, p;
+
+  for(i = 0; i + 16 <= aCount; i += 16)
+  {
+    for(j = 0; j < 4; ++ j)
+    {
+      v[j] = _mm_loadu_si128((const __m128i *) &aSrc[i + j * 4]);
+      if(aSignedInts)
+        v[j] = _mm_xor_si128(_mm_slli_epi32(v[j], 1), _mm_srai_epi32(v[j], 31));
+    }
+
+    // Plane p holds bits 24-8p..31-8p of each word (plane 0 = MSB)
+    for(p = 0; p < 4; ++ p)
+    {
+      for(j = 0; j < 4; ++ j)
+        t[j] = _mm_and_si128(_mm_srl_epi32(v[j], _mm_cvtsi32_si128(24 - 8 * p)), mask);
+      _mm_storeu_si128((__m128i *) &aDst[i + p * aPlaneSize],
+        _mm_packus_epi16(_mm_packs_epi32(t[0], t[1]), _mm_packs_epi32(t[2], t[3])));
+    }
+  }
+
+  // Handle the tail
+  if(i < aCount)
+    _ctmSplitBytePlanes_C(&aSrc[i], aCount - i, &aDst[i], aPlaneSize, aSignedInts);
+}
+
+_CTM_TARGET("sse2")
+static void _ctmMergeBytePlane_SSE2(CTMuint * aDst, CTMuint aStride,
+  const CTMubyte * aSrc, CTMuint aCount, CTMuint aShift, CTMint aSignedInts)
+{
+  __m128i b, w[4], zero = _mm_setzero_si128(), one = _mm_set1_epi32(1);
+  __m128i shift = _mm_cvtsi32_si128((int) aShift);
+  CTMuint i, j;
+
+  // Only contiguous destinations are vectorized
+  if(aStride != 1)
+  {
+    _ctmMergeBytePlane_C(aDst, aStride, aSrc, aCount, aShift, aSignedInts);
+    return;
+  }
+
+  for(i = 0; i + 16 <= aCount; i += 16)
+  {
+    // Expand 16 bytes to 16 words
+    b = _mm_loadu_si128((const __m128i *) &aSrc[i]);
+    w[0] = _mm_unpacklo_epi8(b, zero);
+    w[2] = _mm_unpackhi_epi8(b, zero);
+    w[1] = _mm_unpackhi_epi16(w[0], zero);
+    w[0] = _mm_unpacklo_epi16(w[0], zero);
+    w[3] = _mm_unpackhi_epi16(w[2], zero);
+    w[2] = _mm_unpacklo_epi16(w[2], zero);
+
+    for(j = 0; j < 4; ++ j)
+    {
+      w[j] = _mm_sll_epi32(w[j], shift);
+      if(aShift != 24)
+        w[j] = _mm_or_si128(w[j], _mm_loadu_si128((const __m128i *) &aDst[i + j * 4]));
+      if((aShift == 0) && aSignedInts)
+        w[j] = _mm_xor_si128(_mm_srli_epi32(w[j], 1),
+                             _mm_sub_epi32(zero, _mm_and_si128(w[j], one)));
+      _mm_storeu_si128((__m128i *) &aDst[i + j * 4], w[j]);
+    }
+  }
+
+  // Handle the tail
+  if(i < aCount)
+    _ctmMergeBytePlane_C(&aDst[i], 1, &aSrc[i], aCount - i, aShift, aSignedInts);
+}
+#endif // _CTM_SIMD_SSE2
+
+
+#ifdef _CTM_SIMD_AVX2
+//-----------------------------------------------------------------------------
+// AVX2 implementations.
+//-----------------------------------------------------------------------------
+
+_CTM_TARGET("avx2")
+static void _ctmSplitBytePlanes_AVX2(const CTMuint * aSrc, CTMuint aCount,
+  CTMubyte * aDst, CTMuint aPlaneSize, CTMint aSignedInts)
+{
+  __m256i v[4], t[4], mask = _mm256_set1_epi32(0xff);
+  __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+  CTMuint i, j, p;
+
+  for(i = 0; i + 32 <= aCount; i += 32)
+  {
+    for(j = 0; j < 4; ++ j)
+    {
+      v[j] = _mm256_loadu_si256((const __m256i *) &aSrc[i + j * 8]);
+      if(aSignedInts)
+        v[j] = _mm256_xor_si256(_mm256_slli_epi32(v[j], 1), _mm256_srai_epi32(v[j], 31));
+    }
+
+    // The pack instructions work within 128-bit lanes, so the 32-bit groups
+    // of the result have to be put back in order
+    for(p = 0; p < 4; ++ p)
+    {
+      for(j = 0; j < 4; ++ j)
+        t[j] = _mm256_and_si256(_mm256_srl_epi32(v[j], _mm_cvtsi32_si128(24 - 8 * p)), mask);
+      _mm256_storeu_si256((__m256i *) &aDst[i + p * aPlaneSize],
+        _mm256_permutevar8x32_epi32(
+          _mm256_packus_epi16(_mm256_packs_epi32(t[0], t[1]),
+                              _mm256_packs_epi32(t[2], t[3])), order));
+    }
+  }
+
+  // Handle the tail
+  if(i < aCount)
+    _ctmSplitBytePlanes_C(&aSrc[i], aCount - i, &aDst[i], aPlaneSize, aSignedInts);
+}
+
+_CTM_TARGET("avx2")
+static void _ctmMergeBytePlane_AVX2(CTMuint * aDst, CTMuint aStride,
+  const CTMubyte * aSrc, CTMuint aCount, CTMuint aShift, CTMint aSignedInts)
+{
+  __m256i w, zero = _mm256_setzero_si256(), one = _mm256_set1_epi32(1);
+  __m128i shift = _mm_cvtsi32_si128((int) aShift);
+  CTMuint i;
+
+  // Only contiguous destinations are vectorized
+  if(aStride != 1)
+  {
+    _ctmMergeBytePlane_C(aDst, aStride, aSrc, aCount, aShift, aSignedInts);
+    return;
+  }
+
+  for(i = 0; i + 8 <= aCount; i += 8)
+  {
+    w = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) &aSrc[i]));
+    w = _mm256_sll_epi32(w, shift);
+    if(aShift != 24)
+      w = _mm256_or_si256(w, _mm256_loadu_si256((const __m256i *) &aDst[i]));
+    if((aShift == 0) && aSignedInts)
+      w = _mm256_xor_si256(_mm256_srli_epi32(w, 1),
+                           _mm256_sub_epi32(zero, _mm256_and_si256(w, one)));
+    _mm256_storeu_si256((__m256i *) &aDst[i], w);
+  }
+
+  // Handle the tail
+  if(i < aCount)
+    _ctmMergeBytePlane_C(&aDst[i], 1, &aSrc[i], aCount - i, aShift, aSignedInts);
+}
+#endif // _CTM_SIMD_AVX2
+
+
+#ifdef _CTM_SIMD_NEON
+//-----------------------------------------------------------------------------
+// NEON implementations.
+//-----------------------------------------------------------------------------
+
+static void _ctmSplitBytePlanes_NEON(const CTMuint * aSrc, CTMuint aCount,
+  CTMubyte * aDst, CTMuint aPlaneSize, CTMint aSignedInts)
+{
+  uint32x4_t v[4];
+  uint8x16x2_t lo, hi, p02, p13;
+  CTMuint i, j;
+
+  for(i = 0; i + 16 <= aCount; i += 16)
+  {
+    for(j = 0; j < 4; ++ j)
+    {
+      v[j] = vld1q_u32(&aSrc[i + j * 4]);
+      if(aSignedInts)
+        v[j] = veorq_u32(vshlq_n_u32(v[j], 1),
+          vreinterpretq_u32_s32(vshrq_n_s32(vreinterpretq_s32_u32(v[j]), 31)));
+    }
+
+    // Two rounds of unzipping separates the four bytes of each word
+    lo = vuzpq_u8(vreinterpretq_u8_u32(v[0]), vreinterpretq_u8_u32(v[1]));
+    hi = vuzpq_u8(vreinterpretq_u8_u32(v[2]), vreinterpretq_u8_u32(v[3]));
+    p02 = vuzpq_u8(lo.val[0], hi.val[0]);
+    p13 = vuzpq_u8(lo.val[1], hi.val[1]);
+    vst1q_u8(&aDst[i], p13.val[1]);
+    vst1q_u8(&aDst[i + aPlaneSize], p02.val[1]);
+    vst1q_u8(&aDst[i + 2 * aPlaneSize], p13.val[0]);
+    vst1q_u8(&aDst[i + 3 * aPlaneSize], p02.val[0]);
+  }
+
+  // Handle the tail
+  if(i < aCount)
+    _ctmSplitBytePlanes_C(&aSrc[i], aCount - i, &aDst[i], aPlaneSize, aSignedInts);
+}
+
+static void _ctmMergeBytePlane_NEON(CTMuint * aDst, CTMuint aStride,
+  const CTMubyte * aSrc, CTMuint aCount, CTMuint aShift, CTMint aSignedInts)
+{
+  uint8x16_t b;
+  uint16x8_t h[2];
+  uint32x4_t w[4], one = vdupq_n_u32(1);
+  int32x4_t shift = vdupq_n_s32((int32_t) aShift);
+  CTMuint i, j;
+
+  // Only contiguous destinations are vectorized
+  if(aStride != 1)
+  {
+    _ctmMergeBytePlane_C(aDst, aStride, aSrc, aCount, aShift, aSignedInts);
+    return;
+  }
+
+  for(i = 0; i + 16 <= aCount; i += 16)
+  {
+    // Expand 16 bytes to 16 words
+    b = vld1q_u8(&aSrc[i]);
+    h[0] = vmovl_u8(vget_low_u8(b));
+    h[1] = vmovl_u8(vget_high_u8(b));
+    w[0] = vmovl_u16(vget_low_u16(h[0]));
+    w[1] = vmovl_u16(vget_high_u16(h[0]));
+    w[2] = vmovl_u16(vget_low_u16(h[1]));
+    w[3] = vmovl_u16(vget_high_u16(h[1]));
+
+    for(j = 0; j < 4; ++ j)
+    {
+      w[j] = vshlq_u32(w[j], shift);
+      if(aShift != 24)
+        w[j] = vorrq_u32(w[j], vld1q_u32(&aDst[i + j * 4]));
+      if((aShift == 0) && aSignedInts)
+        w[j] = veorq_u32(vshrq_n_u32(w[j], 1),
+          vreinterpretq_u32_s32(vnegq_s32(vreinterpretq_s32_u32(vandq_u32(w[j], one)))));
+      vst1q_u32(&aDst[i + j * 4], w[j]);
+    }
+  }
+
+  // Handle the tail
+  if(i < aCount)
+    _ctmMergeBytePlane_C(&aDst[i], 1, &aSrc[i], aCount - i, aShift, aSignedInts);
+}
+#endif // _CTM_SIMD_NEON
+
+
+//-----------------------------------------------------------------------------
+// Run time selection of the best implementation for this CPU.
+//-----------------------------------------------------------------------------
+
+static _CTMsplitfn _ctmSplitFn = (_CTMsplitfn) 0;
+static _CTMmergefn _ctmMergeFn = (_CTMmergefn) 0;
+
+#if defined(_CTM_SIMD_SSE2) || defined(_CTM_SIMD_AVX2)
+//-----------------------------------------------------------------------------
+// _ctmCPUHas() - Check if the CPU supports SSE2 (aLevel = 1) or AVX2
+// (aLevel = 2).
+//-----------------------------------------------------------------------------
+static int _ctmCPUHas(int aLevel)
+{
+#if defined(__GNUC__)
+  __builtin_cpu_init();
+  if(aLevel == 2)
+    return __builtin_cpu_supports("avx2");
+  return __builtin_cpu_supports("sse2");
+#else
+  int info[4];
+  __cpuid(info, 0);
+  if(info[0] < (aLevel == 2 ? 7 : 1))
+    return 0;
+  __cpuid(info, 1);
+  if(aLevel == 1)
+    return (info[3] >> 26) & 1;
+  // AVX2 requires OS support for the YMM registers (OSXSAVE + XCR0)
+  if(!((info[2] >> 27) & 1) || ((_xgetbv(0) & 6) != 6))
+    return 0;
+  __cpuidex(info, 7, 0);
+  return (info[1] >> 5) & 1;
+#endif
+}
+#endif
+
+//-----------------------------------------------------------------------------
+// _ctmSelectPlaneFunctions() - Select the implementations to use.
+//-----------------------------------------------------------------------------
+static void _ctmSelectPlaneFunctions(void)
+{
+  _CTMsplitfn splitFn = _ctmSplitBytePlanes_C;
+  _CTMmergefn mergeFn = _ctmMergeBytePlane_C;
+
+#if defined(_CTM_SIMD_AVX2)
+  if(_ctmCPUHas(2))
+  {
+    splitFn = _ctmSplitBytePlanes_AVX2;
+    mergeFn = _ctmMergeBytePlane_AVX2;
+  }
+  else
+#endif
+#if defined(_CTM_SIMD_SSE2)
+  if(_ctmCPUHas(1))
+  {
+    splitFn = _ctmSplitBytePlanes_SSE2;
+    mergeFn = _ctmMergeBytePlane_SSE2;
+  }
+#endif
+#if defined(_CTM_SIMD_NEON)
+  splitFn = _ctmSplitBytePlanes_NEON;
+  mergeFn = _ctmMergeBytePlane_NEON;
+#endif
+
+  // Selecting the same functions from several threads at once is harmless
+  _ctmMergeFn = mergeFn;
+  _ctmSplitFn = splitFn;
+}
+
+//-----------------------------------------------------------------------------
+// _ctmSplitBytePlanes() - Split aCount words into four byte planes, with the
+// most significant bytes first: byte 3 of aSrc[i] is stored in aDst[i], byte 2
+// in aDst[i + aPlaneSize], and so on. If aSignedInts is true, the words are
+// converted from two's complement to signed magnitude form first.
+//-----------------------------------------------------------------------------
+void _ctmSplitBytePlanes(const CTMuint * aSrc, CTMuint aCount,
+  CTMubyte * aDst, CTMuint aPlaneSize, CTMint aSignedInts)
+{
+  if(UNLIKELY(!_ctmSplitFn))
+    _ctmSelectPlaneFunctions();
+  _ctmSplitFn(aSrc, aCount, aDst, aPlaneSize, aSignedInts);
+}
+
+//-----------------------------------------------------------------------------
+// _ctmMergeBytePlane() - Merge one byte plane into aCount words, located
+// aStride words apart. The bytes are shifted left by aShift bits (24 for the
+// first, most significant, plane, which also initializes the words, then 16,
+// 8 and 0). If aSignedInts is true, the words are converted from signed
+// magnitude form to two's complement when the last plane is merged.
+//-----------------------------------------------------------------------------
+void _ctmMergeBytePlane(CTMuint * aDst, CTMuint aStride,
+  const CTMubyte * aSrc, CTMuint aCount, CTMuint aShift, CTMint aSignedInts)
+{
+  if(UNLIKELY(!_ctmMergeFn))
+    _ctmSelectPlaneFunctions();
+  _ctmMergeFn(aDst, aStride, aSrc, aCount, aShift, aSignedInts);
+}
+
+//-----------------------------------------------------------------------------
+// _ctmGetPlaneFunctions() - Get all the byte plane implementations that are
+// built in and supported by this CPU, with the C reference implementation
+// first (aFns must have room for _CTM_MAX_PLANE_FNS entries). Returns the
+// number of implementations. This is used for testing the SIMD
+// implementations against the reference implementation.
+//-----------------------------------------------------------------------------
+CTMuint _ctmGetPlaneFunctions(_CTMplanefns * aFns)
+{
+  CTMuint count = 0;
+
+  aFns[count].mName = "C";
+  aFns[count].mSplit = _ctmSplitBytePlanes_C;
+  aFns[count].mMerge = _ctmMergeBytePlane_C;
+  ++ count;
+#if defined(_CTM_SIMD_SSE2)
+  if(_ctmCPUHas(1))
+  {
+    aFns[count].mName = "SSE2";
+    aFns[count].mSplit = _ctmSplitBytePlanes_SSE2;
+    aFns[count].mMerge = _ctmMergeBytePlane_SSE2;
+    ++ count;
+  }
+#endif
+#if defined(_CTM_SIMD_AVX2)
+  if(_ctmCPUHas(2))
+  {
+    aFns[count].mName = "AVX2";
+    aFns[count].mSplit = _ctmSplitBytePlanes_AVX2;
+    aFns[count].mMerge = _ctmMergeBytePlane_AVX2;
+    ++ count;
+  }
+#endif
+#if defined(_CTM_SIMD_NEON)
+  aFns[count].mName = "NEON";
+  aFns[count].mSplit = _ctmSplitBytePlanes_NEON;
+  aFns[count].mMerge = _ctmMergeBytePlane_NEON;
+  ++ count;
+#endif
+
+  return count;
+}
@@ -0,0 +1,189 @@
+//-----------------------------------------------------------------------------
+// Product:     OpenCTM
+// File:        scratch.c
+// Description: Memory allocation (the memory allocation functions of the
+//              context, and the scratch memory arena, which is reusable
+//              temporary memory for the codecs).
+//-----------------------------------------------------------------------------
+// Copyright (c) 2009-2013 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+
+
+#include <stdlib.h>
+#include "openctm2.h"
+#include "internal.h"
+
+// Alignment of scratch memory allocations (in bytes)
+#define _CTM_SCRATCH_ALIGN 16
+
+// Allocation flags
+#define _CTM_SCRATCH_OVERFLOW 1 // Allocated with _ctmAlloc() (did not fit)
+#define _CTM_SCRATCH_FREED    2 // Freed, but not yet popped from the arena
+
+//-----------------------------------------------------------------------------
+// _CTMscratchhdr - Header in front of every scratch memory allocation.
+//-----------------------------------------------------------------------------
+typedef struct {
+  size_t mSize;   // Size of the allocation (including the header)
+  size_t mPrev;   // Arena offset of the previous allocation
+  CTMuint mFlags; // Allocation flags
+} _CTMscratchhdr;
+
+// Size of the allocation header (rounded up to the allocation alignment)
+#define _CTM_SCRATCH_HDR_SIZE ((sizeof(_CTMscratchhdr) + \
+  _CTM_SCRATCH_ALIGN - 1) & ~((size_t) _CTM_SCRATCH_ALIGN - 1))
+
+//-----------------------------------------------------------------------------
+// _ctmAlloc() - Allocate memory with the memory allocation function of the
+// context (see ctmNewContextEx()).
+//-----------------------------------------------------------------------------
+void * _ctmAlloc(_CTMcontext * self, size_t aSize)
+{
+  return self->mAllocFn(aSize, self->mAllocUserData);
+}
+
+//-----------------------------------------------------------------------------
+// _ctmFree() - Free memory that has been allocated by _ctmAlloc() (aPtr may be
+// nil).
+//-----------------------------------------------------------------------------
+void _ctmFree(_CTMcontext * self, void * aPtr)
+{
+  if(aPtr)
+    self->mFreeFn(aPtr, self->mAllocUserData);
+}
+
+//-----------------------------------------------------------------------------
+// _ctmScratchAlloc() - Allocate temporary memory from the scratch arena of
+// the context (works like malloc()). If the allocation does not fit in the
+// arena, it is allocated with _ctmAlloc() instead, and the arena is grown by
+// the next _ctmScratchReset() call. The scratch memory is not thread safe, so
+// it must only be used by the calling thread (not by tasks, see
+// _ctmRunTasks()).
+//-----------------------------------------------------------------------------
+void * _ctmScratchAlloc(_CTMcontext * self, size_t aSize)
+{
+  _CTMscratch * s = &self->mScratch;
+  _CTMscratchhdr * hdr;
+  size_t size;
+
+  // Total size of the allocation (header + aligned data)
+  size = (aSize + _CTM_SCRATCH_ALIGN - 1) & ~((size_t) _CTM_SCRATCH_ALIGN - 1);
+  if(size < aSize)
+    return (void *) 0;
+  size += _CTM_SCRATCH_HDR_SIZE;
+  if(size < _CTM_SCRATCH_HDR_SIZE)
+    return (void *) 0;
+
+  if(s->mBase && (size <= s->mSize - s->mTop))
+  {
+    // Allocate from the top of the arena
+    hdr = (_CTMscratchhdr *) &s->mBase[s->mTop];
+    hdr->mPrev = s->mLast;
+    hdr->mFlags = 0;
+    s->mLast = s->mTop;
+    s->mTop += size;
+  }
+  else
+  {
+    // The arena is full
+    hdr = (_CTMscratchhdr *) _ctmAlloc(self, size);
+    if(!hdr)
+      return (void *) 0;
+    hdr->mFlags = _CTM_SCRATCH_OVERFLOW;
+  }
+  hdr->mSize = size;
+
+  // Keep track of the high water mark
+  s->mInUse += size;
+  if(s->mInUse > s->mPeak)
+    s->mPeak = s->mInUse;
+
+  return (void *) (((CTMubyte *) hdr) + _CTM_SCRATCH_HDR_SIZE);
+}
+
+//-----------------------------------------------------------------------------
+// _ctmScratchFree() - Free memory that has been allocated by
+// _ctmScratchAlloc() (works like free()). Arena memory is reused as soon as
+// all the allocations above it have been freed too.
+//-----------------------------------------------------------------------------
+void _ctmScratchFree(_CTMcontext * self, void * aPtr)
+{
+  _CTMscratch * s = &self->mScratch;
+  _CTMscratchhdr * hdr;
+
+  if(!aPtr)
+    return;
+
+  hdr = (_CTMscratchhdr *) (((CTMubyte *) aPtr) - _CTM_SCRATCH_HDR_SIZE);
+  s->mInUse -= hdr->mSize;
+  if(hdr->mFlags & _CTM_SCRATCH_OVERFLOW)
+  {
+    _ctmFree(self, (void *) hdr);
+    return;
+  }
+  hdr->mFlags |= _CTM_SCRATCH_FREED;
+
+  // Pop all the freed allocations from the top of the arena
+  while(s->mTop > 0)
+  {
+    hdr = (_CTMscratchhdr *) &s->mBase[s->mLast];
+    if(!(hdr->mFlags & _CTM_SCRATCH_FREED))
+      break;
+    s->mTop = s->mLast;
+    s->mLast = hdr->mPrev;
+  }
+}
+
+//-----------------------------------------------------------------------------
+// _ctmScratchReset() - Prepare the scratch arena for the next operation (this
+// is called when an operation is done with its scratch memory). If the last
+// operations needed more memory than the arena holds, the arena is grown to
+// the high water mark, so that the next operations fit in the arena.
+//-----------------------------------------------------------------------------
+void _ctmScratchReset(_CTMcontext * self)
+{
+  _CTMscratch * s = &self->mScratch;
+
+  if((s->mPeak > s->mSize) && (s->mTop == 0))
+  {
+    if(s->mBase)
+      _ctmFree(self, (void *) s->mBase);
+    s->mBase = (CTMubyte *) _ctmAlloc(self, s->mPeak);
+    s->mSize = s->mBase ? s->mPeak : 0;
+  }
+  s->mPeak = s->mInUse;
+}
+
+//-----------------------------------------------------------------------------
+// _ctmScratchRelease() - Free the scratch arena.
+//-----------------------------------------------------------------------------
+void _ctmScratchRelease(_CTMcontext * self)
+{
+  _CTMscratch * s = &self->mScratch;
+
+  if(s->mBase)
+    _ctmFree(self, (void *) s->mBase);
+  s->mBase = (CTMubyte *) 0;
+  s->mSize = 0;
+  s->mTop = 0;
+  s->mPeak = s->mInUse;
+}
@@ -0,0 +1,251 @@
+//-----------------------------------------------------------------------------
+// Product:     OpenCTM
+// File:        sort.c
+// Description: Stable radix sort (used for ordering vertices and triangles).
+//-----------------------------------------------------------------------------
+// Copyright (c) 2009-2013 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+
+#include <stdlib.h>
+#include <string.h>
+#include "openctm2.h"
+#include "internal.h"
+
+#ifdef _CTM_SUPPORT_SAVE
+
+// Number of elements per chunk (each chunk is counted and scattered by one
+// task, so this is the unit of parallelism)
+#define _CTM_SORT_CHUNK_SIZE 65536
+
+// Maximum number of chunks
+#define _CTM_SORT_MAX_CHUNKS 64
+
+
+//-----------------------------------------------------------------------------
+// _CTMradixpass - State for one pass (one 8-bit digit) of the radix sort.
+//-----------------------------------------------------------------------------
+typedef struct {
+  const CTMuint * mSrc;   // Source elements
+  CTMuint * mDst;         // Destination elements
+  CTMuint mCount;         // Number of elements
+  CTMuint mSize;          // Number of words per element
+  CTMuint mKey;           // Index of the key word within an element
+  CTMuint mShift;         // Bit position of the digit within the key word
+  CTMuint mChunkSize;     // Number of elements per chunk
+  CTMuint * mHist;        // Digit histograms / offsets (256 per chunk)
+} _CTMradixpass;
+
+//-----------------------------------------------------------------------------
+// _ctmRadixCountTask() - Count the digits of one chunk.
+//-----------------------------------------------------------------------------
+static void _ctmRadixCountTask(void * aArg, CTMuint aChunk)
+{
+  _CTMradixpass * pass = (_CTMradixpass *) aArg;
+  const CTMuint * key;
+  CTMuint * hist = &pass->mHist[aChunk * 256];
+  CTMuint i, first, last;
+
+  first = aChunk * pass->mChunkSize;
+  last = first + pass->mChunkSize;
+  if(last > pass->mCount)
+    last = pass->mCount;
+
+  memset(hist, 0, 256 * sizeof(CTMuint));
+  key = &pass->mSrc[first * pass->mSize + pass->mKey];
+  for(i = first; i < last; ++ i)
+  {
+    ++ hist[(*key >> pass->mShift) & 255];
+    key += pass->mSize;
+  }
+}
+
+//-----------------------------------------------------------------------------
+// _ctmRadixScatterTask() - Move the elements of one chunk to their positions
+// in the destination array.
+//-----------------------------------------------------------------------------
+static void _ctmRadixScatterTask(void * aArg, CTMuint aChunk)
+{
+  _CTMradixpass * pass = (_CTMradixpass *) aArg;
+  const CTMuint * src;
+  CTMuint * dst, * offset = &pass->mHist[aChunk * 256];
+  CTMuint i, k, first, last, size = pass->mSize;
+
+  first = aChunk * pass->mChunkSize;
+  last = first + pass->mChunkSize;
+  if(last > pass->mCount)
+    last = pass->mCount;
+
+  src = &pass->mSrc[first * size];
+  for(i = first; i < last; ++ i)
+  {
+    dst = &pass->mDst[(offset[(src[pass->mKey] >> pass->mShift) & 255] ++) * size];
+    for(k = 0; k < size; ++ k)
+      dst[k] = src[k];
+    src += size;
+  }
+}
+
+//-----------------------------------------------------------------------------
+// _ctmRadixSortPasses() - Run all the passes of the radix sort (aPass must be
+// set up with the source/temporary arrays and the histograms). The chunks are
+// processed in parallel, unless self is nil (then aChunkCount must be 1).
+// Returns the array that holds the sorted elements (the source array or the
+// temporary array).
+//-----------------------------------------------------------------------------
+static CTMuint * _ctmRadixSortPasses(_CTMcontext * self, _CTMradixpass * aPass,
+  CTMuint aChunkCount, CTMuint aMajorKey, CTMuint aMinorKey)
+{
+  CTMuint * swap, * hist = aPass->mHist;
+  CTMuint i, c, d, sum, first, count, digitCount;
+
+  // Sort by one 8-bit digit at a time, starting with the least significant
+  // digit of the minor key
+  for(i = 0; i < 8; ++ i)
+  {
+    aPass->mKey = (i < 4) ? aMinorKey : aMajorKey;
+    aPass->mShift = (i & 3) * 8;
+
+    // Count the digits of each chunk
+    if(self)
+      _ctmRunTasks(self, aChunkCount, _ctmRadixCountTask, (void *) aPass);
+    else
+      _ctmRadixCountTask((void *) aPass, 0);
+
+    // Convert the counts to destination offsets. The offsets are assigned in
+    // digit order, and in chunk order within each digit, which keeps the sort
+    // stable.
+    sum = 0;
+    digitCount = 0;
+    for(d = 0; d < 256; ++ d)
+    {
+      first = sum;
+      for(c = 0; c < aChunkCount; ++ c)
+      {
+        count = hist[c * 256 + d];
+        hist[c * 256 + d] = sum;
+        sum += count;
+      }
+      if(sum > first)
+        ++ digitCount;
+    }
+
+    // Nothing to do if all elements have the same digit
+    if(digitCount < 2)
+      continue;
+
+    // Move the elements
+    if(self)
+      _ctmRunTasks(self, aChunkCount, _ctmRadixScatterTask, (void *) aPass);
+    else
+      _ctmRadixScatterTask((void *) aPass, 0);
+    swap = aPass->mDst;
+    aPass->mDst = (CTMuint *) aPass->mSrc;
+    aPass->mSrc = swap;
+  }
+
+  return (CTMuint *) aPass->mSrc;
+}
+
+//-----------------------------------------------------------------------------
+// _ctmRadixSort() - Sort an array of aCount elements, each consisting of
+// aSize unsigned integer words. The elements are sorted by the word at index
+// aMajorKey, and secondly by the word at index aMinorKey (both as unsigned
+// integers). The sort is stable (equal elements keep their relative order).
+// Large arrays are split into chunks that are processed in parallel, which
+// does not affect the result.
+//-----------------------------------------------------------------------------
+CTMbool _ctmRadixSort(_CTMcontext * self, CTMuint * aElements, CTMuint aCount,
+  CTMuint aSize, CTMuint aMajorKey, CTMuint aMinorKey)
+{
+  _CTMradixpass pass;
+  CTMuint * tmp, * hist, * sorted;
+  CTMuint chunkCount;
+
+  if(aCount < 2)
+    return CTM_TRUE;
+
+  // Split the array into chunks
+  chunkCount = (aCount + _CTM_SORT_CHUNK_SIZE - 1) / _CTM_SORT_CHUNK_SIZE;
+  if(chunkCount > _CTM_SORT_MAX_CHUNKS)
+    chunkCount = _CTM_SORT_MAX_CHUNKS;
+  pass.mChunkSize = (aCount + chunkCount - 1) / chunkCount;
+
+  // Allocate memory for the temporary array and the histograms
+  tmp = (CTMuint *) _ctmScratchAlloc(self, sizeof(CTMuint) * aSize * aCount);
+  hist = (CTMuint *) _ctmScratchAlloc(self, sizeof(CTMuint) * 256 * chunkCount);
+  if(!tmp || !hist)
+  {
+    self->mError = CTM_OUT_OF_MEMORY;
+    if(tmp) _ctmScratchFree(self, (void *) tmp);
+    if(hist) _ctmScratchFree(self, (void *) hist);
+    return CTM_FALSE;
+  }
+
+  pass.mSrc = aElements;
+  pass.mDst = tmp;
+  pass.mCount = aCount;
+  pass.mSize = aSize;
+  pass.mHist = hist;
+  sorted = _ctmRadixSortPasses(self, &pass, chunkCount, aMajorKey, aMinorKey);
+
+  // Copy the result back to the caller's array, if necessary
+  if(sorted != aElements)
+    memcpy(aElements, sorted, sizeof(CTMuint) * aSize * aCount);
+
+  _ctmScratchFree(self, (void *) hist);
+  _ctmScratchFree(self, (void *) tmp);
+
+  return CTM_TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// _ctmRadixSortSerial() - Same as _ctmRadixSort(), but the sort is done by the
+// calling thread, with a temporary array that is provided by the caller
+// (aTemp, with room for aCount elements). Since it does not allocate any
+// memory, it can be called from a task (see _ctmRunTasks()).
+//-----------------------------------------------------------------------------
+void _ctmRadixSortSerial(CTMuint * aElements, CTMuint * aTemp, CTMuint aCount,
+  CTMuint aSize, CTMuint aMajorKey, CTMuint aMinorKey)
+{
+  _CTMradixpass pass;
+  CTMuint hist[256], * sorted;
+
+  if(aCount < 2)
+    return;
+
+  pass.mSrc = aElements;
+  pass.mDst = aTemp;
+  pass.mCount = aCount;
+  pass.mSize = aSize;
+  pass.mChunkSize = aCount;
+  pass.mHist = hist;
+  sorted = _ctmRadixSortPasses((_CTMcontext *) 0, &pass, 1, aMajorKey, aMinorKey);
+
+  // Copy the result back to the caller's array, if necessary
+  if(sorted != aElements)
+    memcpy(aElements, sorted, sizeof(CTMuint) * aSize * aCount);
+}
+
+#else
+  // Dummy code (ISO C does not like empty source files)
+  void _ctm_sort_dummy(void) {}
+#endif // _CTM_SUPPORT_SAVE
@@ -25,37 +25,893 @@
 //     distribution.
 //-----------------------------------------------------------------------------
 
+#include "config.h"
+#ifdef _CTM_SUPPORT_MMAP
+  #define _POSIX_C_SOURCE 200112L
+#endif
+
 #include <stdlib.h>
 #include <string.h>
-#include <LzmaLib.h>
+#include <LzmaEnc.h>
+#include <LzmaDec.h>
 #include "openctm2.h"
 #include "internal.h"
 
+#ifdef _CTM_SUPPORT_MMAP
+  #include <sys/types.h>
+  #include <sys/stat.h>
+  #include <sys/mman.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+#endif
+
 #ifdef __DEBUG_
 #include <stdio.h>
 #endif
 
+// Number of words that are gathered at a time when interleaving arrays
+#define _CTM_PLANE_BLOCK_SIZE 256
+
 //-----------------------------------------------------------------------------
-// _ctmStreamRead() - Read data from a stream.
+// _ctmStreamResetBuffer() - Discard any data in the stream buffer. This must
+// be called whenever the underlying stream is changed.
 //-----------------------------------------------------------------------------
-CTMuint _ctmStreamRead(_CTMcontext * self, void * aBuf, CTMuint aCount)
+void _ctmStreamResetBuffer(_CTMcontext * self)
+{
+  self->mReadBuf = self->mStreamBuf;
+  self->mStreamBufPos = 0;
+  self->mStreamBufLen = 0;
+  self->mStreamPos = 0;
+}
+
+//-----------------------------------------------------------------------------
+// _ctmStreamSetMemory() - Use a memory block as the read buffer. The entire
+// stream is then available in the buffer, and no read function is needed (the
+// memory must stay valid until the stream is changed).
+//-----------------------------------------------------------------------------
+void _ctmStreamSetMemory(_CTMcontext * self, const void * aData, CTMuint aSize)
+{
+  self->mReadBuf = (const CTMubyte *) aData;
+  self->mStreamBufPos = 0;
+  self->mStreamBufLen = aSize;
+  self->mStreamPos = 0;
+}
+
+//-----------------------------------------------------------------------------
+// _ctmStreamTell() - Get the current stream offset (the read position when
+// importing, or the number of bytes written so far when exporting).
+//-----------------------------------------------------------------------------
+CTMuint _ctmStreamTell(_CTMcontext * self)
+{
+  if(self->mMode == CTM_EXPORT)
+    return self->mStreamPos + self->mStreamBufLen;
+  else
+    return self->mStreamPos + self->mStreamBufPos;
+}
+
+//-----------------------------------------------------------------------------
+// _ctmStreamSize() - Get the total size of the input stream. This is only
+// possible for memory streams (including memory mapped files) and for files
+// that were opened by ctmOpenReadFile(). The function returns CTM_FALSE if the
+// size is unknown.
+//-----------------------------------------------------------------------------
+CTMbool _ctmStreamSize(_CTMcontext * self, CTMuint * aSize)
+{
+  long pos, size;
+
+  // Memory stream?
+  if(self->mReadBuf != self->mStreamBuf)
+  {
+    *aSize = self->mStreamBufLen;
+    return CTM_TRUE;
+  }
+
+  // Our own file stream?
+  if(self->mFileStream && (self->mUserData == (void *) self->mFileStream))
+  {
+    pos = ftell(self->mFileStream);
+    if((pos < 0) || (fseek(self->mFileStream, 0, SEEK_END) != 0))
+      return CTM_FALSE;
+    size = ftell(self->mFileStream);
+    if(fseek(self->mFileStream, pos, SEEK_SET) != 0)
+      return CTM_FALSE;
+    if((size < 0) || ((unsigned long) size > 0xffffffffUL))
+      return CTM_FALSE;
+    *aSize = (CTMuint) size;
+    return CTM_TRUE;
+  }
+
+  return CTM_FALSE;
+}
+
+//-----------------------------------------------------------------------------
+// _ctmStreamSeek() - Move the read position of the input stream to the given
+// stream offset. Only the streams that _ctmStreamSize() can handle are
+// seekable. The function returns CTM_FALSE if the stream could not be
+// repositioned.
+//-----------------------------------------------------------------------------
+CTMbool _ctmStreamSeek(_CTMcontext * self, CTMuint aOffset)
+{
+  // Memory stream?
+  if(self->mReadBuf != self->mStreamBuf)
+  {
+    if(aOffset > self->mStreamBufLen)
+      return CTM_FALSE;
+    self->mStreamBufPos = aOffset;
+    return CTM_TRUE;
+  }
+
+  // Our own file stream?
+  if(self->mFileStream && (self->mUserData == (void *) self->mFileStream))
+  {
+    if((aOffset > 0x7fffffffUL) ||
+       (fseek(self->mFileStream, (long) aOffset, SEEK_SET) != 0))
+      return CTM_FALSE;
+    _ctmStreamResetBuffer(self);
+    self->mStreamPos = aOffset;
+    return CTM_TRUE;
+  }
+
+  return CTM_FALSE;
+}
+
+#ifdef _CTM_SUPPORT_MMAP
+//-----------------------------------------------------------------------------
+// _ctmStreamMapFile() - Map a file into memory and use the mapping as the
+// read buffer. The function returns CTM_FALSE if the file could not be mapped
+// (e.g. if it is not a regular file), in which case the caller should fall
+// back to ordinary stream reading.
+//-----------------------------------------------------------------------------
+CTMbool _ctmStreamMapFile(_CTMcontext * self, const char * aFileName)
+{
+  struct stat st;
+  void * map;
+  int fd;
+
+  fd = open(aFileName, O_RDONLY);
+  if(fd < 0)
+    return CTM_FALSE;
+
+  // Only regular, non-empty files that fit in the read buffer can be mapped
+  if((fstat(fd, &st) != 0) || !S_ISREG(st.st_mode) || (st.st_size <= 0) ||
+     ((unsigned long long) st.st_size > 0xffffffffULL))
+  {
+    close(fd);
+    return CTM_FALSE;
+  }
+
+  map = mmap((void *) 0, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(map == MAP_FAILED)
+    return CTM_FALSE;
+
+  self->mFileMap = map;
+  self->mFileMapSize = (size_t) st.st_size;
+  self->mReadFn = (CTMreadfn) 0;
+  self->mUserData = (void *) 0;
+  _ctmStreamSetMemory(self, map, (CTMuint) st.st_size);
+
+  return CTM_TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// _ctmStreamUnmapFile() - Release the memory mapped file (if any).
+//-----------------------------------------------------------------------------
+void _ctmStreamUnmapFile(_CTMcontext * self)
 {
+  if(self->mFileMap)
+  {
+    munmap(self->mFileMap, self->mFileMapSize);
+    self->mFileMap = (void *) 0;
+    self->mFileMapSize = 0;
+  }
+}
+#endif
+
+//-----------------------------------------------------------------------------
+// _ctmStreamFillBuffer() - Refill the (empty) stream buffer from the stream.
+// The function returns the number of bytes that are available in the buffer.
+//-----------------------------------------------------------------------------
+static CTMuint _ctmStreamFillBuffer(_CTMcontext * self)
+{
+  self->mStreamPos += self->mStreamBufLen;
+  self->mReadBuf = self->mStreamBuf;
+  self->mStreamBufPos = 0;
+  self->mStreamBufLen = 0;
   if(!self->mUserData || !self->mReadFn)
     return 0;
 
-  return self->mReadFn(aBuf, aCount, self->mUserData);
+  self->mStreamBufLen = self->mReadFn((void *) self->mStreamBuf,
+                                      _CTM_STREAM_BUFFER_SIZE, self->mUserData);
+  return self->mStreamBufLen;
+}
+
+//-----------------------------------------------------------------------------
+// _ctmStreamRead() - Read data from a stream.
+//-----------------------------------------------------------------------------
+CTMuint _ctmStreamRead(_CTMcontext * self, void * aBuf, CTMuint aCount)
+{
+  CTMubyte * dst = (CTMubyte *) aBuf;
+  CTMuint count, total = 0;
+
+  while(aCount > 0)
+  {
+    // Take as much as possible from the buffer
+    count = self->mStreamBufLen - self->mStreamBufPos;
+    if(count > 0)
+    {
+      if(count > aCount)
+        count = aCount;
+      memcpy(dst, &self->mReadBuf[self->mStreamBufPos], count);
+      self->mStreamBufPos += count;
+      dst += count;
+      total += count;
+      aCount -= count;
+      continue;
+    }
+
+    // Large reads go directly to the caller's memory
+    if(aCount >= _CTM_STREAM_BUFFER_SIZE)
+    {
+      if(!self->mUserData || !self->mReadFn)
+        break;
+      count = self->mReadFn((void *) dst, aCount, self->mUserData);
+      self->mStreamPos += count;
+      total += count;
+      break;
+    }
+
+    // Refill the buffer
+    if(!_ctmStreamFillBuffer(self))
+      break;
+  }
+
+  return total;
+}
+
+//-----------------------------------------------------------------------------
+// _ctmStreamMap() - Get a pointer to the next aCount bytes of the stream
+// without copying them, and advance the read position. If the data is not
+// available in the read buffer, a null pointer is returned and the read
+// position is left unchanged. For memory streams this never happens unless the
+// stream is truncated.
+//-----------------------------------------------------------------------------
+const CTMubyte * _ctmStreamMap(_CTMcontext * self, CTMuint aCount)
+{
+  const CTMubyte * ptr;
+
+  if(aCount > self->mStreamBufLen - self->mStreamBufPos)
+    return (const CTMubyte *) 0;
+
+  ptr = &self->mReadBuf[self->mStreamBufPos];
+  self->mStreamBufPos += aCount;
+  return ptr;
+}
+
+//-----------------------------------------------------------------------------
+// _CTMlzmaalloc - LZMA memory allocator, which uses the memory allocation
+// functions of a context.
+//-----------------------------------------------------------------------------
+typedef struct {
+  ISzAlloc mFuncs;        // LZMA allocator interface (must be first)
+  _CTMcontext * mContext; // Context that owns the memory
+} _CTMlzmaalloc;
+
+//-----------------------------------------------------------------------------
+// LZMA memory allocation functions (see _CTMlzmaalloc).
+//-----------------------------------------------------------------------------
+static void * _ctmLzmaAlloc(void * p, size_t size)
+{
+  return _ctmAlloc(((_CTMlzmaalloc *) p)->mContext, size);
+}
+
+static void _ctmLzmaFree(void * p, void * address)
+{
+  _ctmFree(((_CTMlzmaalloc *) p)->mContext, address);
+}
+
+//-----------------------------------------------------------------------------
+// _ctmInitLzmaAlloc() - Initialize an LZMA memory allocator for the context.
+//-----------------------------------------------------------------------------
+static void _ctmInitLzmaAlloc(_CTMcontext * self, _CTMlzmaalloc * aAlloc)
+{
+  aAlloc->mFuncs.Alloc = _ctmLzmaAlloc;
+  aAlloc->mFuncs.Free = _ctmLzmaFree;
+  aAlloc->mContext = self;
+}
+
+//-----------------------------------------------------------------------------
+// _ctmStreamSkip() - Skip aCount bytes of the stream.
+//-----------------------------------------------------------------------------
+static CTMbool _ctmStreamSkip(_CTMcontext * self, CTMuint aCount)
+{
+  CTMuint count;
+
+  while(aCount > 0)
+  {
+    count = self->mStreamBufLen - self->mStreamBufPos;
+    if(count == 0)
+    {
+      count = _ctmStreamFillBuffer(self);
+      if(count == 0)
+        return CTM_FALSE;
+    }
+    if(count > aCount)
+      count = aCount;
+    self->mStreamBufPos += count;
+    aCount -= count;
+  }
+
+  return CTM_TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// _ctmWordsAreFinite() - Check that aCount words (with a stride of aStride
+// words), interpreted as floats, are all finite (non-NaN, non-inf).
+//-----------------------------------------------------------------------------
+static CTMbool _ctmWordsAreFinite(const CTMuint * aWords, CTMuint aStride,
+  CTMuint aCount)
+{
+  CTMuint i;
+
+  for(i = 0; i < aCount; ++ i)
+  {
+    // All exponent bits set = inf or NaN
+    if((aWords[i * aStride] & 0x7f800000) == 0x7f800000)
+      return CTM_FALSE;
+  }
+
+  return CTM_TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// _CTMpackblock - One block of a block split packed array, which is
+// compressed or uncompressed independently of the other blocks.
+//-----------------------------------------------------------------------------
+typedef struct {
+  const CTMubyte * mSrc;      // Input data
+  size_t mSrcSize;            // Size of the input data
+  CTMubyte * mDst;            // Output data
+  size_t mDstSize;            // Size of the output data (in: capacity)
+  unsigned char mProps[5];    // LZMA compression props
+  CTMenum mError;             // CTM_NONE if the block was coded successfully
+} _CTMpackblock;
+
+//-----------------------------------------------------------------------------
+// _CTMblocktask - Argument for the block coding tasks.
+//-----------------------------------------------------------------------------
+typedef struct {
+  _CTMcontext * mContext;
+  _CTMpackblock * mBlocks;
+} _CTMblocktask;
+
+//-----------------------------------------------------------------------------
+// _CTMmergetask - Argument for _ctmMergePlanesTask().
+//-----------------------------------------------------------------------------
+typedef struct {
+  const CTMubyte * mData;     // Interleaved byte plane array
+  CTMuint * mWords;           // Output words
+  CTMuint mCount;             // Number of elements
+  CTMuint mSize;              // Number of components per element
+  CTMuint mChunkSize;         // Number of elements per task
+  CTMint mSignedInts;         // Convert from signed magnitude form?
+  CTMint mCheckFinite;        // Check that the words are finite floats?
+  CTMenum * mErrors;          // Error code of each task
+} _CTMmergetask;
+
+//-----------------------------------------------------------------------------
+// _ctmGetLE32() - Get a little endian 32-bit unsigned integer from memory.
+//-----------------------------------------------------------------------------
+static CTMuint _ctmGetLE32(const CTMubyte * aPtr)
+{
+  return ((CTMuint) aPtr[0]) |
+         (((CTMuint) aPtr[1]) << 8) |
+         (((CTMuint) aPtr[2]) << 16) |
+         (((CTMuint) aPtr[3]) << 24);
+}
+
+//-----------------------------------------------------------------------------
+// _ctmUnpackBlockTask() - Uncompress one block of a block split packed array
+// (task for _ctmRunTasks()).
+//-----------------------------------------------------------------------------
+static void _ctmUnpackBlockTask(void * aArg, CTMuint aIndex)
+{
+  _CTMblocktask * task = (_CTMblocktask *) aArg;
+  _CTMpackblock * block = &task->mBlocks[aIndex];
+  _CTMlzmaalloc lzmaAlloc;
+  ELzmaStatus status;
+  SizeT dstLen = block->mDstSize, srcLen = block->mSrcSize;
+
+  _ctmInitLzmaAlloc(task->mContext, &lzmaAlloc);
+  if(LzmaDecode(block->mDst, &dstLen, block->mSrc, &srcLen, block->mProps,
+                LZMA_PROPS_SIZE, LZMA_FINISH_ANY, &status,
+                &lzmaAlloc.mFuncs) != SZ_OK)
+    block->mError = CTM_LZMA_ERROR;
+  else if(dstLen != block->mDstSize)
+    block->mError = CTM_BAD_FORMAT;
+  else
+    block->mError = CTM_NONE;
+}
+
+//-----------------------------------------------------------------------------
+// _ctmMergePlanesTask() - De-interleave a range of elements of an interleaved
+// byte plane array (task for _ctmRunTasks()).
+//-----------------------------------------------------------------------------
+static void _ctmMergePlanesTask(void * aArg, CTMuint aIndex)
+{
+  _CTMmergetask * task = (_CTMmergetask *) aArg;
+  CTMuint first, n, k, plane;
+  CTMuint * words;
+  const CTMubyte * src;
+
+  first = aIndex * task->mChunkSize;
+  n = task->mCount - first;
+  if(n > task->mChunkSize)
+    n = task->mChunkSize;
+  task->mErrors[aIndex] = CTM_NONE;
+
+  // The array holds all the most significant bytes first, in component-major
+  // order, then the next byte plane, and so on
+  for(plane = 0; plane < 4; ++ plane)
+  {
+    for(k = 0; k < task->mSize; ++ k)
+    {
+      words = &task->mWords[first * task->mSize + k];
+      src = &task->mData[(plane * task->mSize + k) * task->mCount + first];
+      _ctmMergeBytePlane(words, task->mSize, src, n, 24 - 8 * plane,
+                         task->mSignedInts);
+      if(task->mCheckFinite && (plane == 3) &&
+         !_ctmWordsAreFinite(words, task->mSize, n))
+        task->mErrors[aIndex] = CTM_INVALID_MESH;
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+// _ctmDecodeBlocks() - Uncompress a block split packed array of 32-bit words
+// (see _ctmDecodeWords()). All the packed data is needed at once, so if it
+// is not in memory, it is read from the stream first. The blocks are
+// uncompressed in parallel, and then the byte planes are de-interleaved in
+// parallel.
+//-----------------------------------------------------------------------------
+static CTMenum _ctmDecodeBlocks(_CTMcontext * self, _CTMunpackjob * aJob,
+  CTMuint * aWords, CTMuint aCount, CTMuint aSize, CTMint aSignedInts,
+  CTMint aCheckFinite)
+{
+  _CTMpackblock * blocks;
+  _CTMblocktask task;
+  _CTMmergetask merge;
+  const CTMubyte * packed, * entry;
+  CTMubyte * data, * packedBuf = (CTMubyte *) 0;
+  size_t dataSize, blockSize, pos;
+  CTMuint i, blockCount, mergeCount;
+  CTMenum err = CTM_NONE;
+
+  // Get the packed data
+  packed = aJob->mPacked;
+  if(!packed)
+  {
+    if(self->mReadBuf != self->mStreamBuf)
+      packed = _ctmStreamMap(self, aJob->mPackedSize);
+    else
+    {
+      packedBuf = (CTMubyte *) _ctmAlloc(self, aJob->mPackedSize > 0 ? aJob->mPackedSize : 1);
+      if(!packedBuf)
+        return CTM_OUT_OF_MEMORY;
+      if(_ctmStreamRead(self, (void *) packedBuf, aJob->mPackedSize) == aJob->mPackedSize)
+        packed = packedBuf;
+    }
+    if(!packed)
+    {
+      _ctmFree(self, (void *) packedBuf);
+      return CTM_BAD_FORMAT;
+    }
+  }
+
+  // Block layout
+  dataSize = (size_t) aCount * aSize * 4;
+  blockSize = (size_t) _ctmGetLE32(&aJob->mProps[1]);
+  blockCount = blockSize > 0 ? (CTMuint) ((dataSize + blockSize - 1) / blockSize) : 0;
+  if((blockSize == 0) ||
+     ((size_t) blockCount * _CTM_PACK_BLOCK_ENTRY_SIZE > aJob->mPackedSize))
+  {
+    _ctmFree(self, (void *) packedBuf);
+    return CTM_BAD_FORMAT;
+  }
+  if(blockCount == 0)
+  {
+    _ctmFree(self, (void *) packedBuf);
+    return CTM_NONE;
+  }
+
+  // Allocate memory for the block list and the interleaved data
+  blocks = (_CTMpackblock *) _ctmAlloc(self, sizeof(_CTMpackblock) * blockCount);
+  data = (CTMubyte *) _ctmAlloc(self, dataSize);
+  if(!blocks || !data)
+  {
+    _ctmFree(self, (void *) data);
+    _ctmFree(self, (void *) blocks);
+    _ctmFree(self, (void *) packedBuf);
+    return CTM_OUT_OF_MEMORY;
+  }
+
+  // Read the block table
+  pos = (size_t) blockCount * _CTM_PACK_BLOCK_ENTRY_SIZE;
+  for(i = 0; i < blockCount; ++ i)
+  {
+    entry = &packed[i * _CTM_PACK_BLOCK_ENTRY_SIZE];
+    blocks[i].mSrcSize = _ctmGetLE32(entry);
+    if(blocks[i].mSrcSize > aJob->mPackedSize - pos)
+    {
+      err = CTM_BAD_FORMAT;
+      break;
+    }
+    memcpy(blocks[i].mProps, &entry[4], LZMA_PROPS_SIZE);
+    blocks[i].mSrc = &packed[pos];
+    pos += blocks[i].mSrcSize;
+    blocks[i].mDst = &data[i * blockSize];
+    blocks[i].mDstSize = dataSize - i * blockSize;
+    if(blocks[i].mDstSize > blockSize)
+      blocks[i].mDstSize = blockSize;
+  }
+
+  // Uncompress all the blocks
+  if(err == CTM_NONE)
+  {
+    task.mContext = self;
+    task.mBlocks = blocks;
+    _ctmRunTasks(self, blockCount, _ctmUnpackBlockTask, (void *) &task);
+    for(i = 0; (i < blockCount) && (err == CTM_NONE); ++ i)
+      err = blocks[i].mError;
+  }
+
+  // De-interleave the byte planes (in as many tasks as there are blocks)
+  if(err == CTM_NONE)
+  {
+    merge.mData = data;
+    merge.mWords = aWords;
+    merge.mCount = aCount;
+    merge.mSize = aSize;
+    merge.mChunkSize = (aCount + blockCount - 1) / blockCount;
+    merge.mSignedInts = aSignedInts;
+    merge.mCheckFinite = aCheckFinite;
+    mergeCount = (aCount + merge.mChunkSize - 1) / merge.mChunkSize;
+    merge.mErrors = (CTMenum *) _ctmAlloc(self, sizeof(CTMenum) * mergeCount);
+    if(!merge.mErrors)
+      err = CTM_OUT_OF_MEMORY;
+    else
+    {
+      _ctmRunTasks(self, mergeCount, _ctmMergePlanesTask, (void *) &merge);
+      for(i = 0; (i < mergeCount) && (err == CTM_NONE); ++ i)
+        err = merge.mErrors[i];
+      _ctmFree(self, (void *) merge.mErrors);
+    }
+  }
+
+  _ctmFree(self, (void *) data);
+  _ctmFree(self, (void *) blocks);
+  _ctmFree(self, (void *) packedBuf);
+
+  return err;
+}
+
+//-----------------------------------------------------------------------------
+// _ctmDecodeWords() - Uncompress a packed array of 32-bit words. If
+// aJob->mPacked is null, the packed data is fed to the LZMA decoder in blocks
+// straight from the read buffer of the stream (the stream is then positioned
+// after the packed data). Otherwise the packed data is taken from memory, and
+// the stream is not touched. The decoded byte planes are de-interleaved
+// directly into aWords (element i, component k is stored at
+// aWords[i * aSize + k]). If aSignedInts is true, the words are converted from
+// signed magnitude form to two's complement. If aCheckFinite is true, the
+// words are checked to be finite floats as soon as they are complete.
+// The function returns CTM_NONE on success, or an error code.
+//-----------------------------------------------------------------------------
+static CTMenum _ctmDecodeWords(_CTMcontext * self, _CTMunpackjob * aJob,
+  CTMuint * aWords, CTMuint aCount, CTMuint aSize, CTMint aSignedInts,
+  CTMint aCheckFinite)
+{
+  CLzmaDec dec;
+  _CTMlzmaalloc lzmaAlloc;
+  ELzmaStatus status;
+  SRes lzmaRes;
+  unsigned char outBuf[_CTM_LZMA_DECODE_CHUNK_SIZE];
+  const CTMubyte * in = (const CTMubyte *) 0;
+  SizeT inLen = 0, inProcessed, outProcessed;
+  CTMuint packedLeft, unpackedLeft, avail, i = 0, k = 0, shift = 24, j, n;
+  CTMenum err = CTM_NONE;
+
+  // Block split arrays are uncompressed in parallel
+  if(aJob->mProps[0] == _CTM_PACK_BLOCKS_ID)
+    return _ctmDecodeBlocks(self, aJob, aWords, aCount, aSize, aSignedInts,
+                            aCheckFinite);
+
+  // Initialize the LZMA decoder
+  _ctmInitLzmaAlloc(self, &lzmaAlloc);
+  LzmaDec_Construct(&dec);
+  if(LzmaDec_Allocate(&dec, aJob->mProps, LZMA_PROPS_SIZE, &lzmaAlloc.mFuncs) != SZ_OK)
+    return CTM_LZMA_ERROR;
+  LzmaDec_Init(&dec);
+
+  packedLeft = aJob->mPackedSize;
+  unpackedLeft = aCount * aSize * 4;
+  while(unpackedLeft > 0)
+  {
+    // Get more packed data
+    if((inLen == 0) && (packedLeft > 0))
+    {
+      if(aJob->mPacked)
+      {
+        // All the packed data is in memory
+        in = aJob->mPacked;
+        inLen = packedLeft;
+        packedLeft = 0;
+      }
+      else
+      {
+        // Get the next block from the stream (without copying it)
+        avail = self->mStreamBufLen - self->mStreamBufPos;
+        if(avail == 0)
+          avail = _ctmStreamFillBuffer(self);
+        if(avail == 0)
+        {
+          err = CTM_BAD_FORMAT;
+          break;
+        }
+        if(avail > packedLeft)
+          avail = packedLeft;
+        in = _ctmStreamMap(self, avail);
+        inLen = avail;
+        packedLeft -= avail;
+      }
+    }
+
+    // Decode the next block
+    inProcessed = inLen;
+    outProcessed = unpackedLeft < sizeof(outBuf) ? unpackedLeft : sizeof(outBuf);
+    lzmaRes = LzmaDec_DecodeToBuf(&dec, outBuf, &outProcessed, in,
+                                  &inProcessed, LZMA_FINISH_ANY, &status);
+    in += inProcessed;
+    inLen -= inProcessed;
+    if((lzmaRes != SZ_OK) || ((outProcessed == 0) && (inProcessed == 0)))
+    {
+      err = CTM_LZMA_ERROR;
+      break;
+    }
+    unpackedLeft -= (CTMuint) outProcessed;
+
+    // De-interleave the decoded bytes. The stream holds all the most
+    // significant bytes first, in component-major order, then the next
+    // byte plane, and so on.
+    for(j = 0; j < (CTMuint) outProcessed; j += n)
+    {
+      n = aCount - i;
+      if(n > (CTMuint) outProcessed - j)
+        n = (CTMuint) outProcessed - j;
+      _ctmMergeBytePlane(&aWords[i * aSize + k], aSize, &outBuf[j], n, shift,
+                         aSignedInts);
+      if(aCheckFinite && (shift == 0) &&
+         !_ctmWordsAreFinite(&aWords[i * aSize + k], aSize, n))
+        err = CTM_INVALID_MESH;
+      i += n;
+      if(i >= aCount)
+      {
+        i = 0;
+        if(++ k >= aSize)
+        {
+          k = 0;
+          shift -= 8;
+        }
+      }
+    }
+    if(err != CTM_NONE)
+      break;
+  }
+
+  LzmaDec_Free(&dec, &lzmaAlloc.mFuncs);
+
+  // Skip any trailing packed data in the stream
+  if((err == CTM_NONE) && !aJob->mPacked && !_ctmStreamSkip(self, packedLeft))
+    err = CTM_BAD_FORMAT;
+
+  return err;
+}
+
+//-----------------------------------------------------------------------------
+// _ctmDecodeFloatArray() - Uncompress a packed float array (see
+// _ctmDecodeWords()) into aArray.
+// The function returns CTM_NONE on success, or an error code.
+//-----------------------------------------------------------------------------
+static CTMenum _ctmDecodeFloatArray(_CTMcontext * self, _CTMunpackjob * aJob,
+  _CTMarray * aArray, CTMuint aCount, CTMuint aSize)
+{
+  CTMuint i, n;
+  CTMfloat block[_CTM_ARRAY_BLOCK_SIZE * 4];
+  CTMuint * words;
+  CTMenum err;
+
+  // A packed float array can be uncompressed directly into the caller's memory
+  if((aArray->mType == CTM_FLOAT) && (aArray->mSize == aSize) &&
+     (aArray->mStride == aSize * sizeof(CTMfloat)))
+    return _ctmDecodeWords(self, aJob, (CTMuint *) aArray->mData, aCount,
+                           aSize, CTM_FALSE, !self->mTrustedInput);
+
+  // Allocate memory for the uncompressed data
+  words = (CTMuint *) _ctmAlloc(self, aCount * aSize * sizeof(CTMuint));
+  if(!words)
+    return CTM_OUT_OF_MEMORY;
+
+  // Uncompress
+  err = _ctmDecodeWords(self, aJob, words, aCount, aSize, CTM_FALSE,
+                        !self->mTrustedInput);
+  if(err != CTM_NONE)
+  {
+    _ctmFree(self, words);
+    return err;
+  }
+
+  // Convert to the array type
+  for(i = 0; i < aCount; i += n)
+  {
+    n = aCount - i;
+    if(n > _CTM_ARRAY_BLOCK_SIZE)
+      n = _CTM_ARRAY_BLOCK_SIZE;
+    memcpy(block, &words[i * aSize], n * aSize * sizeof(CTMfloat));
+    _ctmScatterArrayf(aArray, i, n, aSize, block);
+  }
+
+  // Free the temporary array
+  _ctmFree(self, words);
+
+  return CTM_NONE;
+}
+
+//-----------------------------------------------------------------------------
+// _ctmStreamReadPackHeader() - Read the packed data size and the LZMA
+// compression props of a packed array from a stream.
+//-----------------------------------------------------------------------------
+static CTMbool _ctmStreamReadPackHeader(_CTMcontext * self,
+  _CTMunpackjob * aJob)
+{
+  aJob->mPacked = (const CTMubyte *) 0;
+  aJob->mBuffer = (CTMubyte *) 0;
+  aJob->mError = CTM_NONE;
+  aJob->mPackedSize = _ctmStreamReadUINT(self);
+  if(_ctmStreamRead(self, (void *) aJob->mProps, LZMA_PROPS_SIZE) != LZMA_PROPS_SIZE)
+  {
+    self->mError = CTM_BAD_FORMAT;
+    return CTM_FALSE;
+  }
+  return CTM_TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// _ctmStreamReadPackJob() - Read a packed array from a stream into memory,
+// without uncompressing it (see _ctmUnpackInts() and _ctmUnpackFloatArray()).
+// Memory streams and memory mapped files are not copied.
+//-----------------------------------------------------------------------------
+CTMbool _ctmStreamReadPackJob(_CTMcontext * self, _CTMunpackjob * aJob)
+{
+  if(!_ctmStreamReadPackHeader(self, aJob))
+    return CTM_FALSE;
+
+  // Use the data in place if the whole stream is in memory
+  if(self->mReadBuf != self->mStreamBuf)
+  {
+    aJob->mPacked = _ctmStreamMap(self, aJob->mPackedSize);
+    if(!aJob->mPacked)
+    {
+      self->mError = CTM_BAD_FORMAT;
+      return CTM_FALSE;
+    }
+    return CTM_TRUE;
+  }
+
+  // Copy the packed data from the stream
+  aJob->mBuffer = (CTMubyte *) _ctmAlloc(self, aJob->mPackedSize > 0 ? aJob->mPackedSize : 1);
+  if(!aJob->mBuffer)
+  {
+    self->mError = CTM_OUT_OF_MEMORY;
+    return CTM_FALSE;
+  }
+  if(_ctmStreamRead(self, (void *) aJob->mBuffer, aJob->mPackedSize) != aJob->mPackedSize)
+  {
+    self->mError = CTM_BAD_FORMAT;
+    _ctmFree(self, aJob->mBuffer);
+    aJob->mBuffer = (CTMubyte *) 0;
+    return CTM_FALSE;
+  }
+  aJob->mPacked = aJob->mBuffer;
+
+  return CTM_TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// _ctmFreeUnpackJob() - Free the packed data of a packed array that has been
+// read by _ctmStreamReadPackJob().
+//-----------------------------------------------------------------------------
+void _ctmFreeUnpackJob(_CTMcontext * self, _CTMunpackjob * aJob)
+{
+  if(aJob->mBuffer)
+    _ctmFree(self, aJob->mBuffer);
+  aJob->mBuffer = (CTMubyte *) 0;
+  aJob->mPacked = (const CTMubyte *) 0;
+}
+
+//-----------------------------------------------------------------------------
+// _ctmUnpackInts() - Uncompress a packed integer array that has been read by
+// _ctmStreamReadPackJob(). This function does not modify the stream or the
+// context (errors are reported in aJob->mError), so several arrays can be
+// uncompressed in parallel.
+//-----------------------------------------------------------------------------
+void _ctmUnpackInts(_CTMcontext * self, _CTMunpackjob * aJob, CTMint * aData,
+  CTMuint aCount, CTMuint aSize, CTMint aSignedInts)
+{
+  aJob->mError = _ctmDecodeWords(self, aJob, (CTMuint *) aData, aCount, aSize,
+                                 aSignedInts, CTM_FALSE);
+}
+
+//-----------------------------------------------------------------------------
+// _ctmUnpackFloatArray() - Uncompress a packed float array that has been read
+// by _ctmStreamReadPackJob() (see _ctmUnpackInts()).
+//-----------------------------------------------------------------------------
+void _ctmUnpackFloatArray(_CTMcontext * self, _CTMunpackjob * aJob,
+  _CTMarray * aArray, CTMuint aCount, CTMuint aSize)
+{
+  aJob->mError = _ctmDecodeFloatArray(self, aJob, aArray, aCount, aSize);
 }
 
 #ifdef _CTM_SUPPORT_SAVE
+//-----------------------------------------------------------------------------
+// _ctmStreamFlush() - Write any pending data in the stream buffer to the
+// stream.
+//-----------------------------------------------------------------------------
+CTMbool _ctmStreamFlush(_CTMcontext * self)
+{
+  CTMuint count;
+
+  if(self->mStreamBufLen == 0)
+    return CTM_TRUE;
+
+  count = self->mStreamBufLen;
+  self->mStreamBufLen = 0;
+  self->mStreamPos += count;
+  if(!self->mUserData || !self->mWriteFn)
+    return CTM_FALSE;
+
+  return self->mWriteFn((const void *) self->mStreamBuf, count,
+                        self->mUserData) == count;
+}
+
 //-----------------------------------------------------------------------------
 // _ctmStreamWrite() - Write data to a stream.
 //-----------------------------------------------------------------------------
 CTMuint _ctmStreamWrite(_CTMcontext * self, void * aBuf, CTMuint aCount)
 {
-  if(!self->mUserData || !self->mWriteFn)
+  // Does the data fit in the buffer?
+  if(LIKELY(aCount <= _CTM_STREAM_BUFFER_SIZE - self->mStreamBufLen))
+  {
+    memcpy(&self->mStreamBuf[self->mStreamBufLen], aBuf, aCount);
+    self->mStreamBufLen += aCount;
+    return aCount;
+  }
+
+  // Make room in the buffer
+  if(!_ctmStreamFlush(self))
     return 0;
 
-  return self->mWriteFn(aBuf, aCount, self->mUserData);
+  // Large writes go directly to the stream
+  if(aCount >= _CTM_STREAM_BUFFER_SIZE)
+  {
+    if(!self->mUserData || !self->mWriteFn)
+      return 0;
+    self->mStreamPos += aCount;
+    return self->mWriteFn(aBuf, aCount, self->mUserData);
+  }
+
+  memcpy(self->mStreamBuf, aBuf, aCount);
+  self->mStreamBufLen = aCount;
+  return aCount;
 }
 #endif
 
@@ -66,11 +922,25 @@ CTMuint _ctmStreamWrite(_CTMcontext * self, void * aBuf, CTMuint aCount)
 CTMuint _ctmStreamReadUINT(_CTMcontext * self)
 {
   unsigned char buf[4];
-  _ctmStreamRead(self, (void *) buf, 4);
-  return ((CTMuint) buf[0]) |
-         (((CTMuint) buf[1]) << 8) |
-         (((CTMuint) buf[2]) << 16) |
-         (((CTMuint) buf[3]) << 24);
+  const unsigned char * ptr;
+
+  // Read directly from the stream buffer if possible
+  if(LIKELY(self->mStreamBufLen - self->mStreamBufPos >= 4))
+  {
+    ptr = &self->mReadBuf[self->mStreamBufPos];
+    self->mStreamBufPos += 4;
+  }
+  else
+  {
+    buf[0] = buf[1] = buf[2] = buf[3] = 0;
+    _ctmStreamRead(self, (void *) buf, 4);
+    ptr = buf;
+  }
+
+  return ((CTMuint) ptr[0]) |
+         (((CTMuint) ptr[1]) << 8) |
+         (((CTMuint) ptr[2]) << 16) |
+         (((CTMuint) ptr[3]) << 24);
 }
 
 #ifdef _CTM_SUPPORT_SAVE
@@ -80,12 +950,24 @@ CTMuint _ctmStreamReadUINT(_CTMcontext * self)
 //-----------------------------------------------------------------------------
 void _ctmStreamWriteUINT(_CTMcontext * self, CTMuint aValue)
 {
-  unsigned char buf[4];
-  buf[0] = aValue & 0x000000ff;
-  buf[1] = (aValue >> 8) & 0x000000ff;
-  buf[2] = (aValue >> 16) & 0x000000ff;
-  buf[3] = (aValue >> 24) & 0x000000ff;
-  _ctmStreamWrite(self, (void *) buf, 4);
+  unsigned char buf[4], * ptr;
+
+  // Write directly to the stream buffer if possible
+  if(LIKELY(_CTM_STREAM_BUFFER_SIZE - self->mStreamBufLen >= 4))
+  {
+    ptr = &self->mStreamBuf[self->mStreamBufLen];
+    self->mStreamBufLen += 4;
+  }
+  else
+    ptr = buf;
+
+  ptr[0] = aValue & 0x000000ff;
+  ptr[1] = (aValue >> 8) & 0x000000ff;
+  ptr[2] = (aValue >> 16) & 0x000000ff;
+  ptr[3] = (aValue >> 24) & 0x000000ff;
+
+  if(ptr == buf)
+    _ctmStreamWrite(self, (void *) buf, 4);
 }
 #endif
 
@@ -132,7 +1014,7 @@ CTMuint _ctmStreamReadSTRING(_CTMcontext * self, char ** aValue)
   // Clear the old string
   if(*aValue)
   {
-    free(*aValue);
+    _ctmFree(self, *aValue);
     *aValue = (char *) 0;
   }
 
@@ -142,7 +1024,7 @@ CTMuint _ctmStreamReadSTRING(_CTMcontext * self, char ** aValue)
   // Read string
   if(len > 0)
   {
-    *aValue = (char *) malloc(len + 1);
+    *aValue = (char *) _ctmAlloc(self, len + 1);
     if(*aValue)
     {
       _ctmStreamRead(self, (void *) *aValue, len);
@@ -185,251 +1067,389 @@ void _ctmStreamWriteSTRING(_CTMcontext * self, const char * aValue)
 CTMbool _ctmStreamReadPackedInts(_CTMcontext * self, CTMint * aData,
   CTMuint aCount, CTMuint aSize, CTMint aSignedInts)
 {
-  size_t packedSize, unpackedSize;
-  CTMuint i, k, x;
-  CTMint value;
-  unsigned char * packed, * tmp;
-  unsigned char props[5];
-  int lzmaRes;
-
-  // Read packed data size from the stream
-  packedSize = (size_t) _ctmStreamReadUINT(self);
-
-  // Read LZMA compression props from the stream
-  _ctmStreamRead(self, (void *) props, 5);
+  _CTMunpackjob job;
 
-  // Allocate memory and read the packed data from the stream
-  packed = (unsigned char *) malloc(packedSize);
-  if(!packed)
-  {
-    self->mError = CTM_OUT_OF_MEMORY;
+  // Uncompress directly from the stream into the integer array
+  if(!_ctmStreamReadPackHeader(self, &job))
     return CTM_FALSE;
-  }
-  _ctmStreamRead(self, (void *) packed, (CTMuint) packedSize);
-
-  // Allocate memory for interleaved array
-  tmp = (unsigned char *) malloc(aCount * aSize * 4);
-  if(!tmp)
+  job.mError = _ctmDecodeWords(self, &job, (CTMuint *) aData, aCount, aSize,
+                               aSignedInts, CTM_FALSE);
+  if(job.mError != CTM_NONE)
   {
-    free(packed);
-    self->mError = CTM_OUT_OF_MEMORY;
+    self->mError = job.mError;
     return CTM_FALSE;
   }
 
-  // Uncompress
-  unpackedSize = aCount * aSize * 4;
-  lzmaRes = LzmaUncompress(tmp, &unpackedSize, packed,
-                           &packedSize, props, 5);
+  return CTM_TRUE;
+}
 
-  // Free the packed array
-  free(packed);
+#ifdef _CTM_SUPPORT_SAVE
+//-----------------------------------------------------------------------------
+// _ctmPackBlockCount() - Number of blocks that an interleaved array of aSize
+// bytes is split into when it is packed (one if it is not split).
+//-----------------------------------------------------------------------------
+static size_t _ctmPackBlockCount(_CTMcontext * self, size_t aSize)
+{
+  if((self->mPackBlockSize == 0) || (aSize <= self->mPackBlockSize))
+    return 1;
+  return (aSize + self->mPackBlockSize - 1) / self->mPackBlockSize;
+}
 
-  // Error?
-  if((lzmaRes != SZ_OK) || (unpackedSize != aCount * aSize * 4))
-  {
-    self->mError = CTM_LZMA_ERROR;
-    free(tmp);
-    return CTM_FALSE;
-  }
+//-----------------------------------------------------------------------------
+// _ctmPackedSizeBound() - Maximum size of the packed data of an interleaved
+// array of aSize bytes (including the block table of a block split array).
+//-----------------------------------------------------------------------------
+static size_t _ctmPackedSizeBound(_CTMcontext * self, size_t aSize)
+{
+  size_t blockCount = _ctmPackBlockCount(self, aSize);
 
-  // Convert interleaved array to integers
-  for(i = 0; i < aCount; ++ i)
-  {
-    for(k = 0; k < aSize; ++ k)
-    {
-      value = (CTMint) tmp[i + k * aCount + 3 * aCount * aSize] |
-              (((CTMint) tmp[i + k * aCount + 2 * aCount * aSize]) << 8) |
-              (((CTMint) tmp[i + k * aCount + aCount * aSize]) << 16) |
-              (((CTMint) tmp[i + k * aCount]) << 24);
-      // Convert signed magnitude to two's complement?
-      if(aSignedInts)
-      {
-        x = (CTMuint) value;
-        value = (x & 1) ? -(CTMint)((x + 1) >> 1) : (CTMint)(x >> 1);
-      }
-      aData[i * aSize + k] = value;
-    }
-  }
+  if(blockCount == 1)
+    return 1000 + aSize;
+  return blockCount * (1000 + _CTM_PACK_BLOCK_ENTRY_SIZE) + aSize;
+}
 
-  // Free the interleaved array
-  free(tmp);
+//-----------------------------------------------------------------------------
+// _ctmPackBufferSize() - Size of the memory that is needed for packing an
+// array of aCount elements with aSize components (the interleaved data,
+// followed by the packed data, see _CTMpackjob::mBuffer).
+//-----------------------------------------------------------------------------
+size_t _ctmPackBufferSize(_CTMcontext * self, CTMuint aCount, CTMuint aSize)
+{
+  size_t size = 4 * (size_t) aCount * aSize;
 
-  return CTM_TRUE;
+  return size + _ctmPackedSizeBound(self, size);
 }
 
-#ifdef _CTM_SUPPORT_SAVE
 //-----------------------------------------------------------------------------
-// _ctmStreamWritePackedInts() - Compress a binary integer data array, and
-// write it to a stream.
+// _ctmLzmaEncode() - Compress aSrcSize bytes with LZMA, using the LZMA
+// settings of the context. On input *aDstSize is the size of the aDst buffer,
+// on output it is the size of the packed data. The LZMA props are stored in
+// aProps (LZMA_PROPS_SIZE bytes).
 //-----------------------------------------------------------------------------
-CTMbool _ctmStreamWritePackedInts(_CTMcontext * self, CTMint * aData,
-  CTMuint aCount, CTMuint aSize, CTMint aSignedInts)
+static CTMenum _ctmLzmaEncode(_CTMcontext * self, const CTMubyte * aSrc,
+  size_t aSrcSize, CTMubyte * aDst, size_t * aDstSize, unsigned char * aProps)
 {
-  int lzmaRes, lzmaAlgo;
-  CTMuint i, k;
-  CTMint value;
-  size_t bufSize, outPropsSize;
-  unsigned char * packed, outProps[5], *tmp;
-#ifdef __DEBUG_
-  CTMuint negCount = 0;  
-#endif
+  CLzmaEncProps props;
+  _CTMlzmaalloc lzmaAlloc;
+  SizeT dstSize = *aDstSize, outPropsSize;
+  SRes lzmaRes;
+
+  // LZMA settings (see ctmCompressionThreads() etc). By default the multi
+  // threaded match finder is not used when arrays are compressed in parallel
+  // (all the cores are busy anyway).
+  LzmaEncProps_Init(&props);
+  props.level = self->mCompressionLevel;              // Level (0-9)
+  props.algo = (self->mCompressionLevel < 1 ? 0 : 1); // 0 = fast, 1 = normal
+  if(self->mLzmaFastBytes > 0)
+    props.fb = (int) self->mLzmaFastBytes;
+  if(self->mLzmaThreads > 0)
+    props.numThreads = (int) self->mLzmaThreads;
+  else if((aSrcSize < _CTM_LZMA_MT_MIN_SIZE) || (self->mTaskThreads > 0))
+    props.numThreads = 1;
+
+  // The dictionary does not need to be larger than the data (this saves
+  // memory both when compressing and when uncompressing)
+  if(self->mLzmaDictSize > 0)
+    props.dictSize = self->mLzmaDictSize;
+  else
+    props.dictSize = LzmaEncProps_GetDictSize(&props);
+  if(props.dictSize > aSrcSize)
+    props.dictSize = aSrcSize > 4096 ? (UInt32) aSrcSize : 4096;
+
+  // Call LZMA to compress (the encoder memory is allocated with the memory
+  // allocation functions of the context)
+  outPropsSize = LZMA_PROPS_SIZE;
+  _ctmInitLzmaAlloc(self, &lzmaAlloc);
+  lzmaRes = LzmaEncode(aDst, &dstSize, aSrc, aSrcSize, &props, aProps,
+                       &outPropsSize, 0, (ICompressProgress *) 0,
+                       &lzmaAlloc.mFuncs, &lzmaAlloc.mFuncs);
+  *aDstSize = dstSize;
+
+  return lzmaRes == SZ_OK ? CTM_NONE : CTM_LZMA_ERROR;
+}
 
-  // Allocate memory for interleaved array
-  tmp = (unsigned char *) malloc(aCount * aSize * 4);
-  if(!tmp)
+//-----------------------------------------------------------------------------
+// _ctmPackBlockTask() - Compress one block of a block split array (task for
+// _ctmRunTasks()).
+//-----------------------------------------------------------------------------
+static void _ctmPackBlockTask(void * aArg, CTMuint aIndex)
+{
+  _CTMblocktask * task = (_CTMblocktask *) aArg;
+  _CTMpackblock * block = &task->mBlocks[aIndex];
+
+  block->mError = _ctmLzmaEncode(task->mContext, block->mSrc, block->mSrcSize,
+                                 block->mDst, &block->mDstSize, block->mProps);
+}
+
+//-----------------------------------------------------------------------------
+// _ctmPackBlocks() - Compress an interleaved array as a block split array
+// into aJob->mPacked (which holds _ctmPackedSizeBound() bytes). The blocks
+// are compressed in parallel. The packed data is the block table (packed size
+// and LZMA props of each block), followed by the packed blocks.
+//-----------------------------------------------------------------------------
+static CTMenum _ctmPackBlocks(_CTMcontext * self, const unsigned char * aData,
+  size_t aSize, _CTMpackjob * aJob)
+{
+  _CTMpackblock * blocks;
+  _CTMblocktask task;
+  CTMubyte * entry;
+  size_t blockSize = self->mPackBlockSize, pos;
+  CTMuint i, blockCount;
+  CTMenum err = CTM_NONE;
+
+  blockCount = (CTMuint) _ctmPackBlockCount(self, aSize);
+  blocks = (_CTMpackblock *) _ctmAlloc(self, sizeof(_CTMpackblock) * blockCount);
+  if(!blocks)
+    return CTM_OUT_OF_MEMORY;
+
+  // Compress all the blocks (each block into its own part of the output
+  // buffer, after the block table)
+  pos = (size_t) blockCount * _CTM_PACK_BLOCK_ENTRY_SIZE;
+  for(i = 0; i < blockCount; ++ i)
   {
-    self->mError = CTM_OUT_OF_MEMORY;
-    return CTM_FALSE;
+    blocks[i].mSrc = &aData[i * blockSize];
+    blocks[i].mSrcSize = aSize - i * blockSize;
+    if(blocks[i].mSrcSize > blockSize)
+      blocks[i].mSrcSize = blockSize;
+    blocks[i].mDst = &aJob->mPacked[pos + i * (1000 + blockSize)];
+    blocks[i].mDstSize = 1000 + blocks[i].mSrcSize;
   }
+  task.mContext = self;
+  task.mBlocks = blocks;
+  _ctmRunTasks(self, blockCount, _ctmPackBlockTask, (void *) &task);
 
-  // Convert integers to an interleaved array
-  for(i = 0; i < aCount; ++ i)
+  // Write the block table, and move the packed blocks together
+  for(i = 0; (i < blockCount) && (err == CTM_NONE); ++ i)
   {
-    for(k = 0; k < aSize; ++ k)
-    {
-      value = aData[i * aSize + k];
-      // Convert two's complement to signed magnitude?
-      if(aSignedInts)
-        value = value < 0 ? -1 - (value << 1) : value << 1;
-#ifdef __DEBUG_
-      else if(value < 0)
-        ++ negCount;
-#endif
-      tmp[i + k * aCount + 3 * aCount * aSize] = value & 0x000000ff;
-      tmp[i + k * aCount + 2 * aCount * aSize] = (value >> 8) & 0x000000ff;
-      tmp[i + k * aCount + aCount * aSize] = (value >> 16) & 0x000000ff;
-      tmp[i + k * aCount] = (value >> 24) & 0x000000ff;
-    }
+    err = blocks[i].mError;
+    entry = &aJob->mPacked[i * _CTM_PACK_BLOCK_ENTRY_SIZE];
+    entry[0] = (CTMubyte) (blocks[i].mDstSize & 0xff);
+    entry[1] = (CTMubyte) ((blocks[i].mDstSize >> 8) & 0xff);
+    entry[2] = (CTMubyte) ((blocks[i].mDstSize >> 16) & 0xff);
+    entry[3] = (CTMubyte) ((blocks[i].mDstSize >> 24) & 0xff);
+    memcpy(&entry[4], blocks[i].mProps, LZMA_PROPS_SIZE);
+    memmove(&aJob->mPacked[pos], blocks[i].mDst, blocks[i].mDstSize);
+    pos += blocks[i].mDstSize;
   }
+  aJob->mPackedSize = pos;
+
+  // The props of the array identify it as a block split array, and give the
+  // block size
+  aJob->mProps[0] = _CTM_PACK_BLOCKS_ID;
+  aJob->mProps[1] = (unsigned char) (blockSize & 0xff);
+  aJob->mProps[2] = (unsigned char) ((blockSize >> 8) & 0xff);
+  aJob->mProps[3] = (unsigned char) ((blockSize >> 16) & 0xff);
+  aJob->mProps[4] = (unsigned char) ((blockSize >> 24) & 0xff);
+
+  _ctmFree(self, (void *) blocks);
 
+  return err;
+}
+
+//-----------------------------------------------------------------------------
+// _ctmPackPlanes() - Compress an interleaved (byte plane) array into memory.
+// The result is stored in aJob (in aJob->mBuffer, after the interleaved data,
+// if the job has a buffer). Large arrays are split into blocks if the context
+// says so (see ctmCompressionBlockSize()).
+//-----------------------------------------------------------------------------
+static void _ctmPackPlanes(_CTMcontext * self, const unsigned char * aData,
+  size_t aSize, _CTMpackjob * aJob)
+{
   // Allocate memory for the packed data
-  bufSize = 1000 + aCount * aSize * 4;
-  packed = (unsigned char *) malloc(bufSize);
-  if(!packed)
+  aJob->mPackedSize = _ctmPackedSizeBound(self, aSize);
+  if(aJob->mBuffer)
+    aJob->mPacked = &aJob->mBuffer[aSize];
+  else
+    aJob->mPacked = (unsigned char *) _ctmAlloc(self, aJob->mPackedSize);
+  if(!aJob->mPacked)
   {
-    free(tmp);
-    self->mError = CTM_OUT_OF_MEMORY;
-    return CTM_FALSE;
+    aJob->mError = CTM_OUT_OF_MEMORY;
+    return;
   }
 
-  // Call LZMA to compress
-  outPropsSize = 5;
-  lzmaAlgo = (self->mCompressionLevel < 1 ? 0 : 1);
-  lzmaRes = LzmaCompress(packed,
-                         &bufSize,
-                         (const unsigned char *) tmp,
-                         aCount * aSize * 4,
-                         outProps,
-                         &outPropsSize,
-                         self->mCompressionLevel, // Level (0-9)
-                         0, -1, -1, -1, -1, -1,   // Default values (set by level)
-                         lzmaAlgo                 // Algorithm (0 = fast, 1 = normal)
-                        );
-
-  // Free temporary array
-  free(tmp);
+  // Compress
+  if(_ctmPackBlockCount(self, aSize) > 1)
+    aJob->mError = _ctmPackBlocks(self, aData, aSize, aJob);
+  else
+    aJob->mError = _ctmLzmaEncode(self, aData, aSize, aJob->mPacked,
+                                  &aJob->mPackedSize, aJob->mProps);
 
   // Error?
-  if(lzmaRes != SZ_OK)
+  if(aJob->mError != CTM_NONE)
   {
-    self->mError = CTM_LZMA_ERROR;
-    free(packed);
-    return CTM_FALSE;
+    if(!aJob->mBuffer)
+      _ctmFree(self, aJob->mPacked);
+    aJob->mPacked = (unsigned char *) 0;
+    return;
   }
 
 #ifdef __DEBUG_
-  printf("%d->%d bytes (%d negative words)\n", aCount * aSize * 4, (int) bufSize, negCount);
+  printf("%d->%d bytes\n", (int) aSize, (int) aJob->mPackedSize);
 #endif
+}
+
+//-----------------------------------------------------------------------------
+// _ctmStreamWritePackJob() - Write a packed array (that has been compressed by
+// _ctmPackInts()) to a stream, and free the packed data (unless it is in the
+// buffer of the job).
+//-----------------------------------------------------------------------------
+CTMbool _ctmStreamWritePackJob(_CTMcontext * self, _CTMpackjob * aJob)
+{
+  // Did the compression fail?
+  if(aJob->mError != CTM_NONE)
+  {
+    self->mError = aJob->mError;
+    return CTM_FALSE;
+  }
 
   // Write packed data size to the stream
-  _ctmStreamWriteUINT(self, (CTMuint) bufSize);
+  _ctmStreamWriteUINT(self, (CTMuint) aJob->mPackedSize);
 
   // Write LZMA compression props to the stream
-  _ctmStreamWrite(self, (void *) outProps, 5);
+  _ctmStreamWrite(self, (void *) aJob->mProps, 5);
 
   // Write the packed data to the stream
-  _ctmStreamWrite(self, (void *) packed, (CTMuint) bufSize);
+  _ctmStreamWrite(self, (void *) aJob->mPacked, (CTMuint) aJob->mPackedSize);
 
   // Free the packed data
-  free(packed);
+  if(!aJob->mBuffer)
+    _ctmFree(self, aJob->mPacked);
+  aJob->mPacked = (unsigned char *) 0;
 
   return CTM_TRUE;
 }
-#endif
 
 //-----------------------------------------------------------------------------
-// _ctmStreamReadPackedFloatArray() - Read a compressed binary float data
-// array from a stream, and uncompress it.
+// _ctmInterleaveWords() - Convert an array of words (element i, component k
+// at aWords[i * aSize + k]) to an interleaved byte plane array.
 //-----------------------------------------------------------------------------
-CTMbool _ctmStreamReadPackedFloatArray(_CTMcontext * self, _CTMarray * aArray,
-  CTMuint aCount, CTMuint aSize)
+static void _ctmInterleaveWords(const CTMuint * aWords, CTMuint aCount,
+  CTMuint aSize, CTMint aSignedInts, unsigned char * aDst)
 {
-  CTMuint i, k;
-  size_t packedSize, unpackedSize;
-  union {
-    CTMfloat f;
-    CTMint i;
-  } value;
-  unsigned char * packed, * tmp;
-  unsigned char props[5];
-  int lzmaRes;
-
-  // Read packed data size from the stream
-  packedSize = (size_t) _ctmStreamReadUINT(self);
+  CTMuint block[_CTM_PLANE_BLOCK_SIZE];
+  CTMuint i, j, k, n;
 
-  // Read LZMA compression props from the stream
-  _ctmStreamRead(self, (void *) props, 5);
+  // Single component arrays need no gathering
+  if(aSize == 1)
+  {
+    _ctmSplitBytePlanes(aWords, aCount, aDst, aCount, aSignedInts);
+    return;
+  }
 
-  // Allocate memory and read the packed data from the stream
-  packed = (unsigned char *) malloc(packedSize);
-  if(!packed)
+  // Gather one component at a time, in blocks
+  for(k = 0; k < aSize; ++ k)
   {
-    self->mError = CTM_OUT_OF_MEMORY;
-    return CTM_FALSE;
+    for(i = 0; i < aCount; i += n)
+    {
+      n = aCount - i;
+      if(n > _CTM_PLANE_BLOCK_SIZE)
+        n = _CTM_PLANE_BLOCK_SIZE;
+      for(j = 0; j < n; ++ j)
+        block[j] = aWords[(i + j) * aSize + k];
+      _ctmSplitBytePlanes(block, n, &aDst[k * aCount + i], aCount * aSize,
+                          aSignedInts);
+    }
   }
-  _ctmStreamRead(self, (void *) packed, (CTMuint) packedSize);
+}
+
+//-----------------------------------------------------------------------------
+// _ctmPackInts() - Compress a binary integer data array (given by aJob) into
+// memory. This function does not modify the stream or the context, so several
+// arrays can be packed in parallel. If the job has no buffer, the memory for
+// the packed data is allocated (and freed by _ctmStreamWritePackJob()).
+//-----------------------------------------------------------------------------
+void _ctmPackInts(_CTMcontext * self, _CTMpackjob * aJob)
+{
+  unsigned char * tmp;
+  CTMuint n = aJob->mCount * aJob->mSize;
+#ifdef __DEBUG_
+  CTMuint i, negCount = 0;
+#endif
+
+  aJob->mError = CTM_NONE;
+  aJob->mPacked = (unsigned char *) 0;
 
   // Allocate memory for interleaved array
-  tmp = (unsigned char *) malloc(aCount * aSize * 4);
+  if(aJob->mBuffer)
+    tmp = aJob->mBuffer;
+  else
+    tmp = (unsigned char *) _ctmAlloc(self, n * 4);
   if(!tmp)
   {
-    free(packed);
-    self->mError = CTM_OUT_OF_MEMORY;
-    return CTM_FALSE;
+    aJob->mError = CTM_OUT_OF_MEMORY;
+    return;
   }
 
-  // Uncompress
-  unpackedSize = aCount * aSize * 4;
-  lzmaRes = LzmaUncompress(tmp, &unpackedSize, packed,
-                           &packedSize, props, 5);
+#ifdef __DEBUG_
+  if(!aJob->mSignedInts)
+  {
+    for(i = 0; i < n; ++ i)
+      if(aJob->mData[i] < 0)
+        ++ negCount;
+  }
+  printf("%d negative words, ", negCount);
+#endif
 
-  // Free the packed array
-  free(packed);
+  // Convert integers to an interleaved array
+  _ctmInterleaveWords((const CTMuint *) aJob->mData, aJob->mCount,
+                      aJob->mSize, aJob->mSignedInts, tmp);
 
-  // Error?
-  if((lzmaRes != SZ_OK) || (unpackedSize != aCount * aSize * 4))
+  // Compress the interleaved array
+  _ctmPackPlanes(self, tmp, n * 4, aJob);
+
+  // Free temporary array
+  if(!aJob->mBuffer)
+    _ctmFree(self, tmp);
+}
+
+//-----------------------------------------------------------------------------
+// _ctmStreamWritePackedInts() - Compress a binary integer data array, and
+// write it to a stream.
+//-----------------------------------------------------------------------------
+CTMbool _ctmStreamWritePackedInts(_CTMcontext * self, CTMint * aData,
+  CTMuint aCount, CTMuint aSize, CTMint aSignedInts)
+{
+  _CTMpackjob job;
+  CTMbool ok;
+
+  job.mData = aData;
+  job.mCount = aCount;
+  job.mSize = aSize;
+  job.mSignedInts = aSignedInts;
+  job.mBuffer = (unsigned char *) _ctmScratchAlloc(self,
+    _ctmPackBufferSize(self, aCount, aSize));
+  if(!job.mBuffer)
   {
-    self->mError = CTM_LZMA_ERROR;
-    free(tmp);
+    self->mError = CTM_OUT_OF_MEMORY;
     return CTM_FALSE;
   }
+  _ctmPackInts(self, &job);
+  ok = _ctmStreamWritePackJob(self, &job);
+  _ctmScratchFree(self, (void *) job.mBuffer);
 
-  // Convert interleaved array to floats
-  for(i = 0; i < aCount; ++ i)
+  return ok;
+}
+#endif
+
+//-----------------------------------------------------------------------------
+// _ctmStreamReadPackedFloatArray() - Read a compressed binary float data
+// array from a stream, and uncompress it.
+//-----------------------------------------------------------------------------
+CTMbool _ctmStreamReadPackedFloatArray(_CTMcontext * self, _CTMarray * aArray,
+  CTMuint aCount, CTMuint aSize)
+{
+  _CTMunpackjob job;
+
+  // Uncompress directly from the stream into the array
+  if(!_ctmStreamReadPackHeader(self, &job))
+    return CTM_FALSE;
+  job.mError = _ctmDecodeFloatArray(self, &job, aArray, aCount, aSize);
+  if(job.mError != CTM_NONE)
   {
-    for(k = 0; k < aSize; ++ k)
-    {
-      value.i = (CTMint) tmp[i + k * aCount + 3 * aCount * aSize] |
-                (((CTMint) tmp[i + k * aCount + 2 * aCount * aSize]) << 8) |
-                (((CTMint) tmp[i + k * aCount + aCount * aSize]) << 16) |
-                (((CTMint) tmp[i + k * aCount]) << 24);
-      aArray->setf(aArray, i, k, value.f);
-    }
+    self->mError = job.mError;
+    return CTM_FALSE;
   }
 
-  // Free the interleaved array
-  free(tmp);
-
   return CTM_TRUE;
 }
 
@@ -441,87 +1461,43 @@ CTMbool _ctmStreamReadPackedFloatArray(_CTMcontext * self, _CTMarray * aArray,
 CTMbool _ctmStreamWritePackedFloatArray(_CTMcontext * self, _CTMarray * aArray,
   CTMuint aCount, CTMuint aSize)
 {
-  int lzmaRes, lzmaAlgo;
-  CTMuint i, k;
-  union {
-    CTMfloat f;
-    CTMint i;
-  } value;
-  size_t bufSize, outPropsSize;
-  unsigned char * packed, outProps[5], *tmp;
-
-  // Allocate memory for interleaved array
-  tmp = (unsigned char *) malloc(aCount * aSize * 4);
-  if(!tmp)
+  const CTMfloat * data;
+  CTMfloat * dataBuf;
+  _CTMpackjob job;
+  CTMbool ok;
+
+  // Allocate memory for the interleaved array and the packed data
+  job.mBuffer = (unsigned char *) _ctmScratchAlloc(self,
+    _ctmPackBufferSize(self, aCount, aSize));
+  if(!job.mBuffer)
   {
     self->mError = CTM_OUT_OF_MEMORY;
     return CTM_FALSE;
   }
 
-  // Convert floats to an interleaved array
-  for(i = 0; i < aCount; ++ i)
+  // Get a packed view of the array (a packed float array is used directly)
+  data = _ctmPackedArrayf(self, aArray, aCount, aSize, &dataBuf);
+  if(!data)
   {
-    for(k = 0; k < aSize; ++ k)
-    {
-      value.f = aArray->getf(aArray, i, k);
-      tmp[i + k * aCount + 3 * aCount * aSize] = value.i & 0x000000ff;
-      tmp[i + k * aCount + 2 * aCount * aSize] = (value.i >> 8) & 0x000000ff;
-      tmp[i + k * aCount + aCount * aSize] = (value.i >> 16) & 0x000000ff;
-      tmp[i + k * aCount] = (value.i >> 24) & 0x000000ff;
-    }
-  }
-
-  // Allocate memory for the packed data
-  bufSize = 1000 + aCount * aSize * 4;
-  packed = (unsigned char *) malloc(bufSize);
-  if(!packed)
-  {
-    free(tmp);
     self->mError = CTM_OUT_OF_MEMORY;
+    _ctmScratchFree(self, (void *) job.mBuffer);
     return CTM_FALSE;
   }
 
-  // Call LZMA to compress
-  outPropsSize = 5;
-  lzmaAlgo = (self->mCompressionLevel < 1 ? 0 : 1);
-  lzmaRes = LzmaCompress(packed,
-                         &bufSize,
-                         (const unsigned char *) tmp,
-                         aCount * aSize * 4,
-                         outProps,
-                         &outPropsSize,
-                         self->mCompressionLevel, // Level (0-9)
-                         0, -1, -1, -1, -1, -1,   // Default values (set by level)
-                         lzmaAlgo                 // Algorithm (0 = fast, 1 = normal)
-                        );
-
-  // Free temporary array
-  free(tmp);
-
-  // Error?
-  if(lzmaRes != SZ_OK)
-  {
-    self->mError = CTM_LZMA_ERROR;
-    free(packed);
-    return CTM_FALSE;
-  }
-
-#ifdef __DEBUG_
-  printf("%d->%d bytes\n", aCount * aSize * 4, (int) bufSize);
-#endif
-
-  // Write packed data size to the stream
-  _ctmStreamWriteUINT(self, (CTMuint) bufSize);
+  // Convert floats to an interleaved array
+  _ctmInterleaveWords((const CTMuint *) data, aCount, aSize, CTM_FALSE,
+                      job.mBuffer);
+  if(dataBuf)
+    _ctmFree(self, dataBuf);
 
-  // Write LZMA compression props to the stream
-  _ctmStreamWrite(self, (void *) outProps, 5);
+  // Compress the interleaved array
+  job.mError = CTM_NONE;
+  _ctmPackPlanes(self, job.mBuffer, aCount * aSize * 4, &job);
 
   // Write the packed data to the stream
-  _ctmStreamWrite(self, (void *) packed, (CTMuint) bufSize);
+  ok = _ctmStreamWritePackJob(self, &job);
+  _ctmScratchFree(self, (void *) job.mBuffer);
 
-  // Free the packed data
-  free(packed);
-
-  return CTM_TRUE;
+  return ok;
 }
 #endif
@@ -0,0 +1,297 @@
+//-----------------------------------------------------------------------------
+// Product:     OpenCTM
+// File:        framestest.c
+// Description: Test of the MG2 animation frames. Meshes that move relative to
+//              the first frame are saved and decoded, and every frame must be
+//              within the vertex precision of the original frame. Frames that
+//              move too far from the grid of the first frame must be rejected
+//              with CTM_INVALID_MESH.
+//-----------------------------------------------------------------------------
+// Copyright (c) 2009-2013 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "openctm2.h"
+#include "internal.h"
+
+// Grid size of the test mesh
+#define GRID_SIZE 32
+#define VERTEX_COUNT (GRID_SIZE * GRID_SIZE)
+#define TRIANGLE_COUNT (2 * (GRID_SIZE - 1) * (GRID_SIZE - 1))
+
+// Maximum number of frames in a test
+#define MAX_FRAMES 4
+
+// Maximum number of failures that are reported in detail
+#define MAX_REPORTS 10
+static int gReports = 0;
+
+#ifdef _CTM_SUPPORT_SAVE
+
+//-----------------------------------------------------------------------------
+// _CTMframetest - One animation test case.
+//-----------------------------------------------------------------------------
+typedef struct {
+  const char * mName;
+  CTMfloat mPrecision;            // Vertex precision
+  CTMbool mParallelogram;         // Use parallelogram prediction?
+  CTMuint mFrameCount;            // Number of frames
+  CTMfloat mOffsets[MAX_FRAMES];  // Offset of each frame (along all axes)
+  CTMbool mValid;                 // Can the last frame be saved?
+} _CTMframetest;
+
+static const _CTMframetest gTests[] = {
+  { "moderate motion", 1.0f / 1024.0f, CTM_FALSE, 4, { 0.0f, 100.0f, -50.0f, 0.5f }, CTM_TRUE },
+  { "moderate motion", 1.0f / 1024.0f, CTM_TRUE, 4, { 0.0f, 100.0f, -50.0f, 0.5f }, CTM_TRUE },
+  { "deltas above 2^31 steps", 1e-6f, CTM_FALSE, 3, { 0.0f, -1500.0f, 1500.0f }, CTM_TRUE },
+  { "2^32 steps from the grid", 1e-6f, CTM_FALSE, 3, { 0.0f, 0.0f, 5000.0f }, CTM_FALSE },
+  { "2^32 steps from the grid", 1e-6f, CTM_FALSE, 2, { 0.0f, -5000.0f }, CTM_FALSE },
+  { "2^22 steps from the lattice", 1.0f / 1024.0f, CTM_TRUE, 2, { 0.0f, 5000.0f }, CTM_TRUE },
+  { "2^32 steps from the lattice", 1e-6f, CTM_TRUE, 2, { 0.0f, 5000.0f }, CTM_FALSE },
+  { "2^27 steps from the lattice", 1.0f / 1024.0f, CTM_TRUE, 2, { 0.0f, -131072.0f }, CTM_FALSE }
+};
+
+static CTMuint gIndices[TRIANGLE_COUNT * 3];
+static CTMfloat gVertices[MAX_FRAMES][VERTEX_COUNT * 3];
+static CTMfloat gIds[VERTEX_COUNT];
+static CTMuint gOutIndices[TRIANGLE_COUNT * 3];
+static CTMfloat gOutVertices[VERTEX_COUNT * 3];
+static CTMfloat gOutIds[VERTEX_COUNT];
+
+//-----------------------------------------------------------------------------
+// MakeFrames() - Create the frames of a test: a wavy GRID_SIZE x GRID_SIZE
+// grid, with a different wave and the given offset in each frame.
+//-----------------------------------------------------------------------------
+static void MakeFrames(const _CTMframetest * aTest)
+{
+  CTMuint f, i, j, k;
+
+  for(j = 0; j < GRID_SIZE; ++ j)
+  {
+    for(i = 0; i < GRID_SIZE; ++ i)
+    {
+      k = j * GRID_SIZE + i;
+      gIds[k] = (CTMfloat) k;
+      for(f = 0; f < aTest->mFrameCount; ++ f)
+      {
+        gVertices[f][k * 3] = 0.1f * i + aTest->mOffsets[f];
+        gVertices[f][k * 3 + 1] = 0.1f * j + aTest->mOffsets[f];
+        gVertices[f][k * 3 + 2] = 0.2f * sinf(0.3f * i + f) * cosf(0.2f * j) +
+                                  aTest->mOffsets[f];
+      }
+
+      // Two triangles per grid cell
+      if((i < GRID_SIZE - 1) && (j < GRID_SIZE - 1))
+      {
+        k = (j * (GRID_SIZE - 1) + i) * 6;
+        gIndices[k] = j * GRID_SIZE + i;
+        gIndices[k + 1] = j * GRID_SIZE + i + 1;
+        gIndices[k + 2] = (j + 1) * GRID_SIZE + i + 1;
+        gIndices[k + 3] = j * GRID_SIZE + i;
+        gIndices[k + 4] = (j + 1) * GRID_SIZE + i + 1;
+        gIndices[k + 5] = (j + 1) * GRID_SIZE + i;
+      }
+    }
+  }
+}
+
+//-----------------------------------------------------------------------------
+// CheckFrame() - Compare a decoded frame with the original frame (the
+// original vertex indices are given by gOutIds). Returns the number of errors.
+//-----------------------------------------------------------------------------
+static int CheckFrame(const _CTMframetest * aTest, CTMuint aFrame)
+{
+  CTMuint i, j, k;
+  CTMfloat d, bound;
+  int errors = 0;
+
+  for(i = 0; i < VERTEX_COUNT; ++ i)
+  {
+    k = (CTMuint) gOutIds[i];
+    if(k >= VERTEX_COUNT)
+    {
+      if(gReports ++ < MAX_REPORTS)
+        printf("FAILED: frame %u, vertex %u has the id %g\n", aFrame, i, gOutIds[i]);
+      ++ errors;
+      continue;
+    }
+    for(j = 0; j < 3; ++ j)
+    {
+      // Half a precision step, plus the rounding of the float calculations
+      d = fabsf(gOutVertices[i * 3 + j] - gVertices[aFrame][k * 3 + j]);
+      bound = 0.5f * aTest->mPrecision +
+              4.0f * FLT_EPSILON * (fabsf(gVertices[aFrame][k * 3 + j]) + 10.0f);
+      if(!(d <= bound))
+      {
+        if(gReports ++ < MAX_REPORTS)
+          printf("FAILED: frame %u, vertex %u is %g (expected %g)\n", aFrame, k,
+                 gOutVertices[i * 3 + j], gVertices[aFrame][k * 3 + j]);
+        ++ errors;
+        break;
+      }
+    }
+  }
+
+  return errors;
+}
+
+//-----------------------------------------------------------------------------
+// DecodeFrames() - Decode an animated MG2 file from memory, and compare each
+// frame with the original frame. Returns the number of errors.
+//-----------------------------------------------------------------------------
+static int DecodeFrames(const _CTMframetest * aTest, const void * aData,
+  CTMuint aSize)
+{
+  CTMcontext ctm;
+  CTMenum err;
+  CTMuint f;
+  int errors = 0;
+
+  ctm = ctmNewContext(CTM_IMPORT);
+  ctmOpenReadMemory(ctm, aData, aSize);
+  err = ctmGetError(ctm);
+  if((err == CTM_NONE) &&
+     ((ctmGetInteger(ctm, CTM_FRAME_COUNT) != aTest->mFrameCount) ||
+      (ctmGetInteger(ctm, CTM_VERTEX_COUNT) != VERTEX_COUNT) ||
+      (ctmGetInteger(ctm, CTM_ATTRIB_MAP_COUNT) != 1)))
+  {
+    printf("FAILED: the file has the wrong frame, vertex or map count\n");
+    ctmFreeContext(ctm);
+    return 1;
+  }
+  if(err == CTM_NONE)
+  {
+    ctmArrayPointer(ctm, CTM_INDICES, 3, CTM_UINT, 0, gOutIndices);
+    ctmArrayPointer(ctm, CTM_VERTICES, 3, CTM_FLOAT, 0, gOutVertices);
+    ctmArrayPointer(ctm, CTM_ATTRIB_MAP_1, 1, CTM_FLOAT, 0, gOutIds);
+    ctmReadMesh(ctm);
+    err = ctmGetError(ctm);
+  }
+  for(f = 0; (f < aTest->mFrameCount) && (err == CTM_NONE); ++ f)
+  {
+    if(f > 0)
+    {
+      ctmReadNextFrame(ctm);
+      err = ctmGetError(ctm);
+      if(err != CTM_NONE)
+        break;
+    }
+    errors += CheckFrame(aTest, f);
+  }
+  if(err != CTM_NONE)
+  {
+    printf("FAILED: could not read frame %u (%s)\n", f, ctmErrorString(err));
+    ++ errors;
+  }
+  ctmFreeContext(ctm);
+
+  return errors;
+}
+
+//-----------------------------------------------------------------------------
+// TestFrames() - Save the frames of a test as an animated MG2 file, and
+// decode it. Returns the number of errors.
+//-----------------------------------------------------------------------------
+static int TestFrames(const _CTMframetest * aTest)
+{
+  CTMcontext ctm;
+  CTMenum ids, err;
+  CTMuint f;
+  int errors = 0;
+
+  printf("Testing %s, vertex precision %g%s...\n", aTest->mName,
+         aTest->mPrecision, aTest->mParallelogram ? ", parallelogram" : "");
+  MakeFrames(aTest);
+
+  // Save all frames (only the last frame may fail)
+  ctm = ctmNewContext(CTM_EXPORT);
+  ctmCompressionMethod(ctm, CTM_METHOD_MG2);
+  ctmVertexPrecision(ctm, aTest->mPrecision);
+  ctmParallelogramPrediction(ctm, aTest->mParallelogram);
+  ctmVertexCount(ctm, VERTEX_COUNT);
+  ctmTriangleCount(ctm, TRIANGLE_COUNT);
+  ctmFrameCount(ctm, aTest->mFrameCount);
+  ctmArrayPointer(ctm, CTM_INDICES, 3, CTM_UINT, 0, gIndices);
+  ctmArrayPointer(ctm, CTM_VERTICES, 3, CTM_FLOAT, 0, gVertices[0]);
+  ids = ctmAddAttribMap(ctm, "id");
+  ctmArrayPointer(ctm, ids, 1, CTM_FLOAT, 0, gIds);
+  ctmAttribPrecision(ctm, ids, 1.0f);
+  ctmSaveMemory(ctm);
+  err = ctmGetError(ctm);
+  for(f = 1; (f < aTest->mFrameCount) && (err == CTM_NONE); ++ f)
+  {
+    ctmArrayPointer(ctm, CTM_VERTICES, 3, CTM_FLOAT, 0, gVertices[f]);
+    ctmWriteNextFrame(ctm, (CTMfloat) f);
+    err = ctmGetError(ctm);
+  }
+  if(!aTest->mValid)
+  {
+    if((err != CTM_INVALID_MESH) || (f != aTest->mFrameCount))
+    {
+      printf("FAILED: frame %u gave %s (expected CTM_INVALID_MESH for the last frame)\n",
+             f - 1, err != CTM_NONE ? ctmErrorString(err) : "no error");
+      ++ errors;
+    }
+    ctmFreeContext(ctm);
+    return errors;
+  }
+  if(err != CTM_NONE)
+  {
+    printf("FAILED: could not save frame %u (%s)\n", f - 1, ctmErrorString(err));
+    ctmFreeContext(ctm);
+    return 1;
+  }
+
+  errors += DecodeFrames(aTest, ctmGetMemoryBuffer(ctm),
+                         ctmGetInteger(ctm, CTM_MEMORY_SIZE));
+  ctmFreeContext(ctm);
+
+  return errors;
+}
+
+#endif // _CTM_SUPPORT_SAVE
+
+//-----------------------------------------------------------------------------
+// main()
+//-----------------------------------------------------------------------------
+int main(void)
+{
+  int errors = 0;
+#ifdef _CTM_SUPPORT_SAVE
+  CTMuint i;
+
+  for(i = 0; i < sizeof(gTests) / sizeof(gTests[0]); ++ i)
+    errors += TestFrames(&gTests[i]);
+#endif
+
+  if(errors > 0)
+  {
+    printf("%d test(s) failed.\n", errors);
+    return 1;
+  }
+  printf("All tests passed.\n");
+  return 0;
+}
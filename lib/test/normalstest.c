@@ -0,0 +1,590 @@
+//-----------------------------------------------------------------------------
+// Product:     OpenCTM
+// File:        normalstest.c
+// Description: Test of the MG2 normal decoding. The batched sine/cosine
+//              function (_ctmSinCosBlock()) is compared to sinf()/cosf() over
+//              its whole angle range, and MG2 files with normals are decoded
+//              both with it and with sinf()/cosf(). The decoded normals must
+//              also be within the quantization step of the original normals.
+//              Usage: normalstest [file.ctm ...] (the given MG2 files are
+//              tested in addition to the built in meshes).
+//-----------------------------------------------------------------------------
+// Copyright (c) 2009-2013 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "openctm2.h"
+#include "internal.h"
+
+#ifndef PI
+#define PI 3.141592653589793238462643f
+#endif
+
+// Number of angles per _ctmSinCosBlock() call
+#define SWEEP_BLOCK 4096
+
+// Number of evenly spaced angles in the sweep over the whole angle range
+#define SWEEP_COUNT (1 << 23)
+
+// Number of floats on each side of the zeros of sin()/cos() that are tested
+#define ZERO_NEIGHBORS 16
+
+// Largest allowed absolute difference from sinf()/cosf()
+#define MAX_ABS_ERROR (2.0f * FLT_EPSILON)
+
+// Largest allowed difference from sinf()/cosf() in ULP, for results whose
+// magnitude is at least MIN_ULP_RESULT (closer to zero, the error in ULP grows
+// without bounds, but the absolute error is still below MAX_ABS_ERROR)
+#define MAX_ULP_ERROR 4.0
+#define MIN_ULP_RESULT (1.0f / 1024.0f)
+
+// Largest allowed difference between normals that are decoded with
+// _ctmSinCosBlock() and with sinf()/cosf() (relative to the normal magnitude)
+#define MAX_DECODE_ERROR (8.0f * FLT_EPSILON)
+
+// Grid size of the built in meshes
+#define GRID_SIZE 96
+
+// Maximum number of failures that are reported in detail
+#define MAX_REPORTS 10
+static int gReports = 0;
+
+#ifdef _CTM_SUPPORT_SAVE
+//-----------------------------------------------------------------------------
+// Random() - Simple pseudo random number generator (deterministic, so that
+// failures can be reproduced). Returns a value in the range [0, 1).
+//-----------------------------------------------------------------------------
+static CTMuint gSeed = 1;
+static CTMfloat Random(void)
+{
+  gSeed = gSeed * 1664525U + 1013904223U;
+  return (CTMfloat) (gSeed >> 8) * (1.0f / 16777216.0f);
+}
+#endif // _CTM_SUPPORT_SAVE
+
+//-----------------------------------------------------------------------------
+// UlpDiff() - Difference between a value and a reference value, in units of
+// the ULP of the reference value.
+//-----------------------------------------------------------------------------
+static double UlpDiff(CTMfloat aValue, CTMfloat aRef)
+{
+  CTMfloat ref = fabsf(aRef);
+  return fabs((double) aValue - (double) aRef) /
+         (double) (nextafterf(ref, 2.0f * ref + 1.0f) - ref);
+}
+
+//-----------------------------------------------------------------------------
+// _CTMsweepstats - Result of the _ctmSinCosBlock() tests.
+//-----------------------------------------------------------------------------
+typedef struct {
+  CTMfloat mMaxAbs;    // Largest absolute difference
+  CTMfloat mMaxAbsAngle;
+  double mMaxUlp;      // Largest difference in ULP (see MIN_ULP_RESULT)
+  CTMfloat mMaxUlpAngle;
+  CTMuint mCount;      // Number of tested angles
+  int mErrors;
+} _CTMsweepstats;
+
+//-----------------------------------------------------------------------------
+// TestSinCos() - Compare _ctmSinCosBlock() to sinf()/cosf() for a number of
+// angles.
+//-----------------------------------------------------------------------------
+static void TestSinCos(const CTMfloat * aAngles, CTMuint aCount,
+  _CTMsweepstats * aStats)
+{
+  CTMfloat s[SWEEP_BLOCK], c[SWEEP_BLOCK], ref[2], res[2], err;
+  double ulp;
+  CTMuint i, j;
+
+  _ctmSinCosBlock(aAngles, s, c, aCount);
+  for(i = 0; i < aCount; ++ i)
+  {
+    ref[0] = sinf(aAngles[i]);
+    ref[1] = cosf(aAngles[i]);
+    res[0] = s[i];
+    res[1] = c[i];
+    for(j = 0; j < 2; ++ j)
+    {
+      err = fabsf(res[j] - ref[j]);
+      ulp = (fabsf(ref[j]) >= MIN_ULP_RESULT) ? UlpDiff(res[j], ref[j]) : 0.0;
+      if(err > aStats->mMaxAbs)
+      {
+        aStats->mMaxAbs = err;
+        aStats->mMaxAbsAngle = aAngles[i];
+      }
+      if(ulp > aStats->mMaxUlp)
+      {
+        aStats->mMaxUlp = ulp;
+        aStats->mMaxUlpAngle = aAngles[i];
+      }
+      if((err > MAX_ABS_ERROR) || (ulp > MAX_ULP_ERROR) || (err != err))
+      {
+        if(gReports ++ < MAX_REPORTS)
+          printf("FAILED: %s(%.9g) is %.9g (expected %.9g)\n",
+                 j ? "cos" : "sin", aAngles[i], res[j], ref[j]);
+        ++ aStats->mErrors;
+      }
+    }
+  }
+  aStats->mCount += aCount;
+}
+
+//-----------------------------------------------------------------------------
+// TestSinCosRange() - Sweep the whole angle range of _ctmSinCosBlock(), and
+// test the floats around all the zeros of sin()/cos() (where the argument
+// reduction is the most critical). Returns the number of errors.
+//-----------------------------------------------------------------------------
+static int TestSinCosRange(void)
+{
+  _CTMsweepstats stats;
+  CTMfloat angles[SWEEP_BLOCK], x;
+  CTMuint i, n;
+  CTMint k, kMax, j;
+
+  printf("Testing _ctmSinCosBlock() against sinf()/cosf()...\n");
+  memset(&stats, 0, sizeof(stats));
+
+  // Evenly spaced angles, including both ends of the range
+  n = 0;
+  for(i = 0; i <= SWEEP_COUNT; ++ i)
+  {
+    angles[n ++] = (CTMfloat) (-_CTM_SINCOS_MAX_ANGLE + (2.0 * _CTM_SINCOS_MAX_ANGLE * i) / SWEEP_COUNT);
+    if((n == SWEEP_BLOCK) || (i == SWEEP_COUNT))
+    {
+      TestSinCos(angles, n, &stats);
+      n = 0;
+    }
+  }
+
+  // The floats closest to k * PI/2, and their neighbors
+  kMax = (CTMint) (_CTM_SINCOS_MAX_ANGLE / (0.5 * 3.14159265358979323846));
+  for(k = -kMax; k <= kMax; ++ k)
+  {
+    x = (CTMfloat) (k * (0.5 * 3.14159265358979323846));
+    for(j = 0; j < ZERO_NEIGHBORS; ++ j)
+      x = nextafterf(x, -2.0f * _CTM_SINCOS_MAX_ANGLE);
+    for(j = 0; j <= 2 * ZERO_NEIGHBORS; ++ j)
+    {
+      if(fabsf(x) <= _CTM_SINCOS_MAX_ANGLE)
+        angles[n ++] = x;
+      x = nextafterf(x, 2.0f * _CTM_SINCOS_MAX_ANGLE);
+    }
+    if((n + 2 * ZERO_NEIGHBORS + 1 > SWEEP_BLOCK) || (k == kMax))
+    {
+      TestSinCos(angles, n, &stats);
+      n = 0;
+    }
+  }
+
+  // Tiny angles (including denormals and signed zeros)
+  angles[n ++] = 0.0f;
+  angles[n ++] = -0.0f;
+  for(x = FLT_MIN; x < 1.0f; x *= 3.0f)
+  {
+    angles[n ++] = x;
+    angles[n ++] = -x;
+    angles[n ++] = x * FLT_EPSILON;
+  }
+  TestSinCos(angles, n, &stats);
+
+  printf("  %u angles, max difference %.3g (at %.9g), max %.3g ULP for "
+         "|result| >= %g (at %.9g)\n", stats.mCount, stats.mMaxAbs,
+         stats.mMaxAbsAngle, stats.mMaxUlp, MIN_ULP_RESULT, stats.mMaxUlpAngle);
+  return stats.mErrors;
+}
+
+//-----------------------------------------------------------------------------
+// _CTMtestmesh - A mesh with normals.
+//-----------------------------------------------------------------------------
+typedef struct {
+  CTMuint mVertexCount;
+  CTMuint mTriangleCount;
+  CTMfloat * mVertices;
+  CTMfloat * mNormals;
+  CTMuint * mIndices;
+  CTMfloat * mIds;   // Original vertex index of each vertex (optional)
+} _CTMtestmesh;
+
+//-----------------------------------------------------------------------------
+// AllocMesh() - Allocate the arrays of a mesh.
+//-----------------------------------------------------------------------------
+static int AllocMesh(_CTMtestmesh * aMesh, CTMuint aVertexCount,
+  CTMuint aTriangleCount)
+{
+  aMesh->mVertexCount = aVertexCount;
+  aMesh->mTriangleCount = aTriangleCount;
+  aMesh->mVertices = (CTMfloat *) malloc(3 * sizeof(CTMfloat) * aVertexCount);
+  aMesh->mNormals = (CTMfloat *) malloc(3 * sizeof(CTMfloat) * aVertexCount);
+  aMesh->mIndices = (CTMuint *) malloc(3 * sizeof(CTMuint) * aTriangleCount);
+  aMesh->mIds = (CTMfloat *) malloc(sizeof(CTMfloat) * aVertexCount);
+  return aMesh->mVertices && aMesh->mNormals && aMesh->mIndices && aMesh->mIds;
+}
+
+//-----------------------------------------------------------------------------
+// FreeMesh() - Free the arrays of a mesh.
+//-----------------------------------------------------------------------------
+static void FreeMesh(_CTMtestmesh * aMesh)
+{
+  free(aMesh->mVertices);
+  free(aMesh->mNormals);
+  free(aMesh->mIndices);
+  free(aMesh->mIds);
+  memset(aMesh, 0, sizeof(_CTMtestmesh));
+}
+
+#ifdef _CTM_SUPPORT_SAVE
+//-----------------------------------------------------------------------------
+// MakeTorus() - Create a torus (a closed GRID_SIZE x GRID_SIZE grid). The
+// normals are the analytic normals of the torus, disturbed by aNoise (zero
+// gives smooth normals, and large values give almost random directions), and
+// scaled by a random magnitude in the range [aMinMagn, aMaxMagn].
+//-----------------------------------------------------------------------------
+static int MakeTorus(_CTMtestmesh * aMesh, CTMfloat aNoise,
+  CTMfloat aMinMagn, CTMfloat aMaxMagn)
+{
+  CTMuint i, j, k, i2, j2;
+  CTMfloat u, v, n[3], len;
+
+  if(!AllocMesh(aMesh, GRID_SIZE * GRID_SIZE, 2 * GRID_SIZE * GRID_SIZE))
+    return 0;
+
+  for(j = 0; j < GRID_SIZE; ++ j)
+  {
+    for(i = 0; i < GRID_SIZE; ++ i)
+    {
+      k = j * GRID_SIZE + i;
+      aMesh->mIds[k] = (CTMfloat) k;
+      u = (2.0f * PI * i) / GRID_SIZE;
+      v = (2.0f * PI * j) / GRID_SIZE;
+      aMesh->mVertices[k * 3] = (3.0f + cosf(v)) * cosf(u);
+      aMesh->mVertices[k * 3 + 1] = (3.0f + cosf(v)) * sinf(u);
+      aMesh->mVertices[k * 3 + 2] = sinf(v);
+      n[0] = cosf(v) * cosf(u) + aNoise * (2.0f * Random() - 1.0f);
+      n[1] = cosf(v) * sinf(u) + aNoise * (2.0f * Random() - 1.0f);
+      n[2] = sinf(v) + aNoise * (2.0f * Random() - 1.0f);
+      len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+      if(len < 1e-3f)
+      {
+        n[0] = 1.0f;
+        len = 1.0f;
+      }
+      len = (aMinMagn + (aMaxMagn - aMinMagn) * Random()) / len;
+      aMesh->mNormals[k * 3] = n[0] * len;
+      aMesh->mNormals[k * 3 + 1] = n[1] * len;
+      aMesh->mNormals[k * 3 + 2] = n[2] * len;
+
+      // Two triangles per grid cell
+      i2 = (i + 1) % GRID_SIZE;
+      j2 = (j + 1) % GRID_SIZE;
+      aMesh->mIndices[k * 6] = k;
+      aMesh->mIndices[k * 6 + 1] = j * GRID_SIZE + i2;
+      aMesh->mIndices[k * 6 + 2] = j2 * GRID_SIZE + i2;
+      aMesh->mIndices[k * 6 + 3] = k;
+      aMesh->mIndices[k * 6 + 4] = j2 * GRID_SIZE + i2;
+      aMesh->mIndices[k * 6 + 5] = j2 * GRID_SIZE + i;
+    }
+  }
+  return 1;
+}
+
+#endif // _CTM_SUPPORT_SAVE
+
+//-----------------------------------------------------------------------------
+// ReadMesh() - Decode an MG2 file from memory. If aReference is true, the
+// normals are restored with sinf()/cosf() instead of _ctmSinCosBlock().
+// The original vertex indices are read from the first attribute map, if the
+// file has one. Returns 1 on success, 0 if the file is not an MG2 file with
+// (spherical) normals, and -1 if the file could not be read (aMesh is empty
+// unless 1 is returned).
+//-----------------------------------------------------------------------------
+static int ReadMesh(const void * aData, CTMuint aSize, CTMbool aReference,
+  _CTMtestmesh * aMesh)
+{
+  CTMcontext ctm;
+  CTMenum err;
+  int result = 0;
+
+  memset(aMesh, 0, sizeof(_CTMtestmesh));
+  ctm = ctmNewContext(CTM_IMPORT);
+  ((_CTMcontext *) ctm)->mReferenceSinCos = aReference;
+  ctmOpenReadMemory(ctm, aData, aSize);
+  if((ctmGetError(ctm) == CTM_NONE) &&
+     (ctmGetInteger(ctm, CTM_COMPRESSION_METHOD) == CTM_METHOD_MG2) &&
+     ctmGetBoolean(ctm, CTM_HAS_NORMALS) &&
+     !ctmGetBoolean(ctm, CTM_OCTAHEDRAL_NORMALS))
+  {
+    result = 1;
+    if(AllocMesh(aMesh, ctmGetInteger(ctm, CTM_VERTEX_COUNT),
+                 ctmGetInteger(ctm, CTM_TRIANGLE_COUNT)))
+    {
+      ctmArrayPointer(ctm, CTM_INDICES, 3, CTM_UINT, 0, aMesh->mIndices);
+      ctmArrayPointer(ctm, CTM_VERTICES, 3, CTM_FLOAT, 0, aMesh->mVertices);
+      ctmArrayPointer(ctm, CTM_NORMALS, 3, CTM_FLOAT, 0, aMesh->mNormals);
+      if(ctmGetInteger(ctm, CTM_ATTRIB_MAP_COUNT) > 0)
+        ctmArrayPointer(ctm, CTM_ATTRIB_MAP_1, 1, CTM_FLOAT, 0, aMesh->mIds);
+      else
+      {
+        free(aMesh->mIds);
+        aMesh->mIds = NULL;
+      }
+      ctmReadMesh(ctm);
+    }
+    else
+      result = -1;
+  }
+  err = ctmGetError(ctm);
+  ctmFreeContext(ctm);
+  if(err != CTM_NONE)
+  {
+    printf("FAILED: could not read the file (%s)\n", ctmErrorString(err));
+    result = -1;
+  }
+  if(result != 1)
+    FreeMesh(aMesh);
+  return result;
+}
+
+//-----------------------------------------------------------------------------
+// TestDecode() - Decode an MG2 file with _ctmSinCosBlock() and with
+// sinf()/cosf(), and compare the normals. If aOriginal is given, the decoded
+// normals are also compared to it (they must be within the quantization step
+// of the given normal precision, and the file must have the original vertex
+// indices, see ReadMesh()). Returns the number of errors.
+//-----------------------------------------------------------------------------
+static int TestDecode(const char * aName, const void * aData, CTMuint aSize,
+  const _CTMtestmesh * aOriginal, CTMfloat aPrecision)
+{
+  _CTMtestmesh fast, ref;
+  CTMuint i, j, k;
+  CTMfloat d, dist, magn, maxDiff = 0.0f, maxQuant = 0.0f, bound;
+  int errors = 0, result;
+
+  printf("Testing %s...\n", aName);
+  result = ReadMesh(aData, aSize, CTM_FALSE, &fast);
+  if(result == 0)
+  {
+    printf("  not an MG2 file with (spherical) normals, skipped\n");
+    return aOriginal ? 1 : 0;
+  }
+  if((result < 0) || (ReadMesh(aData, aSize, CTM_TRUE, &ref) != 1))
+  {
+    FreeMesh(&fast);
+    return 1;
+  }
+  if(aOriginal && !fast.mIds)
+  {
+    printf("FAILED: the file has no vertex indices\n");
+    ++ errors;
+    aOriginal = NULL;
+  }
+
+  for(i = 0; i < fast.mVertexCount; ++ i)
+  {
+    // Difference between the two decoders (relative to the normal magnitude)
+    magn = sqrtf(ref.mNormals[i * 3] * ref.mNormals[i * 3] +
+                 ref.mNormals[i * 3 + 1] * ref.mNormals[i * 3 + 1] +
+                 ref.mNormals[i * 3 + 2] * ref.mNormals[i * 3 + 2]);
+    dist = 0.0f;
+    for(j = 0; j < 3; ++ j)
+    {
+      d = fast.mNormals[i * 3 + j] - ref.mNormals[i * 3 + j];
+      dist += d * d;
+    }
+    dist = sqrtf(dist) / (magn > 1.0f ? magn : 1.0f);
+    if(dist > maxDiff)
+      maxDiff = dist;
+    if(!(dist <= MAX_DECODE_ERROR))
+    {
+      if(gReports ++ < MAX_REPORTS)
+        printf("FAILED: normal %u differs by %g between the decoders\n", i, dist);
+      ++ errors;
+    }
+
+    // Difference from the original normal. The normal direction is given by
+    // phi (step PI/2 * precision) and theta (an arc of at most PI^2 *
+    // precision), so the direction is within half of those steps, and the
+    // magnitude is within half the precision. The encoder gets phi from
+    // acosf(), which can not resolve angles much below sqrt(2 * FLT_EPSILON)
+    // close to zero, so that is the limit for very fine precisions.
+    if(aOriginal)
+    {
+      k = (CTMuint) fast.mIds[i];
+      magn = sqrtf(aOriginal->mNormals[k * 3] * aOriginal->mNormals[k * 3] +
+                   aOriginal->mNormals[k * 3 + 1] * aOriginal->mNormals[k * 3 + 1] +
+                   aOriginal->mNormals[k * 3 + 2] * aOriginal->mNormals[k * 3 + 2]);
+      bound = (magn * (0.25f * PI + 0.5f * PI * PI) + 0.5f) * aPrecision +
+              magn * sqrtf(4.0f * FLT_EPSILON);
+      dist = 0.0f;
+      for(j = 0; j < 3; ++ j)
+      {
+        d = fast.mNormals[i * 3 + j] - aOriginal->mNormals[k * 3 + j];
+        dist += d * d;
+      }
+      dist = sqrtf(dist);
+      if(dist / bound > maxQuant)
+        maxQuant = dist / bound;
+      if(!(dist <= bound))
+      {
+        if(gReports ++ < MAX_REPORTS)
+          printf("FAILED: normal %u is off by %g (quantization bound %g)\n",
+                 i, dist, bound);
+        ++ errors;
+      }
+    }
+  }
+
+  printf("  %u normals, max difference between the decoders %.3g",
+         fast.mVertexCount, maxDiff);
+  if(aOriginal)
+    printf(", max error %.2f of the quantization bound", maxQuant);
+  printf("\n");
+
+  FreeMesh(&fast);
+  FreeMesh(&ref);
+  return errors;
+}
+
+#ifdef _CTM_SUPPORT_SAVE
+//-----------------------------------------------------------------------------
+// TestMesh() - Save a mesh as an MG2 file with the given normal precision,
+// and test the decoding of it. Returns the number of errors.
+//-----------------------------------------------------------------------------
+static int TestMesh(const char * aName, _CTMtestmesh * aMesh,
+  CTMfloat aPrecision)
+{
+  CTMcontext ctm;
+  CTMenum ids;
+  char name[100];
+  int errors;
+
+  sprintf(name, "%s, normal precision %g", aName, aPrecision);
+
+  ctm = ctmNewContext(CTM_EXPORT);
+  ctmCompressionMethod(ctm, CTM_METHOD_MG2);
+  ctmNormalPrecision(ctm, aPrecision);
+  ctmVertexCount(ctm, aMesh->mVertexCount);
+  ctmTriangleCount(ctm, aMesh->mTriangleCount);
+  ctmArrayPointer(ctm, CTM_INDICES, 3, CTM_UINT, 0, aMesh->mIndices);
+  ctmArrayPointer(ctm, CTM_VERTICES, 3, CTM_FLOAT, 0, aMesh->mVertices);
+  ctmArrayPointer(ctm, CTM_NORMALS, 3, CTM_FLOAT, 0, aMesh->mNormals);
+  ids = ctmAddAttribMap(ctm, "id");
+  ctmArrayPointer(ctm, ids, 1, CTM_FLOAT, 0, aMesh->mIds);
+  ctmAttribPrecision(ctm, ids, 1.0f);
+  ctmSaveMemory(ctm);
+  if(ctmGetError(ctm) != CTM_NONE)
+  {
+    printf("FAILED: could not save %s\n", name);
+    ctmFreeContext(ctm);
+    return 1;
+  }
+  errors = TestDecode(name, ctmGetMemoryBuffer(ctm),
+                      ctmGetInteger(ctm, CTM_MEMORY_SIZE), aMesh, aPrecision);
+  ctmFreeContext(ctm);
+  return errors;
+}
+
+#endif // _CTM_SUPPORT_SAVE
+
+//-----------------------------------------------------------------------------
+// TestFile() - Test the decoding of an MG2 file. Returns the number of errors.
+//-----------------------------------------------------------------------------
+static int TestFile(const char * aFileName)
+{
+  FILE * f;
+  void * data;
+  long size;
+  int errors;
+
+  f = fopen(aFileName, "rb");
+  if(!f)
+  {
+    printf("FAILED: could not open %s\n", aFileName);
+    return 1;
+  }
+  fseek(f, 0, SEEK_END);
+  size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  data = malloc(size > 0 ? (size_t) size : 1);
+  if(!data || (fread(data, 1, (size_t) size, f) != (size_t) size))
+  {
+    printf("FAILED: could not read %s\n", aFileName);
+    free(data);
+    fclose(f);
+    return 1;
+  }
+  fclose(f);
+  errors = TestDecode(aFileName, data, (CTMuint) size, NULL, 0.0f);
+  free(data);
+  return errors;
+}
+
+//-----------------------------------------------------------------------------
+// main()
+//-----------------------------------------------------------------------------
+int main(int argc, char ** argv)
+{
+#ifdef _CTM_SUPPORT_SAVE
+  static const CTMfloat precisions[] = {
+    1.0f / 16.0f, 1.0f / 256.0f, 1.0f / 4096.0f, 1.0f / 65536.0f, 0.0f
+  };
+  _CTMtestmesh mesh;
+#endif
+  int errors = 0, i;
+
+  errors += TestSinCosRange();
+
+#ifdef _CTM_SUPPORT_SAVE
+  // Built in meshes: smooth unit normals, noisy normals and random normals
+  // (which gives all phi angles up to PI), with varying magnitudes
+  for(i = 0; precisions[i] != 0.0f; ++ i)
+  {
+    if(!MakeTorus(&mesh, 0.0f, 1.0f, 1.0f))
+      return 1;
+    errors += TestMesh("smooth torus", &mesh, precisions[i]);
+    FreeMesh(&mesh);
+    if(!MakeTorus(&mesh, 0.3f, 0.5f, 2.0f))
+      return 1;
+    errors += TestMesh("noisy torus", &mesh, precisions[i]);
+    FreeMesh(&mesh);
+    if(!MakeTorus(&mesh, 100.0f, 0.1f, 10.0f))
+      return 1;
+    errors += TestMesh("random torus", &mesh, precisions[i]);
+    FreeMesh(&mesh);
+  }
+#endif
+
+  // Files from the command line
+  for(i = 1; i < argc; ++ i)
+    errors += TestFile(argv[i]);
+
+  if(errors > 0)
+  {
+    printf("%d test(s) failed.\n", errors);
+    return 1;
+  }
+  printf("All tests passed.\n");
+  return 0;
+}
@@ -0,0 +1,238 @@
+//-----------------------------------------------------------------------------
+// Product:     OpenCTM
+// File:        planestest.c
+// Description: Test of the byte plane functions. All the SIMD implementations
+//              that are built in (and supported by the CPU) must give
+//              exactly the same output as the C reference implementation.
+//-----------------------------------------------------------------------------
+// Copyright (c) 2009-2013 Marcus Geelnard
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+//     1. The origin of this software must not be misrepresented; you must not
+//     claim that you wrote the original software. If you use this software
+//     in a product, an acknowledgment in the product documentation would be
+//     appreciated but is not required.
+//
+//     2. Altered source versions must be plainly marked as such, and must not
+//     be misrepresented as being the original software.
+//
+//     3. This notice may not be removed or altered from any source
+//     distribution.
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+#include "openctm2.h"
+#include "internal.h"
+
+// Largest tested element count
+#define MAX_COUNT 4099
+
+// Largest tested destination stride (in words) for _ctmMergeBytePlane()
+#define MAX_STRIDE 8
+
+// Number of tested misalignments (in words for word arrays, and in bytes for
+// byte arrays)
+#define WORD_OFFSETS 8
+#define BYTE_OFFSETS 32
+
+// Extra room after the arrays, where nothing may be written
+#define GUARD_SIZE 64
+
+// Fill pattern for the output buffers
+#define FILL_BYTE 0xcd
+
+// Maximum number of failures that are reported in detail
+#define MAX_REPORTS 10
+static int gReports = 0;
+
+static CTMuint gWords[MAX_COUNT + WORD_OFFSETS];
+static CTMubyte gPlanes[4][MAX_COUNT + BYTE_OFFSETS];
+static CTMubyte gSplitRef[4 * (MAX_COUNT + 32) + BYTE_OFFSETS + GUARD_SIZE];
+static CTMubyte gSplitOut[4 * (MAX_COUNT + 32) + BYTE_OFFSETS + GUARD_SIZE];
+static CTMuint gMergeRef[MAX_COUNT * MAX_STRIDE + WORD_OFFSETS + GUARD_SIZE];
+static CTMuint gMergeOut[MAX_COUNT * MAX_STRIDE + WORD_OFFSETS + GUARD_SIZE];
+
+//-----------------------------------------------------------------------------
+// Random() - Simple pseudo random number generator (deterministic, so that
+// failures can be reproduced).
+//-----------------------------------------------------------------------------
+static CTMuint gSeed = 1;
+static CTMuint Random(void)
+{
+  gSeed = gSeed * 1664525U + 1013904223U;
+  return (gSeed >> 16) | (gSeed << 16);
+}
+
+//-----------------------------------------------------------------------------
+// FillInput() - Fill the input arrays with random values, mixed with values
+// that are special for the signed magnitude conversion.
+//-----------------------------------------------------------------------------
+static void FillInput(void)
+{
+  static const CTMuint special[] = {
+    0x00000000U, 0x00000001U, 0xffffffffU, 0x7fffffffU,
+    0x80000000U, 0x80000001U, 0x000000ffU, 0xff000000U
+  };
+  CTMuint i, p;
+
+  for(i = 0; i < MAX_COUNT + WORD_OFFSETS; ++ i)
+  {
+    if((Random() & 7) == 0)
+      gWords[i] = special[Random() & 7];
+    else if((Random() & 3) == 0)
+      gWords[i] = Random() & 0x3ff;
+    else
+      gWords[i] = Random();
+  }
+  for(p = 0; p < 4; ++ p)
+    for(i = 0; i < MAX_COUNT + BYTE_OFFSETS; ++ i)
+      gPlanes[p][i] = (CTMubyte) Random();
+}
+
+//-----------------------------------------------------------------------------
+// TestSplit() - Test one split implementation for one set of parameters.
+// Returns 0 on success.
+//-----------------------------------------------------------------------------
+static int TestSplit(const _CTMplanefns * aFns, CTMuint aCount,
+  CTMuint aSrcOffset, CTMuint aDstOffset, CTMuint aPlaneSize,
+  CTMint aSignedInts)
+{
+  CTMuint i, size;
+
+  size = 4 * aPlaneSize + aDstOffset + GUARD_SIZE;
+  memset(gSplitRef, FILL_BYTE, size);
+  memset(gSplitOut, FILL_BYTE, size);
+  _ctmSplitBytePlanes_C(&gWords[aSrcOffset], aCount, &gSplitRef[aDstOffset],
+                        aPlaneSize, aSignedInts);
+  aFns->mSplit(&gWords[aSrcOffset], aCount, &gSplitOut[aDstOffset],
+               aPlaneSize, aSignedInts);
+  for(i = 0; i < size; ++ i)
+  {
+    if(gSplitOut[i] != gSplitRef[i])
+    {
+      if(gReports ++ < MAX_REPORTS)
+        printf("FAILED: %s split, count %u, source offset %u, destination "
+               "offset %u, plane size %u, signed %d: byte %u is 0x%02x "
+               "(expected 0x%02x)\n", aFns->mName, aCount, aSrcOffset,
+               aDstOffset, aPlaneSize, (int) aSignedInts, i, gSplitOut[i],
+               gSplitRef[i]);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+//-----------------------------------------------------------------------------
+// TestMerge() - Test one merge implementation for one set of parameters (all
+// four planes are merged, in the same order as when unpacking an array).
+// Returns 0 on success.
+//-----------------------------------------------------------------------------
+static int TestMerge(const _CTMplanefns * aFns, CTMuint aCount,
+  CTMuint aStride, CTMuint aDstOffset, CTMuint aSrcOffset, CTMint aSignedInts)
+{
+  CTMuint i, p, size;
+
+  size = (aCount > 0 ? (aCount - 1) * aStride + 1 : 0) + aDstOffset + GUARD_SIZE;
+  for(i = 0; i < size; ++ i)
+    gMergeRef[i] = gMergeOut[i] = 0xcdcdcdcdU + i;
+  for(p = 0; p < 4; ++ p)
+  {
+    _ctmMergeBytePlane_C(&gMergeRef[aDstOffset], aStride,
+                         &gPlanes[p][aSrcOffset], aCount, 24 - 8 * p,
+                         aSignedInts);
+    aFns->mMerge(&gMergeOut[aDstOffset], aStride, &gPlanes[p][aSrcOffset],
+                 aCount, 24 - 8 * p, aSignedInts);
+    for(i = 0; i < size; ++ i)
+    {
+      if(gMergeOut[i] != gMergeRef[i])
+      {
+        if(gReports ++ < MAX_REPORTS)
+          printf("FAILED: %s merge, count %u, stride %u, destination "
+                 "offset %u, source offset %u, signed %d, shift %u: word %u "
+                 "is 0x%08x (expected 0x%08x)\n", aFns->mName, aCount,
+                 aStride, aDstOffset, aSrcOffset, (int) aSignedInts,
+                 24 - 8 * p, i, gMergeOut[i], gMergeRef[i]);
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+//-----------------------------------------------------------------------------
+// NextCount() - Get the next element count to test (all counts up to a few
+// SIMD blocks, and then odd and even counts around larger block multiples).
+//-----------------------------------------------------------------------------
+static CTMuint NextCount(CTMuint aCount)
+{
+  static const CTMuint large[] = {
+    127, 128, 129, 255, 256, 257, 1000, 1023, 4095, 4096, MAX_COUNT, 0
+  };
+  CTMuint i;
+
+  if(aCount < 100)
+    return aCount + 1;
+  for(i = 0; large[i] != 0; ++ i)
+    if(large[i] > aCount)
+      return large[i];
+  return 0;
+}
+
+//-----------------------------------------------------------------------------
+// main()
+//-----------------------------------------------------------------------------
+int main(void)
+{
+  _CTMplanefns fns[_CTM_MAX_PLANE_FNS];
+  CTMuint fnCount, f, count, srcOffset, dstOffset, stride, pad;
+  CTMint signedInts;
+  int errors = 0;
+
+  FillInput();
+
+  fnCount = _ctmGetPlaneFunctions(fns);
+  for(f = 1; f < fnCount; ++ f)
+  {
+    printf("Testing %s...\n", fns[f].mName);
+    count = 0;
+    do
+    {
+      for(signedInts = 0; signedInts <= 1; ++ signedInts)
+      {
+        // Split: misaligned source and destination, with and without padding
+        // between the planes
+        for(srcOffset = 0; srcOffset < WORD_OFFSETS; ++ srcOffset)
+          for(dstOffset = 0; dstOffset < BYTE_OFFSETS; ++ dstOffset)
+            for(pad = 0; pad <= 17; pad += 17)
+              errors += TestSplit(&fns[f], count, srcOffset, dstOffset,
+                                  count + pad, signedInts);
+
+        // Merge: every stride, misaligned destination and source
+        for(stride = 1; stride <= MAX_STRIDE; ++ stride)
+          for(dstOffset = 0; dstOffset < WORD_OFFSETS; ++ dstOffset)
+            for(srcOffset = 0; srcOffset < BYTE_OFFSETS; srcOffset += 3)
+              errors += TestMerge(&fns[f], count, stride, dstOffset,
+                                  srcOffset, signedInts);
+      }
+      count = NextCount(count);
+    } while((count != 0) && (errors == 0));
+  }
+
+  if(fnCount < 2)
+    printf("No SIMD implementations to test.\n");
+  if(errors > 0)
+  {
+    printf("%d test(s) failed.\n", errors);
+    return 1;
+  }
+  printf("All tests passed.\n");
+  return 0;
+}
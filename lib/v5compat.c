@@ -64,7 +64,8 @@
 //-----------------------------------------------------------------------------
 // _ctmNewMemChunk() - Allocate memory for a new chunk.
 //-----------------------------------------------------------------------------
-static _CTMchunklist * _ctmNewMemChunk(CTMuint aSize)
+static _CTMchunklist * _ctmNewMemChunk(_CTMcontext * self,
+  CTMuint aSize)
 {
   _CTMchunklist *chunk;
 
@@ -73,15 +74,15 @@ static _CTMchunklist * _ctmNewMemChunk(CTMuint aSize)
 #endif
 
   // Allocate memory for the object
-  chunk = (_CTMchunklist *) malloc(sizeof(_CTMchunklist));
+  chunk = (_CTMchunklist *) _ctmAlloc(self, sizeof(_CTMchunklist));
   if(!chunk)
     return (_CTMchunklist *) 0;
 
   // Initialize the object
-  chunk->mData = (CTMubyte *) malloc(aSize);
+  chunk->mData = (CTMubyte *) _ctmAlloc(self, aSize);
   if(!chunk->mData)
   {
-    free((void *) chunk);
+    _ctmFree(self, (void *) chunk);
     return (_CTMchunklist *) 0;
   }
   chunk->mSize = aSize;
@@ -97,7 +98,7 @@ static _CTMchunklist * _ctmNewMemChunk(CTMuint aSize)
 static _CTMchunklist * _ctmAppendHeadChunk(_CTMcontext * self, CTMuint aSize)
 {
   // Create chunk
-  _CTMchunklist * chunk = _ctmNewMemChunk(aSize);
+  _CTMchunklist * chunk = _ctmNewMemChunk(self, aSize);
   if(!chunk)
   {
     self->mError = CTM_OUT_OF_MEMORY;
@@ -122,7 +123,7 @@ static _CTMchunklist * _ctmAppendTailChunk(_CTMcontext * self, CTMuint aSize)
   _CTMchunklist * chunk;
 
   // Create chunk
-  chunk = _ctmNewMemChunk(aSize);
+  chunk = _ctmNewMemChunk(self, aSize);
   if(!chunk)
   {
     self->mError = CTM_OUT_OF_MEMORY;
@@ -278,7 +279,7 @@ static CTMbool _ctmLoadV5_Header(_CTMcontext * self)
   if(len > 0)
   {
     memcpy((void *) &chunk->mData[32], (void *) fileComment, len);
-    free((void *) fileComment);
+    _ctmFree(self, (void *) fileComment);
   }
 
   // Here is where we want to insert UV and attrib map info later on...
@@ -373,13 +374,13 @@ static CTMbool _ctmLoadV5_RAW(_CTMcontext * self)
     if(len > 0)
     {
       memcpy((void *) &chunk->mData[4], (void *) name, len);
-      free((void *) name);
+      _ctmFree(self, (void *) name);
     }
     _ctmSetUINT(&chunk->mData[4+len], len2);
     if(len2 > 0)
     {
       memcpy((void *) &chunk->mData[8+len], (void *) fileName, len2);
-      free((void *) fileName);
+      _ctmFree(self, (void *) fileName);
     }
 
     // Read texture coordinates for this map
@@ -415,7 +416,7 @@ static CTMbool _ctmLoadV5_RAW(_CTMcontext * self)
     if(len > 0)
     {
       memcpy((void *) &chunk->mData[4], (void *) name, len);
-      free((void *) name);
+      _ctmFree(self, (void *) name);
     }
 
     // Read vertex attributes for this map
@@ -515,13 +516,13 @@ static CTMbool _ctmLoadV5_MG1(_CTMcontext * self)
     if(len > 0)
     {
       memcpy((void *) &chunk->mData[4], (void *) name, len);
-      free((void *) name);
+      _ctmFree(self, (void *) name);
     }
     _ctmSetUINT(&chunk->mData[4+len], len2);
     if(len2 > 0)
     {
       memcpy((void *) &chunk->mData[8+len], (void *) fileName, len2);
-      free((void *) fileName);
+      _ctmFree(self, (void *) fileName);
     }
 
     // Read texture coordinates for this map
@@ -558,7 +559,7 @@ static CTMbool _ctmLoadV5_MG1(_CTMcontext * self)
     if(len > 0)
     {
       memcpy((void *) &chunk->mData[4], (void *) name, len);
-      free((void *) name);
+      _ctmFree(self, (void *) name);
     }
 
     // Read vertex attributes for this map
@@ -684,13 +685,13 @@ static CTMbool _ctmLoadV5_MG2(_CTMcontext * self)
     if(len > 0)
     {
       memcpy((void *) &chunk->mData[4], (void *) name, len);
-      free((void *) name);
+      _ctmFree(self, (void *) name);
     }
     _ctmSetUINT(&chunk->mData[4+len], len2);
     if(len2 > 0)
     {
       memcpy((void *) &chunk->mData[8+len], (void *) fileName, len2);
-      free((void *) fileName);
+      _ctmFree(self, (void *) fileName);
     }
 
     // Read texture coordinates for this map
@@ -727,7 +728,7 @@ static CTMbool _ctmLoadV5_MG2(_CTMcontext * self)
     if(len > 0)
     {
       memcpy((void *) &chunk->mData[4], (void *) name, len);
-      free((void *) name);
+      _ctmFree(self, (void *) name);
     }
 
     // Read vertex attributes for this map
@@ -801,8 +802,12 @@ CTMbool _ctmLoadV5FileToMem(_CTMcontext * self)
     fclose(self->mFileStream);
     self->mFileStream = (FILE *) 0;
   }
+#ifdef _CTM_SUPPORT_MMAP
+  _ctmStreamUnmapFile(self);
+#endif
   self->mReadFn = _ctmMemChunkRead;
   self->mUserData = (void *) &self->mV5Compat;
+  _ctmStreamResetBuffer(self);
 
 #ifdef __DEBUG_
   printf(" v5 compat: conversion done\n");
@@ -817,15 +822,15 @@ CTMbool _ctmLoadV5FileToMem(_CTMcontext * self)
 //-----------------------------------------------------------------------------
 CTMbool _ctmConvertV5MG1Vertices(_CTMcontext * self)
 {
-  CTMuint i, k, idx, maxIdx;
-  CTMfloat * tmpArray, * ptr;
+  CTMuint i, k, idx, maxIdx, blockSize;
+  CTMfloat * tmpArray, block[_CTM_ARRAY_BLOCK_SIZE * 3];
 
   // Nothing to do?
   if(self->mVertexCount == 0)
     return CTM_TRUE;
 
   // Allocate memory for the temporary array
-  tmpArray = (CTMfloat *) malloc(self->mVertexCount * 3 * sizeof(CTMfloat));
+  tmpArray = (CTMfloat *) _ctmAlloc(self, self->mVertexCount * 3 * sizeof(CTMfloat));
   if(!tmpArray)
   {
     self->mError = CTM_OUT_OF_MEMORY;
@@ -833,27 +838,28 @@ CTMbool _ctmConvertV5MG1Vertices(_CTMcontext * self)
   }
 
   // Make a copy of the original array
-  ptr = tmpArray;
-  for(i = 0; i < self->mVertexCount; ++ i)
-    for(k = 0; k < 3; ++ k)
-      *ptr ++ = self->mVertices.getf(&self->mVertices, i, k);
+  _ctmGatherArrayf(&self->mVertices, 0, self->mVertexCount, 3, tmpArray);
 
   // Copy the array back to the original array, in the correct order
   maxIdx = 3 * self->mVertexCount;
   idx = 0;
-  for(i = 0; i < self->mVertexCount; ++ i)
+  for(i = 0; i < self->mVertexCount; i += blockSize)
   {
-    for(k = 0; k < 3; ++ k)
+    blockSize = self->mVertexCount - i;
+    if(blockSize > _CTM_ARRAY_BLOCK_SIZE)
+      blockSize = _CTM_ARRAY_BLOCK_SIZE;
+    for(k = 0; k < blockSize * 3; ++ k)
     {
-      self->mVertices.setf(&self->mVertices, i, k, tmpArray[idx]);
+      block[k] = tmpArray[idx];
       idx += 3;
       if(idx >= maxIdx)
         idx = idx - maxIdx + 1;
     }
+    _ctmScatterArrayf(&self->mVertices, i, blockSize, 3, block);
   }
 
   // Free the temporary array
-  free(tmpArray);
+  _ctmFree(self, tmpArray);
 
   return CTM_TRUE;
 }
@@ -870,9 +876,9 @@ void _ctmCleanupV5Data(_CTMcontext * self)
   while(chunk)
   {
     if(chunk->mData)
-      free(chunk->mData);
+      _ctmFree(self, chunk->mData);
     next = chunk->mNext;
-    free((void *) chunk);
+    _ctmFree(self, (void *) chunk);
     chunk = next;
   }
 